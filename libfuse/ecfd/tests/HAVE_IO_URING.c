@@ -0,0 +1,14 @@
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+
+int
+main(int   argc,
+     char *argv[])
+{
+  (void)__NR_io_uring_setup;
+  (void)__NR_io_uring_enter;
+  (void)IORING_SETUP_SQE128;
+  (void)IORING_OP_URING_CMD;
+
+  return 0;
+}
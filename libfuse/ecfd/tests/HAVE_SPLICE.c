@@ -0,0 +1,12 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+
+int
+main(int   argc,
+     char *argv[])
+{
+  (void)splice;
+  (void)F_SETPIPE_SZ;
+
+  return 0;
+}
@@ -466,6 +466,19 @@ struct fuse_operations
                 size_t                  size,
                 off_t                   off);
 
+  /**
+   * Write data held in a pipe to an open file
+   *
+   * Optional. Used when requests are spliced from the device. The
+   * data should be spliced from pipefd to the destination. Return
+   * values match write(). Return -ENOTSUP, without having consumed
+   * any data, to have write() called instead.
+   */
+  int (*write_pipe)(const fuse_file_info_t *ffi,
+                    int                     pipefd,
+                    size_t                  size,
+                    off_t                   off);
+
   /** Store data from an open file in a buffer
    *
    * Similar to the read() method, but data is stored and
@@ -486,6 +499,16 @@ struct fuse_operations
               char                   *buf,
               size_t                  size,
               off_t                   off);
+
+  /**
+   * Return the file descriptor backing an open file
+   *
+   * Optional. When splice writes are enabled read data is spliced
+   * straight from the returned fd to the kernel. If splicing is
+   * not possible read() is used instead. Return -errno to always
+   * use read().
+   */
+  int (*read_fd)(const fuse_file_info_t *ffi);
   /**
    * Perform BSD file locking operation
    *
@@ -779,6 +802,12 @@ void fuse_gc1();
 void fuse_gc();
 void fuse_invalidate_all_nodes();
 
+/** Register fd as a passthrough backing file. Returns the backing id
+    to set in fuse_file_info_t or -errno. Ids set on open/create
+    replies are managed (shared and released) by the library */
+int  fuse_passthrough_open(const int fd);
+int  fuse_passthrough_close(const int backing_id);
+
 EXTERN_C_END
 
 #endif /* _FUSE_H_ */
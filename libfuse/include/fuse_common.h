@@ -88,6 +88,15 @@ struct fuse_file_info_t
 
   uint32_t noflush:1;
 
+  /** Can be filled in by open/create, to indicate that read/write
+      should be serviced by the kernel directly from the backing file
+      registered with fuse_passthrough_open(). backing_id must be set */
+  uint32_t passthrough:1;
+
+  /** Backing file id returned by fuse_passthrough_open(). Only used
+      when passthrough is set */
+  int32_t backing_id;
+
   /** File handle.  May be filled in by filesystem in open().
       Available in all other file operations */
   uint64_t fh;
@@ -107,6 +116,11 @@ struct fuse_file_info_t
  * FUSE_CAP_DONT_MASK: don't apply umask to file mode on create operations
  * FUSE_CAP_IOCTL_DIR: ioctl support on directories
  * FUSE_CAP_CACHE_SYMLINKS: cache READLINK responses
+ * FUSE_CAP_SPLICE_WRITE: ability to use splice() to write to the fuse device
+ * FUSE_CAP_SPLICE_MOVE: ability to move data to the fuse device with splice()
+ * FUSE_CAP_SPLICE_READ: ability to use splice() to read from the fuse device
+ * FUSE_CAP_PASSTHROUGH: kernel performs read/write on backing files
+ * FUSE_CAP_OVER_IO_URING: requests can be received and replied to over io_uring
  */
 #define FUSE_CAP_ASYNC_READ        (1 << 0)
 #define FUSE_CAP_POSIX_LOCKS       (1 << 1)
@@ -114,6 +128,9 @@ struct fuse_file_info_t
 #define FUSE_CAP_EXPORT_SUPPORT    (1 << 4)
 #define FUSE_CAP_BIG_WRITES        (1 << 5)
 #define FUSE_CAP_DONT_MASK         (1 << 6)
+#define FUSE_CAP_SPLICE_WRITE      (1 << 7)
+#define FUSE_CAP_SPLICE_MOVE       (1 << 8)
+#define FUSE_CAP_SPLICE_READ       (1 << 9)
 #define FUSE_CAP_FLOCK_LOCKS       (1 << 10)
 #define FUSE_CAP_IOCTL_DIR         (1 << 11)
 #define FUSE_CAP_READDIR_PLUS      (1 << 13)
@@ -125,6 +142,8 @@ struct fuse_file_info_t
 #define FUSE_CAP_CACHE_SYMLINKS    (1 << 20)
 #define FUSE_CAP_MAX_PAGES         (1 << 21)
 #define FUSE_CAP_SETXATTR_EXT      (1 << 22)
+#define FUSE_CAP_PASSTHROUGH       (1 << 23)
+#define FUSE_CAP_OVER_IO_URING     (1 << 24)
 
 /**
  * Ioctl flags
@@ -23,9 +23,15 @@
 int         fuse_config_get_read_thread_count();
 int         fuse_config_get_process_thread_count();
 int         fuse_config_get_process_thread_queue_depth();
+std::string fuse_config_get_process_thread_scheduler();
 std::string fuse_config_get_pin_threads();
+bool        fuse_config_get_clone_fd();
+int         fuse_config_get_io_uring_queue_depth();
 
 void        fuse_config_set_read_thread_count(int const);
 void        fuse_config_set_process_thread_count(int const);
 void        fuse_config_set_process_thread_queue_depth(int const);
+void        fuse_config_set_process_thread_scheduler(std::string const);
 void        fuse_config_set_pin_threads(std::string const);
+void        fuse_config_set_clone_fd(bool const);
+void        fuse_config_set_io_uring_queue_depth(int const);
@@ -49,11 +49,15 @@ struct fuse_dirents_t
   kvec_t(char)        data;
   kvec_t(uint32_t)    offs;
   fuse_dirents_type_t type;
+  uint64_t            base;
+  int                 more;
 };
 
 int  fuse_dirents_init(fuse_dirents_t *d);
 void fuse_dirents_free(fuse_dirents_t *d);
 void fuse_dirents_reset(fuse_dirents_t *d);
+void fuse_dirents_trim(fuse_dirents_t *d,
+                       const uint64_t  off);
 
 int  fuse_dirents_add(fuse_dirents_t      *d,
                       const struct dirent *de,
@@ -75,6 +79,8 @@ int  fuse_dirents_add_linux_plus(fuse_dirents_t         *d,
 void *fuse_dirents_find(fuse_dirents_t *d,
                         const uint64_t  ino);
 
+fuse_direntplus_t *fuse_direntplus_next(fuse_direntplus_t *cur);
+
 int fuse_dirents_convert_plus2normal(fuse_dirents_t *d);
 
 EXTERN_C_END
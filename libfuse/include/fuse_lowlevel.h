@@ -14,6 +14,7 @@
 #include "fuse_kernel.h"
 
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
@@ -1150,6 +1151,29 @@ int fuse_reply_data(fuse_req_t  req,
                     char       *buf,
                     size_t      bufsize);
 
+/**
+ * Reply with data spliced directly from a file descriptor
+ *
+ * Data is moved from fd to the device via a per thread pipe without
+ * being copied into userspace. Requires FUSE_CAP_SPLICE_WRITE.
+ *
+ * Possible requests:
+ *   read
+ *
+ * @param req request handle
+ * @param fd file descriptor to read from
+ * @param offset offset in fd to read from
+ * @param size the max size of data in bytes
+ * @return -ENOTSUP if splicing is not possible in which case the
+ *         request is untouched and must be replied to some other
+ *         way, otherwise zero for success or -errno for failure to
+ *         send reply
+ */
+int fuse_reply_data_fd(fuse_req_t   req,
+                       const int    fd,
+                       const off_t  offset,
+                       const size_t size);
+
 /**
  * Reply with data vector
  *
@@ -1380,6 +1404,30 @@ int fuse_lowlevel_notify_store(struct fuse_chan *ch, uint64_t ino,
 int fuse_lowlevel_notify_retrieve(struct fuse_chan *ch, uint64_t ino,
                                   size_t size, off_t offset, void *cookie);
 
+/**
+ * Register a file descriptor as a passthrough backing file
+ *
+ * Requires FUSE_CAP_PASSTHROUGH to have been negotiated and
+ * CAP_SYS_ADMIN. The returned id can be set in fuse_file_info_t
+ * backing_id on open/create replies along with passthrough.
+ *
+ * @param ch the channel of the session
+ * @param fd the file descriptor of the backing file
+ * @return positive backing id on success, -errno for failure
+ */
+int fuse_lowlevel_backing_open(struct fuse_chan *ch, const int fd);
+
+/**
+ * Unregister a passthrough backing file
+ *
+ * Files already opened with the id keep their reference.
+ *
+ * @param ch the channel of the session
+ * @param backing_id id returned by fuse_lowlevel_backing_open()
+ * @return zero for success, -errno for failure
+ */
+int fuse_lowlevel_backing_close(struct fuse_chan *ch, const int backing_id);
+
 
 /* ----------------------------------------------------------- *
  * Utility functions					       *
@@ -1455,6 +1503,7 @@ struct fuse_session *fuse_session_new(void *data,
                                       void *destroy);
 void fuse_session_add_chan(struct fuse_session *se, struct fuse_chan *ch);
 void fuse_session_remove_chan(struct fuse_chan *ch);
+struct fuse_chan *fuse_session_clone_chan(struct fuse_session *se);
 void fuse_session_destroy(struct fuse_session *se);
 void fuse_session_exit(struct fuse_session *se);
 int fuse_session_exited(struct fuse_session *se);
@@ -1470,7 +1519,9 @@ int fuse_session_loop_mt(struct fuse_session *se,
                          const int            read_thread_count,
                          const int            process_thread_count,
                          const int            process_thread_queue_depth,
-                         const char          *pin_threads_type);
+                         const char          *process_thread_scheduler,
+                         const char          *pin_threads_type,
+                         const bool           clone_fd);
 
 /* ----------------------------------------------------------- *
  * Channel interface					       *
@@ -1478,6 +1529,15 @@ int fuse_session_loop_mt(struct fuse_session *se,
 
 struct fuse_chan *fuse_chan_new(int fd, size_t bufsize);
 
+/**
+ * Open a new /dev/fuse fd attached to the same connection as the
+ * channel using FUSE_DEV_IOC_CLONE.
+ *
+ * @param ch the channel to clone
+ * @return the new channel, or NULL on failure
+ */
+struct fuse_chan *fuse_chan_clone(struct fuse_chan *ch);
+
 /**
  * Query the file descriptor of the channel
  *
@@ -7,4 +7,7 @@ struct fuse_msgbuf_t
 {
   uint32_t  size;
   char     *mem;
+  int       pipefd[2];
+  uint32_t  pipe_len;
+  int       node;
 };
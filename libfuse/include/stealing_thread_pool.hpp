@@ -0,0 +1,372 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <syslog.h>
+#include <time.h>
+
+
+/*
+  Each producer owns a queue. Every thread has a home queue which it
+  drains first and when that is empty it takes the oldest request
+  from the other queues before going to sleep. A producer which finds
+  all threads of its own queue busy wakes an idle thread from another
+  queue so a request isn't stuck behind a slow one.
+
+  Queue depth is bounded per queue so producers don't share a
+  counter.
+*/
+class StealingThreadPool
+{
+private:
+  using Func = std::function<void(void)>;
+
+  struct Queue
+  {
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::deque<Func>        work;
+    unsigned                wakeups;
+    std::atomic<unsigned>   idle;
+  };
+
+  struct Worker
+  {
+    StealingThreadPool    *pool;
+    std::atomic<unsigned>  home;
+  };
+
+public:
+  StealingThreadPool(unsigned const    queue_count_,
+                     unsigned const    thread_count_,
+                     unsigned const    max_queue_depth_,
+                     std::string const name_ = {})
+    : _max_queue_depth(0),
+      _stop(false),
+      _steals(0),
+      _name(name_)
+  {
+    unsigned queue_count;
+    unsigned max_queue_depth;
+
+    queue_count     = std::max(1U,queue_count_);
+    max_queue_depth = std::max(thread_count_,max_queue_depth_);
+    _max_queue_depth = std::max(1U,((max_queue_depth + queue_count - 1) /
+                                    queue_count));
+
+    syslog(LOG_DEBUG,
+           "threadpool (%s): spawning %u threads over %u queues"
+           " w/ max queue depth %u per queue",
+           _name.c_str(),
+           thread_count_,
+           queue_count,
+           _max_queue_depth);
+
+    for(unsigned i = 0; i < queue_count; i++)
+      {
+        _queues.emplace_back(new Queue());
+        _queues.back()->wakeups = 0;
+        _queues.back()->idle    = 0;
+      }
+
+    sigset_t oldset;
+    sigset_t newset;
+
+    sigfillset(&newset);
+    pthread_sigmask(SIG_BLOCK,&newset,&oldset);
+
+    _workers.reserve(thread_count_);
+    _threads.reserve(thread_count_);
+    for(unsigned i = 0; i < thread_count_; i++)
+      {
+        int rv;
+        pthread_t t;
+        Worker *w;
+
+        w = new Worker();
+        w->pool = this;
+        w->home = (i % queue_count);
+
+        rv = pthread_create(&t,NULL,StealingThreadPool::start_routine,w);
+        if(rv != 0)
+          {
+            syslog(LOG_WARNING,
+                   "threadpool (%s): error spawning thread - %d (%s)",
+                   _name.c_str(),
+                   rv,
+                   strerror(rv));
+            delete w;
+            continue;
+          }
+
+        if(!_name.empty())
+          pthread_setname_np(t,_name.c_str());
+
+        _workers.emplace_back(w);
+        _threads.push_back(t);
+      }
+
+    pthread_sigmask(SIG_SETMASK,&oldset,NULL);
+
+    if(_threads.empty())
+      throw std::runtime_error("threadpool: failed to spawn any threads");
+  }
+
+  ~StealingThreadPool()
+  {
+    syslog(LOG_DEBUG,
+           "threadpool (%s): destroying %lu threads",
+           _name.c_str(),
+           _threads.size());
+
+    _stop.store(true);
+    for(auto &q : _queues)
+      {
+        std::lock_guard<std::mutex> lg(q->mutex);
+        q->cv.notify_all();
+      }
+
+    for(auto t : _threads)
+      pthread_cancel(t);
+
+    for(auto t : _threads)
+      pthread_join(t,NULL);
+  }
+
+private:
+  StealingThreadPool(const StealingThreadPool&);
+  StealingThreadPool& operator=(const StealingThreadPool&);
+
+private:
+  static
+  void*
+  start_routine(void *arg_)
+  {
+    Worker *w = static_cast<Worker*>(arg_);
+    StealingThreadPool *pool = w->pool;
+    StealingThreadPool::Func func;
+
+    // Waiting on a std::condition_variable must not be a cancellation
+    // point. Requests themselves remain cancelable.
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,NULL);
+    while(pool->next(w->home.load(std::memory_order_relaxed),func))
+      {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE,NULL);
+        func();
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,NULL);
+        func = nullptr;
+      }
+
+    return NULL;
+  }
+
+  bool
+  pop(Queue &q_,
+      Func  &func_)
+  {
+    if(q_.work.empty())
+      return false;
+
+    func_ = std::move(q_.work.front());
+    q_.work.pop_front();
+
+    return true;
+  }
+
+  // A non-blocking pass skips queues currently locked. The pass made
+  // after announcing idleness must look at every queue or a request
+  // enqueued in between could be missed.
+  bool
+  steal(unsigned const  home_,
+        Func           &func_,
+        bool const      block_)
+  {
+    for(std::size_t i = 1; i < _queues.size(); i++)
+      {
+        Queue &q = *_queues[(home_ + i) % _queues.size()];
+        std::unique_lock<std::mutex> lk(q.mutex,std::defer_lock);
+
+        if(block_)
+          lk.lock();
+        else if(!lk.try_lock())
+          continue;
+
+        if(pop(q,func_))
+          {
+            _steals.fetch_add(1,std::memory_order_relaxed);
+            return true;
+          }
+      }
+
+    return false;
+  }
+
+  bool
+  next(unsigned const  home_,
+       Func           &func_)
+  {
+    Queue &home = *_queues[home_ % _queues.size()];
+
+    while(!_stop.load(std::memory_order_relaxed))
+      {
+        {
+          std::lock_guard<std::mutex> lg(home.mutex);
+          if(pop(home,func_))
+            return true;
+        }
+
+        if(steal(home_,func_,false))
+          return true;
+
+        home.idle.fetch_add(1);
+        if(steal(home_,func_,true))
+          {
+            home.idle.fetch_sub(1);
+            return true;
+          }
+
+        {
+          std::unique_lock<std::mutex> lk(home.mutex);
+
+          home.cv.wait(lk,[&]
+          {
+            return (_stop.load(std::memory_order_relaxed) ||
+                    !home.work.empty() ||
+                    (home.wakeups > 0));
+          });
+
+          if(home.wakeups > 0)
+            home.wakeups--;
+          home.idle.fetch_sub(1);
+
+          if(pop(home,func_))
+            return true;
+        }
+      }
+
+    return false;
+  }
+
+  void
+  wake_idle(unsigned const queue_)
+  {
+    for(std::size_t i = 1; i < _queues.size(); i++)
+      {
+        Queue &q = *_queues[(queue_ + i) % _queues.size()];
+
+        if(q.idle.load() == 0)
+          continue;
+
+        std::lock_guard<std::mutex> lg(q.mutex);
+        if(q.wakeups < q.idle.load())
+          q.wakeups++;
+        q.cv.notify_one();
+
+        return;
+      }
+  }
+
+public:
+  template<typename FuncType>
+  void
+  enqueue_work(unsigned const   queue_,
+               FuncType       &&f_)
+  {
+    unsigned queue;
+    timespec ts = {0,1000};
+
+    queue = (queue_ % _queues.size());
+    Queue &q = *_queues[queue];
+    for(unsigned i = 0; true; i++)
+      {
+        std::unique_lock<std::mutex> lk(q.mutex);
+
+        if((q.work.size() < _max_queue_depth) || (i >= 1000000))
+          {
+            q.work.emplace_back(std::forward<FuncType>(f_));
+            break;
+          }
+
+        lk.unlock();
+        ::nanosleep(&ts,NULL);
+      }
+
+    if(q.idle.load() > 0)
+      q.cv.notify_one();
+    else
+      wake_idle(queue);
+  }
+
+public:
+  void
+  set_home(std::size_t const thread_idx_,
+           unsigned const    queue_)
+  {
+    if(thread_idx_ >= _workers.size())
+      return;
+
+    _workers[thread_idx_]->home.store(queue_ % _queues.size(),
+                                      std::memory_order_relaxed);
+  }
+
+  unsigned
+  queue_count() const
+  {
+    return _queues.size();
+  }
+
+  uint64_t
+  steals() const
+  {
+    return _steals.load(std::memory_order_relaxed);
+  }
+
+  std::vector<pthread_t>
+  threads() const
+  {
+    return _threads;
+  }
+
+private:
+  std::vector<std::unique_ptr<Queue>> _queues;
+  unsigned                            _max_queue_depth;
+  std::atomic<bool>                   _stop;
+  std::atomic<uint64_t>               _steals;
+
+private:
+  std::string const                    _name;
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::vector<pthread_t>               _threads;
+};
@@ -8,7 +8,9 @@
 
 #include <sched.h>
 
+#include <cstdio>
 #include <fstream>
+#include <string>
 
 
 int
@@ -161,3 +163,36 @@ CPU::core2cpus()
 
   return c2c;
 }
+
+// All CPUs, not just those in the affinity mask, as threads can be
+// pinned elsewhere later. Empty when NUMA info is not available.
+CPU::CPU2NodeMap
+CPU::cpu2node()
+{
+  std::error_code ec;
+  CPU::CPU2NodeMap c2n;
+  const ghc::filesystem::path basepath{"/sys/devices/system/node"};
+
+  for(auto const &node_dir : ghc::filesystem::directory_iterator(basepath,ec))
+    {
+      int node_id;
+      std::string name;
+
+      name = node_dir.path().filename().string();
+      if(sscanf(name.c_str(),"node%d",&node_id) != 1)
+        continue;
+
+      for(auto const &cpu_dir : ghc::filesystem::directory_iterator(node_dir.path(),ec))
+        {
+          int cpu_id;
+
+          name = cpu_dir.path().filename().string();
+          if(sscanf(name.c_str(),"cpu%d",&cpu_id) != 1)
+            continue;
+
+          c2n[cpu_id] = node_id;
+        }
+    }
+
+  return c2n;
+}
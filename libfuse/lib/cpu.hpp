@@ -19,6 +19,7 @@ public:
   typedef std::vector<int> CPUVec;
   typedef std::unordered_map<int,int> CPU2CoreMap;
   typedef std::unordered_map<int,std::set<int>> Core2CPUsMap;
+  typedef std::unordered_map<int,int> CPU2NodeMap;
 
 public:
   static int count();
@@ -30,4 +31,5 @@ public:
   static CPU::CPUVec cpus();
   static CPU::CPU2CoreMap cpu2core();
   static CPU::Core2CPUsMap core2cpus();
+  static CPU::CPU2NodeMap cpu2node();
 };
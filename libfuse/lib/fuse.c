@@ -15,6 +15,7 @@
 #include "kvec.h"
 
 #include "node.h"
+#include "wyhash.h"
 #include "config.h"
 #include "fuse_dirents.h"
 #include "fuse_i.h"
@@ -56,6 +57,7 @@
 #define OFFSET_MAX 0x7fffffffffffffffLL
 
 #define NODE_TABLE_MIN_SIZE 8192
+#define NODE_STAT_LOCKS 64
 
 #define PARAM(inarg) ((void*)(((char*)(inarg)) + sizeof(*(inarg))))
 
@@ -96,12 +98,18 @@ struct lock_queue_element
   bool done : 1;
 };
 
+typedef struct node_slot_t node_slot_t;
+struct node_slot_t
+{
+  uint64_t  hash;
+  node_t   *node;
+};
+
 struct node_table
 {
-  node_t **array;
-  size_t   use;
-  size_t   size;
-  size_t   split;
+  node_slot_t *array;
+  size_t       use;
+  size_t       size;
 };
 
 #define container_of(ptr,type,member) ({                        \
@@ -138,7 +146,22 @@ struct fuse
   struct node_table id_table;
   nodeid_gen_t nodeid_gen;
   unsigned int hidectr;
-  pthread_mutex_t lock;
+  /*
+    The node tables, the tree they describe, the lock queue and node
+    reference counts are guarded by f->lock, a reader / writer lock.
+
+    Path resolution only walks up the tree and bumps reader treelock
+    counts (atomically) so it runs under the read lock and lookups of
+    unrelated paths no longer serialize on each other. Anything that
+    reshapes the tables or tree, drops references or queues / wakes
+    waiters takes the write lock. The per node stat cache is guarded
+    by a small set of mutexes striped by nodeid.
+
+    Writers prefer to avoid starving behind a stream of readers.
+  */
+  pthread_rwlock_t lock;
+  pthread_mutex_t lockq_lock;
+  pthread_mutex_t stat_locks[NODE_STAT_LOCKS];
   struct fuse_config conf;
   struct fuse_fs *fs;
   struct lock_queue_element *lockq;
@@ -177,6 +200,30 @@ static pthread_key_t fuse_context_key;
 static pthread_mutex_t fuse_context_lock = PTHREAD_MUTEX_INITIALIZER;
 static int fuse_context_ref;
 
+static
+void
+fuse_rwlock_init(pthread_rwlock_t *rwlock_)
+{
+  pthread_rwlockattr_t attr;
+
+  pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+  pthread_rwlockattr_setkind_np(&attr,
+                                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+  pthread_rwlock_init(rwlock_,&attr);
+  pthread_rwlockattr_destroy(&attr);
+}
+
+static
+inline
+pthread_mutex_t*
+node_stat_lock(struct fuse  *f_,
+               const node_t *node_)
+{
+  return &f_->stat_locks[node_->nodeid & (NODE_STAT_LOCKS - 1)];
+}
+
 /*
   Why was the nodeid:generation logic simplified?
 
@@ -258,18 +305,197 @@ list_del(struct list_head *entry)
   prev->next = next;
 }
 
+/*
+  The node tables are open addressing, linear probing hash tables of
+  (hash,node) slots. Keeping the full 64bit hash in the slot means
+  probes and rehashes rarely touch the node itself and nodes no longer
+  need chain pointers. Deletion uses backward shifting so there are no
+  tombstones and probe sequences stay short after heavy churn.
+*/
+static
+int
+node_table_init(struct node_table *t_,
+                size_t             size_)
+{
+  t_->array = (node_slot_t*)calloc(size_,sizeof(node_slot_t));
+  if(t_->array == NULL)
+    {
+      fprintf(stderr,"fuse: memory allocation failed\n");
+      return -1;
+    }
+  t_->size = size_;
+  t_->use  = 0;
+
+  return 0;
+}
+
+static
+int
+node_table_rehash(struct node_table *t_,
+                  size_t             newsize_)
+{
+  size_t mask;
+  node_slot_t *newarray;
+
+  newarray = (node_slot_t*)calloc(newsize_,sizeof(node_slot_t));
+  if(newarray == NULL)
+    return -1;
+
+  mask = (newsize_ - 1);
+  for(size_t i = 0; i < t_->size; i++)
+    {
+      size_t idx;
+
+      if(t_->array[i].node == NULL)
+        continue;
+
+      idx = (t_->array[i].hash & mask);
+      while(newarray[idx].node != NULL)
+        idx = ((idx + 1) & mask);
+      newarray[idx] = t_->array[i];
+    }
+
+  free(t_->array);
+  t_->array = newarray;
+  t_->size  = newsize_;
+
+  return 0;
+}
+
+static
+int
+node_table_insert(struct node_table *t_,
+                  uint64_t           hash_,
+                  node_t            *node_)
+{
+  size_t idx;
+  size_t mask;
+
+  if(((t_->use + 1) * 4) > (t_->size * 3))
+    {
+      if((node_table_rehash(t_,t_->size * 2) == -1) &&
+         ((t_->use + 1) >= t_->size))
+        return -1;
+    }
+
+  mask = (t_->size - 1);
+  idx  = (hash_ & mask);
+  while(t_->array[idx].node != NULL)
+    idx = ((idx + 1) & mask);
+
+  t_->array[idx].hash = hash_;
+  t_->array[idx].node = node_;
+  t_->use++;
+
+  return 0;
+}
+
+static
+void
+node_table_remove(struct node_table *t_,
+                  size_t             idx_)
+{
+  size_t i;
+  size_t j;
+  size_t home;
+  size_t mask;
+
+  i    = idx_;
+  j    = idx_;
+  mask = (t_->size - 1);
+  for(;;)
+    {
+      j = ((j + 1) & mask);
+      if(t_->array[j].node == NULL)
+        break;
+
+      home = (t_->array[j].hash & mask);
+      if(((j > i) && ((home <= i) || (home > j))) ||
+         ((j < i) && ((home <= i) && (home > j))))
+        {
+          t_->array[i] = t_->array[j];
+          i = j;
+        }
+    }
+
+  t_->array[i].hash = 0;
+  t_->array[i].node = NULL;
+  t_->use--;
+
+  if((t_->size > NODE_TABLE_MIN_SIZE) && (t_->use < (t_->size / 8)))
+    node_table_rehash(t_,t_->size / 2);
+}
+
 static
 size_t
-id_hash(struct fuse *f,
-        uint64_t     ino)
+node_table_find(const struct node_table *t_,
+                uint64_t                 hash_,
+                const node_t            *node_)
 {
-  uint64_t hash = ((uint32_t)ino * 2654435761U) % f->id_table.size;
-  uint64_t oldhash = hash % (f->id_table.size / 2);
+  size_t idx;
+  size_t mask;
 
-  if(oldhash >= f->id_table.split)
-    return oldhash;
-  else
-    return hash;
+  mask = (t_->size - 1);
+  idx  = (hash_ & mask);
+  while(t_->array[idx].node != node_)
+    {
+      if(t_->array[idx].node == NULL)
+        return SIZE_MAX;
+      idx = ((idx + 1) & mask);
+    }
+
+  return idx;
+}
+
+/*
+  Average and max distance of entries from their home slot. Walks the
+  whole table so only used when logging metrics.
+*/
+static
+void
+node_table_probe_stats(const struct node_table *t_,
+                       double                  *avg_,
+                       uint64_t                *max_)
+{
+  size_t mask;
+  uint64_t max;
+  uint64_t total;
+
+  max   = 0;
+  total = 0;
+  mask  = (t_->size - 1);
+  for(size_t i = 0; i < t_->size; i++)
+    {
+      uint64_t dist;
+
+      if(t_->array[i].node == NULL)
+        continue;
+
+      dist   = ((i - t_->array[i].hash) & mask);
+      total += dist;
+      if(dist > max)
+        max = dist;
+    }
+
+  *avg_ = ((t_->use > 0) ? ((double)total / t_->use) : 0.0);
+  *max_ = max;
+}
+
+static
+inline
+uint64_t
+id_hash(uint64_t nodeid_)
+{
+  return wyhash64(nodeid_,0x6e6f64656964);
+}
+
+static
+inline
+uint64_t
+name_hash(uint64_t    parent_,
+          const char *name_)
+{
+  return wyhash(name_,strlen(name_),parent_,_wyp);
 }
 
 static
@@ -277,12 +503,20 @@ node_t*
 get_node_nocheck(struct fuse *f,
                  uint64_t     nodeid)
 {
-  size_t hash = id_hash(f,nodeid);
-  node_t *node;
+  size_t idx;
+  size_t mask;
+  uint64_t hash;
+  const node_slot_t *slot;
 
-  for(node = f->id_table.array[hash]; node != NULL; node = node->id_next)
-    if(node->nodeid == nodeid)
-      return node;
+  hash = id_hash(nodeid);
+  mask = (f->id_table.size - 1);
+  idx  = (hash & mask);
+  for(slot = &f->id_table.array[idx]; slot->node != NULL; slot = &f->id_table.array[idx])
+    {
+      if((slot->hash == hash) && (slot->node->nodeid == nodeid))
+        return slot->node;
+      idx = ((idx + 1) & mask);
+    }
 
   return NULL;
 }
@@ -372,162 +606,24 @@ free_node(struct fuse *f_,
   node_free(node_);
 }
 
-static
-void
-node_table_reduce(struct node_table *t)
-{
-  size_t newsize = t->size / 2;
-  void *newarray;
-
-  if(newsize < NODE_TABLE_MIN_SIZE)
-    return;
-
-  newarray = realloc(t->array,sizeof(node_t*) * newsize);
-  if(newarray != NULL)
-    t->array = newarray;
-
-  t->size = newsize;
-  t->split = t->size / 2;
-}
-
-static
-void
-remerge_id(struct fuse *f)
-{
-  struct node_table *t = &f->id_table;
-  int iter;
-
-  if(t->split == 0)
-    node_table_reduce(t);
-
-  for(iter = 8; t->split > 0 && iter; iter--)
-    {
-      node_t **upper;
-
-      t->split--;
-      upper = &t->array[t->split + t->size / 2];
-      if(*upper)
-        {
-          node_t **nodep;
-
-          for(nodep = &t->array[t->split]; *nodep;
-              nodep = &(*nodep)->id_next);
-
-          *nodep = *upper;
-          *upper = NULL;
-          break;
-        }
-    }
-}
-
 static
 void
 unhash_id(struct fuse *f,
           node_t      *node)
 {
-  node_t **nodep = &f->id_table.array[id_hash(f,node->nodeid)];
+  size_t idx;
 
-  for(; *nodep != NULL; nodep = &(*nodep)->id_next)
-    if(*nodep == node)
-      {
-        *nodep = node->id_next;
-        f->id_table.use--;
-
-        if(f->id_table.use < f->id_table.size / 4)
-          remerge_id(f);
-        return;
-      }
+  idx = node_table_find(&f->id_table,id_hash(node->nodeid),node);
+  if(idx != SIZE_MAX)
+    node_table_remove(&f->id_table,idx);
 }
 
 static
 int
-node_table_resize(struct node_table *t)
-{
-  size_t newsize = t->size * 2;
-  void *newarray;
-
-  newarray = realloc(t->array,sizeof(node_t*) * newsize);
-  if(newarray == NULL)
-    return -1;
-
-  t->array = newarray;
-  memset(t->array + t->size,0,t->size * sizeof(node_t*));
-  t->size = newsize;
-  t->split = 0;
-
-  return 0;
-}
-
-static
-void
-rehash_id(struct fuse *f)
-{
-  struct node_table *t = &f->id_table;
-  node_t **nodep;
-  node_t **next;
-  size_t hash;
-
-  if(t->split == t->size / 2)
-    return;
-
-  hash = t->split;
-  t->split++;
-  for(nodep = &t->array[hash]; *nodep != NULL; nodep = next)
-    {
-      node_t *node = *nodep;
-      size_t newhash = id_hash(f,node->nodeid);
-
-      if(newhash != hash)
-        {
-          next = nodep;
-          *nodep = node->id_next;
-          node->id_next = t->array[newhash];
-          t->array[newhash] = node;
-        }
-      else
-        {
-          next = &node->id_next;
-        }
-    }
-
-  if(t->split == t->size / 2)
-    node_table_resize(t);
-}
-
-static
-void
 hash_id(struct fuse *f,
         node_t      *node)
 {
-  size_t hash;
-
-  hash = id_hash(f,node->nodeid);
-  node->id_next = f->id_table.array[hash];
-  f->id_table.array[hash] = node;
-  f->id_table.use++;
-
-  if(f->id_table.use >= f->id_table.size / 2)
-    rehash_id(f);
-}
-
-static
-size_t
-name_hash(struct fuse *f,
-          uint64_t     parent,
-          const char  *name)
-{
-  uint64_t hash = parent;
-  uint64_t oldhash;
-
-  for(; *name; name++)
-    hash = hash * 31 + (unsigned char)*name;
-
-  hash %= f->name_table.size;
-  oldhash = hash % (f->name_table.size / 2);
-  if(oldhash >= f->name_table.split)
-    return oldhash;
-  else
-    return hash;
+  return node_table_insert(&f->id_table,id_hash(node->nodeid),node);
 }
 
 static
@@ -535,35 +631,6 @@ void
 unref_node(struct fuse *f,
            node_t      *node);
 
-static
-void
-remerge_name(struct fuse *f)
-{
-  int iter;
-  struct node_table *t = &f->name_table;
-
-  if(t->split == 0)
-    node_table_reduce(t);
-
-  for(iter = 8; t->split > 0 && iter; iter--)
-    {
-      node_t **upper;
-
-      t->split--;
-      upper = &t->array[t->split + t->size / 2];
-      if(*upper)
-        {
-          node_t **nodep;
-
-          for(nodep = &t->array[t->split]; *nodep; nodep = &(*nodep)->name_next);
-
-          *nodep = *upper;
-          *upper = NULL;
-          break;
-        }
-    }
-}
-
 static
 void
 unhash_name(struct fuse *f,
@@ -571,24 +638,20 @@ unhash_name(struct fuse *f,
 {
   if(node->name)
     {
-      size_t hash = name_hash(f,node->parent->nodeid,node->name);
-      node_t **nodep = &f->name_table.array[hash];
+      size_t idx;
+      uint64_t hash;
 
-      for(; *nodep != NULL; nodep = &(*nodep)->name_next)
-        if(*nodep == node)
-          {
-            *nodep = node->name_next;
-            node->name_next = NULL;
-            unref_node(f,node->parent);
-            filename_free(f,node->name);
-            node->name = NULL;
-            node->parent = NULL;
-            f->name_table.use--;
-
-            if(f->name_table.use < f->name_table.size / 4)
-              remerge_name(f);
-            return;
-          }
+      hash = name_hash(node->parent->nodeid,node->name);
+      idx  = node_table_find(&f->name_table,hash,node);
+      if(idx != SIZE_MAX)
+        {
+          node_table_remove(&f->name_table,idx);
+          unref_node(f,node->parent);
+          filename_free(f,node->name);
+          node->name = NULL;
+          node->parent = NULL;
+          return;
+        }
 
       fprintf(stderr,
               "fuse internal error: unable to unhash node: %llu\n",
@@ -598,42 +661,6 @@ unhash_name(struct fuse *f,
     }
 }
 
-static
-void
-rehash_name(struct fuse *f)
-{
-  struct node_table *t = &f->name_table;
-  node_t **nodep;
-  node_t **next;
-  size_t hash;
-
-  if(t->split == t->size / 2)
-    return;
-
-  hash = t->split;
-  t->split++;
-  for(nodep = &t->array[hash]; *nodep != NULL; nodep = next)
-    {
-      node_t *node = *nodep;
-      size_t newhash = name_hash(f,node->parent->nodeid,node->name);
-
-      if(newhash != hash)
-        {
-          next = nodep;
-          *nodep = node->name_next;
-          node->name_next = t->array[newhash];
-          t->array[newhash] = node;
-        }
-      else
-        {
-          next = &node->name_next;
-        }
-    }
-
-  if(t->split == t->size / 2)
-    node_table_resize(t);
-}
-
 static
 int
 hash_name(struct fuse *f,
@@ -641,20 +668,20 @@ hash_name(struct fuse *f,
           uint64_t     parentid,
           const char  *name)
 {
-  size_t hash = name_hash(f,parentid,name);
   node_t *parent = get_node(f,parentid);
   node->name = filename_strdup(f,name);
   if(node->name == NULL)
     return -1;
 
+  if(node_table_insert(&f->name_table,name_hash(parentid,name),node) == -1)
+    {
+      filename_free(f,node->name);
+      node->name = NULL;
+      return -1;
+    }
+
   parent->refctr++;
   node->parent = parent;
-  node->name_next = f->name_table.array[hash];
-  f->name_table.array[hash] = node;
-  f->name_table.use++;
-
-  if(f->name_table.use >= f->name_table.size / 2)
-    rehash_name(f);
 
   return 0;
 }
@@ -710,13 +737,22 @@ lookup_node(struct fuse *f,
             uint64_t     parent,
             const char  *name)
 {
-  size_t hash;
-  node_t *node;
+  size_t idx;
+  size_t mask;
+  uint64_t hash;
+  const node_slot_t *slot;
 
-  hash =  name_hash(f,parent,name);
-  for(node = f->name_table.array[hash]; node != NULL; node = node->name_next)
-    if(node->parent->nodeid == parent && strcmp(node->name,name) == 0)
-      return node;
+  hash = name_hash(parent,name);
+  mask = (f->name_table.size - 1);
+  idx  = (hash & mask);
+  for(slot = &f->name_table.array[idx]; slot->node != NULL; slot = &f->name_table.array[idx])
+    {
+      if((slot->hash == hash) &&
+         (slot->node->parent->nodeid == parent) &&
+         (strcmp(slot->node->name,name) == 0))
+        return slot->node;
+      idx = ((idx + 1) & mask);
+    }
 
   return NULL;
 }
@@ -730,6 +766,29 @@ inc_nlookup(node_t *node)
   node->nlookup++;
 }
 
+/*
+  Bumping an existing, already referenced node's lookup count doesn't
+  change the tree or any refcount so it can be done while only holding
+  the read lock. nlookup only ever decreases under the write lock.
+*/
+static
+bool
+inc_nlookup_shared(struct fuse *f_,
+                   node_t      *node_)
+{
+  uint64_t nlookup;
+
+  nlookup = __atomic_load_n(&node_->nlookup,__ATOMIC_RELAXED);
+  if(nlookup == 0)
+    return false;
+  if((nlookup == 1) && remember_nodes(f_))
+    return false;
+
+  __atomic_add_fetch(&node_->nlookup,1,__ATOMIC_RELAXED);
+
+  return true;
+}
+
 static
 node_t*
 find_node(struct fuse *f,
@@ -738,7 +797,19 @@ find_node(struct fuse *f,
 {
   node_t *node;
 
-  pthread_mutex_lock(&f->lock);
+  if(name != NULL)
+    {
+      pthread_rwlock_rdlock(&f->lock);
+      node = lookup_node(f,parent,name);
+      if((node != NULL) && inc_nlookup_shared(f,node))
+        {
+          pthread_rwlock_unlock(&f->lock);
+          return node;
+        }
+      pthread_rwlock_unlock(&f->lock);
+    }
+
+  pthread_rwlock_wrlock(&f->lock);
   if(!name)
     node = get_node(f,parent);
   else
@@ -760,7 +831,13 @@ find_node(struct fuse *f,
           node = NULL;
           goto out_err;
         }
-      hash_id(f,node);
+      if(hash_id(f,node) == -1)
+        {
+          unhash_name(f,node);
+          free_node(f,node);
+          node = NULL;
+          goto out_err;
+        }
     }
   else if((node->nlookup == 1) && remember_nodes(f))
     {
@@ -768,7 +845,7 @@ find_node(struct fuse *f,
     }
   inc_nlookup(node);
  out_err:
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
   return node;
 }
 
@@ -829,12 +906,14 @@ unlock_path(struct fuse *f,
 
   for(node = get_node(f,nodeid); node != end && node->nodeid != FUSE_ROOT_ID; node = node->parent)
     {
-      assert(node->treelock != 0);
-      assert(node->treelock != TREELOCK_WAIT_OFFSET);
-      assert(node->treelock != TREELOCK_WRITE);
-      node->treelock--;
-      if(node->treelock == TREELOCK_WAIT_OFFSET)
-        node->treelock = 0;
+      int32_t treelock;
+
+      treelock = __atomic_fetch_sub(&node->treelock,1,__ATOMIC_RELAXED);
+      assert(treelock != 0);
+      assert(treelock != TREELOCK_WAIT_OFFSET);
+      assert(treelock != TREELOCK_WRITE);
+      if((treelock - 1) == TREELOCK_WAIT_OFFSET)
+        __atomic_store_n(&node->treelock,0,__ATOMIC_RELAXED);
     }
 }
 
@@ -903,10 +982,10 @@ try_get_path(struct fuse  *f,
       if(need_lock)
         {
           err = -EAGAIN;
-          if(node->treelock < 0)
+          if(__atomic_load_n(&node->treelock,__ATOMIC_RELAXED) < 0)
             goto out_unlock;
 
-          node->treelock++;
+          __atomic_add_fetch(&node->treelock,1,__ATOMIC_RELAXED);
         }
     }
 
@@ -961,6 +1040,34 @@ try_get_path2(struct fuse  *f,
   return err;
 }
 
+/*
+  Waiters block on their queue element's condition which can't be
+  paired with the rwlock. lockq_lock is taken before the write lock is
+  released so a waker, which must hold the write lock, can't signal
+  before the waiter is actually waiting.
+*/
+static
+void
+lockq_wait(struct fuse    *f_,
+           pthread_cond_t *cond_)
+{
+  pthread_mutex_lock(&f_->lockq_lock);
+  pthread_rwlock_unlock(&f_->lock);
+  pthread_cond_wait(cond_,&f_->lockq_lock);
+  pthread_mutex_unlock(&f_->lockq_lock);
+  pthread_rwlock_wrlock(&f_->lock);
+}
+
+static
+void
+lockq_signal(struct fuse    *f_,
+             pthread_cond_t *cond_)
+{
+  pthread_mutex_lock(&f_->lockq_lock);
+  pthread_cond_signal(cond_);
+  pthread_mutex_unlock(&f_->lockq_lock);
+}
+
 static
 void
 queue_element_wakeup(struct fuse               *f,
@@ -972,7 +1079,7 @@ queue_element_wakeup(struct fuse               *f,
     {
       /* Just waiting for it to be unlocked */
       if(get_node(f,qe->nodeid1)->treelock == 0)
-        pthread_cond_signal(&qe->cond);
+        lockq_signal(f,&qe->cond);
 
       return;
     }
@@ -1007,7 +1114,7 @@ queue_element_wakeup(struct fuse               *f,
 
   qe->err = err;
   qe->done = true;
-  pthread_cond_signal(&qe->cond);
+  lockq_signal(f,&qe->cond);
 }
 
 static
@@ -1055,7 +1162,7 @@ wait_path(struct fuse               *f,
 
   do
     {
-      pthread_cond_wait(&qe->cond,&f->lock);
+      lockq_wait(f,&qe->cond);
     } while(!qe->done);
 
   dequeue_path(f,qe);
@@ -1073,7 +1180,16 @@ get_path_common(struct fuse  *f,
 {
   int err;
 
-  pthread_mutex_lock(&f->lock);
+  if(wnode == NULL)
+    {
+      pthread_rwlock_rdlock(&f->lock);
+      err = try_get_path(f,nodeid,name,path,NULL,true);
+      pthread_rwlock_unlock(&f->lock);
+      if(err != -EAGAIN)
+        return err;
+    }
+
+  pthread_rwlock_wrlock(&f->lock);
   err = try_get_path(f,nodeid,name,path,wnode,true);
   if(err == -EAGAIN)
     {
@@ -1086,7 +1202,7 @@ get_path_common(struct fuse  *f,
 
       err = wait_path(f,&qe);
     }
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
 
   return err;
 }
@@ -1135,7 +1251,7 @@ get_path2(struct fuse  *f,
 {
   int err;
 
-  pthread_mutex_lock(&f->lock);
+  pthread_rwlock_wrlock(&f->lock);
   err = try_get_path2(f,nodeid1,name1,nodeid2,name2,
                       path1,path2,wnode1,wnode2);
   if(err == -EAGAIN)
@@ -1153,7 +1269,7 @@ get_path2(struct fuse  *f,
 
       err = wait_path(f,&qe);
     }
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
 
   return err;
 }
@@ -1165,11 +1281,32 @@ free_path_wrlock(struct fuse *f,
                  node_t *wnode,
                  char        *path)
 {
-  pthread_mutex_lock(&f->lock);
+  bool queued;
+
+  if(wnode == NULL)
+    {
+      pthread_rwlock_rdlock(&f->lock);
+      unlock_path(f,nodeid,NULL,NULL);
+      queued = (f->lockq != NULL);
+      pthread_rwlock_unlock(&f->lock);
+
+      if(queued)
+        {
+          pthread_rwlock_wrlock(&f->lock);
+          if(f->lockq)
+            wake_up_queued(f);
+          pthread_rwlock_unlock(&f->lock);
+        }
+
+      free(path);
+      return;
+    }
+
+  pthread_rwlock_wrlock(&f->lock);
   unlock_path(f,nodeid,wnode,NULL);
   if(f->lockq)
     wake_up_queued(f);
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
   free(path);
 }
 
@@ -1193,11 +1330,11 @@ free_path2(struct fuse *f,
            char        *path1,
            char        *path2)
 {
-  pthread_mutex_lock(&f->lock);
+  pthread_rwlock_wrlock(&f->lock);
   unlock_path(f,nodeid1,wnode1,NULL);
   unlock_path(f,nodeid2,wnode2,NULL);
   wake_up_queued(f);
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
   free(path1);
   free(path2);
 }
@@ -1213,7 +1350,7 @@ forget_node(struct fuse      *f,
   if(nodeid == FUSE_ROOT_ID)
     return;
 
-  pthread_mutex_lock(&f->lock);
+  pthread_rwlock_wrlock(&f->lock);
   node = get_node(f,nodeid);
 
   /*
@@ -1230,7 +1367,7 @@ forget_node(struct fuse      *f,
 
       do
         {
-          pthread_cond_wait(&qe.cond,&f->lock);
+          lockq_wait(f,&qe.cond);
         }
       while((node->nlookup == nlookup) && node->treelock);
 
@@ -1254,7 +1391,7 @@ forget_node(struct fuse      *f,
       kv_push(remembered_node_t,f->remembered_nodes,fn);
     }
 
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
 }
 
 static
@@ -1278,11 +1415,11 @@ remove_node(struct fuse *f,
 {
   node_t *node;
 
-  pthread_mutex_lock(&f->lock);
+  pthread_rwlock_wrlock(&f->lock);
   node = lookup_node(f,dir,name);
   if(node != NULL)
     unlink_node(f,node);
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
 }
 
 static
@@ -1297,7 +1434,7 @@ rename_node(struct fuse *f,
   node_t *newnode;
   int err = 0;
 
-  pthread_mutex_lock(&f->lock);
+  pthread_rwlock_wrlock(&f->lock);
   node = lookup_node(f,olddir,oldname);
   newnode = lookup_node(f,newdir,newname);
   if(node == NULL)
@@ -1314,7 +1451,7 @@ rename_node(struct fuse *f,
     }
 
  out:
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
   return err;
 }
 
@@ -1377,9 +1514,9 @@ set_path_info(struct fuse             *f,
   e->ino        = node->nodeid;
   e->generation = f->nodeid_gen.generation;
 
-  pthread_mutex_lock(&f->lock);
+  pthread_mutex_lock(node_stat_lock(f,node));
   update_stat(node,&e->attr);
-  pthread_mutex_unlock(&f->lock);
+  pthread_mutex_unlock(node_stat_lock(f,node));
 
   set_stat(f,e->ino,&e->attr);
 
@@ -1563,16 +1700,16 @@ fuse_lib_lookup(fuse_req_t             req,
       if(name[1] == '\0')
         {
           name = NULL;
-          pthread_mutex_lock(&f->lock);
+          pthread_rwlock_wrlock(&f->lock);
           dot = get_node_nocheck(f,nodeid);
           if(dot == NULL)
             {
-              pthread_mutex_unlock(&f->lock);
+              pthread_rwlock_unlock(&f->lock);
               reply_entry(req,&e,-ESTALE);
               return;
             }
           dot->refctr++;
-          pthread_mutex_unlock(&f->lock);
+          pthread_rwlock_unlock(&f->lock);
         }
       else if((name[1] == '.') && (name[2] == '\0'))
         {
@@ -1583,9 +1720,9 @@ fuse_lib_lookup(fuse_req_t             req,
             }
 
           name = NULL;
-          pthread_mutex_lock(&f->lock);
+          pthread_rwlock_rdlock(&f->lock);
           nodeid = get_node(f,nodeid)->parent->nodeid;
-          pthread_mutex_unlock(&f->lock);
+          pthread_rwlock_unlock(&f->lock);
         }
     }
 
@@ -1603,9 +1740,9 @@ fuse_lib_lookup(fuse_req_t             req,
 
   if(dot)
     {
-      pthread_mutex_lock(&f->lock);
+      pthread_rwlock_wrlock(&f->lock);
       unref_node(f,dot);
-      pthread_mutex_unlock(&f->lock);
+      pthread_rwlock_unlock(&f->lock);
     }
 
   reply_entry(req,&e,err);
@@ -1674,11 +1811,11 @@ fuse_lib_getattr(fuse_req_t             req,
     }
   else
     {
-      pthread_mutex_lock(&f->lock);
+      pthread_rwlock_rdlock(&f->lock);
       node = get_node(f,hdr_->nodeid);
       if(node->hidden_fh)
         ffi.fh = node->hidden_fh;
-      pthread_mutex_unlock(&f->lock);
+      pthread_rwlock_unlock(&f->lock);
     }
 
   memset(&buf,0,sizeof(buf));
@@ -1699,10 +1836,12 @@ fuse_lib_getattr(fuse_req_t             req,
 
   if(!err)
     {
-      pthread_mutex_lock(&f->lock);
+      pthread_rwlock_rdlock(&f->lock);
       node = get_node(f,hdr_->nodeid);
+      pthread_rwlock_unlock(&f->lock);
+      pthread_mutex_lock(node_stat_lock(f,node));
       update_stat(node,&buf);
-      pthread_mutex_unlock(&f->lock);
+      pthread_mutex_unlock(node_stat_lock(f,node));
       set_stat(f,hdr_->nodeid,&buf);
       fuse_reply_attr(req,&buf,timeout.attr);
     }
@@ -1737,14 +1876,14 @@ fuse_lib_setattr(fuse_req_t             req,
     }
   else
     {
-      pthread_mutex_lock(&f->lock);
+      pthread_rwlock_rdlock(&f->lock);
       node = get_node(f,hdr_->nodeid);
       if(node->hidden_fh)
         {
           fi = &ffi;
           fi->fh = node->hidden_fh;
         }
-      pthread_mutex_unlock(&f->lock);
+      pthread_rwlock_unlock(&f->lock);
     }
 
   err = 0;
@@ -1823,9 +1962,12 @@ fuse_lib_setattr(fuse_req_t             req,
 
   if(!err)
     {
-      pthread_mutex_lock(&f->lock);
-      update_stat(get_node(f,hdr_->nodeid),&stbuf);
-      pthread_mutex_unlock(&f->lock);
+      pthread_rwlock_rdlock(&f->lock);
+      node = get_node(f,hdr_->nodeid);
+      pthread_rwlock_unlock(&f->lock);
+      pthread_mutex_lock(node_stat_lock(f,node));
+      update_stat(node,&stbuf);
+      pthread_mutex_unlock(node_stat_lock(f,node));
       set_stat(f,hdr_->nodeid,&stbuf);
       fuse_reply_attr(req,&stbuf,timeout.attr);
     }
@@ -1990,10 +2132,10 @@ fuse_lib_unlink(fuse_req_t             req,
 
   if(!err)
     {
-      pthread_mutex_lock(&f->lock);
+      pthread_rwlock_wrlock(&f->lock);
       if(node_open(wnode))
         err = f->fs->op.prepare_hide(path,&wnode->hidden_fh);
-      pthread_mutex_unlock(&f->lock);
+      pthread_rwlock_unlock(&f->lock);
 
       err = f->fs->op.unlink(path);
       if(!err)
@@ -2086,10 +2228,10 @@ fuse_lib_rename(fuse_req_t             req,
 
   if(!err)
     {
-      pthread_mutex_lock(&f->lock);
+      pthread_rwlock_wrlock(&f->lock);
       if(node_open(wnode2))
         err = f->fs->op.prepare_hide(newpath,&wnode2->hidden_fh);
-      pthread_mutex_unlock(&f->lock);
+      pthread_rwlock_unlock(&f->lock);
 
       err = f->fs->op.rename(oldpath,newpath);
       if(!err)
@@ -2134,6 +2276,57 @@ fuse_lib_link(fuse_req_t             req,
   reply_entry(req,&e,rv);
 }
 
+/*
+  The kernel requires all passthrough opens of an inode to share the
+  same backing file and refuses passthrough while page cached opens
+  exist (and vice versa). The first passthrough open of a node donates
+  its backing id which is then shared by later opens till the node is
+  no longer open. Non-passthrough opens of such a node are made
+  direct_io which the kernel allows to coexist.
+*/
+static
+void
+open_node(struct fuse      *f_,
+          uint64_t          ino_,
+          fuse_file_info_t *ffi_)
+{
+  node_t *node;
+  int32_t unused_backing_id;
+
+  unused_backing_id = 0;
+
+  pthread_rwlock_wrlock(&f_->lock);
+  node = get_node(f_,ino_);
+  if(ffi_->passthrough)
+    {
+      if(node->backing_id > 0)
+        {
+          unused_backing_id = ffi_->backing_id;
+          ffi_->backing_id  = node->backing_id;
+        }
+      else if(node->open_count == 0)
+        {
+          node->backing_id = ffi_->backing_id;
+        }
+      else
+        {
+          unused_backing_id = ffi_->backing_id;
+          ffi_->passthrough = 0;
+          ffi_->backing_id  = 0;
+        }
+    }
+  else if(node->backing_id > 0)
+    {
+      ffi_->direct_io  = 1;
+      ffi_->keep_cache = 0;
+    }
+  node->open_count++;
+  pthread_rwlock_unlock(&f_->lock);
+
+  if(unused_backing_id > 0)
+    fuse_lowlevel_backing_close(f_->se->ch,unused_backing_id);
+}
+
 static
 void
 fuse_do_release(struct fuse      *f,
@@ -2142,12 +2335,14 @@ fuse_do_release(struct fuse      *f,
 {
   uint64_t fh;
   node_t *node;
+  int32_t backing_id;
 
   fh = 0;
+  backing_id = 0;
 
   f->fs->op.release(fi);
 
-  pthread_mutex_lock(&f->lock);
+  pthread_rwlock_wrlock(&f->lock);
   {
     node = get_node(f,ino);
     assert(node->open_count > 0);
@@ -2158,11 +2353,19 @@ fuse_do_release(struct fuse      *f,
         fh = node->hidden_fh;
         node->hidden_fh = 0;
       }
+
+    if((node->backing_id > 0) && (node->open_count == 0))
+      {
+        backing_id = node->backing_id;
+        node->backing_id = 0;
+      }
   }
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
 
   if(fh)
     f->fs->op.free_hide(fh);
+  if(backing_id > 0)
+    fuse_lowlevel_backing_close(f->se->ch,backing_id);
 }
 
 static
@@ -2212,9 +2415,7 @@ fuse_lib_create(fuse_req_t             req,
 
   if(!err)
     {
-      pthread_mutex_lock(&f->lock);
-      get_node(f,e.ino)->open_count++;
-      pthread_mutex_unlock(&f->lock);
+      open_node(f,e.ino,&ffi);
 
       if(fuse_reply_create(req,&e,&ffi) == -ENOENT)
         {
@@ -2242,17 +2443,19 @@ open_auto_cache(struct fuse      *f,
   node_t *node;
   fuse_timeouts_t timeout;
 
-  pthread_mutex_lock(&f->lock);
-
+  pthread_rwlock_rdlock(&f->lock);
   node = get_node(f,ino);
+  pthread_rwlock_unlock(&f->lock);
+
+  pthread_mutex_lock(node_stat_lock(f,node));
   if(node->is_stat_cache_valid)
     {
       int err;
       struct stat stbuf;
 
-      pthread_mutex_unlock(&f->lock);
+      pthread_mutex_unlock(node_stat_lock(f,node));
       err = f->fs->op.fgetattr(fi,&stbuf,&timeout);
-      pthread_mutex_lock(&f->lock);
+      pthread_mutex_lock(node_stat_lock(f,node));
 
       if(!err)
         update_stat(node,&stbuf);
@@ -2265,7 +2468,7 @@ open_auto_cache(struct fuse      *f,
 
   node->is_stat_cache_valid = 1;
 
-  pthread_mutex_unlock(&f->lock);
+  pthread_mutex_unlock(node_stat_lock(f,node));
 }
 
 static
@@ -2298,9 +2501,7 @@ fuse_lib_open(fuse_req_t             req,
 
   if(!err)
     {
-      pthread_mutex_lock(&f->lock);
-      get_node(f,hdr_->nodeid)->open_count++;
-      pthread_mutex_unlock(&f->lock);
+      open_node(f,hdr_->nodeid,&ffi);
       /* The open syscall was interrupted,so it must be cancelled */
       if(fuse_reply_open(req,&ffi) == -ENOENT)
         fuse_do_release(f,hdr_->nodeid,&ffi);
@@ -2334,6 +2535,17 @@ fuse_lib_read(fuse_req_t             req,
 
   f = req_fuse_prepare(req);
 
+  if(f->fs->op.read_fd != NULL)
+    {
+      res = f->fs->op.read_fd(&ffi);
+      if(res >= 0)
+        {
+          res = fuse_reply_data_fd(req,res,arg->offset,arg->size);
+          if(res != -ENOTSUP)
+            return;
+        }
+    }
+
   msgbuf = msgbuf_alloc_page_aligned();
 
   res = f->fs->op.read(&ffi,msgbuf->mem,arg->size,arg->offset);
@@ -2346,6 +2558,43 @@ fuse_lib_read(fuse_req_t             req,
   msgbuf_free(msgbuf);
 }
 
+/*
+  The payload was left in the msgbuf's pipe by the splice receive
+  path. Splice it straight to the file if supported otherwise pull it
+  into the msgbuf where it would have been and write it normally.
+*/
+static
+int
+fuse_write_pipe(struct fuse            *f_,
+                fuse_msgbuf_t          *msgbuf_,
+                const fuse_file_info_t *ffi_,
+                char                   *data_,
+                const size_t            size_,
+                const off_t             offset_)
+{
+  int res;
+
+  if(msgbuf_->pipe_len != size_)
+    return -EIO;
+
+  if(f_->fs->op.write_pipe != NULL)
+    {
+      res = f_->fs->op.write_pipe(ffi_,msgbuf_->pipefd[0],size_,offset_);
+      if(res != -ENOTSUP)
+        {
+          if(res == size_)
+            msgbuf_->pipe_len = 0;
+          return res;
+        }
+    }
+
+  res = msgbuf_pipe_read(msgbuf_,data_,size_);
+  if(res < 0)
+    return res;
+
+  return f_->fs->op.write(ffi_,data_,size_,offset_);
+}
+
 static
 void
 fuse_lib_write(fuse_req_t             req,
@@ -2373,7 +2622,10 @@ fuse_lib_write(fuse_req_t             req,
 
   f = req_fuse_prepare(req);
 
-  res = f->fs->op.write(&ffi,data,arg->size,arg->offset);
+  if(req->msgbuf && req->msgbuf->pipe_len)
+    res = fuse_write_pipe(f,req->msgbuf,&ffi,data,arg->size,arg->offset);
+  else
+    res = f->fs->op.write(&ffi,data,arg->size,arg->offset);
   free_path(f,hdr_->nodeid,NULL);
 
   if(res >= 0)
@@ -2481,6 +2733,9 @@ readdir_buf_size(fuse_dirents_t *d_,
                  size_t          size_,
                  off_t           off_)
 {
+  if(off_ < d_->base)
+    return 0;
+  off_ -= d_->base;
   if(off_ >= kv_size(d_->offs))
     return 0;
   if((kv_A(d_->offs,off_) + size_) > kv_size(d_->data))
@@ -2495,11 +2750,56 @@ readdir_buf(fuse_dirents_t *d_,
 {
   size_t i;
 
-  i = kv_A(d_->offs,off_);
+  i = kv_A(d_->offs,off_ - d_->base);
 
   return &kv_A(d_->data,i);
 }
 
+/*
+  A filesystem may add entries incrementally by setting d->more when
+  it returns early. Entries before the requested offset are dropped
+  as more are added so only roughly what is being replied with is
+  kept in memory. Seeking back before what is buffered restarts the
+  listing from the beginning.
+*/
+static
+int
+readdir_fill(fuse_dirents_t    *d_,
+             fuse_file_info_t  *ffi_,
+             int              (*op_)(const fuse_file_info_t*,fuse_dirents_t*),
+             const off_t        off_,
+             const size_t       size_)
+{
+  int rv;
+  uint64_t end;
+
+  if((off_ == 0) ||
+     (off_ < d_->base) ||
+     ((d_->base == 0) && (kv_size(d_->data) == 0)))
+    {
+      fuse_dirents_reset(d_);
+      rv = op_(ffi_,d_);
+      if(rv)
+        return rv;
+    }
+
+  while(d_->more)
+    {
+      if(readdir_buf_size(d_,size_,off_) == size_)
+        break;
+
+      end = (d_->base + kv_size(d_->offs) - 1);
+      fuse_dirents_trim(d_,((off_ < end) ? off_ : end));
+
+      d_->more = 0;
+      rv = op_(ffi_,d_);
+      if(rv)
+        return rv;
+    }
+
+  return 0;
+}
+
 static
 void
 fuse_lib_readdir(fuse_req_t             req_,
@@ -2524,9 +2824,7 @@ fuse_lib_readdir(fuse_req_t             req_,
 
   pthread_mutex_lock(&dh->lock);
 
-  rv = 0;
-  if((arg->offset == 0) || (kv_size(d->data) == 0))
-    rv = f->fs->op.readdir(&ffi,d);
+  rv = readdir_fill(d,&ffi,f->fs->op.readdir,arg->offset,size);
 
   if(rv)
     {
@@ -2544,12 +2842,137 @@ fuse_lib_readdir(fuse_req_t             req_,
   pthread_mutex_unlock(&dh->lock);
 }
 
+/*
+  Returns the entry at cur_ if it lies entirely before end_. The
+  kernel ignores a trailing partial entry so it must be ignored here
+  as well.
+*/
+static
+fuse_direntplus_t*
+readdir_plus_entry(char       *cur_,
+                   const char *end_)
+{
+  fuse_direntplus_t *dp;
+
+  dp = (fuse_direntplus_t*)cur_;
+  if((cur_ + offsetof(fuse_direntplus_t,dirent.name)) > end_)
+    return NULL;
+  if((char*)fuse_direntplus_next(dp) > end_)
+    return NULL;
+
+  return dp;
+}
+
+static
+int
+is_dot_or_dotdot(const char     *name_,
+                 const uint32_t  namelen_)
+{
+  return (((namelen_ == 1) && (name_[0] == '.')) ||
+          ((namelen_ == 2) && (name_[0] == '.') && (name_[1] == '.')));
+}
+
+static
+void
+readdir_plus_set_attr(struct fuse *f_,
+                      fuse_attr_t *attr_)
+{
+  if(f_->conf.set_mode)
+    attr_->mode = (attr_->mode & S_IFMT) | (0777 & ~f_->conf.umask);
+  if(f_->conf.set_uid)
+    attr_->uid = f_->conf.uid;
+  if(f_->conf.set_gid)
+    attr_->gid = f_->conf.gid;
+}
+
+/*
+  The kernel treats each entry in a readdirplus reply with a nonzero
+  nodeid as a lookup so nodes are looked up here, for only the
+  entries being returned, rather than by the filesystem when the
+  buffer is filled. '.', '..' and entries the filesystem failed to
+  stat (mode of 0) are given a nodeid of 0 which the kernel skips.
+*/
+static
+void
+readdir_plus_lookup(struct fuse    *f_,
+                    const uint64_t  parent_,
+                    char           *buf_,
+                    const size_t    size_)
+{
+  node_t *node;
+  uint32_t namelen;
+  struct stat st;
+  fuse_direntplus_t *dp;
+  const char *end;
+  char name[NAME_MAX + 1];
+
+  end = (buf_ + size_);
+  for(dp = readdir_plus_entry(buf_,end);
+      dp != NULL;
+      dp = readdir_plus_entry((char*)fuse_direntplus_next(dp),end))
+    {
+      dp->entry.nodeid     = 0;
+      dp->entry.generation = 0;
+
+      if(dp->attr.mode == 0)
+        continue;
+
+      readdir_plus_set_attr(f_,&dp->attr);
+
+      namelen = dp->dirent.namelen;
+      if(is_dot_or_dotdot(dp->dirent.name,namelen))
+        continue;
+      if(namelen > NAME_MAX)
+        continue;
+
+      memcpy(name,dp->dirent.name,namelen);
+      name[namelen] = '\0';
+
+      node = find_node(f_,parent_,name);
+      if(node == NULL)
+        continue;
+
+      dp->entry.nodeid     = node->nodeid;
+      dp->entry.generation = f_->nodeid_gen.generation;
+
+      memset(&st,0,sizeof(st));
+      st.st_ino          = dp->attr.ino;
+      st.st_size         = dp->attr.size;
+      st.st_mtim.tv_sec  = dp->attr.mtime;
+      st.st_mtim.tv_nsec = dp->attr.mtimensec;
+
+      pthread_mutex_lock(node_stat_lock(f_,node));
+      update_stat(node,&st);
+      pthread_mutex_unlock(node_stat_lock(f_,node));
+    }
+}
+
+static
+void
+readdir_plus_forget(struct fuse  *f_,
+                    char         *buf_,
+                    const size_t  size_)
+{
+  fuse_direntplus_t *dp;
+  const char *end;
+
+  end = (buf_ + size_);
+  for(dp = readdir_plus_entry(buf_,end);
+      dp != NULL;
+      dp = readdir_plus_entry((char*)fuse_direntplus_next(dp),end))
+    {
+      if(dp->entry.nodeid != 0)
+        forget_node(f_,dp->entry.nodeid,1);
+    }
+}
+
 static
 void
 fuse_lib_readdir_plus(fuse_req_t             req_,
                       struct fuse_in_header *hdr_)
 {
   int rv;
+  char *buf;
   size_t size;
   struct fuse *f;
   fuse_dirents_t *d;
@@ -2568,9 +2991,7 @@ fuse_lib_readdir_plus(fuse_req_t             req_,
 
   pthread_mutex_lock(&dh->lock);
 
-  rv = 0;
-  if((arg->offset == 0) || (kv_size(d->data) == 0))
-    rv = f->fs->op.readdir_plus(&ffi,d);
+  rv = readdir_fill(d,&ffi,f->fs->op.readdir_plus,arg->offset,size);
 
   if(rv)
     {
@@ -2579,10 +3000,13 @@ fuse_lib_readdir_plus(fuse_req_t             req_,
     }
 
   size = readdir_buf_size(d,size,arg->offset);
+  buf  = ((size > 0) ? readdir_buf(d,arg->offset) : NULL);
 
-  fuse_reply_buf(req_,
-                 readdir_buf(d,arg->offset),
-                 size);
+  readdir_plus_lookup(f,hdr_->nodeid,buf,size);
+
+  rv = fuse_reply_buf(req_,buf,size);
+  if(rv == -ENOENT)
+    readdir_plus_forget(f,buf,size);
 
  out:
   pthread_mutex_unlock(&dh->lock);
@@ -2953,9 +3377,7 @@ fuse_lib_tmpfile(fuse_req_t                   req_,
 
   if(!err)
     {
-      pthread_mutex_lock(&f->lock);
-      get_node(f,e.ino)->open_count++;
-      pthread_mutex_unlock(&f->lock);
+      open_node(f,e.ino,&ffi);
 
       if(fuse_reply_create(req_,&e,&ffi) == -ENOENT)
         {
@@ -3137,9 +3559,9 @@ fuse_flush_common(struct fuse      *f,
     {
       flock_to_lock(&lock,&l);
       l.owner = fi->lock_owner;
-      pthread_mutex_lock(&f->lock);
+      pthread_rwlock_wrlock(&f->lock);
       locks_insert(get_node(f,ino),&l);
-      pthread_mutex_unlock(&f->lock);
+      pthread_rwlock_unlock(&f->lock);
 
       /* if op.lock() is defined FLUSH is needed regardless
          of op.flush() */
@@ -3267,11 +3689,11 @@ fuse_lib_getlk(fuse_req_t                   req,
 
   flock_to_lock(&flk,&lk);
   lk.owner = ffi.lock_owner;
-  pthread_mutex_lock(&f->lock);
+  pthread_rwlock_wrlock(&f->lock);
   conflict = locks_conflict(get_node(f,hdr_->nodeid),&lk);
   if(conflict)
     lock_to_flock(conflict,&flk);
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
   if(!conflict)
     err = fuse_lock_common(req,hdr_->nodeid,&ffi,&flk,F_GETLK);
   else
@@ -3299,9 +3721,9 @@ fuse_lib_setlk(fuse_req_t        req,
       lock_t l;
       flock_to_lock(lock,&l);
       l.owner = fi->lock_owner;
-      pthread_mutex_lock(&f->lock);
+      pthread_rwlock_wrlock(&f->lock);
       locks_insert(get_node(f,ino),&l);
-      pthread_mutex_unlock(&f->lock);
+      pthread_rwlock_unlock(&f->lock);
     }
 
   fuse_reply_err(req,err);
@@ -3496,12 +3918,12 @@ static
 void
 remembered_nodes_sort(struct fuse *f_)
 {
-  pthread_mutex_lock(&f_->lock);
+  pthread_rwlock_wrlock(&f_->lock);
   qsort(&kv_first(f_->remembered_nodes),
         kv_size(f_->remembered_nodes),
         sizeof(remembered_node_t),
         remembered_node_cmp);
-  pthread_mutex_unlock(&f_->lock);
+  pthread_rwlock_unlock(&f_->lock);
 }
 
 #define MAX_PRUNE 100
@@ -3515,7 +3937,7 @@ fuse_prune_some_remembered_nodes(struct fuse *f_,
   int pruned;
   int checked;
 
-  pthread_mutex_lock(&f_->lock);
+  pthread_rwlock_wrlock(&f_->lock);
 
   pruned = 0;
   checked = 0;
@@ -3550,7 +3972,7 @@ fuse_prune_some_remembered_nodes(struct fuse *f_,
       pruned++;
     }
 
-  pthread_mutex_unlock(&f_->lock);
+  pthread_rwlock_unlock(&f_->lock);
 
   if((pruned < MAX_PRUNE) && (checked < MAX_CHECK))
     *offset_ = -1;
@@ -3764,23 +4186,6 @@ fuse_fs_new(const struct fuse_operations *op,
   return fs;
 }
 
-static
-int
-node_table_init(struct node_table *t)
-{
-  t->size = NODE_TABLE_MIN_SIZE;
-  t->array = (node_t **)calloc(1,sizeof(node_t *) * t->size);
-  if(t->array == NULL)
-    {
-      fprintf(stderr,"fuse: memory allocation failed\n");
-      return -1;
-    }
-  t->use = 0;
-  t->split = 0;
-
-  return 0;
-}
-
 static
 struct fuse*
 fuse_get_fuse_obj()
@@ -3795,7 +4200,7 @@ void
 metrics_log_nodes_info(struct fuse *f_,
                        FILE        *file_)
 {
-  char buf[1024];
+  char buf[4096];
   char time_str[64];
   struct tm tm;
   struct timeval tv;
@@ -3804,6 +4209,14 @@ metrics_log_nodes_info(struct fuse *f_,
   uint64_t node_slab_count;
   uint64_t node_avail_objs;
   uint64_t node_total_alloc_mem;
+  lfmp_stats_t node_mag_stats;
+  lfmp_stats_t req_mag_stats;
+  msgbuf_stats_t msgbuf_stats_;
+  double msgbuf_reqs;
+  double id_probe_avg;
+  uint64_t id_probe_max;
+  double name_probe_avg;
+  uint64_t name_probe_max;
 
   gettimeofday(&tv,NULL);
   localtime_r(&tv.tv_sec,&tm);
@@ -3819,6 +4232,21 @@ metrics_log_nodes_info(struct fuse *f_,
   node_avail_objs = fmp_avail_objs(&lfmp->fmp);
   node_total_alloc_mem = fmp_total_allocated_memory(&lfmp->fmp);
   lfmp_unlock(lfmp);
+  lfmp_stats(lfmp,&node_mag_stats);
+  lfmp_stats(fuse_ll_req_lfmp(),&req_mag_stats);
+
+  msgbuf_stats(&msgbuf_stats_);
+  msgbuf_reqs = (msgbuf_stats_.thread_hits +
+                 msgbuf_stats_.node_hits +
+                 msgbuf_stats_.global_hits +
+                 msgbuf_stats_.allocs);
+  if(msgbuf_reqs == 0)
+    msgbuf_reqs = 1;
+
+  pthread_rwlock_rdlock(&f_->lock);
+  node_table_probe_stats(&f_->id_table,&id_probe_avg,&id_probe_max);
+  node_table_probe_stats(&f_->name_table,&name_probe_avg,&name_probe_max);
+  pthread_rwlock_unlock(&f_->lock);
 
   snprintf(buf,sizeof(buf),
            "time: %s\n"
@@ -3826,35 +4254,79 @@ metrics_log_nodes_info(struct fuse *f_,
            "node id_table size: %"PRIu64"\n"
            "node id_table usage: %"PRIu64"\n"
            "node id_table total allocated memory: %"PRIu64"\n"
+           "node id_table avg probe length: %f\n"
+           "node id_table max probe length: %"PRIu64"\n"
            "node name_table size: %"PRIu64"\n"
            "node name_table usage: %"PRIu64"\n"
            "node name_table total allocated memory: %"PRIu64"\n"
+           "node name_table avg probe length: %f\n"
+           "node name_table max probe length: %"PRIu64"\n"
            "node memory pool slab count: %"PRIu64"\n"
            "node memory pool usage ratio: %f\n"
            "node memory pool avail objs: %"PRIu64"\n"
            "node memory pool total allocated memory: %"PRIu64"\n"
+           "node memory pool thread caches: %"PRIu64"\n"
+           "node memory pool thread cached objs: %"PRIu64"\n"
+           "node memory pool thread cache hits: %"PRIu64"\n"
+           "node memory pool thread cache refills: %"PRIu64"\n"
+           "node memory pool thread cache flushes: %"PRIu64"\n"
+           "req memory pool thread caches: %"PRIu64"\n"
+           "req memory pool thread cached objs: %"PRIu64"\n"
+           "req memory pool thread cache hits: %"PRIu64"\n"
+           "req memory pool thread cache refills: %"PRIu64"\n"
+           "req memory pool thread cache flushes: %"PRIu64"\n"
            "msgbuf bufsize: %"PRIu64"\n"
            "msgbuf allocation count: %"PRIu64"\n"
            "msgbuf available count: %"PRIu64"\n"
            "msgbuf total allocated memory: %"PRIu64"\n"
+           "msgbuf numa nodes: %"PRIu64"\n"
+           "msgbuf thread cache avail: %"PRIu64"\n"
+           "msgbuf thread cache hit ratio: %f\n"
+           "msgbuf node cache avail: %"PRIu64"\n"
+           "msgbuf node cache hit ratio: %f\n"
+           "msgbuf global cache avail: %"PRIu64"\n"
+           "msgbuf global cache hit ratio: %f\n"
+           "msgbuf new allocation ratio: %f\n"
            "\n"
            ,
            time_str,
            sizeof_node,
            (uint64_t)f_->id_table.size,
            (uint64_t)f_->id_table.use,
-           (uint64_t)(f_->id_table.size * sizeof(node_t*)),
+           (uint64_t)(f_->id_table.size * sizeof(node_slot_t)),
+           id_probe_avg,
+           id_probe_max,
            (uint64_t)f_->name_table.size,
            (uint64_t)f_->name_table.use,
-           (uint64_t)(f_->name_table.size * sizeof(node_t*)),
+           (uint64_t)(f_->name_table.size * sizeof(node_slot_t)),
+           name_probe_avg,
+           name_probe_max,
            node_slab_count,
            node_usage_ratio,
            node_avail_objs,
            node_total_alloc_mem,
+           node_mag_stats.mags,
+           node_mag_stats.cached_objs,
+           node_mag_stats.hits,
+           node_mag_stats.refills,
+           node_mag_stats.flushes,
+           req_mag_stats.mags,
+           req_mag_stats.cached_objs,
+           req_mag_stats.hits,
+           req_mag_stats.refills,
+           req_mag_stats.flushes,
            msgbuf_get_bufsize(),
            msgbuf_alloc_count(),
            msgbuf_avail_count(),
-           msgbuf_alloc_count() * msgbuf_get_bufsize()
+           msgbuf_alloc_count() * msgbuf_get_bufsize(),
+           msgbuf_stats_.numa_nodes,
+           msgbuf_stats_.thread_avail,
+           msgbuf_stats_.thread_hits / msgbuf_reqs,
+           msgbuf_stats_.node_avail,
+           msgbuf_stats_.node_hits / msgbuf_reqs,
+           msgbuf_stats_.global_avail,
+           msgbuf_stats_.global_hits / msgbuf_reqs,
+           msgbuf_stats_.allocs / msgbuf_reqs
            );
 
   fputs(buf,file_);
@@ -3895,6 +4367,22 @@ fuse_malloc_trim(void)
 #endif
 }
 
+int
+fuse_passthrough_open(const int fd_)
+{
+  struct fuse *f = fuse_get_fuse_obj();
+
+  return fuse_lowlevel_backing_open(f->se->ch,fd_);
+}
+
+int
+fuse_passthrough_close(const int backing_id_)
+{
+  struct fuse *f = fuse_get_fuse_obj();
+
+  return fuse_lowlevel_backing_close(f->se->ch,backing_id_);
+}
+
 void
 fuse_invalidate_all_nodes()
 {
@@ -3902,25 +4390,25 @@ fuse_invalidate_all_nodes()
 
   syslog(LOG_INFO,"invalidating file entries");
 
-  pthread_mutex_lock(&f->lock);
-  for(int i = 0; i < f->id_table.size; i++)
+  pthread_rwlock_rdlock(&f->lock);
+  for(size_t i = 0; i < f->id_table.size; i++)
     {
       node_t *node;
 
-      for(node = f->id_table.array[i]; node != NULL; node = node->id_next)
-        {
-          if(node->nodeid == FUSE_ROOT_ID)
-            continue;
-          if(node->parent->nodeid != FUSE_ROOT_ID)
-            continue;
+      node = f->id_table.array[i].node;
+      if(node == NULL)
+        continue;
+      if(node->nodeid == FUSE_ROOT_ID)
+        continue;
+      if(node->parent->nodeid != FUSE_ROOT_ID)
+        continue;
 
-          fuse_lowlevel_notify_inval_entry(f->se->ch,
-                                           node->parent->nodeid,
-                                           node->name,
-                                           strlen(node->name));
-        }
+      fuse_lowlevel_notify_inval_entry(f->se->ch,
+                                       node->parent->nodeid,
+                                       node->name,
+                                       strlen(node->name));
     }
-  pthread_mutex_unlock(&f->lock);
+  pthread_rwlock_unlock(&f->lock);
 }
 
 void
@@ -3980,9 +4468,9 @@ fuse_start_maintenance_thread(struct fuse *f_)
 void
 fuse_stop_maintenance_thread(struct fuse *f_)
 {
-  pthread_mutex_lock(&f_->lock);
+  pthread_rwlock_wrlock(&f_->lock);
   pthread_cancel(f_->maintenance_thread);
-  pthread_mutex_unlock(&f_->lock);
+  pthread_rwlock_unlock(&f_->lock);
   pthread_join(f_->maintenance_thread,NULL);
 }
 
@@ -4035,13 +4523,16 @@ fuse_new_common(struct fuse_chan             *ch,
   srand(time(NULL));
   f->nodeid_gen.nodeid = FUSE_ROOT_ID;
   f->nodeid_gen.generation = rand64();
-  if(node_table_init(&f->name_table) == -1)
+  if(node_table_init(&f->name_table,NODE_TABLE_MIN_SIZE) == -1)
     goto out_free_session;
 
-  if(node_table_init(&f->id_table) == -1)
+  if(node_table_init(&f->id_table,NODE_TABLE_MIN_SIZE) == -1)
     goto out_free_name_table;
 
-  fuse_mutex_init(&f->lock);
+  fuse_rwlock_init(&f->lock);
+  fuse_mutex_init(&f->lockq_lock);
+  for(size_t i = 0; i < NODE_STAT_LOCKS; i++)
+    fuse_mutex_init(&f->stat_locks[i]);
 
   kv_init(f->remembered_nodes);
 
@@ -4105,33 +4596,36 @@ fuse_destroy(struct fuse *f)
         {
           node_t *node;
 
-          for(node = f->id_table.array[i]; node != NULL; node = node->id_next)
-            {
-              if(!node->hidden_fh)
-                continue;
+          node = f->id_table.array[i].node;
+          if(node == NULL)
+            continue;
+          if(!node->hidden_fh)
+            continue;
 
-              f->fs->op.free_hide(node->hidden_fh);
-              node->hidden_fh = 0;
-            }
+          f->fs->op.free_hide(node->hidden_fh);
+          node->hidden_fh = 0;
         }
     }
 
   for(i = 0; i < f->id_table.size; i++)
     {
       node_t *node;
-      node_t *next;
 
-      for(node = f->id_table.array[i]; node != NULL; node = next)
-        {
-          next = node->id_next;
-          free_node(f,node);
-          f->id_table.use--;
-        }
+      node = f->id_table.array[i].node;
+      if(node == NULL)
+        continue;
+
+      free_node(f,node);
+      f->id_table.array[i].node = NULL;
+      f->id_table.use--;
     }
 
   free(f->id_table.array);
   free(f->name_table.array);
-  pthread_mutex_destroy(&f->lock);
+  for(size_t i = 0; i < NODE_STAT_LOCKS; i++)
+    pthread_mutex_destroy(&f->stat_locks[i]);
+  pthread_mutex_destroy(&f->lockq_lock);
+  pthread_rwlock_destroy(&f->lock);
   fuse_session_destroy(f->se);
   kv_destroy(f->remembered_nodes);
   fuse_delete_context_key();
@@ -21,7 +21,10 @@
 static int         g_READ_THREAD_COUNT          = -1;
 static int         g_PROCESS_THREAD_COUNT       = -1;
 static int         g_PROCESS_THREAD_QUEUE_DEPTH = -1;
+static std::string g_PROCESS_THREAD_SCHEDULER   = "shared";
 static std::string g_PIN_THREADS                = {};
+static bool        g_CLONE_FD                   = false;
+static int         g_IO_URING_QUEUE_DEPTH       = 4;
 
 
 int
@@ -60,6 +63,18 @@ fuse_config_set_process_thread_queue_depth(int const v_)
   g_PROCESS_THREAD_QUEUE_DEPTH = v_;
 }
 
+std::string
+fuse_config_get_process_thread_scheduler()
+{
+  return g_PROCESS_THREAD_SCHEDULER;
+}
+
+void
+fuse_config_set_process_thread_scheduler(std::string const v_)
+{
+  g_PROCESS_THREAD_SCHEDULER = v_;
+}
+
 std::string
 fuse_config_get_pin_threads()
 {
@@ -71,3 +86,27 @@ fuse_config_set_pin_threads(std::string const v_)
 {
   g_PIN_THREADS = v_;
 }
+
+bool
+fuse_config_get_clone_fd()
+{
+  return g_CLONE_FD;
+}
+
+void
+fuse_config_set_clone_fd(bool const v_)
+{
+  g_CLONE_FD = v_;
+}
+
+int
+fuse_config_get_io_uring_queue_depth()
+{
+  return g_IO_URING_QUEUE_DEPTH;
+}
+
+void
+fuse_config_set_io_uring_queue_depth(int const v_)
+{
+  g_IO_URING_QUEUE_DEPTH = v_;
+}
@@ -255,7 +255,7 @@ fuse_dirents_add(fuse_dirents_t      *d_,
   if(d == NULL)
     return -ENOMEM;
 
-  d->off     = kv_size(d_->offs);
+  d->off     = (d_->base + kv_size(d_->offs));
   kv_push(uint32_t,d_->offs,kv_size(d_->data));
   d->ino     = dirent_->d_ino;
   d->namelen = namelen_;
@@ -289,7 +289,7 @@ fuse_dirents_add_plus(fuse_dirents_t      *d_,
   if(d == NULL)
     return -ENOMEM;
 
-  d->dirent.off     = kv_size(d_->offs);
+  d->dirent.off     = (d_->base + kv_size(d_->offs));
   kv_push(uint32_t,d_->offs,kv_size(d_->data));
   d->dirent.ino     = dirent_->d_ino;
   d->dirent.namelen = namelen_;
@@ -325,7 +325,7 @@ fuse_dirents_add_linux(fuse_dirents_t         *d_,
   if(d == NULL)
     return -ENOMEM;
 
-  d->off     = kv_size(d_->offs);
+  d->off     = (d_->base + kv_size(d_->offs));
   kv_push(uint32_t,d_->offs,kv_size(d_->data));
   d->ino     = dirent_->ino;
   d->namelen = namelen_;
@@ -359,7 +359,7 @@ fuse_dirents_add_linux_plus(fuse_dirents_t         *d_,
   if(d == NULL)
     return -ENOMEM;
 
-  d->dirent.off     = kv_size(d_->offs);
+  d->dirent.off     = (d_->base + kv_size(d_->offs));
   kv_push(uint32_t,d_->offs,kv_size(d_->data));
   d->dirent.ino     = dirent_->ino;
   d->dirent.namelen = namelen_;
@@ -377,14 +377,49 @@ void
 fuse_dirents_reset(fuse_dirents_t *d_)
 {
   d_->type          = UNSET;
+  d_->base          = 0;
+  d_->more          = 0;
   kv_size(d_->data) = 0;
   kv_size(d_->offs) = 1;
 }
 
+/*
+  Drop the entries before offset off_ (which must be within what is
+  buffered). Entries keep their offsets. Used when entries are added
+  incrementally and those before off_ have already been returned.
+*/
+void
+fuse_dirents_trim(fuse_dirents_t *d_,
+                  const uint64_t  off_)
+{
+  uint64_t i;
+  uint64_t n;
+  uint32_t start;
+
+  if(off_ <= d_->base)
+    return;
+
+  n     = (off_ - d_->base);
+  start = kv_A(d_->offs,n);
+
+  memmove(&kv_A(d_->data,0),
+          &kv_A(d_->data,start),
+          (kv_size(d_->data) - start));
+  kv_size(d_->data) -= start;
+
+  for(i = n; i < kv_size(d_->offs); i++)
+    kv_A(d_->offs,i - n) = (kv_A(d_->offs,i) - start);
+  kv_size(d_->offs) -= n;
+
+  d_->base = off_;
+}
+
 int
 fuse_dirents_init(fuse_dirents_t *d_)
 {
   d_->type = UNSET;
+  d_->base = 0;
+  d_->more = 0;
 
   kv_init(d_->data);
   kv_resize(char,d_->data,DEFAULT_SIZE);
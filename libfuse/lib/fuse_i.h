@@ -13,23 +13,31 @@
 #include "fuse_msgbuf.h"
 
 #include "extern_c.h"
+#include "kvec.h"
+
+#include <pthread.h>
 
 struct fuse_chan;
 struct fuse_ll;
+struct fuse_uring_ent;
 
 struct fuse_session
 {
   int (*receive_buf)(struct fuse_session *se,
+                     struct fuse_chan    *ch,
                      fuse_msgbuf_t       *msgbuf);
 
   void (*process_buf)(struct fuse_session *se,
-                      const fuse_msgbuf_t *msgbuf);
+                      struct fuse_chan    *ch,
+                      fuse_msgbuf_t       *msgbuf);
 
   void (*destroy)(void *data);
 
   struct fuse_ll *f;
   volatile int exited;
   struct fuse_chan *ch;
+  pthread_mutex_t lock;
+  kvec_t(struct fuse_chan*) clones;
 };
 
 struct fuse_req
@@ -38,6 +46,8 @@ struct fuse_req
   uint64_t unique;
   struct fuse_ctx ctx;
   struct fuse_chan *ch;
+  fuse_msgbuf_t *msgbuf;
+  struct fuse_uring_ent *ring_ent;
   unsigned int ioctl_64bit : 1;
 };
 
@@ -98,6 +108,7 @@ int fuse_kern_mount(const char *mountpoint, struct fuse_args *args);
 int fuse_send_reply_iov_nofree(fuse_req_t req, int error, struct iovec *iov,
 			       int count);
 void fuse_free_req(fuse_req_t req);
+struct lfmp_t *fuse_ll_req_lfmp(void);
 
 
 struct fuse *fuse_setup_common(int argc, char *argv[],
@@ -108,4 +119,8 @@ struct fuse *fuse_setup_common(int argc, char *argv[],
 
 int fuse_start_thread(pthread_t *thread_id, void *(*func)(void *), void *arg);
 
+void fuse_ll_process_uring(struct fuse_session   *se,
+                           struct fuse_uring_ent *ring_ent,
+                           fuse_msgbuf_t         *msgbuf);
+
 EXTERN_C_END
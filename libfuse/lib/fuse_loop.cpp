@@ -6,6 +6,7 @@
 #include "fmt/core.h"
 #include "make_unique.hpp"
 #include "scope_guard.hpp"
+#include "stealing_thread_pool.hpp"
 #include "thread_pool.hpp"
 
 #include "fuse_i.h"
@@ -16,6 +17,7 @@
 #include "fuse_config.hpp"
 #include "fuse_msgbuf.hpp"
 #include "fuse_ll.hpp"
+#include "fuse_uring.hpp"
 
 #include <errno.h>
 #include <pthread.h>
@@ -29,6 +31,7 @@
 #include <unistd.h>
 
 #include <cassert>
+#include <set>
 #include <vector>
 
 static
@@ -66,18 +69,32 @@ handle_receive_error(const int      rv_,
              -rv_);
 }
 
+static
+fuse_chan*
+worker_chan(fuse_session *se_,
+            const bool    clone_fd_)
+{
+  if(clone_fd_)
+    return fuse_session_clone_chan(se_);
+
+  return se_->ch;
+}
+
 struct AsyncWorker
 {
   fuse_session *_se;
   sem_t *_finished;
   std::shared_ptr<ThreadPool> _process_tp;
+  bool _clone_fd;
 
   AsyncWorker(fuse_session                       *se_,
               sem_t                              *finished_,
-              std::shared_ptr<ThreadPool>  process_tp_)
+              std::shared_ptr<ThreadPool>  process_tp_,
+              const bool                          clone_fd_)
     : _se(se_),
       _finished(finished_),
-      _process_tp(process_tp_)
+      _process_tp(process_tp_),
+      _clone_fd(clone_fd_)
   {
   }
 
@@ -88,6 +105,7 @@ struct AsyncWorker
     DEFER{ fuse_session_exit(_se); };
     DEFER{ sem_post(_finished); };
 
+    fuse_chan *ch = ::worker_chan(_se,_clone_fd);
     moodycamel::ProducerToken ptok(_process_tp->ptoken());
     while(!fuse_session_exited(_se))
       {
@@ -99,7 +117,7 @@ struct AsyncWorker
         do
           {
             pthread_setcancelstate(PTHREAD_CANCEL_ENABLE,NULL);
-            rv = _se->receive_buf(_se,msgbuf);
+            rv = _se->receive_buf(_se,ch,msgbuf);
             pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,NULL);
             if(rv == 0)
               return;
@@ -111,7 +129,7 @@ struct AsyncWorker
 
         auto const func = [=]
         {
-          _se->process_buf(_se,msgbuf);
+          _se->process_buf(_se,ch,msgbuf);
           msgbuf_free(msgbuf);
         };
 
@@ -120,16 +138,79 @@ struct AsyncWorker
   }
 };
 
+struct StealingAsyncWorker
+{
+  fuse_session *_se;
+  sem_t *_finished;
+  std::shared_ptr<StealingThreadPool> _process_tp;
+  unsigned _queue;
+  bool _clone_fd;
+
+  StealingAsyncWorker(fuse_session                        *se_,
+                      sem_t                               *finished_,
+                      std::shared_ptr<StealingThreadPool>  process_tp_,
+                      const unsigned                       queue_,
+                      const bool                           clone_fd_)
+    : _se(se_),
+      _finished(finished_),
+      _process_tp(process_tp_),
+      _queue(queue_),
+      _clone_fd(clone_fd_)
+  {
+  }
+
+  inline
+  void
+  operator()() const
+  {
+    DEFER{ fuse_session_exit(_se); };
+    DEFER{ sem_post(_finished); };
+
+    fuse_chan *ch = ::worker_chan(_se,_clone_fd);
+    while(!fuse_session_exited(_se))
+      {
+        int rv;
+        fuse_msgbuf_t *msgbuf;
+
+        msgbuf = msgbuf_alloc();
+
+        do
+          {
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE,NULL);
+            rv = _se->receive_buf(_se,ch,msgbuf);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,NULL);
+            if(rv == 0)
+              return;
+            if(retriable_receive_error(rv))
+              continue;
+            if(fatal_receive_error(rv))
+              return handle_receive_error(rv,msgbuf);
+          } while(false);
+
+        auto const func = [=]
+        {
+          _se->process_buf(_se,ch,msgbuf);
+          msgbuf_free(msgbuf);
+        };
+
+        _process_tp->enqueue_work(_queue,func);
+      }
+  }
+};
+
 struct SyncWorker
 {
   fuse_session *_se;
   sem_t *_finished;
+  bool _clone_fd;
 
   SyncWorker(fuse_session *se_,
-             sem_t        *finished_)
+             sem_t        *finished_,
+             const bool    clone_fd_)
 
     : _se(se_),
-      _finished(finished_)
+      _finished(finished_),
+      _clone_fd(clone_fd_)
   {
   }
 
@@ -140,6 +221,8 @@ struct SyncWorker
     DEFER{ fuse_session_exit(_se); };
     DEFER{ sem_post(_finished); };
 
+    fuse_chan *ch = ::worker_chan(_se,_clone_fd);
+
     while(!fuse_session_exited(_se))
       {
         int rv;
@@ -150,7 +233,7 @@ struct SyncWorker
         do
           {
             pthread_setcancelstate(PTHREAD_CANCEL_ENABLE,NULL);
-            rv = _se->receive_buf(_se,msgbuf);
+            rv = _se->receive_buf(_se,ch,msgbuf);
             pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,NULL);
             if(rv == 0)
               return;
@@ -160,7 +243,7 @@ struct SyncWorker
               return handle_receive_error(rv,msgbuf);
           } while(false);
 
-        _se->process_buf(_se,msgbuf);
+        _se->process_buf(_se,ch,msgbuf);
         msgbuf_free(msgbuf);
       }
   }
@@ -454,6 +537,105 @@ pin_threads(const std::vector<pthread_t> read_threads_,
          type_.c_str());
 }
 
+static
+std::set<int>
+cpuset_to_ids(const cpu_set_t                    &cpuset_,
+              const std::unordered_map<int,int> &map_)
+{
+  std::set<int> ids;
+
+  for(auto const &kv : map_)
+    {
+      if(CPU_ISSET(kv.first,&cpuset_))
+        ids.insert(kv.second);
+    }
+
+  return ids;
+}
+
+static
+bool
+intersects(const std::set<int> &a_,
+           const std::set<int> &b_)
+{
+  for(auto const id : a_)
+    {
+      if(b_.count(id))
+        return true;
+    }
+
+  return false;
+}
+
+/*
+  Each process thread is homed on the queue of the read thread closest
+  to it: sharing a logical CPU, then a physical core, then a NUMA
+  node. Ties go to the queue with the fewest threads so unpinned
+  threads are spread evenly.
+*/
+static
+void
+assign_process_thread_homes(const std::vector<pthread_t>  read_threads_,
+                            StealingThreadPool           &process_tp_)
+{
+  std::vector<pthread_t> process_threads;
+  std::vector<cpu_set_t> read_cpus;
+  std::vector<unsigned>  assigned;
+  CPU::CPU2CoreMap       cpu2core;
+  CPU::CPU2NodeMap       cpu2node;
+
+  if(read_threads_.empty())
+    return;
+
+  cpu2core = CPU::cpu2core();
+  cpu2node = CPU::cpu2node();
+
+  read_cpus.resize(read_threads_.size());
+  for(std::size_t i = 0; i < read_threads_.size(); i++)
+    pthread_getaffinity_np(read_threads_[i],sizeof(cpu_set_t),&read_cpus[i]);
+
+  assigned.resize(read_threads_.size(),0);
+  process_threads = process_tp_.threads();
+  for(std::size_t i = 0; i < process_threads.size(); i++)
+    {
+      int best_score;
+      unsigned best;
+      cpu_set_t cpuset;
+
+      pthread_getaffinity_np(process_threads[i],sizeof(cpu_set_t),&cpuset);
+
+      best       = 0;
+      best_score = -1;
+      for(std::size_t r = 0; r < read_cpus.size(); r++)
+        {
+          int score;
+          cpu_set_t both;
+
+          CPU_AND(&both,&cpuset,&read_cpus[r]);
+
+          score = 0;
+          if(CPU_COUNT(&both) > 0)
+            score = 3;
+          else if(::intersects(::cpuset_to_ids(cpuset,cpu2core),
+                               ::cpuset_to_ids(read_cpus[r],cpu2core)))
+            score = 2;
+          else if(::intersects(::cpuset_to_ids(cpuset,cpu2node),
+                               ::cpuset_to_ids(read_cpus[r],cpu2node)))
+            score = 1;
+
+          if((score > best_score) ||
+             ((score == best_score) && (assigned[r] < assigned[best])))
+            {
+              best       = r;
+              best_score = score;
+            }
+        }
+
+      assigned[best]++;
+      process_tp_.set_home(i,best);
+    }
+}
+
 static
 void
 wait(fuse_session *se_,
@@ -468,16 +650,20 @@ fuse_session_loop_mt(struct fuse_session *se_,
                      const int            raw_read_thread_count_,
                      const int            raw_process_thread_count_,
                      const int            raw_process_thread_queue_depth_,
-                     const std::string    pin_threads_type_)
+                     const std::string    process_thread_scheduler_,
+                     const std::string    pin_threads_type_,
+                     const bool           clone_fd_)
 {
   sem_t finished;
   int read_thread_count;
   int process_thread_count;
   int process_thread_queue_depth;
+  std::string process_thread_scheduler;
   std::vector<pthread_t> read_threads;
   std::vector<pthread_t> process_threads;
   std::unique_ptr<ThreadPool> read_tp;
   std::shared_ptr<ThreadPool> process_tp;
+  std::shared_ptr<StealingThreadPool> stealing_tp;
 
   sem_init(&finished,0,0);
 
@@ -488,46 +674,90 @@ fuse_session_loop_mt(struct fuse_session *se_,
                             &process_thread_count,
                             &process_thread_queue_depth);
 
-  if(process_thread_count > 0)
+  process_thread_scheduler = process_thread_scheduler_;
+  if((process_thread_scheduler != "shared") &&
+     (process_thread_scheduler != "steal"))
+    {
+      syslog(LOG_WARNING,
+             "Invalid process-thread-scheduler value, using 'shared': %s",
+             process_thread_scheduler.c_str());
+      process_thread_scheduler = "shared";
+    }
+
+  if((process_thread_count > 0) && (process_thread_scheduler == "steal"))
+    stealing_tp = std::make_shared<StealingThreadPool>(read_thread_count,
+                                                       process_thread_count,
+                                                       (process_thread_count *
+                                                        process_thread_queue_depth),
+                                                       "fuse.process");
+  else if(process_thread_count > 0)
     process_tp = std::make_shared<ThreadPool>(process_thread_count,
                                               (process_thread_count *
                                                process_thread_queue_depth),
                                               "fuse.process");
 
+  if(stealing_tp)
+    fuse_uring_set_dispatch([stealing_tp](const int                  qid_,
+                                          std::function<void(void)>  func_)
+                            {
+                              stealing_tp->enqueue_work(qid_,std::move(func_));
+                            });
+  else if(process_tp)
+    fuse_uring_set_dispatch([process_tp](const int                  qid_,
+                                         std::function<void(void)>  func_)
+                            {
+                              process_tp->enqueue_work(std::move(func_));
+                            });
+
   read_tp = std::make_unique<ThreadPool>(read_thread_count,
                                          read_thread_count,
                                          "fuse.read");
-  if(process_tp)
+  if(stealing_tp)
     {
       for(auto i = 0; i < read_thread_count; i++)
-        read_tp->enqueue_work(AsyncWorker(se_,&finished,process_tp));
+        read_tp->enqueue_work(StealingAsyncWorker(se_,&finished,stealing_tp,i,clone_fd_));
+    }
+  else if(process_tp)
+    {
+      for(auto i = 0; i < read_thread_count; i++)
+        read_tp->enqueue_work(AsyncWorker(se_,&finished,process_tp,clone_fd_));
     }
   else
     {
       for(auto i = 0; i < read_thread_count; i++)
-        read_tp->enqueue_work(SyncWorker(se_,&finished));
+        read_tp->enqueue_work(SyncWorker(se_,&finished,clone_fd_));
     }
 
   if(read_tp)
     read_threads = read_tp->threads();
   if(process_tp)
     process_threads = process_tp->threads();
+  if(stealing_tp)
+    process_threads = stealing_tp->threads();
 
   ::pin_threads(read_threads,process_threads,pin_threads_type_);
+  if(stealing_tp)
+    ::assign_process_thread_homes(read_threads,*stealing_tp);
 
   syslog(LOG_INFO,
          "read-thread-count=%d; "
          "process-thread-count=%d; "
          "process-thread-queue-depth=%d; "
-         "pin-threads=%s;"
+         "process-thread-scheduler=%s; "
+         "pin-threads=%s; "
+         "clone-fd=%s;"
          ,
          read_thread_count,
          process_thread_count,
          process_thread_queue_depth,
-         pin_threads_type_.c_str());
+         process_thread_scheduler.c_str(),
+         pin_threads_type_.c_str(),
+         (clone_fd_ ? "true" : "false"));
 
   ::wait(se_,&finished);
 
+  fuse_uring_stop();
+
   sem_destroy(&finished);
 
   return 0;
@@ -547,7 +777,9 @@ fuse_loop_mt(struct fuse *f)
                              fuse_config_get_read_thread_count(),
                              fuse_config_get_process_thread_count(),
                              fuse_config_get_process_thread_queue_depth(),
-                             fuse_config_get_pin_threads());
+                             fuse_config_get_process_thread_scheduler(),
+                             fuse_config_get_pin_threads(),
+                             fuse_config_get_clone_fd());
 
   fuse_stop_maintenance_thread(f);
 
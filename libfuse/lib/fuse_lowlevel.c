@@ -18,6 +18,7 @@
 #include "fuse_misc.h"
 #include "fuse_pollhandle.h"
 #include "fuse_msgbuf.hpp"
+#include "fuse_uring.hpp"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,7 +28,9 @@
 #include <limits.h>
 #include <errno.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <sys/file.h>
+#include <sys/ioctl.h>
 
 #ifndef F_LINUX_SPECIFIC_BASE
 #define F_LINUX_SPECIFIC_BASE       1024
@@ -64,6 +67,12 @@ fuse_ll_destructor(void)
   lfmp_destroy(&g_FMP_fuse_req);
 }
 
+struct lfmp_t*
+fuse_ll_req_lfmp(void)
+{
+  return &g_FMP_fuse_req;
+}
+
 
 static
 void
@@ -146,6 +155,22 @@ fuse_send_msg(struct fuse_ll   *f,
   return 0;
 }
 
+/*
+  Requests received over io_uring must be answered through the ring
+  entry they arrived on.
+*/
+static
+int
+fuse_send_req_msg(fuse_req_t    req_,
+                  struct iovec *iov_,
+                  int           count_)
+{
+  if(req_->ring_ent)
+    return fuse_uring_send_reply(req_->ring_ent,iov_,count_);
+
+  return fuse_send_msg(req_->f,req_->ch,iov_,count_);
+}
+
 #define MAX_ERRNO 4095
 
 int
@@ -171,7 +196,7 @@ fuse_send_reply_iov_nofree(fuse_req_t    req,
   iov[0].iov_base = &out;
   iov[0].iov_len  = sizeof(struct fuse_out_header);
 
-  return fuse_send_msg(req->f, req->ch, iov, count);
+  return fuse_send_req_msg(req, iov, count);
 }
 
 static
@@ -277,6 +302,15 @@ fill_open(struct fuse_open_out   *arg_,
     arg_->open_flags |= FOPEN_PARALLEL_DIRECT_WRITES;
   if(ffi_->noflush)
     arg_->open_flags |= FOPEN_NOFLUSH;
+  if(ffi_->passthrough)
+    {
+      /* The kernel rejects passthrough opens combined with page cache
+         related flags and FOPEN_DIRECT_IO overrides passthrough */
+      arg_->open_flags &= ~(FOPEN_KEEP_CACHE|FOPEN_CACHE_DIR|
+                            FOPEN_DIRECT_IO|FOPEN_PARALLEL_DIRECT_WRITES);
+      arg_->open_flags |= FOPEN_PASSTHROUGH;
+      arg_->backing_id  = ffi_->backing_id;
+    }
 }
 
 int
@@ -470,7 +504,7 @@ fuse_reply_data(fuse_req_t    req,
   out.unique = req->unique;
   out.error = 0;
 
-  res = fuse_send_msg(req->f,req->ch,iov,2);
+  res = fuse_send_req_msg(req,iov,2);
   if(res <= 0)
     {
       destroy_req(req);
@@ -482,6 +516,200 @@ fuse_reply_data(fuse_req_t    req,
     }
 }
 
+#ifdef HAVE_SPLICE
+static
+struct fuse_ll_pipe*
+fuse_ll_get_pipe(struct fuse_ll *f_)
+{
+  int rv;
+  struct fuse_ll_pipe *llp;
+
+  llp = pthread_getspecific(f_->pipe_key);
+  if(llp != NULL)
+    return llp;
+
+  llp = malloc(sizeof(struct fuse_ll_pipe));
+  if(llp == NULL)
+    return NULL;
+
+  rv = pipe2(llp->pipe,O_CLOEXEC|O_NONBLOCK);
+  if(rv == -1)
+    {
+      free(llp);
+      return NULL;
+    }
+
+  rv = fcntl(llp->pipe[0],F_GETPIPE_SZ);
+  llp->size     = ((rv > 0) ? rv : 0);
+  llp->can_grow = 1;
+
+  pthread_setspecific(f_->pipe_key,llp);
+
+  return llp;
+}
+
+static
+void
+fuse_ll_clear_pipe(struct fuse_ll *f_)
+{
+  struct fuse_ll_pipe *llp;
+
+  llp = pthread_getspecific(f_->pipe_key);
+  if(llp == NULL)
+    return;
+
+  pthread_setspecific(f_->pipe_key,NULL);
+  fuse_ll_pipe_free(llp);
+}
+
+/*
+  The kernel requires the whole reply be spliced into /dev/fuse in a
+  single call so the pipe must be able to hold the header + data.
+*/
+static
+int
+fuse_ll_pipe_fit(struct fuse_ll_pipe *llp_,
+                 const size_t         size_)
+{
+  int rv;
+
+  if(llp_->size >= size_)
+    return 1;
+  if(!llp_->can_grow)
+    return 0;
+
+  rv = fcntl(llp_->pipe[0],F_SETPIPE_SZ,size_);
+  if(rv == -1)
+    {
+      llp_->can_grow = 0;
+      return 0;
+    }
+
+  llp_->size = rv;
+
+  return (llp_->size >= size_);
+}
+
+/*
+  A short splice (EOF) leaves a header with the wrong length in the
+  pipe. Drain it to memory and send it the regular way.
+*/
+static
+int
+fuse_reply_data_drain_pipe(fuse_req_t           req_,
+                           struct fuse_ll_pipe *llp_,
+                           const size_t         size_)
+{
+  int res;
+  ssize_t rv;
+  size_t len;
+  fuse_msgbuf_t *msgbuf;
+
+  msgbuf = msgbuf_alloc();
+
+  len = sizeof(struct fuse_out_header) + size_;
+  rv  = read(llp_->pipe[0],msgbuf->mem,len);
+  if(rv != (ssize_t)len)
+    {
+      fuse_ll_clear_pipe(req_->f);
+      res = fuse_reply_err(req_,EIO);
+    }
+  else
+    {
+      res = fuse_reply_data(req_,
+                            msgbuf->mem + sizeof(struct fuse_out_header),
+                            size_);
+    }
+
+  msgbuf_free(msgbuf);
+
+  return res;
+}
+
+int
+fuse_reply_data_fd(fuse_req_t    req_,
+                   const int     fd_,
+                   const off_t   offset_,
+                   const size_t  size_)
+{
+  int res;
+  off_t pos;
+  ssize_t rv;
+  size_t copied;
+  struct fuse_ll_pipe *llp;
+  struct fuse_out_header out;
+
+  if(!(req_->f->conn.want & FUSE_CAP_SPLICE_WRITE))
+    return -ENOTSUP;
+  if(req_->ring_ent)
+    return -ENOTSUP;
+
+  llp = fuse_ll_get_pipe(req_->f);
+  if(llp == NULL)
+    return -ENOTSUP;
+  if(!fuse_ll_pipe_fit(llp,sizeof(out) + size_))
+    return -ENOTSUP;
+
+  out.unique = req_->unique;
+  out.error  = 0;
+  out.len    = sizeof(out) + size_;
+
+  rv = write(llp->pipe[1],&out,sizeof(out));
+  if(rv != sizeof(out))
+    {
+      fuse_ll_clear_pipe(req_->f);
+      return -ENOTSUP;
+    }
+
+  pos    = offset_;
+  copied = 0;
+  while(copied < size_)
+    {
+      rv = splice(fd_,&pos,llp->pipe[1],NULL,size_ - copied,SPLICE_F_NONBLOCK);
+      if(rv <= 0)
+        break;
+      copied += rv;
+    }
+
+  // Not spliceable or an error. Let the caller retry via read so
+  // the filesystem's error is reported.
+  if((rv == -1) && (copied == 0))
+    {
+      rv = read(llp->pipe[0],&out,sizeof(out));
+      if(rv != sizeof(out))
+        fuse_ll_clear_pipe(req_->f);
+      return -ENOTSUP;
+    }
+
+  if(copied < size_)
+    return fuse_reply_data_drain_pipe(req_,llp,copied);
+
+  rv = splice(llp->pipe[0],NULL,fuse_chan_fd(req_->ch),NULL,out.len,0);
+  if(rv == out.len)
+    res = 0;
+  else if(rv == -1)
+    res = -errno;
+  else
+    res = -EIO;
+
+  if(res)
+    fuse_ll_clear_pipe(req_->f);
+
+  destroy_req(req_);
+
+  return res;
+}
+#else
+int
+fuse_reply_data_fd(fuse_req_t    req_,
+                   const int     fd_,
+                   const off_t   offset_,
+                   const size_t  size_)
+{
+  return -ENOTSUP;
+}
+#endif
+
 int
 fuse_reply_statfs(fuse_req_t            req,
                   const struct statvfs *stbuf)
@@ -1092,10 +1320,15 @@ do_init(fuse_req_t             req,
   struct fuse_init_in *arg = (struct fuse_init_in *) &hdr_[1];
   struct fuse_ll *f = req->f;
   size_t bufsize = fuse_chan_bufsize(req->ch);
+  uint64_t inflags;
 
   if(f->debug)
     debug_fuse_init_in(arg);
 
+  inflags = arg->flags;
+  if(inflags & FUSE_INIT_EXT)
+    inflags |= ((uint64_t)arg->flags2 << 32);
+
   f->conn.proto_major = arg->major;
   f->conn.proto_minor = arg->minor;
   f->conn.capable = 0;
@@ -1156,6 +1389,12 @@ do_init(fuse_req_t             req,
         f->conn.capable |= FUSE_CAP_READDIR_PLUS_AUTO;
       if(arg->flags & FUSE_SETXATTR_EXT)
         f->conn.capable |= FUSE_CAP_SETXATTR_EXT;
+      if(inflags & FUSE_PASSTHROUGH)
+        f->conn.capable |= FUSE_CAP_PASSTHROUGH;
+#ifdef HAVE_IO_URING
+      if(inflags & FUSE_OVER_IO_URING)
+        f->conn.capable |= FUSE_CAP_OVER_IO_URING;
+#endif
     }
   else
     {
@@ -1163,6 +1402,13 @@ do_init(fuse_req_t             req,
       f->conn.max_readahead = 0;
     }
 
+  /* Splice support is a property of the device rather than
+     something the kernel advertises */
+#ifdef HAVE_SPLICE
+  if(req->f->conn.proto_minor >= 14)
+    f->conn.capable |= (FUSE_CAP_SPLICE_WRITE|FUSE_CAP_SPLICE_READ);
+#endif
+
   if(req->f->conn.proto_minor >= 18)
     f->conn.capable |= FUSE_CAP_IOCTL_DIR;
 
@@ -1224,6 +1470,24 @@ do_init(fuse_req_t             req,
     outarg.flags |= FUSE_READDIRPLUS_AUTO;
   if(f->conn.want & FUSE_CAP_SETXATTR_EXT)
     outarg.flags |= FUSE_SETXATTR_EXT;
+  /* The kernel silently disables passthrough when combined with
+     writeback caching */
+  if((f->conn.want & FUSE_CAP_PASSTHROUGH) &&
+     !(f->conn.want & FUSE_CAP_WRITEBACK_CACHE))
+    {
+      outarg.flags           |= FUSE_INIT_EXT;
+      outarg.flags2          |= (FUSE_PASSTHROUGH >> 32);
+      outarg.max_stack_depth  = 1;
+    }
+  else
+    {
+      f->conn.want &= ~FUSE_CAP_PASSTHROUGH;
+    }
+  if(f->conn.want & FUSE_CAP_OVER_IO_URING)
+    {
+      outarg.flags  |= FUSE_INIT_EXT;
+      outarg.flags2 |= (FUSE_OVER_IO_URING >> 32);
+    }
 
   outarg.max_readahead = f->conn.max_readahead;
   outarg.max_write = f->conn.max_write;
@@ -1620,6 +1884,44 @@ fuse_lowlevel_notify_retrieve(struct fuse_chan *ch,
   return err;
 }
 
+int
+fuse_lowlevel_backing_open(struct fuse_chan *ch_,
+                           const int         fd_)
+{
+  int rv;
+  struct fuse_backing_map map = {0};
+
+  if(!ch_)
+    return -EINVAL;
+
+  map.fd = fd_;
+
+  rv = ioctl(fuse_chan_fd(ch_),FUSE_DEV_IOC_BACKING_OPEN,&map);
+  if(rv == -1)
+    return -errno;
+
+  return rv;
+}
+
+int
+fuse_lowlevel_backing_close(struct fuse_chan *ch_,
+                            const int         backing_id_)
+{
+  int rv;
+  uint32_t id;
+
+  if(!ch_)
+    return -EINVAL;
+
+  id = backing_id_;
+
+  rv = ioctl(fuse_chan_fd(ch_),FUSE_DEV_IOC_BACKING_CLOSE,&id);
+  if(rv == -1)
+    return -errno;
+
+  return 0;
+}
+
 void *
 fuse_req_userdata(fuse_req_t req)
 {
@@ -1829,11 +2131,12 @@ fuse_send_enomem(struct fuse_ll   *f_,
 static
 int
 fuse_ll_buf_receive_read(struct fuse_session *se_,
+                         struct fuse_chan    *ch_,
                          fuse_msgbuf_t       *msgbuf_)
 {
   int rv;
 
-  rv = read(fuse_chan_fd(se_->ch),msgbuf_->mem,msgbuf_->size);
+  rv = read(fuse_chan_fd(ch_),msgbuf_->mem,msgbuf_->size);
   if(rv == -1)
     return -errno;
 
@@ -1846,10 +2149,109 @@ fuse_ll_buf_receive_read(struct fuse_session *se_,
   return rv;
 }
 
+/*
+  Splice the request into the msgbuf's pipe. The header is always read
+  into memory. Write payloads are left in the pipe (pipe_len) to be
+  spliced directly to the destination by the write handler. Everything
+  else is read into memory as usual.
+*/
+#ifdef HAVE_SPLICE
+static
+int
+fuse_ll_buf_receive_splice(struct fuse_session *se_,
+                           struct fuse_chan    *ch_,
+                           fuse_msgbuf_t       *msgbuf_)
+{
+  int rv;
+  ssize_t len;
+  size_t hdrlen;
+  struct fuse_in_header *in;
+
+  // Such as EPERM once over pipe-user-pages-soft. Only this request
+  // falls back; the msgbuf tries again next time.
+  rv = msgbuf_pipe_open(msgbuf_);
+  if(rv < 0)
+    return fuse_ll_buf_receive_read(se_,ch_,msgbuf_);
+
+  len = splice(fuse_chan_fd(ch_),NULL,
+               msgbuf_->pipefd[1],NULL,
+               msgbuf_->size,0);
+  if(len == -1)
+    return -errno;
+
+  msgbuf_->pipe_len = len;
+  if(len < (ssize_t)sizeof(struct fuse_in_header))
+    {
+      fprintf(stderr, "short splice from fuse device\n");
+      msgbuf_pipe_close(msgbuf_);
+      return -EIO;
+    }
+
+  in = (struct fuse_in_header*)msgbuf_->mem;
+
+  rv = msgbuf_pipe_read(msgbuf_,msgbuf_->mem,sizeof(struct fuse_in_header));
+  if(rv < 0)
+    goto err;
+
+  hdrlen = sizeof(struct fuse_in_header);
+  if((in->opcode == FUSE_WRITE) && (se_->f->conn.proto_minor >= 9))
+    hdrlen += sizeof(struct fuse_write_in);
+  else
+    hdrlen = len;
+
+  if(hdrlen > (size_t)len)
+    hdrlen = len;
+
+  rv = msgbuf_pipe_read(msgbuf_,
+                        msgbuf_->mem + sizeof(struct fuse_in_header),
+                        hdrlen - sizeof(struct fuse_in_header));
+  if(rv < 0)
+    goto err;
+
+  return len;
+
+ err:
+  msgbuf_pipe_close(msgbuf_);
+  return -EIO;
+}
+
+/*
+  Whether to splice at all is decided once at INIT so the receive
+  function is never changed while reader threads are using it. EPERM
+  reflects the user's current pipe usage rather than a lack of
+  support and is left to the per request fallback.
+*/
+static
+int
+fuse_ll_splice_usable(void)
+{
+  int rv;
+  fuse_msgbuf_t *msgbuf;
+
+  msgbuf = msgbuf_alloc();
+  if(msgbuf == NULL)
+    return 0;
+
+  rv = msgbuf_pipe_open(msgbuf);
+  msgbuf_free(msgbuf);
+  if((rv < 0) && (rv != -EPERM))
+    {
+      fprintf(stderr,
+              "fuse: unable to create pipe for splicing, disabling: %s\n",
+              strerror(-rv));
+      return 0;
+    }
+
+  return 1;
+}
+#endif
+
 static
 void
-fuse_ll_buf_process_read(struct fuse_session *se_,
-                         const fuse_msgbuf_t *msgbuf_)
+fuse_ll_process_msg(struct fuse_session   *se_,
+                    struct fuse_chan      *ch_,
+                    struct fuse_uring_ent *ring_ent_,
+                    fuse_msgbuf_t         *msgbuf_)
 {
   int err;
   struct fuse_req *req;
@@ -1861,13 +2263,19 @@ fuse_ll_buf_process_read(struct fuse_session *se_,
 
   req = fuse_ll_alloc_req(se_->f);
   if(req == NULL)
-    return fuse_send_enomem(se_->f,se_->ch,in->unique);
+    {
+      if(ring_ent_)
+        return fuse_uring_send_errno(ring_ent_,ENOMEM,in->unique);
+      return fuse_send_enomem(se_->f,ch_,in->unique);
+    }
 
-  req->unique  = in->unique;
-  req->ctx.uid = in->uid;
-  req->ctx.gid = in->gid;
-  req->ctx.pid = in->pid;
-  req->ch      = se_->ch;
+  req->unique   = in->unique;
+  req->ctx.uid  = in->uid;
+  req->ctx.gid  = in->gid;
+  req->ctx.pid  = in->pid;
+  req->ch       = ch_;
+  req->msgbuf   = msgbuf_;
+  req->ring_ent = ring_ent_;
 
   err = ENOSYS;
   if(in->opcode >= FUSE_MAXOP)
@@ -1884,10 +2292,28 @@ fuse_ll_buf_process_read(struct fuse_session *se_,
   return;
 }
 
+static
+void
+fuse_ll_buf_process_read(struct fuse_session *se_,
+                         struct fuse_chan    *ch_,
+                         fuse_msgbuf_t       *msgbuf_)
+{
+  fuse_ll_process_msg(se_,ch_,NULL,msgbuf_);
+}
+
+void
+fuse_ll_process_uring(struct fuse_session   *se_,
+                      struct fuse_uring_ent *ring_ent_,
+                      fuse_msgbuf_t         *msgbuf_)
+{
+  fuse_ll_process_msg(se_,se_->ch,ring_ent_,msgbuf_);
+}
+
 static
 void
 fuse_ll_buf_process_read_init(struct fuse_session *se_,
-                              const fuse_msgbuf_t *msgbuf_)
+                              struct fuse_chan    *ch_,
+                              fuse_msgbuf_t       *msgbuf_)
 {
   int err;
   struct fuse_req *req;
@@ -1897,13 +2323,13 @@ fuse_ll_buf_process_read_init(struct fuse_session *se_,
 
   req = fuse_ll_alloc_req(se_->f);
   if(req == NULL)
-    return fuse_send_enomem(se_->f,se_->ch,in->unique);
+    return fuse_send_enomem(se_->f,ch_,in->unique);
 
   req->unique  = in->unique;
   req->ctx.uid = in->uid;
   req->ctx.gid = in->gid;
   req->ctx.pid = in->pid;
-  req->ch      = se_->ch;
+  req->ch      = ch_;
 
   err = EIO;
   if(in->opcode != FUSE_INIT)
@@ -1915,6 +2341,17 @@ fuse_ll_buf_process_read_init(struct fuse_session *se_,
 
   fuse_ll_ops[in->opcode].func(req, in);
 
+#ifdef HAVE_SPLICE
+  if((se_->f->conn.want & FUSE_CAP_SPLICE_READ) && fuse_ll_splice_usable())
+    se_->receive_buf = fuse_ll_buf_receive_splice;
+#endif
+
+  /* The ring can only be registered once the kernel has processed
+     the INIT reply. Requests keep arriving via /dev/fuse until every
+     queue is registered and always for FORGET and INTERRUPT. */
+  if(se_->f->conn.want & FUSE_CAP_OVER_IO_URING)
+    fuse_uring_start(se_);
+
   return;
 
  reply_err:
@@ -15,18 +15,70 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "config.h"
+#include "cpu.hpp"
 #include "fuse_msgbuf.hpp"
 #include "fuse.h"
 #include "fuse_kernel.h"
 
+#include <fcntl.h>
+#include <sched.h>
 #include <unistd.h>
 
 #include <atomic>
+#include <cerrno>
 #include <cstdint>
 #include <cstdlib>
 #include <mutex>
+#include <set>
 #include <vector>
 
+/*
+  Free msgbufs are kept in three tiers:
+
+  1. a few per thread which need no locking
+  2. a list per NUMA node each with its own lock
+  3. a global stack used when a node's list is full
+
+  A msgbuf remembers the node of the thread which allocated it. Its
+  memory is first touched by that thread (the kernel copying a
+  request into it) so it is returned to that node's tiers when freed
+  regardless of which thread frees it.
+*/
+
+#define MSGBUF_THREAD_MAX 4
+#define MSGBUF_NODE_MAX   64
+#define MSGBUF_MAX_NODES  64
+
+namespace
+{
+  struct Stats
+  {
+    std::atomic<std::uint64_t> thread_hits{0};
+    std::atomic<std::uint64_t> node_hits{0};
+    std::atomic<std::uint64_t> global_hits{0};
+    std::atomic<std::uint64_t> allocs{0};
+  };
+
+  struct alignas(64) NodeList
+  {
+    std::mutex                  mutex;
+    std::vector<fuse_msgbuf_t*> stack;
+  };
+
+  class ThreadCache
+  {
+  public:
+    ThreadCache();
+    ~ThreadCache();
+
+  public:
+    std::uint64_t     gc_epoch;
+    std::atomic<int>  count;
+    fuse_msgbuf_t    *bufs[MSGBUF_THREAD_MAX];
+    Stats             stats;
+  };
+}
 
 static std::uint32_t g_PAGESIZE = 0;
 static std::uint32_t g_BUFSIZE  = 0;
@@ -36,6 +88,19 @@ static std::atomic<std::uint_fast64_t> g_MSGBUF_ALLOC_COUNT;
 static std::mutex g_MUTEX;
 static std::vector<fuse_msgbuf_t*> g_MSGBUF_STACK;
 
+static std::once_flag    g_NUMA_ONCE;
+static std::vector<int>  g_CPU2NODE;
+static int               g_NODE_COUNT = 1;
+static NodeList          g_NODES[MSGBUF_MAX_NODES];
+
+static std::atomic<std::uint64_t> g_GC_EPOCH;
+
+static std::mutex             g_THREAD_CACHES_MUTEX;
+static std::set<ThreadCache*> g_THREAD_CACHES;
+static Stats                  g_EXITED_STATS;
+
+static thread_local ThreadCache t_CACHE;
+
 uint64_t
 msgbuf_get_bufsize()
 {
@@ -98,30 +163,244 @@ page_aligned_malloc(const uint64_t size_)
   return buf;
 }
 
+static
+void
+msgbuf_destroy(fuse_msgbuf_t *msgbuf_)
+{
+  //  free(msgbuf_->mem);
+  msgbuf_pipe_close(msgbuf_);
+  free(msgbuf_);
+  g_MSGBUF_ALLOC_COUNT.fetch_sub(1,std::memory_order_relaxed);
+}
+
+static
+void
+numa_init()
+{
+  CPU::CPU2NodeMap c2n;
+
+  c2n = CPU::cpu2node();
+  for(auto const &kv : c2n)
+    {
+      if((kv.first < 0) || (kv.second < 0) || (kv.second >= MSGBUF_MAX_NODES))
+        continue;
+      if((int)g_CPU2NODE.size() <= kv.first)
+        g_CPU2NODE.resize(kv.first + 1,0);
+
+      g_CPU2NODE[kv.first] = kv.second;
+      if(kv.second >= g_NODE_COUNT)
+        g_NODE_COUNT = (kv.second + 1);
+    }
+}
+
+static
+int
+current_node()
+{
+  int cpu;
+
+  std::call_once(g_NUMA_ONCE,numa_init);
+
+  if(g_NODE_COUNT == 1)
+    return 0;
+
+  cpu = sched_getcpu();
+  if((cpu < 0) || (cpu >= (int)g_CPU2NODE.size()))
+    return 0;
+
+  return g_CPU2NODE[cpu];
+}
+
+static
+inline
+void
+inc(std::atomic<std::uint64_t> &counter_)
+{
+  counter_.store(counter_.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+}
+
+static
+void
+stats_add(Stats       &dst_,
+          const Stats &src_)
+{
+  dst_.thread_hits += src_.thread_hits.load(std::memory_order_relaxed);
+  dst_.node_hits   += src_.node_hits.load(std::memory_order_relaxed);
+  dst_.global_hits += src_.global_hits.load(std::memory_order_relaxed);
+  dst_.allocs      += src_.allocs.load(std::memory_order_relaxed);
+}
+
+// Returns to the node list or, if full, the global stack.
+static
+void
+release_shared(fuse_msgbuf_t *msgbuf_)
+{
+  NodeList &nl = g_NODES[msgbuf_->node];
+
+  {
+    std::lock_guard<std::mutex> lck(nl.mutex);
+
+    if(nl.stack.size() < MSGBUF_NODE_MAX)
+      {
+        nl.stack.emplace_back(msgbuf_);
+        return;
+      }
+  }
+
+  std::lock_guard<std::mutex> lck(g_MUTEX);
+
+  g_MSGBUF_STACK.emplace_back(msgbuf_);
+}
+
+// A thorough gc can't reach into other threads' caches so they are
+// emptied by their owners the next time they are used.
+static
+void
+thread_cache_check_gc(ThreadCache &tc_)
+{
+  int count;
+  std::uint64_t epoch;
+
+  epoch = g_GC_EPOCH.load(std::memory_order_relaxed);
+  if(tc_.gc_epoch == epoch)
+    return;
+
+  tc_.gc_epoch = epoch;
+  count = tc_.count.load(std::memory_order_relaxed);
+  while(count)
+    msgbuf_destroy(tc_.bufs[--count]);
+  tc_.count.store(0,std::memory_order_relaxed);
+}
+
+ThreadCache::ThreadCache()
+  : gc_epoch(g_GC_EPOCH.load()),
+    count(0)
+{
+  std::lock_guard<std::mutex> lck(g_THREAD_CACHES_MUTEX);
+
+  g_THREAD_CACHES.insert(this);
+}
+
+ThreadCache::~ThreadCache()
+{
+  int n;
+
+  n = count.load(std::memory_order_relaxed);
+  while(n)
+    release_shared(bufs[--n]);
+  count.store(0,std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lck(g_THREAD_CACHES_MUTEX);
+
+  stats_add(g_EXITED_STATS,stats);
+  g_THREAD_CACHES.erase(this);
+}
+
+static
+fuse_msgbuf_t*
+thread_cache_pop(ThreadCache &tc_)
+{
+  int count;
+
+  count = tc_.count.load(std::memory_order_relaxed);
+  if(count == 0)
+    return NULL;
+
+  tc_.count.store(--count,std::memory_order_relaxed);
+  inc(tc_.stats.thread_hits);
+
+  return tc_.bufs[count];
+}
+
+static
+fuse_msgbuf_t*
+node_pop(ThreadCache &tc_,
+         const int    node_)
+{
+  fuse_msgbuf_t *msgbuf;
+  NodeList &nl = g_NODES[node_];
+  std::lock_guard<std::mutex> lck(nl.mutex);
+
+  if(nl.stack.empty())
+    return NULL;
+
+  msgbuf = nl.stack.back();
+  nl.stack.pop_back();
+  inc(tc_.stats.node_hits);
+
+  return msgbuf;
+}
+
+static
+fuse_msgbuf_t*
+global_pop(ThreadCache &tc_,
+           const int    node_)
+{
+  fuse_msgbuf_t *msgbuf;
+
+  {
+    std::lock_guard<std::mutex> lck(g_MUTEX);
+
+    if(g_MSGBUF_STACK.empty())
+      return NULL;
+
+    msgbuf = g_MSGBUF_STACK.back();
+    g_MSGBUF_STACK.pop_back();
+  }
+
+  msgbuf->node = node_;
+  inc(tc_.stats.global_hits);
+
+  return msgbuf;
+}
+
+static
+fuse_msgbuf_t*
+new_msgbuf(ThreadCache &tc_,
+           const int    node_)
+{
+  fuse_msgbuf_t *msgbuf;
+
+  msgbuf = (fuse_msgbuf_t*)page_aligned_malloc(g_BUFSIZE);
+  if(msgbuf == NULL)
+    return NULL;
+
+  msgbuf->pipefd[0] = -1;
+  msgbuf->pipefd[1] = -1;
+  msgbuf->pipe_len  = 0;
+  msgbuf->node      = node_;
+
+  g_MSGBUF_ALLOC_COUNT.fetch_add(1,std::memory_order_relaxed);
+  inc(tc_.stats.allocs);
+
+  return msgbuf;
+}
+
 typedef void (*msgbuf_setup_func_t)(fuse_msgbuf_t*);
 
 static
 fuse_msgbuf_t*
 _msgbuf_alloc(msgbuf_setup_func_t setup_func_)
 {
+  int node;
   fuse_msgbuf_t *msgbuf;
+  ThreadCache &tc = t_CACHE;
 
-  g_MUTEX.lock();
-  if(g_MSGBUF_STACK.empty())
+  thread_cache_check_gc(tc);
+
+  msgbuf = thread_cache_pop(tc);
+  if(msgbuf == NULL)
     {
-      g_MUTEX.unlock();
+      node = current_node();
 
-      msgbuf = (fuse_msgbuf_t*)page_aligned_malloc(g_BUFSIZE);
+      msgbuf = node_pop(tc,node);
+      if(msgbuf == NULL)
+        msgbuf = global_pop(tc,node);
+      if(msgbuf == NULL)
+        msgbuf = new_msgbuf(tc,node);
       if(msgbuf == NULL)
         return NULL;
-
-      g_MSGBUF_ALLOC_COUNT.fetch_add(1,std::memory_order_relaxed);
-    }
-  else
-    {
-      msgbuf = g_MSGBUF_STACK.back();
-      g_MSGBUF_STACK.pop_back();
-      g_MUTEX.unlock();
     }
 
   setup_func_(msgbuf);
@@ -144,28 +423,110 @@ msgbuf_alloc_page_aligned()
   return _msgbuf_alloc(msgbuf_page_align);
 }
 
-static
-void
-msgbuf_destroy(fuse_msgbuf_t *msgbuf_)
-{
-  //  free(msgbuf_->mem);
-  free(msgbuf_);
-}
-
 void
 msgbuf_free(fuse_msgbuf_t *msgbuf_)
 {
-  std::lock_guard<std::mutex> lck(g_MUTEX);
+  int count;
+  ThreadCache &tc = t_CACHE;
+
+  // A pipe with unconsumed data can't be reused for another message
+  if(msgbuf_->pipe_len)
+    msgbuf_pipe_close(msgbuf_);
 
   if(msgbuf_->size != (g_BUFSIZE - g_PAGESIZE))
     {
       msgbuf_destroy(msgbuf_);
-      g_MSGBUF_ALLOC_COUNT.fetch_sub(1,std::memory_order_relaxed);
       return;
     }
 
-  g_MSGBUF_STACK.emplace_back(msgbuf_);
+  thread_cache_check_gc(tc);
+
+  count = tc.count.load(std::memory_order_relaxed);
+  if((count < MSGBUF_THREAD_MAX) && (msgbuf_->node == current_node()))
+    {
+      tc.bufs[count] = msgbuf_;
+      tc.count.store(count + 1,std::memory_order_relaxed);
+      return;
+    }
+
+  release_shared(msgbuf_);
+}
+
+// Each msgbuf can own a pipe used to splice requests from the
+// device. It lives as long as the msgbuf so the cost of creating and
+// sizing it is amortized. The pipe must be able to hold a full
+// message.
+#ifdef HAVE_SPLICE
+int
+msgbuf_pipe_open(fuse_msgbuf_t *msgbuf_)
+{
+  int rv;
+
+  if(msgbuf_->pipefd[0] != -1)
+    return 0;
+
+  rv = pipe2(msgbuf_->pipefd,O_CLOEXEC);
+  if(rv == -1)
+    return -errno;
+
+  rv = fcntl(msgbuf_->pipefd[0],F_SETPIPE_SZ,g_BUFSIZE);
+  if(rv == -1)
+    {
+      rv = -errno;
+      msgbuf_pipe_close(msgbuf_);
+      return rv;
+    }
+
+  return 0;
+}
+#else
+int
+msgbuf_pipe_open(fuse_msgbuf_t *msgbuf_)
+{
+  return -ENOTSUP;
+}
+#endif
+
+void
+msgbuf_pipe_close(fuse_msgbuf_t *msgbuf_)
+{
+  if(msgbuf_->pipefd[0] != -1)
+    {
+      close(msgbuf_->pipefd[0]);
+      close(msgbuf_->pipefd[1]);
+    }
 
+  msgbuf_->pipefd[0] = -1;
+  msgbuf_->pipefd[1] = -1;
+  msgbuf_->pipe_len  = 0;
+}
+
+int
+msgbuf_pipe_read(fuse_msgbuf_t  *msgbuf_,
+                 char           *buf_,
+                 const uint32_t  size_)
+{
+  ssize_t rv;
+  uint32_t count;
+
+  count = 0;
+  while(count < size_)
+    {
+      rv = read(msgbuf_->pipefd[0],buf_ + count,size_ - count);
+      if(rv == -1)
+        {
+          if(errno == EINTR)
+            continue;
+          return -errno;
+        }
+      if(rv == 0)
+        return -EIO;
+
+      count             += rv;
+      msgbuf_->pipe_len -= rv;
+    }
+
+  return count;
 }
 
 uint64_t
@@ -177,52 +538,121 @@ msgbuf_alloc_count()
 uint64_t
 msgbuf_avail_count()
 {
-  std::lock_guard<std::mutex> lck(g_MUTEX);
+  msgbuf_stats_t stats;
+
+  msgbuf_stats(&stats);
 
-  return g_MSGBUF_STACK.size();
+  return (stats.thread_avail + stats.node_avail + stats.global_avail);
 }
 
+// Thread cache values are owned by other threads and only
+// approximate.
 void
-msgbuf_gc_10percent()
+msgbuf_stats(msgbuf_stats_t *stats_)
 {
-  std::vector<fuse_msgbuf_t*> togc;
+  Stats total;
 
-  {
-    std::size_t size;
-    std::size_t ten_percent;
+  std::call_once(g_NUMA_ONCE,numa_init);
 
-    std::lock_guard<std::mutex> lck(g_MUTEX);
+  stats_->numa_nodes   = g_NODE_COUNT;
+  stats_->thread_avail = 0;
+  stats_->node_avail   = 0;
 
-    size        = g_MSGBUF_STACK.size();
-    ten_percent = (size / 10);
+  {
+    std::lock_guard<std::mutex> lck(g_THREAD_CACHES_MUTEX);
 
-    for(std::size_t i = 0; i < ten_percent; i++)
+    stats_add(total,g_EXITED_STATS);
+    for(auto tc : g_THREAD_CACHES)
       {
-        togc.push_back(g_MSGBUF_STACK.back());
-        g_MSGBUF_STACK.pop_back();
+        stats_add(total,tc->stats);
+        stats_->thread_avail += tc->count.load(std::memory_order_relaxed);
       }
   }
 
-  for(auto msgbuf : togc)
+  stats_->thread_hits = total.thread_hits;
+  stats_->node_hits   = total.node_hits;
+  stats_->global_hits = total.global_hits;
+  stats_->allocs      = total.allocs;
+
+  for(int i = 0; i < g_NODE_COUNT; i++)
     {
-      msgbuf_destroy(msgbuf);
-      g_MSGBUF_ALLOC_COUNT.fetch_sub(1,std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lck(g_NODES[i].mutex);
+
+      stats_->node_avail += g_NODES[i].stack.size();
     }
+
+  {
+    std::lock_guard<std::mutex> lck(g_MUTEX);
+
+    stats_->global_avail = g_MSGBUF_STACK.size();
+  }
 }
 
+static
 void
-msgbuf_gc()
+take_10percent(std::vector<fuse_msgbuf_t*> &stack_,
+               std::vector<fuse_msgbuf_t*> &togc_)
 {
-  std::vector<fuse_msgbuf_t*> oldstack;
+  std::size_t ten_percent;
+
+  ten_percent = (stack_.size() / 10);
+  for(std::size_t i = 0; i < ten_percent; i++)
+    {
+      togc_.push_back(stack_.back());
+      stack_.pop_back();
+    }
+}
+
+// Trims the shared tiers. Thread caches are small enough to leave
+// alone.
+void
+msgbuf_gc_10percent()
+{
+  std::vector<fuse_msgbuf_t*> togc;
+
+  for(int i = 0; i < g_NODE_COUNT; i++)
+    {
+      std::lock_guard<std::mutex> lck(g_NODES[i].mutex);
+
+      take_10percent(g_NODES[i].stack,togc);
+    }
 
   {
     std::lock_guard<std::mutex> lck(g_MUTEX);
-    oldstack.swap(g_MSGBUF_STACK);
+
+    take_10percent(g_MSGBUF_STACK,togc);
   }
 
-  for(auto msgbuf: oldstack)
+  for(auto msgbuf : togc)
+    msgbuf_destroy(msgbuf);
+}
+
+void
+msgbuf_gc()
+{
+  std::vector<fuse_msgbuf_t*> oldstack;
+
+  g_GC_EPOCH.fetch_add(1,std::memory_order_relaxed);
+
+  for(int i = 0; i < g_NODE_COUNT; i++)
     {
-      msgbuf_destroy(msgbuf);
-      g_MSGBUF_ALLOC_COUNT.fetch_sub(1,std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lck(g_NODES[i].mutex);
+
+      oldstack.insert(oldstack.end(),
+                      g_NODES[i].stack.begin(),
+                      g_NODES[i].stack.end());
+      g_NODES[i].stack.clear();
     }
+
+  {
+    std::lock_guard<std::mutex> lck(g_MUTEX);
+
+    oldstack.insert(oldstack.end(),
+                    g_MSGBUF_STACK.begin(),
+                    g_MSGBUF_STACK.end());
+    g_MSGBUF_STACK.clear();
+  }
+
+  for(auto msgbuf : oldstack)
+    msgbuf_destroy(msgbuf);
 }
@@ -23,6 +23,19 @@
 
 EXTERN_C_BEGIN
 
+typedef struct msgbuf_stats_t msgbuf_stats_t;
+struct msgbuf_stats_t
+{
+  uint64_t numa_nodes;
+  uint64_t thread_hits;
+  uint64_t node_hits;
+  uint64_t global_hits;
+  uint64_t allocs;
+  uint64_t thread_avail;
+  uint64_t node_avail;
+  uint64_t global_avail;
+};
+
 void     msgbuf_set_bufsize(const uint32_t size);
 uint64_t msgbuf_get_bufsize();
 
@@ -35,8 +48,15 @@ void           msgbuf_gc_10percent();
 
 uint64_t       msgbuf_alloc_count();
 uint64_t       msgbuf_avail_count();
+void           msgbuf_stats(msgbuf_stats_t *stats);
 
 void           msgbuf_page_align(fuse_msgbuf_t *msgbuf);
 void           msgbuf_write_align(fuse_msgbuf_t *msgbuf);
 
+int            msgbuf_pipe_open(fuse_msgbuf_t *msgbuf);
+void           msgbuf_pipe_close(fuse_msgbuf_t *msgbuf);
+int            msgbuf_pipe_read(fuse_msgbuf_t *msgbuf,
+                                char          *buf,
+                                uint32_t       size);
+
 EXTERN_C_END
@@ -12,10 +12,12 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/uio.h>
 
 
@@ -39,6 +41,8 @@ fuse_session_new(void *data,
   }
 
   memset(se, 0, sizeof(*se));
+  kv_init(se->clones);
+  pthread_mutex_init(&se->lock,NULL);
   se->f           = data;
   se->receive_buf = receive_buf;
   se->process_buf = process_buf;
@@ -59,18 +63,45 @@ void fuse_session_remove_chan(struct fuse_chan *ch)
 {
   struct fuse_session *se = ch->se;
   if (se) {
-    assert(se->ch == ch);
-    se->ch = NULL;
+    if(se->ch == ch)
+      se->ch = NULL;
     ch->se = NULL;
   }
 }
 
+/*
+  Clone the session's primary channel so the calling thread can read
+  requests and write replies on its own /dev/fuse fd. Replies must be
+  written to the fd the request was read from. Falls back to the
+  primary channel if cloning is not supported.
+*/
+struct fuse_chan *
+fuse_session_clone_chan(struct fuse_session *se_)
+{
+  struct fuse_chan *ch;
+
+  ch = fuse_chan_clone(se_->ch);
+  if(ch == NULL)
+    return se_->ch;
+
+  pthread_mutex_lock(&se_->lock);
+  ch->se = se_;
+  kv_push(struct fuse_chan*,se_->clones,ch);
+  pthread_mutex_unlock(&se_->lock);
+
+  return ch;
+}
+
 void
 fuse_session_destroy(struct fuse_session *se)
 {
   se->destroy(se->f);
+  for(size_t i = 0; i < kv_size(se->clones); i++)
+    fuse_chan_destroy(kv_A(se->clones,i));
+  kv_destroy(se->clones);
   if(se->ch != NULL)
     fuse_chan_destroy(se->ch);
+  pthread_mutex_destroy(&se->lock);
   free(se);
 }
 
@@ -118,6 +149,41 @@ fuse_chan_new(int fd,
   return ch;
 }
 
+struct fuse_chan *
+fuse_chan_clone(struct fuse_chan *ch_)
+{
+  int fd;
+  int rv;
+  uint32_t masterfd;
+  struct fuse_chan *ch;
+
+  fd = open("/dev/fuse",O_RDWR|O_CLOEXEC);
+  if(fd == -1)
+    {
+      fprintf(stderr,
+              "fuse: failed to open /dev/fuse for cloning: %s\n",
+              strerror(errno));
+      return NULL;
+    }
+
+  masterfd = ch_->fd;
+  rv = ioctl(fd,FUSE_DEV_IOC_CLONE,&masterfd);
+  if(rv == -1)
+    {
+      fprintf(stderr,
+              "fuse: failed to clone device fd: %s\n",
+              strerror(errno));
+      close(fd);
+      return NULL;
+    }
+
+  ch = fuse_chan_new(fd,ch_->bufsize);
+  if(ch == NULL)
+    close(fd);
+
+  return ch;
+}
+
 int fuse_chan_fd(struct fuse_chan *ch)
 {
   return ch->fd;
@@ -0,0 +1,744 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "config.h"
+#include "fuse_uring.hpp"
+
+#include "cpu.hpp"
+#include "fuse_config.hpp"
+#include "fuse_i.h"
+#include "fuse_kernel.h"
+#include "fuse_lowlevel.h"
+#include "fuse_msgbuf.hpp"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <syslog.h>
+
+/*
+  FUSE over io_uring (kernel 6.14+, fuse.enable_uring=1)
+
+  The kernel keeps one queue per possible CPU and a request is
+  delivered to the queue of the CPU the requesting task ran on. Each
+  queue gets its own ring and thread which registers `depth` entries
+  made up of a header buffer and a msgbuf for the payload. Requests
+  are handed to the process thread pool and each reply commits its
+  entry directly. Without process threads the queue's thread handles
+  requests itself and commits the batch before it next waits. The
+  ring only becomes active once every queue has registered so until
+  then, or if anything fails, requests continue to be read from
+  /dev/fuse. FORGET and INTERRUPT always arrive via /dev/fuse.
+*/
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#define FUSE_URING_SQE_SIZE 128
+
+struct fuse_uring_queue;
+
+struct fuse_uring_ent
+{
+  struct fuse_uring_req_header  hdr;
+  struct fuse_uring_queue      *q;
+  fuse_msgbuf_t                *msgbuf;
+  struct iovec                  iov[2];
+  std::atomic<uint64_t>         replies;
+};
+
+struct fuse_uring_queue
+{
+  struct fuse_session *se;
+  int                  qid;
+  int                  dev_fd;
+  int                  ring_fd;
+  unsigned             to_submit;
+  pthread_t            thread;
+  bool                 started;
+  std::atomic<bool>    stop;
+  std::atomic<unsigned> inflight;
+  std::mutex           lock;
+  FuseUringDispatch    dispatch;
+
+  unsigned            *sq_head;
+  unsigned            *sq_tail;
+  unsigned            *sq_mask;
+  unsigned            *sq_entries;
+  unsigned            *sq_array;
+  char                *sqes;
+  unsigned            *cq_head;
+  unsigned            *cq_tail;
+  unsigned            *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void                *sq_ptr;
+  size_t               sq_ptr_size;
+  void                *cq_ptr;
+  size_t               cq_ptr_size;
+  size_t               sqes_size;
+
+  std::vector<fuse_uring_ent*> ents;
+};
+
+static std::mutex                     g_lock;
+static FuseUringDispatch              g_dispatch;
+static std::vector<fuse_uring_queue*> g_queues;
+
+static
+void
+uring_queue_unmap(fuse_uring_queue *q_)
+{
+  if(q_->sqes != MAP_FAILED)
+    munmap(q_->sqes,q_->sqes_size);
+  if((q_->cq_ptr != MAP_FAILED) && (q_->cq_ptr != q_->sq_ptr))
+    munmap(q_->cq_ptr,q_->cq_ptr_size);
+  if(q_->sq_ptr != MAP_FAILED)
+    munmap(q_->sq_ptr,q_->sq_ptr_size);
+  if(q_->ring_fd != -1)
+    close(q_->ring_fd);
+
+  q_->sqes    = (char*)MAP_FAILED;
+  q_->cq_ptr  = MAP_FAILED;
+  q_->sq_ptr  = MAP_FAILED;
+  q_->ring_fd = -1;
+}
+
+static
+void
+uring_queue_destroy(fuse_uring_queue *q_)
+{
+  uring_queue_unmap(q_);
+
+  for(auto ent : q_->ents)
+    {
+      msgbuf_page_align(ent->msgbuf);
+      msgbuf_free(ent->msgbuf);
+      delete ent;
+    }
+
+  delete q_;
+}
+
+static
+int
+uring_queue_setup_ring(fuse_uring_queue *q_,
+                       const unsigned    entries_)
+{
+  int fd;
+  char *sq;
+  char *cq;
+  struct io_uring_params p = {};
+
+  p.flags = IORING_SETUP_SQE128;
+
+  fd = syscall(__NR_io_uring_setup,entries_,&p);
+  if(fd == -1)
+    return -errno;
+
+  q_->ring_fd     = fd;
+  q_->sq_ptr_size = (p.sq_off.array + (p.sq_entries * sizeof(unsigned)));
+  q_->cq_ptr_size = (p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe)));
+  q_->sqes_size   = (p.sq_entries * FUSE_URING_SQE_SIZE);
+  if(p.features & IORING_FEAT_SINGLE_MMAP)
+    q_->sq_ptr_size = q_->cq_ptr_size = std::max(q_->sq_ptr_size,q_->cq_ptr_size);
+
+  q_->sq_ptr = mmap(NULL,q_->sq_ptr_size,
+                    PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+                    fd,IORING_OFF_SQ_RING);
+  if(q_->sq_ptr == MAP_FAILED)
+    return -errno;
+
+  if(p.features & IORING_FEAT_SINGLE_MMAP)
+    q_->cq_ptr = q_->sq_ptr;
+  else
+    q_->cq_ptr = mmap(NULL,q_->cq_ptr_size,
+                      PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+                      fd,IORING_OFF_CQ_RING);
+  if(q_->cq_ptr == MAP_FAILED)
+    return -errno;
+
+  q_->sqes = (char*)mmap(NULL,q_->sqes_size,
+                         PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+                         fd,IORING_OFF_SQES);
+  if(q_->sqes == MAP_FAILED)
+    return -errno;
+
+  sq = (char*)q_->sq_ptr;
+  cq = (char*)q_->cq_ptr;
+  q_->sq_head    = (unsigned*)(sq + p.sq_off.head);
+  q_->sq_tail    = (unsigned*)(sq + p.sq_off.tail);
+  q_->sq_mask    = (unsigned*)(sq + p.sq_off.ring_mask);
+  q_->sq_entries = (unsigned*)(sq + p.sq_off.ring_entries);
+  q_->sq_array   = (unsigned*)(sq + p.sq_off.array);
+  q_->cq_head    = (unsigned*)(cq + p.cq_off.head);
+  q_->cq_tail    = (unsigned*)(cq + p.cq_off.tail);
+  q_->cq_mask    = (unsigned*)(cq + p.cq_off.ring_mask);
+  q_->cqes       = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+  return 0;
+}
+
+static
+int
+uring_queue_new(fuse_session             *se_,
+                const int                 qid_,
+                const unsigned            depth_,
+                const FuseUringDispatch  &dispatch_,
+                fuse_uring_queue        **q_)
+{
+  int rv;
+  fuse_uring_queue *q;
+
+  q = new fuse_uring_queue();
+  q->se        = se_;
+  q->qid       = qid_;
+  q->dispatch  = dispatch_;
+  q->dev_fd    = fuse_chan_fd(se_->ch);
+  q->ring_fd   = -1;
+  q->to_submit = 0;
+  q->sq_ptr    = MAP_FAILED;
+  q->cq_ptr    = MAP_FAILED;
+  q->sqes      = (char*)MAP_FAILED;
+
+  rv = uring_queue_setup_ring(q,depth_ + 1);
+  if(rv < 0)
+    {
+      uring_queue_destroy(q);
+      return rv;
+    }
+
+  for(unsigned i = 0; i < depth_; i++)
+    {
+      fuse_uring_ent *ent;
+
+      ent = new fuse_uring_ent();
+      ent->q      = q;
+      ent->msgbuf = msgbuf_alloc_page_aligned();
+      if(ent->msgbuf == NULL)
+        {
+          delete ent;
+          uring_queue_destroy(q);
+          return -ENOMEM;
+        }
+
+      ent->iov[0].iov_base = &ent->hdr;
+      ent->iov[0].iov_len  = sizeof(ent->hdr);
+      ent->iov[1].iov_base = ent->msgbuf->mem;
+      ent->iov[1].iov_len  = ent->msgbuf->size;
+
+      q->ents.push_back(ent);
+    }
+
+  *q_ = q;
+
+  return 0;
+}
+
+// Called with the queue's lock held. Each entry has at most one
+// command outstanding and the SQ has room for one more for the stop
+// NOP.
+static
+struct io_uring_sqe*
+uring_queue_sqe(fuse_uring_queue *q_)
+{
+  unsigned idx;
+  unsigned head;
+  unsigned tail;
+  struct io_uring_sqe *sqe;
+
+  head = __atomic_load_n(q_->sq_head,__ATOMIC_ACQUIRE);
+  tail = *q_->sq_tail;
+  if((tail - head) >= *q_->sq_entries)
+    return NULL;
+
+  idx = (tail & *q_->sq_mask);
+  sqe = (struct io_uring_sqe*)(q_->sqes + (idx * FUSE_URING_SQE_SIZE));
+  memset(sqe,0,FUSE_URING_SQE_SIZE);
+
+  return sqe;
+}
+
+static
+void
+uring_queue_push(fuse_uring_queue *q_)
+{
+  unsigned idx;
+  unsigned tail;
+
+  tail = *q_->sq_tail;
+  idx  = (tail & *q_->sq_mask);
+
+  q_->sq_array[idx] = idx;
+  __atomic_store_n(q_->sq_tail,tail + 1,__ATOMIC_RELEASE);
+  q_->to_submit++;
+}
+
+// Called with the queue's lock held.
+static
+int
+uring_queue_submit(fuse_uring_queue *q_)
+{
+  int rv;
+
+  while(q_->to_submit)
+    {
+      rv = syscall(__NR_io_uring_enter,
+                   q_->ring_fd,
+                   q_->to_submit,
+                   0,
+                   0,
+                   NULL,
+                   0);
+      if(rv == -1)
+        {
+          if(errno == EINTR)
+            continue;
+          return -errno;
+        }
+      if(rv == 0)
+        break;
+
+      q_->to_submit -= rv;
+    }
+
+  return 0;
+}
+
+// Replies come from the process threads and are submitted right
+// away. Those made on the queue's own thread are left for it to
+// submit together before it next waits.
+static
+int
+uring_queue_cmd(fuse_uring_ent *ent_,
+                const uint32_t  cmd_op_)
+{
+  fuse_uring_queue *q;
+  struct io_uring_sqe *sqe;
+  struct fuse_uring_cmd_req *req;
+
+  q = ent_->q;
+
+  std::lock_guard<std::mutex> lg(q->lock);
+
+  sqe = uring_queue_sqe(q);
+  if(sqe == NULL)
+    return -EBUSY;
+
+  sqe->opcode    = IORING_OP_URING_CMD;
+  sqe->fd        = q->dev_fd;
+  sqe->cmd_op    = cmd_op_;
+  sqe->user_data = (uint64_t)(uintptr_t)ent_;
+  if(cmd_op_ == FUSE_IO_URING_CMD_REGISTER)
+    {
+      sqe->addr = (uint64_t)(uintptr_t)ent_->iov;
+      sqe->len  = 2;
+    }
+
+  req = (struct fuse_uring_cmd_req*)sqe->cmd;
+  req->qid       = q->qid;
+  req->commit_id = ent_->hdr.ring_ent_in_out.commit_id;
+
+  uring_queue_push(q);
+  if(pthread_equal(pthread_self(),q->thread))
+    return 0;
+
+  return uring_queue_submit(q);
+}
+
+/*
+  The kernel places the fuse_in_header and per opcode header in the
+  header buffer and the rest in the payload. The opcode header is
+  copied in front of the payload so the message looks as if it were
+  read from /dev/fuse. The payload stays page aligned.
+*/
+static
+void
+uring_process_ent(fuse_uring_ent *ent_)
+{
+  uint32_t op_sz;
+  uint32_t payload_sz;
+  uint64_t unique;
+  uint64_t replies;
+  fuse_msgbuf_t *msgbuf;
+  struct fuse_in_header *in;
+
+  msgbuf     = ent_->msgbuf;
+  in         = (struct fuse_in_header*)ent_->hdr.in_out;
+  payload_sz = ent_->hdr.ring_ent_in_out.payload_sz;
+
+  if((in->len < (sizeof(*in) + payload_sz)) ||
+     ((in->len - sizeof(*in) - payload_sz) > FUSE_URING_OP_IN_OUT_SZ))
+    return fuse_uring_send_errno(ent_,EIO,in->unique);
+
+  op_sz = (in->len - sizeof(*in) - payload_sz);
+
+  msgbuf_page_align(msgbuf);
+  msgbuf->mem  -= (sizeof(*in) + op_sz);
+  msgbuf->size += (sizeof(*in) + op_sz);
+  memcpy(msgbuf->mem,in,sizeof(*in));
+  memcpy(msgbuf->mem + sizeof(*in),ent_->hdr.op_in,op_sz);
+
+  // Once replied to the entry may already hold the next request so
+  // only the count of replies is looked at afterwards.
+  unique  = in->unique;
+  replies = ent_->replies.load(std::memory_order_acquire);
+  fuse_ll_process_uring(ent_->q->se,ent_,msgbuf);
+  if(ent_->replies.load(std::memory_order_acquire) == replies)
+    fuse_uring_send_errno(ent_,EIO,unique);
+}
+
+static
+void
+uring_dispatch_ent(fuse_uring_ent *ent_)
+{
+  fuse_uring_queue *q;
+
+  q = ent_->q;
+  if(!q->dispatch)
+    return uring_process_ent(ent_);
+
+  q->inflight.fetch_add(1,std::memory_order_relaxed);
+  q->dispatch(q->qid,
+              [ent_,q]()
+              {
+                uring_process_ent(ent_);
+                q->inflight.fetch_sub(1,std::memory_order_release);
+              });
+}
+
+static
+void
+uring_ent_error(fuse_uring_ent *ent_,
+                const int       err_)
+{
+  switch(err_)
+    {
+    case -ENOTCONN:
+    case -ECANCELED:
+    case -ENODEV:
+      break;
+    default:
+      syslog(LOG_ERR,
+             "fuse: io_uring queue %d entry failed: %s",
+             ent_->q->qid,
+             strerror(-err_));
+      break;
+    }
+}
+
+static
+void*
+uring_queue_thread(void *arg_)
+{
+  int rv;
+  size_t active;
+  fuse_uring_queue *q;
+
+  q = (fuse_uring_queue*)arg_;
+
+  pthread_setname_np(pthread_self(),"fuse.uring");
+
+  for(auto ent : q->ents)
+    uring_queue_cmd(ent,FUSE_IO_URING_CMD_REGISTER);
+
+  active = q->ents.size();
+  while(active && !q->stop.load(std::memory_order_acquire))
+    {
+      unsigned head;
+      unsigned tail;
+
+      {
+        std::lock_guard<std::mutex> lg(q->lock);
+        rv = uring_queue_submit(q);
+      }
+      if(rv < 0)
+        {
+          syslog(LOG_ERR,
+                 "fuse: io_uring submit failed on queue %d: %s",
+                 q->qid,
+                 strerror(-rv));
+          break;
+        }
+
+      rv = syscall(__NR_io_uring_enter,
+                   q->ring_fd,
+                   0,
+                   1,
+                   IORING_ENTER_GETEVENTS,
+                   NULL,
+                   0);
+      if(rv == -1)
+        {
+          if(errno == EINTR)
+            continue;
+          syslog(LOG_ERR,
+                 "fuse: io_uring_enter failed on queue %d: %s",
+                 q->qid,
+                 strerror(errno));
+          break;
+        }
+
+      head = *q->cq_head;
+      tail = __atomic_load_n(q->cq_tail,__ATOMIC_ACQUIRE);
+      for(; head != tail; head++)
+        {
+          fuse_uring_ent *ent;
+          struct io_uring_cqe *cqe;
+
+          cqe = &q->cqes[head & *q->cq_mask];
+          ent = (fuse_uring_ent*)(uintptr_t)cqe->user_data;
+          if(ent == NULL)
+            continue;
+          if(cqe->res < 0)
+            {
+              uring_ent_error(ent,cqe->res);
+              active--;
+              continue;
+            }
+
+          uring_dispatch_ent(ent);
+        }
+
+      __atomic_store_n(q->cq_head,head,__ATOMIC_RELEASE);
+    }
+
+  return NULL;
+}
+
+/*
+  A NOP wakes the queue's thread to see the stop flag. Requests
+  already handed to the process threads still reference the entries
+  so those are waited on before the queue is destroyed.
+*/
+static
+void
+uring_queue_stop(fuse_uring_queue *q_)
+{
+  timespec ts = {0,1000000};
+
+  q_->stop.store(true,std::memory_order_release);
+  {
+    struct io_uring_sqe *sqe;
+    std::lock_guard<std::mutex> lg(q_->lock);
+
+    sqe = uring_queue_sqe(q_);
+    if(sqe != NULL)
+      {
+        sqe->opcode    = IORING_OP_NOP;
+        sqe->user_data = 0;
+        uring_queue_push(q_);
+        uring_queue_submit(q_);
+      }
+  }
+
+  pthread_join(q_->thread,NULL);
+  while(q_->inflight.load(std::memory_order_acquire) > 0)
+    nanosleep(&ts,NULL);
+
+  uring_queue_destroy(q_);
+}
+
+int
+fuse_uring_start(struct fuse_session *se_)
+{
+  int rv;
+  int nr_queues;
+  unsigned depth;
+  FuseUringDispatch dispatch;
+  std::vector<fuse_uring_queue*> queues;
+
+  nr_queues = get_nprocs_conf();
+  depth     = std::max(1,fuse_config_get_io_uring_queue_depth());
+
+  {
+    std::lock_guard<std::mutex> lg(g_lock);
+    dispatch = g_dispatch;
+  }
+
+  for(int qid = 0; qid < nr_queues; qid++)
+    {
+      fuse_uring_queue *q;
+
+      rv = uring_queue_new(se_,qid,depth,dispatch,&q);
+      if(rv < 0)
+        goto err;
+
+      queues.push_back(q);
+    }
+
+  // The thread compares itself against q->thread under the lock.
+  for(auto q : queues)
+    {
+      {
+        std::lock_guard<std::mutex> lg(q->lock);
+        rv = fuse_start_thread(&q->thread,uring_queue_thread,q);
+      }
+      if(rv != 0)
+        {
+          rv = -EAGAIN;
+          goto err;
+        }
+
+      q->started = true;
+      CPU::setaffinity(q->thread,q->qid);
+    }
+
+  {
+    std::lock_guard<std::mutex> lg(g_lock);
+    g_queues = queues;
+  }
+
+  syslog(LOG_INFO,
+         "io-uring=true; "
+         "io-uring-queues=%d; "
+         "io-uring-queue-depth=%u;",
+         nr_queues,
+         depth);
+
+  return 0;
+
+ err:
+  syslog(LOG_ERR,
+         "fuse: unable to setup io_uring, using /dev/fuse: %s",
+         strerror(-rv));
+  for(auto q : queues)
+    {
+      if(q->started)
+        uring_queue_stop(q);
+      else
+        uring_queue_destroy(q);
+    }
+
+  return rv;
+}
+
+void
+fuse_uring_stop(void)
+{
+  std::vector<fuse_uring_queue*> queues;
+
+  {
+    std::lock_guard<std::mutex> lg(g_lock);
+    queues.swap(g_queues);
+    g_dispatch = nullptr;
+  }
+
+  for(auto q : queues)
+    uring_queue_stop(q);
+}
+
+void
+fuse_uring_set_dispatch(const FuseUringDispatch &dispatch_)
+{
+  std::lock_guard<std::mutex> lg(g_lock);
+
+  g_dispatch = dispatch_;
+}
+
+int
+fuse_uring_send_reply(struct fuse_uring_ent *ent_,
+                      struct iovec          *iov_,
+                      int                    count_)
+{
+  char *payload;
+  size_t off;
+  struct fuse_out_header *out;
+
+  out     = (struct fuse_out_header*)iov_[0].iov_base;
+  payload = (char*)ent_->iov[1].iov_base;
+
+  off = 0;
+  for(int i = 1; i < count_; i++)
+    {
+      if((off + iov_[i].iov_len) > ent_->iov[1].iov_len)
+        {
+          out->error = -EIO;
+          off = 0;
+          break;
+        }
+
+      memmove(payload + off,iov_[i].iov_base,iov_[i].iov_len);
+      off += iov_[i].iov_len;
+    }
+
+  out->len = (sizeof(*out) + off);
+  memcpy(ent_->hdr.in_out,out,sizeof(*out));
+  ent_->hdr.ring_ent_in_out.payload_sz = off;
+  ent_->replies.fetch_add(1,std::memory_order_release);
+
+  return uring_queue_cmd(ent_,FUSE_IO_URING_CMD_COMMIT_AND_FETCH);
+}
+
+#else
+
+int
+fuse_uring_start(struct fuse_session *se_)
+{
+  return -ENOTSUP;
+}
+
+void
+fuse_uring_stop(void)
+{
+}
+
+void
+fuse_uring_set_dispatch(const FuseUringDispatch &dispatch_)
+{
+}
+
+int
+fuse_uring_send_reply(struct fuse_uring_ent *ent_,
+                      struct iovec          *iov_,
+                      int                    count_)
+{
+  return -ENOTSUP;
+}
+
+#endif
+
+void
+fuse_uring_send_errno(struct fuse_uring_ent *ent_,
+                      const int              errno_,
+                      const uint64_t         unique_)
+{
+  struct iovec iov;
+  struct fuse_out_header out = {0};
+
+  out.unique   = unique_;
+  out.error    = -errno_;
+  iov.iov_base = &out;
+  iov.iov_len  = sizeof(out);
+
+  fuse_uring_send_reply(ent_,&iov,1);
+}
@@ -0,0 +1,51 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "fuse_msgbuf.h"
+
+#include "extern_c.h"
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+struct fuse_session;
+struct fuse_uring_ent;
+
+EXTERN_C_BEGIN
+
+int  fuse_uring_start(struct fuse_session *se);
+void fuse_uring_stop(void);
+int  fuse_uring_send_reply(struct fuse_uring_ent *ent,
+                           struct iovec          *iov,
+                           int                    count);
+void fuse_uring_send_errno(struct fuse_uring_ent *ent,
+                           const int              errno_,
+                           const uint64_t         unique);
+
+EXTERN_C_END
+
+#ifdef __cplusplus
+#include <functional>
+
+// Hands a request from io_uring queue `qid` to the process threads.
+typedef std::function<void(const int,std::function<void(void)>)> FuseUringDispatch;
+
+void fuse_uring_set_dispatch(const FuseUringDispatch &dispatch);
+#endif
@@ -22,15 +22,91 @@
 
 #include <pthread.h>
 
+#define LFMP_MAG_SIZE  64
+#define LFMP_MAG_BATCH 32
 
+/*
+  Each thread keeps a small stack of free objects (a magazine) per
+  pool so most allocs and frees never take the pool lock. When empty
+  or full a magazine is refilled from or flushed to the pool in
+  batches. Magazines are returned to the pool when their thread
+  exits. Objects sitting in magazines keep their slabs from being
+  gc'ed.
+*/
 typedef struct lfmp_t lfmp_t;
+typedef struct lfmp_mag_t lfmp_mag_t;
+typedef struct lfmp_stats_t lfmp_stats_t;
+
+struct lfmp_mag_t
+{
+  lfmp_t     *lfmp;
+  lfmp_mag_t *prev;
+  lfmp_mag_t *next;
+  uint64_t    generation;
+  uint64_t    hits;
+  uint64_t    count;
+  void       *objs[LFMP_MAG_SIZE];
+};
+
 struct lfmp_t
 {
   fmp_t fmp;
   pthread_mutex_t lock;
+  pthread_key_t   mag_key;
+  lfmp_mag_t     *mags;
+  uint64_t        generation;
+  uint64_t        mag_hits;
+  uint64_t        mag_refills;
+  uint64_t        mag_flushes;
+};
+
+struct lfmp_stats_t
+{
+  uint64_t mags;
+  uint64_t cached_objs;
+  uint64_t hits;
+  uint64_t refills;
+  uint64_t flushes;
 };
 
 
+static
+inline
+void
+lfmp_mag_unlink(lfmp_t     *lfmp_,
+                lfmp_mag_t *mag_)
+{
+  if(mag_->prev)
+    mag_->prev->next = mag_->next;
+  else
+    lfmp_->mags = mag_->next;
+  if(mag_->next)
+    mag_->next->prev = mag_->prev;
+}
+
+static
+inline
+void
+lfmp_mag_destructor(void *data_)
+{
+  lfmp_t *lfmp;
+  lfmp_mag_t *mag = (lfmp_mag_t*)data_;
+
+  lfmp = mag->lfmp;
+
+  pthread_mutex_lock(&lfmp->lock);
+  if(mag->generation == lfmp->generation)
+    {
+      while(mag->count)
+        fmp_free(&lfmp->fmp,mag->objs[--mag->count]);
+    }
+  lfmp->mag_hits += mag->hits;
+  lfmp_mag_unlink(lfmp,mag);
+  pthread_mutex_unlock(&lfmp->lock);
+
+  free(mag);
+}
+
 static
 inline
 void
@@ -40,6 +116,64 @@ lfmp_init(lfmp_t         *lfmp_,
 {
   fmp_init(&lfmp_->fmp,obj_size_,page_multiple_);
   pthread_mutex_init(&lfmp_->lock,NULL);
+  pthread_key_create(&lfmp_->mag_key,lfmp_mag_destructor);
+  lfmp_->mags        = NULL;
+  lfmp_->generation  = 0;
+  lfmp_->mag_hits    = 0;
+  lfmp_->mag_refills = 0;
+  lfmp_->mag_flushes = 0;
+}
+
+static
+inline
+lfmp_mag_t*
+lfmp_mag(lfmp_t *lfmp_)
+{
+  lfmp_mag_t *mag;
+
+  mag = (lfmp_mag_t*)pthread_getspecific(lfmp_->mag_key);
+  if(mag != NULL)
+    return mag;
+
+  mag = (lfmp_mag_t*)calloc(1,sizeof(lfmp_mag_t));
+  if(mag == NULL)
+    return NULL;
+
+  mag->lfmp = lfmp_;
+
+  pthread_mutex_lock(&lfmp_->lock);
+  mag->generation = lfmp_->generation;
+  mag->next       = lfmp_->mags;
+  if(mag->next)
+    mag->next->prev = mag;
+  lfmp_->mags = mag;
+  pthread_mutex_unlock(&lfmp_->lock);
+
+  pthread_setspecific(lfmp_->mag_key,mag);
+
+  return mag;
+}
+
+/*
+  A clear or destroy of the pool invalidates whatever magazines
+  hold. They are simply dropped as the memory is already gone.
+*/
+static
+inline
+int
+lfmp_mag_valid(lfmp_t     *lfmp_,
+               lfmp_mag_t *mag_)
+{
+  uint64_t generation;
+
+  generation = __atomic_load_n(&lfmp_->generation,__ATOMIC_RELAXED);
+  if(mag_->generation == generation)
+    return 1;
+
+  mag_->count      = 0;
+  mag_->generation = generation;
+
+  return 0;
 }
 
 static
@@ -92,12 +226,40 @@ void*
 lfmp_alloc(lfmp_t *lfmp_)
 {
   void *rv;
+  lfmp_mag_t *mag;
+
+  mag = lfmp_mag(lfmp_);
+  if(mag == NULL)
+    {
+      pthread_mutex_lock(&lfmp_->lock);
+      rv = fmp_alloc(&lfmp_->fmp);
+      pthread_mutex_unlock(&lfmp_->lock);
+
+      return rv;
+    }
+
+  lfmp_mag_valid(lfmp_,mag);
+  if(mag->count)
+    {
+      mag->hits++;
+      return mag->objs[--mag->count];
+    }
 
   pthread_mutex_lock(&lfmp_->lock);
-  rv = fmp_alloc(&lfmp_->fmp);
+  lfmp_->mag_refills++;
+  while(mag->count < LFMP_MAG_BATCH)
+    {
+      rv = fmp_alloc(&lfmp_->fmp);
+      if(rv == NULL)
+        break;
+      mag->objs[mag->count++] = rv;
+    }
   pthread_mutex_unlock(&lfmp_->lock);
 
-  return rv;
+  if(mag->count == 0)
+    return NULL;
+
+  return mag->objs[--mag->count];
 }
 
 static
@@ -107,9 +269,11 @@ lfmp_calloc(lfmp_t *lfmp_)
 {
   void *rv;
 
-  pthread_mutex_lock(&lfmp_->lock);
-  rv = fmp_calloc(&lfmp_->fmp);
-  pthread_mutex_unlock(&lfmp_->lock);
+  rv = lfmp_alloc(lfmp_);
+  if(rv == NULL)
+    return NULL;
+
+  memset(rv,0,lfmp_->fmp.obj_size);
 
   return rv;
 }
@@ -120,27 +284,66 @@ void
 lfmp_free(lfmp_t *lfmp_,
           void   *obj_)
 {
-  pthread_mutex_lock(&lfmp_->lock);
-  fmp_free(&lfmp_->fmp,obj_);
-  pthread_mutex_unlock(&lfmp_->lock);
+  lfmp_mag_t *mag;
+
+  mag = lfmp_mag(lfmp_);
+  if((mag == NULL) || !lfmp_mag_valid(lfmp_,mag))
+    {
+      pthread_mutex_lock(&lfmp_->lock);
+      fmp_free(&lfmp_->fmp,obj_);
+      pthread_mutex_unlock(&lfmp_->lock);
+      return;
+    }
+
+  if(mag->count == LFMP_MAG_SIZE)
+    {
+      pthread_mutex_lock(&lfmp_->lock);
+      lfmp_->mag_flushes++;
+      while(mag->count > (LFMP_MAG_SIZE - LFMP_MAG_BATCH))
+        fmp_free(&lfmp_->fmp,mag->objs[--mag->count]);
+      pthread_mutex_unlock(&lfmp_->lock);
+    }
+
+  mag->objs[mag->count++] = obj_;
 }
 
+/*
+  Must not run concurrently with alloc or free. A thread which
+  checked its magazine's generation just before the clear would still
+  hand out an object from the freed slabs.
+*/
 static
 inline
 void
 lfmp_clear(lfmp_t *lfmp_)
 {
   pthread_mutex_lock(&lfmp_->lock);
+  __atomic_add_fetch(&lfmp_->generation,1,__ATOMIC_RELAXED);
   fmp_clear(&lfmp_->fmp);
   pthread_mutex_unlock(&lfmp_->lock);
 }
 
+/*
+  pthread_key_delete runs no destructors so the magazines of threads
+  still alive are freed here. As with clear, nothing may be using the
+  pool.
+*/
 static
 inline
 void
 lfmp_destroy(lfmp_t *lfmp_)
 {
+  lfmp_mag_t *mag;
+
+  pthread_key_delete(lfmp_->mag_key);
   pthread_mutex_lock(&lfmp_->lock);
+  __atomic_add_fetch(&lfmp_->generation,1,__ATOMIC_RELAXED);
+  while(lfmp_->mags != NULL)
+    {
+      mag = lfmp_->mags;
+      lfmp_->mags = mag->next;
+      free(mag);
+    }
   fmp_destroy(&lfmp_->fmp);
   pthread_mutex_unlock(&lfmp_->lock);
   pthread_mutex_destroy(&lfmp_->lock);
@@ -241,3 +444,28 @@ lfmp_total_allocated_memory(lfmp_t *lfmp_)
 
   return rv;
 }
+
+/*
+  Counts owned by other threads' magazines are read without
+  synchronization so the numbers are approximate.
+*/
+static
+inline
+void
+lfmp_stats(lfmp_t       *lfmp_,
+           lfmp_stats_t *stats_)
+{
+  pthread_mutex_lock(&lfmp_->lock);
+  stats_->mags        = 0;
+  stats_->cached_objs = 0;
+  stats_->hits        = lfmp_->mag_hits;
+  stats_->refills     = lfmp_->mag_refills;
+  stats_->flushes     = lfmp_->mag_flushes;
+  for(lfmp_mag_t *mag = lfmp_->mags; mag != NULL; mag = mag->next)
+    {
+      stats_->mags++;
+      stats_->cached_objs += __atomic_load_n(&mag->count,__ATOMIC_RELAXED);
+      stats_->hits        += __atomic_load_n(&mag->hits,__ATOMIC_RELAXED);
+    }
+  pthread_mutex_unlock(&lfmp_->lock);
+}
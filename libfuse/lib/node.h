@@ -4,9 +4,6 @@
 typedef struct node_s node_t;
 struct node_s
 {
-  node_t *name_next;
-  node_t *id_next;
-
   uint64_t nodeid;
   char *name;
   node_t *parent;
@@ -15,6 +12,7 @@ struct node_s
   uint32_t refctr;
   uint32_t open_count;
   uint64_t hidden_fh;
+  int32_t backing_id;
 
   int32_t treelock;
   lock_t *locks;
@@ -0,0 +1,174 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "branch.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <string>
+
+
+/*
+  The branches a policy picked. Holds pointers into the branch list
+  given to the policy rather than copies of their paths so it's only
+  valid while that list is. The first few are stored inline so
+  evaluating a policy doesn't allocate. Iterating yields the branch
+  paths.
+*/
+class BasePaths
+{
+public:
+  enum { INLINE_SIZE = 8 };
+
+public:
+  class const_iterator
+  {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::string               value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const std::string*        pointer;
+    typedef const std::string&        reference;
+
+  public:
+    const_iterator(const Branch *const *p_)
+      : _p(p_)
+    {
+    }
+
+  public:
+    reference operator*()  const { return (*_p)->path; }
+    pointer   operator->() const { return &(*_p)->path; }
+
+    const_iterator&
+    operator++()
+    {
+      ++_p;
+      return *this;
+    }
+
+    bool operator==(const const_iterator &o_) const { return (_p == o_._p); }
+    bool operator!=(const const_iterator &o_) const { return (_p != o_._p); }
+
+  private:
+    const Branch *const *_p;
+  };
+
+public:
+  BasePaths()
+    : _data(_inline),
+      _size(0),
+      _capacity(INLINE_SIZE)
+  {
+  }
+
+  BasePaths(const BasePaths &o_)
+    : BasePaths()
+  {
+    *this = o_;
+  }
+
+  ~BasePaths()
+  {
+    if(_data != _inline)
+      delete[] _data;
+  }
+
+  BasePaths&
+  operator=(const BasePaths &o_)
+  {
+    if(this == &o_)
+      return *this;
+
+    clear();
+    reserve(o_._size);
+    std::copy(o_._data,o_._data + o_._size,_data);
+    _size = o_._size;
+
+    return *this;
+  }
+
+public:
+  void
+  push_back(const Branch &branch_)
+  {
+    if(_size == _capacity)
+      reserve(_capacity * 2);
+
+    _data[_size++] = &branch_;
+  }
+
+  void
+  reserve(const std::size_t capacity_)
+  {
+    const Branch **data;
+
+    if(capacity_ <= _capacity)
+      return;
+
+    data = new const Branch*[capacity_];
+    std::copy(_data,_data + _size,data);
+    if(_data != _inline)
+      delete[] _data;
+
+    _data     = data;
+    _capacity = capacity_;
+  }
+
+  // Keeps only the idx'th entry.
+  void
+  keep(const std::size_t idx_)
+  {
+    _data[0] = _data[idx_];
+    _size    = 1;
+  }
+
+  void
+  clear(void)
+  {
+    _size = 0;
+  }
+
+public:
+  std::size_t size(void)  const { return _size; }
+  bool        empty(void) const { return (_size == 0); }
+
+  const std::string&
+  operator[](const std::size_t idx_) const
+  {
+    return _data[idx_]->path;
+  }
+
+  const Branch&
+  branch(const std::size_t idx_) const
+  {
+    return *_data[idx_];
+  }
+
+  const_iterator begin(void) const { return const_iterator(_data); }
+  const_iterator end(void)   const { return const_iterator(_data + _size); }
+
+private:
+  const Branch **_data;
+  std::size_t    _size;
+  std::size_t    _capacity;
+  const Branch  *_inline[INLINE_SIZE];
+};
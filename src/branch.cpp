@@ -17,13 +17,141 @@
 */
 
 #include "branch.hpp"
+#include "branch_io.hpp"
+#include "dir_filter.hpp"
 #include "ef.hpp"
 #include "errno.hpp"
+#include "fs_close.hpp"
+#include "fs_fstat.hpp"
+#include "fs_open.hpp"
+#include "fs_stat.hpp"
+#include "fs_statvfs_cache.hpp"
 #include "num.hpp"
+#include "syslog.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <sys/stat.h>
+#include <time.h>
+
+
+namespace l
+{
+  static
+  uint64_t
+  get_time(void)
+  {
+    struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE,&ts);
+#else
+    ::clock_gettime(CLOCK_MONOTONIC,&ts);
+#endif
+
+    return ts.tv_sec;
+  }
+}
+
+/*
+  fd is what callers use, -1 if the root couldn't be opened. Every fd
+  ever opened is kept until the last copy of the branch goes away as
+  a caller may still be using one which was replaced.
+*/
+struct Branch::Dir
+{
+  Dir(const std::string &path_)
+    : path(path_),
+      fd(-1),
+      checked(l::get_time()),
+      dev(0),
+      ino(0)
+  {
+  }
+
+  ~Dir()
+  {
+    for(const auto fd : fds)
+      fs::close(fd);
+  }
+
+  bool reopen(void);
+  bool revalidate(void);
+
+  const std::string     path;
+  std::atomic<int>      fd;
+  std::atomic<uint64_t> checked;
+  std::mutex            mutex;
+  dev_t                 dev;
+  ino_t                 ino;
+  std::vector<int>      fds;
+};
+
+// Called with mutex held.
+bool
+Branch::Dir::reopen(void)
+{
+  int rv;
+  int newfd;
+  struct stat st;
+
+  newfd = fs::open_dir_path(path);
+  if(newfd == -1)
+    {
+      fd.store(-1,std::memory_order_release);
+      return false;
+    }
+
+  rv = fs::fstat(newfd,&st);
+  if(rv == -1)
+    {
+      fs::close(newfd);
+      fd.store(-1,std::memory_order_release);
+      return false;
+    }
+
+  dev = st.st_dev;
+  ino = st.st_ino;
+  fds.push_back(newfd);
+  fd.store(newfd,std::memory_order_release);
+
+  return true;
+}
+
+// True if the path now refers to something other than the fd.
+bool
+Branch::Dir::revalidate(void)
+{
+  int rv;
+  struct stat st;
+  std::lock_guard<std::mutex> lg(mutex);
+
+  rv = fs::stat(path,&st);
+  if((rv == 0) &&
+     (fd.load(std::memory_order_relaxed) != -1) &&
+     (st.st_dev == dev) &&
+     (st.st_ino == ino))
+    return false;
+  if((rv == -1) && (fd.load(std::memory_order_relaxed) == -1))
+    return false;
+
+  reopen();
+  syslog_notice("%s - branch root changed, %s",
+                path.c_str(),
+                ((fd.load(std::memory_order_relaxed) == -1) ?
+                 "using the path" :
+                 "reopened"));
+
+  return true;
+}
 
 
 Branch::Branch(const uint64_t &default_minfreespace_)
-  : _default_minfreespace(&default_minfreespace_)
+  : _default_minfreespace(&default_minfreespace_),
+    _io(NULL),
+    _dir_filter(NULL)
 {
 }
 
@@ -69,6 +197,12 @@ Branch::set_minfreespace(const uint64_t minfreespace_)
   _minfreespace = minfreespace_;
 }
 
+void
+Branch::set_default_minfreespace(const uint64_t &default_minfreespace_)
+{
+  _default_minfreespace = &default_minfreespace_;
+}
+
 uint64_t
 Branch::minfreespace(void) const
 {
@@ -95,3 +229,78 @@ Branch::ro_or_nc(void) const
   return ((mode == Branch::Mode::RO) ||
           (mode == Branch::Mode::NC));
 }
+
+/*
+  A directory fd for the branch root so getattr, open and existence
+  checks can use *at() calls relative to it rather than building and
+  walking the full path each time. Copies of the branch share the fd
+  so in flight requests holding an older branch list stay valid
+  across runtime changes. -1 if the branch could not be opened in
+  which case callers use the path.
+
+  Everything else, create, mkdir, rename, unlink and such, goes by
+  path. Should something be mounted over or unmounted from the
+  branch path the fd would keep pointing at what was there before
+  while those follow the path. So at most once a second the path's
+  st_dev and st_ino are compared with the fd's and on a mismatch the
+  path is reopened and the statvfs cache expired. Until then, up to a
+  second after the mount changes, the two may disagree.
+
+  The statvfs cache entry describes whatever the fd pins so it is
+  replaced and seeded along with it. The executor is keyed by path
+  and outlives the branch as does the directory filter.
+*/
+void
+Branch::open_fd(void)
+{
+  _statvfs_cache = std::make_shared<fs::StatVFSCacheEntry>();
+  _io = BranchIO::get(path);
+  _dir_filter = DirFilter::get(path);
+
+  _dir = std::make_shared<Dir>(path);
+  {
+    std::lock_guard<std::mutex> lg(_dir->mutex);
+    _dir->reopen();
+  }
+
+  fs::statvfs_cache_seed(*this);
+}
+
+int
+Branch::fd(void) const
+{
+  uint64_t now;
+  uint64_t checked;
+
+  if(!_dir)
+    return -1;
+
+  now     = l::get_time();
+  checked = _dir->checked.load(std::memory_order_relaxed);
+  if((now != checked) &&
+     _dir->checked.compare_exchange_strong(checked,now,
+                                           std::memory_order_relaxed) &&
+     _dir->revalidate() &&
+     _statvfs_cache)
+    _statvfs_cache->time.store(0,std::memory_order_relaxed);
+
+  return _dir->fd.load(std::memory_order_acquire);
+}
+
+fs::StatVFSCacheEntry*
+Branch::statvfs_cache(void) const
+{
+  return _statvfs_cache.get();
+}
+
+BranchIO*
+Branch::io(void) const
+{
+  return _io;
+}
+
+DirFilter*
+Branch::dir_filter(void) const
+{
+  return _dir_filter;
+}
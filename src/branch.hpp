@@ -23,10 +23,15 @@
 #include "tofrom_string.hpp"
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 
+class BranchIO;
+class DirFilter;
+namespace fs { class StatVFSCacheEntry; }
+
 class Branch final : public ToFromString
 {
 public:
@@ -56,12 +61,29 @@ public:
 public:
   uint64_t minfreespace() const;
   void set_minfreespace(const uint64_t);
+  void set_default_minfreespace(const uint64_t &);
+
+public:
+  int  fd(void) const;
+  void open_fd(void);
+
+public:
+  fs::StatVFSCacheEntry* statvfs_cache(void) const;
+  BranchIO* io(void) const;
+  DirFilter* dir_filter(void) const;
 
 public:
   Mode mode;
   std::string path;
 
+private:
+  struct Dir;
+
 private:
   nonstd::optional<uint64_t>  _minfreespace;
   const uint64_t             *_default_minfreespace;
+  std::shared_ptr<Dir>        _dir;
+  std::shared_ptr<fs::StatVFSCacheEntry> _statvfs_cache;
+  BranchIO                               *_io;
+  DirFilter                              *_dir_filter;
 };
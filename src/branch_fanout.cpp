@@ -0,0 +1,178 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "branch_fanout.hpp"
+
+#include "ugid.hpp"
+
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+static std::atomic<unsigned>       g_THREADS(0);
+static std::atomic<unsigned>       g_MIN_BRANCHES(3);
+static std::once_flag              g_TP_ONCE;
+static std::unique_ptr<ThreadPool> g_TP;
+
+namespace l
+{
+  static
+  bool
+  concurrent(const BasePaths &basepaths_)
+  {
+    unsigned threads;
+
+    threads = BranchFanOut::threads();
+    if(threads == 0)
+      return false;
+    if(basepaths_.size() < 2)
+      return false;
+
+    return (basepaths_.size() >= BranchFanOut::min_branches());
+  }
+
+  /*
+    The caller waits for every task so they can refer to its stack.
+  */
+  static
+  void
+  run_concurrent(const BasePaths          &basepaths_,
+                 const BranchFanOut::Func &func_,
+                 std::vector<int>         &errs_)
+  {
+    uid_t uid;
+    gid_t gid;
+    std::size_t remaining;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::call_once(g_TP_ONCE,
+                   []()
+                   {
+                     unsigned threads;
+
+                     threads = BranchFanOut::threads();
+                     g_TP.reset(new ThreadPool(threads,threads * 4,"fanout"));
+                   });
+
+    uid = ugid::currentuid;
+    gid = ugid::currentgid;
+
+    errs_.resize(basepaths_.size());
+    remaining = (basepaths_.size() - 1);
+    for(std::size_t i = 1; i < basepaths_.size(); i++)
+      {
+        g_TP->enqueue_work([&,i]()
+        {
+          int err;
+          const ugid::Set ugid(uid,gid);
+
+          err = func_(basepaths_[i]);
+
+          std::lock_guard<std::mutex> lg(mutex);
+          errs_[i] = err;
+          if(--remaining == 0)
+            cv.notify_one();
+        });
+      }
+
+    errs_[0] = func_(basepaths_[0]);
+
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait(lk,[&remaining]() { return (remaining == 0); });
+  }
+}
+
+unsigned
+BranchFanOut::threads(void)
+{
+  return g_THREADS.load(std::memory_order_relaxed);
+}
+
+void
+BranchFanOut::threads(const unsigned threads_)
+{
+  g_THREADS.store(threads_,std::memory_order_relaxed);
+}
+
+unsigned
+BranchFanOut::min_branches(void)
+{
+  return g_MIN_BRANCHES.load(std::memory_order_relaxed);
+}
+
+void
+BranchFanOut::min_branches(const unsigned min_branches_)
+{
+  g_MIN_BRANCHES.store(min_branches_,std::memory_order_relaxed);
+}
+
+void
+BranchFanOut::run(const BasePaths &basepaths_,
+                  const Func      &func_,
+                  PolicyRV        *prv_)
+{
+  std::vector<int> errs;
+
+  if(!l::concurrent(basepaths_))
+    {
+      for(const auto &basepath : basepaths_)
+        prv_->insert(func_(basepath),basepath);
+      return;
+    }
+
+  l::run_concurrent(basepaths_,func_,errs);
+  for(std::size_t i = 0; i < basepaths_.size(); i++)
+    prv_->insert(errs[i],basepaths_[i]);
+}
+
+int
+BranchFanOut::run(const BasePaths &basepaths_,
+                  const Func      &func_)
+{
+  int err;
+  int first;
+  std::vector<int> errs;
+
+  first = 0;
+  if(!l::concurrent(basepaths_))
+    {
+      for(const auto &basepath : basepaths_)
+        {
+          err = func_(basepath);
+          if(first == 0)
+            first = err;
+        }
+
+      return first;
+    }
+
+  l::run_concurrent(basepaths_,func_,errs);
+  for(const auto e : errs)
+    {
+      if(first == 0)
+        first = e;
+    }
+
+  return first;
+}
@@ -0,0 +1,58 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "basepaths.hpp"
+#include "policy_rv.hpp"
+
+#include <functional>
+#include <string>
+
+
+/*
+  Applies an operation to each branch an action policy returned. With
+  fanout-threads set and at least fanout-min-branches branches the
+  branches are done concurrently on a shared pool with the calling
+  thread doing the first. Otherwise they are done in order on the
+  calling thread. Pool threads take on the caller's uid and gid.
+
+  The function returns 0 or an errno. Results are gathered in branch
+  order either way so error selection doesn't change.
+*/
+class BranchFanOut
+{
+public:
+  typedef std::function<int(const std::string&)> Func;
+
+public:
+  static unsigned threads(void);
+  static void     threads(const unsigned);
+  static unsigned min_branches(void);
+  static void     min_branches(const unsigned);
+
+public:
+  // Records each result in prv.
+  static void run(const BasePaths &basepaths,
+                  const Func      &func,
+                  PolicyRV        *prv);
+
+  // Returns the first error in branch order.
+  static int  run(const BasePaths &basepaths,
+                  const Func      &func);
+};
@@ -0,0 +1,300 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "branch_io.hpp"
+
+#include "branch.hpp"
+#include "syslog.hpp"
+#include "ugid.hpp"
+
+#include "fuse.h"
+
+#include "thread_pool.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+
+
+#define QUEUE_DEPTH_PER_THREAD 4
+
+static std::atomic<unsigned> g_THREADS(0);
+static std::atomic<uint64_t> g_TIMEOUT(10);
+static std::atomic<bool>     g_FAST_FAIL(true);
+
+static std::mutex                        g_REGISTRY_LOCK;
+static std::map<std::string,BranchIO*>  *g_REGISTRY = new std::map<std::string,BranchIO*>();
+
+namespace
+{
+  enum class Phase
+    {
+     PENDING,
+     DONE,
+     ABANDONED
+    };
+}
+
+// Shared between the caller and the task. The caller may give up
+// waiting and return before the task runs or finishes.
+struct BranchIO::Pending
+{
+  std::mutex                            mutex;
+  std::condition_variable               cv;
+  Phase                                 phase;
+  int                                   rv;
+  bool                                  timeout;
+  std::chrono::steady_clock::time_point deadline;
+};
+
+BranchIO*
+BranchIO::get(const std::string &path_)
+{
+  BranchIO *io;
+  std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+
+  io = (*g_REGISTRY)[path_];
+  if(io == NULL)
+    {
+      io = new BranchIO(path_);
+      (*g_REGISTRY)[path_] = io;
+    }
+
+  return io;
+}
+
+unsigned
+BranchIO::threads(void)
+{
+  return g_THREADS.load(std::memory_order_relaxed);
+}
+
+void
+BranchIO::threads(const unsigned threads_)
+{
+  g_THREADS.store(threads_,std::memory_order_relaxed);
+}
+
+uint64_t
+BranchIO::timeout(void)
+{
+  return g_TIMEOUT.load(std::memory_order_relaxed);
+}
+
+void
+BranchIO::timeout(const uint64_t timeout_)
+{
+  g_TIMEOUT.store(timeout_,std::memory_order_relaxed);
+}
+
+bool
+BranchIO::fast_fail(void)
+{
+  return g_FAST_FAIL.load(std::memory_order_relaxed);
+}
+
+void
+BranchIO::fast_fail(const bool fast_fail_)
+{
+  g_FAST_FAIL.store(fast_fail_,std::memory_order_relaxed);
+}
+
+BranchIO::BranchIO(const std::string &path_)
+  : _path(path_),
+    _stalled(0)
+{
+}
+
+bool
+BranchIO::healthy(void) const
+{
+  return (_stalled.load(std::memory_order_relaxed) == 0);
+}
+
+void
+BranchIO::stalled(void)
+{
+  if(_stalled.fetch_add(1) != 0)
+    return;
+
+  syslog_warning("%s - branch request exceeded %lus, marking unhealthy",
+                 _path.c_str(),
+                 BranchIO::timeout());
+}
+
+void
+BranchIO::recovered(void)
+{
+  if(_stalled.fetch_sub(1) != 1)
+    return;
+
+  syslog_notice("%s - branch requests completed, marking healthy",
+                _path.c_str());
+}
+
+/*
+  Runs inline when disabled. The thread count is only read when the
+  pool is first used. The deadline is fixed at submission so waiting
+  on several in turn is bounded by the timeout as a whole.
+*/
+BranchIO::PendingPtr
+BranchIO::submit(std::function<int(void)> func_,
+                 std::function<void(int)> orphaned_)
+{
+  uint64_t timeout;
+  PendingPtr state;
+
+  state = std::make_shared<Pending>();
+  state->phase = Phase::DONE;
+  state->rv    = 0;
+
+  if(BranchIO::threads() == 0)
+    {
+      state->rv = func_();
+      return state;
+    }
+
+  std::call_once(_tp_once,
+                 [this]()
+                 {
+                   unsigned threads;
+
+                   threads = BranchIO::threads();
+                   _tp.reset(new ThreadPool(threads,
+                                            threads * QUEUE_DEPTH_PER_THREAD,
+                                            "branch.io"));
+                 });
+
+  state->rv = -EIO;
+  if(BranchIO::fast_fail() && !healthy())
+    return state;
+
+  timeout = BranchIO::timeout();
+  state->phase    = Phase::PENDING;
+  state->rv       = 0;
+  state->timeout  = (timeout != 0);
+  state->deadline = (std::chrono::steady_clock::now() +
+                     std::chrono::seconds(timeout));
+
+  _tp->enqueue_work([this,state,func_,orphaned_]()
+  {
+    int rv;
+    bool abandoned;
+
+    {
+      std::lock_guard<std::mutex> lg(state->mutex);
+      abandoned = (state->phase == Phase::ABANDONED);
+    }
+
+    rv = (abandoned ? -EIO : func_());
+
+    {
+      std::lock_guard<std::mutex> lg(state->mutex);
+      abandoned = (state->phase == Phase::ABANDONED);
+      state->phase = Phase::DONE;
+      state->rv    = rv;
+      state->cv.notify_one();
+    }
+
+    if(abandoned)
+      recovered();
+    if(abandoned && orphaned_)
+      orphaned_(rv);
+  });
+
+  return state;
+}
+
+int
+BranchIO::wait(const PendingPtr &state_)
+{
+  bool done;
+
+  std::unique_lock<std::mutex> lk(state_->mutex);
+  auto pred = [&state_]() { return (state_->phase == Phase::DONE); };
+  if(!state_->timeout)
+    {
+      state_->cv.wait(lk,pred);
+      done = true;
+    }
+  else
+    {
+      done = state_->cv.wait_until(lk,state_->deadline,pred);
+    }
+
+  if(done)
+    return state_->rv;
+
+  state_->phase = Phase::ABANDONED;
+  stalled();
+
+  return -EIO;
+}
+
+int
+BranchIO::run(std::function<int(void)> func_,
+              std::function<void(int)> orphaned_)
+{
+  return wait(submit(std::move(func_),std::move(orphaned_)));
+}
+
+bool
+BranchIO::enabled(const Branch &branch_)
+{
+  return ((branch_.io() != NULL) && (BranchIO::threads() != 0));
+}
+
+int
+BranchIO::run_on(const Branch             &branch_,
+                 BranchFunc                func_,
+                 std::function<void(int)>  orphaned_)
+{
+  if(!BranchIO::enabled(branch_))
+    return func_(branch_);
+
+  Branch branch(branch_);
+
+  return branch_.io()->run([branch,func_]()
+  {
+    return func_(branch);
+  },
+  std::move(orphaned_));
+}
+
+int
+BranchIO::run_as(const Branch             &branch_,
+                 BranchFunc                func_,
+                 std::function<void(int)>  orphaned_)
+{
+  if(!BranchIO::enabled(branch_))
+    return func_(branch_);
+
+  const fuse_context *fc = fuse_get_context();
+  const uid_t uid = fc->uid;
+  const gid_t gid = fc->gid;
+  Branch branch(branch_);
+
+  return branch_.io()->run([uid,gid,branch,func_]()
+  {
+    const ugid::Set ugid(uid,gid);
+
+    return func_(branch);
+  },
+  std::move(orphaned_));
+}
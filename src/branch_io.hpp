@@ -0,0 +1,103 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class Branch;
+class ThreadPool;
+
+
+/*
+  A bounded executor per branch. Probes of a branch made while
+  choosing one for a request are run on that branch's own threads
+  and waited on with a timeout so a branch which hangs only ties up
+  its own threads rather than the FUSE process threads.
+  Probes of several branches can be submitted together and waited on
+  afterwards. The same goes for the operation on the branch finally
+  chosen. Should the caller give up on something which acquires a
+  resource, such as an open, the result is handed to a cleanup
+  function once it does complete.
+
+  Submitting blocks once the pool's queue is full. A branch with
+  requests which timed out and have yet to return is considered
+  unhealthy. If fast fail is enabled further requests to it fail with
+  EIO immediately rather than queuing. It becomes healthy again once
+  they complete.
+
+  Executors are looked up by path and never freed. Threads stuck in
+  the kernel on a dead mount can't be joined and the state carries
+  over if the branch is removed and added back.
+*/
+class BranchIO
+{
+public:
+  static BranchIO* get(const std::string &path);
+
+  static unsigned threads(void);
+  static void     threads(const unsigned);
+  static uint64_t timeout(void);
+  static void     timeout(const uint64_t);
+  static bool     fast_fail(void);
+  static void     fast_fail(const bool);
+
+public:
+  typedef std::function<int(const Branch&)> BranchFunc;
+
+  // Whether requests to the branch are run on its executor.
+  static bool enabled(const Branch &branch);
+  // Runs func on a copy of the branch, inline if not enabled.
+  static int  run_on(const Branch             &branch,
+                     BranchFunc                func,
+                     std::function<void(int)>  orphaned = NULL);
+  // As run_on but with the calling FUSE request's uid and gid.
+  static int  run_as(const Branch             &branch,
+                     BranchFunc                func,
+                     std::function<void(int)>  orphaned = NULL);
+
+private:
+  BranchIO(const std::string &path);
+
+public:
+  struct Pending;
+  typedef std::shared_ptr<Pending> PendingPtr;
+
+public:
+  PendingPtr submit(std::function<int(void)> func,
+                    std::function<void(int)> orphaned = NULL);
+  int        wait(const PendingPtr &pending);
+  int        run(std::function<int(void)> func,
+                 std::function<void(int)> orphaned = NULL);
+  bool       healthy(void) const;
+
+private:
+  void stalled(void);
+  void recovered(void);
+
+private:
+  const std::string           _path;
+  std::once_flag              _tp_once;
+  std::unique_ptr<ThreadPool> _tp;
+  std::atomic<unsigned>       _stalled;
+};
@@ -42,13 +42,17 @@ Branches::Impl::Impl(const uint64_t &default_minfreespace_)
 {
 }
 
+// Branches take on the default minfreespace of the Impl they are
+// assigned into.
 Branches::Impl&
-Branches::Impl::operator=(Branches::Impl &rval_)
+Branches::Impl::operator=(const Branches::Impl &rval_)
 {
   auto this_base = dynamic_cast<Branch::Vector*>(this);
-  auto rval_base = dynamic_cast<Branch::Vector*>(&rval_);
+  auto rval_base = dynamic_cast<const Branch::Vector*>(&rval_);
 
   *this_base = *rval_base;
+  for(auto &branch : *this_base)
+    branch.set_default_minfreespace(_default_minfreespace);
 
   return *this;
 }
@@ -60,6 +64,8 @@ Branches::Impl::operator=(Branches::Impl &&rval_)
   auto rval_base = dynamic_cast<Branch::Vector*>(&rval_);
 
   *this_base = std::move(*rval_base);
+  for(auto &branch : *this_base)
+    branch.set_default_minfreespace(_default_minfreespace);
 
   return *this;
 }
@@ -197,6 +203,7 @@ namespace l
     for(auto &path : paths)
       {
         branch.path = path;
+        branch.open_fd();
         branches_->push_back(branch);
       }
 
@@ -382,29 +389,31 @@ Branches::Impl::to_paths() const
   return vp;
 }
 
+Branches::Branches(const Branches &branches_,
+                   const uint64_t &default_minfreespace_)
+{
+  Branches::Ptr impl;
+
+  impl  = std::make_shared<Branches::Impl>(default_minfreespace_);
+  *impl = *branches_._impl;
+
+  _impl = impl;
+}
+
 int
 Branches::from_string(const std::string &str_)
 {
   int rv;
-  Branches::Ptr impl;
   Branches::Ptr new_impl;
 
-  {
-    std::lock_guard<std::mutex> lock_guard(_mutex);
-    impl = _impl;
-  }
-
-  new_impl = std::make_shared<Branches::Impl>(impl->minfreespace());
-  *new_impl = *impl;
+  new_impl = std::make_shared<Branches::Impl>(_impl->minfreespace());
+  *new_impl = *_impl;
 
   rv = new_impl->from_string(str_);
   if(rv < 0)
     return rv;
 
-  {
-    std::lock_guard<std::mutex> lock_guard(_mutex);
-    _impl = new_impl;
-  }
+  _impl = new_impl;
 
   return 0;
 }
@@ -412,15 +421,18 @@ Branches::from_string(const std::string &str_)
 string
 Branches::to_string(void) const
 {
-  std::lock_guard<std::mutex> lock_guard(_mutex);
-
   return _impl->to_string();
 }
 
 void
 Branches::find_and_set_mode_ro()
 {
-  for(auto &branch : *_impl)
+  Branches::Ptr new_impl;
+
+  new_impl = std::make_shared<Branches::Impl>(_impl->minfreespace());
+  *new_impl = *_impl;
+
+  for(auto &branch : *new_impl)
     {
       if(branch.mode != Branch::Mode::RW)
         continue;
@@ -433,6 +445,28 @@ Branches::find_and_set_mode_ro()
 
       branch.mode = Branch::Mode::RO;
     }
+
+  _impl = new_impl;
+}
+
+/*
+  The branch fds pin whatever directory was at the path when the
+  branches were set. If a filesystem was mounted over a branch since
+  (such as after waiting on branches-mount-timeout) they need to be
+  reopened to see it.
+*/
+void
+Branches::reopen_fds()
+{
+  Branches::Ptr new_impl;
+
+  new_impl = std::make_shared<Branches::Impl>(_impl->minfreespace());
+  *new_impl = *_impl;
+
+  for(auto &branch : *new_impl)
+    branch.open_fd();
+
+  _impl = new_impl;
 }
 
 SrcMounts::SrcMounts(Branches &b_)
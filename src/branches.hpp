@@ -25,11 +25,12 @@
 
 #include <cstdint>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <vector>
 
 
+// Not synchronized. Branches are only changed on a Config::Write
+// copy before it is published and are immutable afterwards.
 class Branches final : public ToFromString
 {
 public:
@@ -52,7 +53,7 @@ public:
     fs::PathVector to_paths() const;
 
   public:
-    Impl& operator=(Impl &impl_);
+    Impl& operator=(const Impl &impl_);
     Impl& operator=(Impl &&impl_);
 
   private:
@@ -67,21 +68,23 @@ public:
   Branches(const uint64_t &default_minfreespace_)
     : _impl(std::make_shared<Impl>(default_minfreespace_))
   {}
+  Branches(const Branches &branches_,
+           const uint64_t &default_minfreespace_);
 
 public:
   int from_string(const std::string &str) final;
   std::string to_string(void) const final;
 
 public:
-  operator CPtr()   const { std::lock_guard<std::mutex> lg(_mutex); return _impl; }
-  CPtr operator->() const { std::lock_guard<std::mutex> lg(_mutex); return _impl; }
+  operator const CPtr&()   const { return _impl; }
+  const CPtr& operator->() const { return _impl; }
 
 public:
   void find_and_set_mode_ro();
+  void reopen_fds();
 
 private:
-  mutable std::mutex _mutex;
-  Ptr                _impl;
+  CPtr _impl;
 };
 
 class SrcMounts : public ToFromString
@@ -19,7 +19,6 @@
 #include "errno.hpp"
 #include "from_string.hpp"
 #include "num.hpp"
-#include "rwlock.hpp"
 #include "str.hpp"
 #include "to_string.hpp"
 #include "version.hpp"
@@ -28,6 +27,7 @@
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 
 #include <pthread.h>
@@ -45,7 +45,10 @@ constexpr static const char CACHE_FILES_PROCESS_NAMES_DEFAULT[] =
   "qbittorrent-nox";
 
 
-Config Config::_singleton;
+std::atomic<Config*> Config::_current(new Config());
+thread_local Config *Config::_writing = NULL;
+static std::mutex    g_WRITE_LOCK;
+static thread_local  uint64_t t_WRITE_DEPTH = 0;
 
 
 namespace l
@@ -56,19 +59,32 @@ namespace l
   {
     IFERT("async_read");
     IFERT("branches-mount-timeout");
+    IFERT("branch-io-threads");
     IFERT("cache.symlinks");
     IFERT("cache.writeback");
+    IFERT("clone-fd");
+    IFERT("fanout-threads");
     IFERT("fsname");
     IFERT("fuse_msg_size");
+    IFERT("io-uring");
+    IFERT("io-uring-queue-depth");
+    IFERT("location-index");
+    IFERT("location-index-entries");
     IFERT("mount");
+    IFERT("moveonenospc.stats");
     IFERT("nullrw");
+    IFERT("passthrough");
     IFERT("pid");
     IFERT("pin-threads");
+    IFERT("policy-probe-threads");
     IFERT("process-thread-count");
     IFERT("process-thread-queue-depth");
+    IFERT("process-thread-scheduler");
     IFERT("read-thread-count");
     IFERT("readdirplus");
     IFERT("scheduling-priority");
+    IFERT("splice_read");
+    IFERT("splice_write");
     IFERT("srcmounts");
     IFERT("threads");
     IFERT("version");
@@ -77,23 +93,29 @@ namespace l
   }
 }
 
-Config::Config()
+ConfigOptions::ConfigOptions()
   : async_read(true),
     auto_cache(false),
     minfreespace(MINFREESPACE_DEFAULT),
-    branches(minfreespace),
     branches_mount_timeout(0),
+    branch_io_threads(0),
+    branch_io_timeout(10),
+    branch_io_fast_fail(true),
     cache_attr(1),
     cache_entry(1),
     cache_files(CacheFiles::ENUM::LIBFUSE),
     cache_files_process_names(CACHE_FILES_PROCESS_NAMES_DEFAULT),
     cache_negative_entry(0),
+    cache_open(0),
     cache_readdir(false),
     cache_statfs(0),
+    cache_statfs_background(false),
     cache_symlinks(false),
-    category(func),
+    dir_filter(false),
     direct_io(false),
     dropcacheonclose(false),
+    fanout_min_branches(3),
+    fanout_threads(0),
     flushonclose(FlushOnClose::ENUM::OPENED_FOR_WRITE),
     follow_symlinks(FollowSymlinks::ENUM::NEVER),
     fsname(),
@@ -101,24 +123,31 @@ Config::Config()
     fuse_msg_size(FUSE_MAX_MAX_PAGES),
     ignorepponrename(false),
     inodecalc("hybrid-hash"),
+    kernel_cache(false),
     lazy_umount_mountpoint(false),
     link_cow(false),
     link_exdev(LinkEXDEV::ENUM::PASSTHROUGH),
+    location_index(),
+    location_index_entries(1 << 20),
     log_metrics(false),
     mountpoint(),
     moveonenospc(false),
+    moveonenospc_stats(),
     nfsopenhack(NFSOpenHack::ENUM::OFF),
     nullrw(false),
     parallel_direct_writes(false),
+    passthrough(Passthrough::ENUM::OFF),
     pid(::getpid()),
     posix_acl(false),
+    policy_probe_threads(0),
     readahead(0),
     readdir("seq"),
     readdirplus(false),
     rename_exdev(RenameEXDEV::ENUM::PASSTHROUGH),
     scheduling_priority(-10),
     security_capability(true),
-    srcmounts(branches),
+    splice_read(false),
+    splice_write(false),
     statfs(StatFS::ENUM::BASE),
     statfs_ignore(StatFSIgnore::ENUM::NONE),
     symlinkify(false),
@@ -126,30 +155,104 @@ Config::Config()
     fuse_read_thread_count(0),
     fuse_process_thread_count(-1),
     fuse_process_thread_queue_depth(0),
+    fuse_process_thread_scheduler("shared"),
     fuse_pin_threads("false"),
+    fuse_clone_fd(false),
+    io_uring(false),
+    io_uring_queue_depth(4),
     version(MERGERFS_VERSION),
     writeback_cache(false),
-    xattr(XAttr::ENUM::PASSTHROUGH),
+    xattr(XAttr::ENUM::PASSTHROUGH)
+{
+
+}
+
+Config::Config()
+  : ConfigOptions(),
+    branches(minfreespace),
+    category(func),
+    srcmounts(branches),
     _initialized(false)
+{
+  register_keys();
+}
+
+/*
+  Copies share whatever the members share (branch fds, readdir thread
+  pools, etc.) but branches are rebound to this instance's
+  minfreespace so a copy never refers back into the original. The
+  key map is rebuilt to point at this instance's members.
+*/
+Config::Config(const Config &cfg_)
+  : ConfigOptions(cfg_),
+    branches(cfg_.branches,minfreespace),
+    category(func),
+    srcmounts(branches),
+    _initialized(cfg_._initialized)
+{
+  register_keys();
+}
+
+/*
+  Writers work on a private copy of the current config which is
+  published when the outermost Write on the thread goes out of
+  scope. Readers never wait on writers. The replaced config is freed
+  once no reader can still be using it.
+*/
+Config::Write::Write()
+{
+  if(t_WRITE_DEPTH++ == 0)
+    {
+      g_WRITE_LOCK.lock();
+      Config::_writing = new Config(*Config::_current.load());
+    }
+
+  _cfg = Config::_writing;
+}
+
+Config::Write::~Write()
+{
+  Config *old;
+
+  if(--t_WRITE_DEPTH != 0)
+    return;
+
+  old = Config::_current.exchange(Config::_writing);
+  Config::_writing = NULL;
+  g_WRITE_LOCK.unlock();
+
+  rcu::retire([old]() { delete old; });
+}
+
+void
+Config::register_keys()
 {
   _map["async_read"]             = &async_read;
   _map["auto_cache"]             = &auto_cache;
   _map["branches"]               = &branches;
   _map["branches-mount-timeout"] = &branches_mount_timeout;
+  _map["branch-io-threads"]      = &branch_io_threads;
+  _map["branch-io-timeout"]      = &branch_io_timeout;
+  _map["branch-io-fast-fail"]    = &branch_io_fast_fail;
   _map["cache.attr"]             = &cache_attr;
   _map["cache.entry"]            = &cache_entry;
   _map["cache.files"]            = &cache_files;
   _map["cache.files.process-names"] = &cache_files_process_names;
   _map["cache.negative_entry"]   = &cache_negative_entry;
+  _map["cache.open"]             = &cache_open;
   _map["cache.readdir"]          = &cache_readdir;
   _map["cache.statfs"]           = &cache_statfs;
+  _map["cache.statfs.background"] = &cache_statfs_background;
   _map["cache.symlinks"]         = &cache_symlinks;
   _map["cache.writeback"]        = &writeback_cache;
   _map["category.action"]        = &category.action;
   _map["category.create"]        = &category.create;
   _map["category.search"]        = &category.search;
+  _map["dir-filter"]             = &dir_filter;
   _map["direct_io"]              = &direct_io;
   _map["dropcacheonclose"]       = &dropcacheonclose;
+  _map["fanout-min-branches"]    = &fanout_min_branches;
+  _map["fanout-threads"]         = &fanout_threads;
   _map["flush-on-close"]         = &flushonclose;
   _map["follow-symlinks"]        = &follow_symlinks;
   _map["fsname"]                 = &fsname;
@@ -181,21 +284,28 @@ Config::Config()
   _map["lazy-umount-mountpoint"] = &lazy_umount_mountpoint;
   _map["link_cow"]               = &link_cow;
   _map["link-exdev"]             = &link_exdev;
+  _map["location-index"]         = &location_index;
+  _map["location-index-entries"] = &location_index_entries;
   _map["log.metrics"]            = &log_metrics;
   _map["minfreespace"]           = &minfreespace;
   _map["mount"]                  = &mountpoint;
   _map["moveonenospc"]           = &moveonenospc;
+  _map["moveonenospc.stats"]     = &moveonenospc_stats;
   _map["nfsopenhack"]            = &nfsopenhack;
   _map["nullrw"]                 = &nullrw;
   _map["pid"]                    = &pid;
   _map["parallel-direct-writes"] = &parallel_direct_writes;
+  _map["passthrough"]            = &passthrough;
   _map["pin-threads"]            = &fuse_pin_threads;
+  _map["policy-probe-threads"]   = &policy_probe_threads;
   _map["posix_acl"]              = &posix_acl;
   _map["readahead"]              = &readahead;
   _map["readdirplus"]            = &readdirplus;
   _map["rename-exdev"]           = &rename_exdev;
   _map["scheduling-priority"]    = &scheduling_priority;
   _map["security_capability"]    = &security_capability;
+  _map["splice_read"]            = &splice_read;
+  _map["splice_write"]           = &splice_write;
   _map["srcmounts"]              = &srcmounts;
   _map["statfs"]                 = &statfs;
   _map["statfs_ignore"]          = &statfs_ignore;
@@ -205,6 +315,10 @@ Config::Config()
   _map["read-thread-count"]      = &fuse_read_thread_count;
   _map["process-thread-count"]   = &fuse_process_thread_count;
   _map["process-thread-queue-depth"] = &fuse_process_thread_queue_depth;
+  _map["process-thread-scheduler"]   = &fuse_process_thread_scheduler;
+  _map["clone-fd"]               = &fuse_clone_fd;
+  _map["io-uring"]               = &io_uring;
+  _map["io-uring-queue-depth"]   = &io_uring_queue_depth;
   _map["version"]                = &version;
   _map["xattr"]                  = &xattr;
 }
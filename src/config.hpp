@@ -26,6 +26,7 @@
 #include "config_log_metrics.hpp"
 #include "config_moveonenospc.hpp"
 #include "config_nfsopenhack.hpp"
+#include "config_passthrough.hpp"
 #include "config_rename_exdev.hpp"
 #include "config_set.hpp"
 #include "config_statfs.hpp"
@@ -36,11 +37,12 @@
 #include "funcs.hpp"
 #include "fuse_readdir.hpp"
 #include "policy.hpp"
-#include "rwlock.hpp"
+#include "rcu.hpp"
 #include "tofrom_wrapper.hpp"
 
 #include "fuse.h"
 
+#include <atomic>
 #include <cstdint>
 #include <map>
 #include <memory>
@@ -57,66 +59,37 @@ typedef std::map<std::string,ToFromString*> Str2TFStrMap;
 
 extern const std::string CONTROLFILE;
 
-class Config
+/*
+  The plain options. A Config copies these as a whole so only the
+  members which refer to other members need handling in its copy
+  constructor.
+*/
+struct ConfigOptions
 {
-public:
-  struct Err
-  {
-    int err;
-    std::string str;
-  };
-
-  typedef std::vector<Err> ErrVec;
-
-public:
-  class Read
-  {
-  public:
-    Read();
+  ConfigOptions();
 
-  public:
-    inline const Config* operator->() const;
-
-  private:
-    const Config &_cfg;
-  };
-
-public:
-  class Write
-  {
-  public:
-    Write();
-
-  public:
-    Config* operator->();
-
-  private:
-    Config &_cfg;
-  };
-
-public:
-  Config();
-
-public:
-  Config& operator=(const Config&);
-
-public:
   ConfigBOOL     async_read;
   ConfigBOOL     auto_cache;
   ConfigUINT64   minfreespace;
-  Branches       branches;
   ConfigUINT64   branches_mount_timeout;
+  ConfigUINT64   branch_io_threads;
+  ConfigUINT64   branch_io_timeout;
+  ConfigBOOL     branch_io_fast_fail;
   ConfigUINT64   cache_attr;
   ConfigUINT64   cache_entry;
   CacheFiles     cache_files;
   ConfigSet      cache_files_process_names;
   ConfigUINT64   cache_negative_entry;
+  ConfigUINT64   cache_open;
   ConfigBOOL     cache_readdir;
   ConfigUINT64   cache_statfs;
+  ConfigBOOL     cache_statfs_background;
   ConfigBOOL     cache_symlinks;
-  Categories     category;
+  ConfigBOOL     dir_filter;
   ConfigBOOL     direct_io;
   ConfigBOOL     dropcacheonclose;
+  ConfigUINT64   fanout_min_branches;
+  ConfigUINT64   fanout_threads;
   FlushOnClose   flushonclose;
   FollowSymlinks follow_symlinks;
   ConfigSTR      fsname;
@@ -128,21 +101,27 @@ public:
   ConfigBOOL     lazy_umount_mountpoint;
   ConfigBOOL     link_cow;
   LinkEXDEV      link_exdev;
+  ConfigSTR      location_index;
+  ConfigUINT64   location_index_entries;
   LogMetrics     log_metrics;
   ConfigSTR      mountpoint;
   MoveOnENOSPC   moveonenospc;
+  MoveOnENOSPCStats moveonenospc_stats;
   NFSOpenHack    nfsopenhack;
   ConfigBOOL     nullrw;
   ConfigBOOL     parallel_direct_writes;
+  Passthrough    passthrough;
   ConfigUINT64   pid;
   ConfigBOOL     posix_acl;
+  ConfigUINT64   policy_probe_threads;
   ConfigUINT64   readahead;
   FUSE::ReadDir  readdir;
   ConfigBOOL     readdirplus;
   RenameEXDEV    rename_exdev;
   ConfigINT      scheduling_priority;
   ConfigBOOL     security_capability;
-  SrcMounts      srcmounts;
+  ConfigBOOL     splice_read;
+  ConfigBOOL     splice_write;
   StatFS         statfs;
   StatFSIgnore   statfs_ignore;
   ConfigBOOL     symlinkify;
@@ -150,10 +129,77 @@ public:
   ConfigINT      fuse_read_thread_count;
   ConfigINT      fuse_process_thread_count;
   ConfigINT      fuse_process_thread_queue_depth;
+  ConfigSTR      fuse_process_thread_scheduler;
   ConfigSTR      fuse_pin_threads;
+  ConfigBOOL     fuse_clone_fd;
+  ConfigBOOL     io_uring;
+  ConfigINT      io_uring_queue_depth;
   ConfigSTR      version;
   ConfigBOOL     writeback_cache;
   XAttr          xattr;
+};
+
+class Config : public ConfigOptions
+{
+public:
+  struct Err
+  {
+    int err;
+    std::string str;
+  };
+
+  typedef std::vector<Err> ErrVec;
+
+public:
+  class Read
+  {
+  public:
+    Read();
+
+  public:
+    inline const Config* operator->() const;
+
+  public:
+    void refresh();
+
+  private:
+    Read(const Read&);
+    Read& operator=(const Read&);
+
+  private:
+    rcu::ReadGuard  _guard;
+    const Config   *_cfg;
+  };
+
+public:
+  class Write
+  {
+  public:
+    Write();
+    ~Write();
+
+  public:
+    Config* operator->();
+
+  private:
+    Write(const Write&);
+    Write& operator=(const Write&);
+
+  private:
+    Config *_cfg;
+  };
+
+public:
+  Config();
+  Config(const Config&);
+
+public:
+  Config& operator=(const Config&);
+
+public:
+  Branches       branches;
+  Categories     category;
+  SrcMounts      srcmounts;
 
 private:
   bool _initialized;
@@ -180,11 +226,15 @@ public:
   int from_stream(std::istream &istrm, ErrVec *errs);
   int from_file(const std::string &filepath, ErrVec *errs);
 
+private:
+  void register_keys();
+
 private:
   Str2TFStrMap _map;
 
 private:
-  static Config _singleton;
+  static std::atomic<Config*> _current;
+  static thread_local Config *_writing;
 
 public:
   friend class Read;
@@ -193,9 +243,16 @@ public:
 
 std::ostream& operator<<(std::ostream &s,const Config::ErrVec &ev);
 
+/*
+  A thread with an open Config::Write reads its own pending copy so
+  changes made earlier in the same update are visible to it.
+*/
 inline
 Config::Read::Read()
-  : _cfg(Config::_singleton)
+  : _guard(),
+    _cfg(Config::_writing ?
+         Config::_writing :
+         Config::_current.load(std::memory_order_acquire))
 {
 
 }
@@ -205,19 +262,21 @@ const
 Config*
 Config::Read::operator->() const
 {
-  return &_cfg;
+  return _cfg;
 }
 
 inline
-Config::Write::Write()
-  : _cfg(Config::_singleton)
+void
+Config::Read::refresh()
 {
-
+  _cfg = (Config::_writing ?
+          Config::_writing :
+          Config::_current.load(std::memory_order_acquire));
 }
 
 inline
 Config*
 Config::Write::operator->()
 {
-  return &_cfg;
+  return _cfg;
 }
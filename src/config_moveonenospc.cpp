@@ -19,6 +19,7 @@
 #include "config_moveonenospc.hpp"
 #include "ef.hpp"
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "from_string.hpp"
 
 
@@ -54,3 +55,15 @@ MoveOnENOSPC::to_string(void) const
     return policy.name();
   return "false";
 }
+
+int
+MoveOnENOSPCStats::from_string(const std::string &s_)
+{
+  return -EROFS;
+}
+
+std::string
+MoveOnENOSPCStats::to_string(void) const
+{
+  return FileMigration::stats();
+}
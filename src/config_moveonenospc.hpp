@@ -42,3 +42,11 @@ public:
   bool enabled;
   Policy::Create policy;
 };
+
+// Read only view of the moves in progress and totals since mount.
+class MoveOnENOSPCStats : public ToFromString
+{
+public:
+  int from_string(const std::string &s) final;
+  std::string to_string() const final;
+};
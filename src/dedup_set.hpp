@@ -0,0 +1,282 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "wyhash.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+  Insert only set of 64bit name hashes used to dedup readdir entries
+  across branches. Laid out like a Swiss table: a control byte per
+  slot holds the low 7 bits of the hash, or EMPTY, and is scanned a
+  group of 16 at a time (with SSE2 when available) so a lookup
+  usually reads one group of control bytes and compares at most a
+  couple of full hashes.
+
+  As with HashSet only the hash is kept so names colliding on all 64
+  bits are treated as the same name.
+*/
+class DedupSet
+{
+public:
+  static const uint64_t GROUP_SIZE = 16;
+
+private:
+  static const int8_t EMPTY = -128;
+
+public:
+  DedupSet(const uint64_t count_ = 0)
+    : _ctrl(NULL),
+      _slots(NULL),
+      _group_mask(0),
+      _size(0),
+      _growth_left(0)
+  {
+    _alloc(_groups_for(count_));
+  }
+
+  ~DedupSet()
+  {
+    ::free(_ctrl);
+    ::free(_slots);
+  }
+
+private:
+  DedupSet(const DedupSet&);
+  DedupSet& operator=(const DedupSet&);
+
+public:
+  static
+  inline
+  uint64_t
+  hash(const char     *str_,
+       const uint64_t  len_)
+  {
+    return wyhash(str_,len_,0x7472617065786974,_wyp);
+  }
+
+  // 1 if inserted, 0 if already present
+  inline
+  int
+  put(const char     *str_,
+      const uint64_t  len_)
+  {
+    return put(DedupSet::hash(str_,len_));
+  }
+
+  inline
+  int
+  put(const uint64_t hash_)
+  {
+    uint64_t slot;
+
+    if(_find_or_empty(hash_,&slot))
+      return 0;
+
+    if(_growth_left == 0)
+      {
+        _grow();
+        _find_or_empty(hash_,&slot);
+      }
+
+    _ctrl[slot]  = (hash_ & 0x7F);
+    _slots[slot] = hash_;
+    _size++;
+    _growth_left--;
+
+    return 1;
+  }
+
+  inline
+  bool
+  contains(const uint64_t hash_) const
+  {
+    uint64_t slot;
+
+    return _find_or_empty(hash_,&slot);
+  }
+
+  void
+  reserve(const uint64_t count_)
+  {
+    uint64_t groups;
+
+    groups = _groups_for(count_);
+    if(groups > (_group_mask + 1))
+      _rehash(groups);
+  }
+
+  inline
+  uint64_t
+  size(void) const
+  {
+    return _size;
+  }
+
+private:
+  // Keeps the load factor at or under 7/8.
+  static
+  uint64_t
+  _groups_for(const uint64_t count_)
+  {
+    uint64_t groups;
+
+    groups = 1;
+    while(((groups * GROUP_SIZE * 7) / 8) < count_)
+      groups <<= 1;
+
+    return groups;
+  }
+
+  static
+  inline
+  uint32_t
+  _match(const int8_t *group_,
+         const int8_t  byte_)
+  {
+#if defined(__SSE2__)
+    __m128i ctrl;
+
+    ctrl = _mm_loadu_si128((const __m128i*)group_);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,_mm_set1_epi8(byte_)));
+#else
+    uint32_t mask;
+
+    mask = 0;
+    for(uint64_t i = 0; i < GROUP_SIZE; i++)
+      mask |= ((uint32_t)(group_[i] == byte_) << i);
+
+    return mask;
+#endif
+  }
+
+  // Probes groups quadratically. With no deletes the first group
+  // with an empty slot ends the search and that slot is where the
+  // hash belongs.
+  inline
+  bool
+  _find_or_empty(const uint64_t  hash_,
+                 uint64_t       *slot_) const
+  {
+    int8_t h2;
+    uint64_t group;
+    uint32_t mask;
+
+    h2    = (hash_ & 0x7F);
+    group = ((hash_ >> 7) & _group_mask);
+    for(uint64_t i = 1; true; i++)
+      {
+        const int8_t *ctrl = &_ctrl[group * GROUP_SIZE];
+
+        mask = _match(ctrl,h2);
+        while(mask)
+          {
+            uint64_t slot;
+
+            slot = ((group * GROUP_SIZE) + __builtin_ctz(mask));
+            if(_slots[slot] == hash_)
+              return (*slot_ = slot,true);
+
+            mask &= (mask - 1);
+          }
+
+        mask = _match(ctrl,EMPTY);
+        if(mask)
+          return (*slot_ = ((group * GROUP_SIZE) + __builtin_ctz(mask)),false);
+
+        group = ((group + i) & _group_mask);
+      }
+  }
+
+  void
+  _alloc(const uint64_t groups_)
+  {
+    int8_t   *ctrl;
+    uint64_t *slotv;
+    uint64_t  slots;
+
+    slots = (groups_ * GROUP_SIZE);
+
+    ctrl  = (int8_t*)::malloc(slots);
+    slotv = (uint64_t*)::malloc(slots * sizeof(uint64_t));
+    if((ctrl == NULL) || (slotv == NULL))
+      {
+        ::free(ctrl);
+        ::free(slotv);
+        throw std::bad_alloc();
+      }
+
+    ::memset(ctrl,EMPTY,slots);
+    _ctrl        = ctrl;
+    _slots       = slotv;
+    _group_mask  = (groups_ - 1);
+    _growth_left = (((slots * 7) / 8) - _size);
+  }
+
+  void
+  _rehash(const uint64_t groups_)
+  {
+    int8_t   *old_ctrl;
+    uint64_t *old_slots;
+    uint64_t  old_count;
+
+    old_ctrl  = _ctrl;
+    old_slots = _slots;
+    old_count = ((_group_mask + 1) * GROUP_SIZE);
+
+    _alloc(groups_);
+    for(uint64_t i = 0; i < old_count; i++)
+      {
+        uint64_t slot;
+
+        if(old_ctrl[i] == EMPTY)
+          continue;
+
+        _find_or_empty(old_slots[i],&slot);
+        _ctrl[slot]  = old_ctrl[i];
+        _slots[slot] = old_slots[i];
+      }
+
+    ::free(old_ctrl);
+    ::free(old_slots);
+  }
+
+  void
+  _grow(void)
+  {
+    _rehash((_group_mask + 1) * 2);
+  }
+
+private:
+  int8_t   *_ctrl;
+  uint64_t *_slots;
+  uint64_t  _group_mask;
+  uint64_t  _size;
+  uint64_t  _growth_left;
+};
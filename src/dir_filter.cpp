@@ -0,0 +1,787 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "dir_filter.hpp"
+
+#include "fs_rename.hpp"
+
+#include "rcu.hpp"
+#include "syslog.hpp"
+#include "wyhash.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INITIAL_BUCKETS 4096
+#define MAX_KICKS       512
+
+static std::atomic<bool>     g_ENABLED(false);
+static std::atomic<uint64_t> g_GENERATION(1);
+
+static std::mutex                         g_REGISTRY_LOCK;
+static std::map<std::string,DirFilter*>  *g_REGISTRY = new std::map<std::string,DirFilter*>();
+
+namespace l
+{
+  static
+  uint64_t
+  hash(const char        *fusepath_,
+       const std::size_t  len_)
+  {
+    return wyhash(fusepath_,len_,0x646972666c746572,_wyp);
+  }
+
+  static
+  uint64_t
+  hash(const std::string &fusepath_)
+  {
+    return l::hash(fusepath_.data(),fusepath_.size());
+  }
+
+  static
+  uint32_t
+  fingerprint(const uint64_t hash_)
+  {
+    uint32_t fp;
+
+    fp = (hash_ >> 32);
+
+    return ((fp == 0) ? 1 : fp);
+  }
+
+  static
+  uint64_t
+  alt_index(const uint64_t idx_,
+            const uint32_t fp_,
+            const uint64_t mask_)
+  {
+    return ((idx_ ^ (fp_ * 0x5bd1e995ULL)) & mask_);
+  }
+
+  static
+  uint32_t
+  lane(const uint64_t bucket_,
+       const int      lane_)
+  {
+    return (uint32_t)(bucket_ >> (lane_ * 32));
+  }
+
+  static
+  uint64_t
+  set_lane(const uint64_t bucket_,
+           const int      lane_,
+           const uint32_t fp_)
+  {
+    uint64_t mask;
+
+    mask = (0xFFFFFFFFULL << (lane_ * 32));
+
+    return ((bucket_ & ~mask) | ((uint64_t)fp_ << (lane_ * 32)));
+  }
+
+  // The path of fullpath_ relative to the branch or false if it isn't
+  // below it. The branch root itself is never tracked.
+  static
+  bool
+  relative(const std::string &branch_,
+           const std::string &fullpath_,
+           std::string       *relpath_)
+  {
+    std::size_t len;
+    std::size_t start;
+
+    len = branch_.size();
+    while((len > 1) && (branch_[len - 1] == '/'))
+      len--;
+
+    if(fullpath_.compare(0,len,branch_,0,len) != 0)
+      return false;
+    if((fullpath_.size() <= len) || (fullpath_[len] != '/'))
+      return false;
+
+    start = len;
+    while(((start + 1) < fullpath_.size()) && (fullpath_[start + 1] == '/'))
+      start++;
+    if((start + 1) == fullpath_.size())
+      return false;
+
+    *relpath_ = fullpath_.substr(start);
+
+    return true;
+  }
+
+  // Calls func_ with the path of every directory below dirfd_. Takes
+  // ownership of dirfd_.
+  static
+  bool
+  walk(const int                                      dirfd_,
+       std::string                                   &fusepath_,
+       const std::function<bool(const std::string&)> &func_)
+  {
+    int fd;
+    DIR *dir;
+    bool rv;
+    std::size_t len;
+    struct stat st;
+    struct dirent *de;
+
+    dir = ::fdopendir(dirfd_);
+    if(dir == NULL)
+      {
+        ::close(dirfd_);
+        return true;
+      }
+
+    rv  = true;
+    len = fusepath_.size();
+    while(rv && ((de = ::readdir(dir)) != NULL))
+      {
+        if((strcmp(de->d_name,".") == 0) ||
+           (strcmp(de->d_name,"..") == 0))
+          continue;
+
+        if(de->d_type == DT_UNKNOWN)
+          {
+            if(::fstatat(::dirfd(dir),de->d_name,&st,AT_SYMLINK_NOFOLLOW) == -1)
+              continue;
+            if(!S_ISDIR(st.st_mode))
+              continue;
+          }
+        else if(de->d_type != DT_DIR)
+          {
+            continue;
+          }
+
+        fusepath_ += '/';
+        fusepath_ += de->d_name;
+
+        rv = func_(fusepath_);
+        if(rv)
+          {
+            fd = ::openat(::dirfd(dir),
+                          de->d_name,
+                          O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+            if(fd != -1)
+              rv = l::walk(fd,fusepath_,func_);
+          }
+
+        fusepath_.resize(len);
+      }
+
+    ::closedir(dir);
+
+    return rv;
+  }
+}
+
+/*
+  Buckets are 64bit and hold two 32bit fingerprints with 0 meaning
+  empty. Only one thread modifies a table at a time. Readers go
+  through DirFilter which detects a concurrent modification.
+*/
+class DirFilter::Table
+{
+public:
+  Table(const uint64_t buckets_)
+    : _mask(buckets_ - 1),
+      _buckets(buckets_),
+      _saturated(false)
+  {
+  }
+
+public:
+  uint64_t
+  size(void) const
+  {
+    return _buckets.size();
+  }
+
+  bool
+  saturated(void) const
+  {
+    return _saturated.load(std::memory_order_relaxed);
+  }
+
+  bool
+  contains(const uint64_t hash_) const
+  {
+    uint32_t fp;
+    uint64_t i1;
+    uint64_t i2;
+
+    fp = l::fingerprint(hash_);
+    i1 = (hash_ & _mask);
+    i2 = l::alt_index(i1,fp,_mask);
+
+    return (has(i1,fp) || has(i2,fp));
+  }
+
+  // An entry is lost if the table is too full to place it so the
+  // table is marked saturated and should no longer be trusted.
+  // Equal fingerprints are stored once per insert, whether the same
+  // path or another, so removing one never drops the other.
+  bool
+  insert(const uint64_t hash_)
+  {
+    int lane;
+    uint32_t fp;
+    uint32_t victim;
+    uint64_t i;
+    uint64_t i1;
+    uint64_t i2;
+    uint64_t bucket;
+
+    fp = l::fingerprint(hash_);
+    i1 = (hash_ & _mask);
+    i2 = l::alt_index(i1,fp,_mask);
+    if(place(i1,fp) || place(i2,fp))
+      return true;
+
+    i = ((fp & 1) ? i1 : i2);
+    for(int n = 0; n < MAX_KICKS; n++)
+      {
+        lane   = (n & 1);
+        bucket = _buckets[i].load(std::memory_order_relaxed);
+        victim = l::lane(bucket,lane);
+        _buckets[i].store(l::set_lane(bucket,lane,fp),std::memory_order_relaxed);
+
+        fp = victim;
+        i  = l::alt_index(i,fp,_mask);
+        if(place(i,fp))
+          return true;
+      }
+
+    _saturated.store(true);
+
+    return false;
+  }
+
+  void
+  remove(const uint64_t hash_)
+  {
+    uint32_t fp;
+    uint64_t i1;
+    uint64_t i2;
+
+    fp = l::fingerprint(hash_);
+    i1 = (hash_ & _mask);
+    i2 = l::alt_index(i1,fp,_mask);
+
+    if(!clear(i1,fp))
+      clear(i2,fp);
+  }
+
+private:
+  bool
+  has(const uint64_t idx_,
+      const uint32_t fp_) const
+  {
+    uint64_t bucket;
+
+    bucket = _buckets[idx_].load(std::memory_order_relaxed);
+
+    return ((l::lane(bucket,0) == fp_) ||
+            (l::lane(bucket,1) == fp_));
+  }
+
+  bool
+  place(const uint64_t idx_,
+        const uint32_t fp_)
+  {
+    uint64_t bucket;
+
+    bucket = _buckets[idx_].load(std::memory_order_relaxed);
+    for(int lane = 0; lane < 2; lane++)
+      {
+        if(l::lane(bucket,lane) != 0)
+          continue;
+
+        _buckets[idx_].store(l::set_lane(bucket,lane,fp_),
+                             std::memory_order_relaxed);
+        return true;
+      }
+
+    return false;
+  }
+
+  bool
+  clear(const uint64_t idx_,
+        const uint32_t fp_)
+  {
+    uint64_t bucket;
+
+    bucket = _buckets[idx_].load(std::memory_order_relaxed);
+    for(int lane = 0; lane < 2; lane++)
+      {
+        if(l::lane(bucket,lane) != fp_)
+          continue;
+
+        _buckets[idx_].store(l::set_lane(bucket,lane,0),
+                             std::memory_order_relaxed);
+        return true;
+      }
+
+    return false;
+  }
+
+private:
+  const uint64_t                     _mask;
+  std::vector<std::atomic<uint64_t>> _buckets;
+  std::atomic<bool>                  _saturated;
+};
+
+DirFilter::DirFilter(const std::string &path_)
+  : _path(path_),
+    _table(NULL),
+    _building(NULL),
+    _rebuilding(false),
+    _pending(0),
+    _seq(0),
+    _generation(0),
+    _buckets(INITIAL_BUCKETS)
+{
+
+}
+
+DirFilter*
+DirFilter::get(const std::string &path_)
+{
+  DirFilter *filter;
+  std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+
+  filter = (*g_REGISTRY)[path_];
+  if(filter == NULL)
+    {
+      filter = new DirFilter(path_);
+      (*g_REGISTRY)[path_] = filter;
+    }
+
+  return filter;
+}
+
+bool
+DirFilter::enabled(void)
+{
+  return g_ENABLED.load(std::memory_order_relaxed);
+}
+
+// Enabling rebuilds the filters so directories created on the
+// branches while disabled are seen.
+void
+DirFilter::enabled(const bool enabled_)
+{
+  if(g_ENABLED.exchange(enabled_) == enabled_)
+    return;
+
+  if(enabled_)
+    g_GENERATION.fetch_add(1);
+}
+
+void
+DirFilter::added(const std::string &fullpath_)
+{
+  std::string relpath;
+
+  if(!DirFilter::enabled())
+    return;
+
+  std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+  for(auto &kv : *g_REGISTRY)
+    {
+      if(l::relative(kv.first,fullpath_,&relpath))
+        kv.second->add(relpath);
+    }
+}
+
+void
+DirFilter::removed(const std::string &fullpath_)
+{
+  std::string relpath;
+
+  if(!DirFilter::enabled())
+    return;
+
+  std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+  for(auto &kv : *g_REGISTRY)
+    {
+      if(l::relative(kv.first,fullpath_,&relpath))
+        kv.second->remove(relpath);
+    }
+}
+
+/*
+  fs::rename for paths which may be directories on a branch. Each
+  filter of the branch is marked as having a rename pending before
+  the rename is made so there is no point at which the new name is
+  visible on the branch but missing from the filter.
+*/
+int
+DirFilter::rename(const std::string &oldfullpath_,
+                  const std::string &newfullpath_)
+{
+  int rv;
+  int err;
+  std::string oldrelpath;
+  std::string newrelpath;
+  std::vector<DirFilter*> filters;
+  std::vector<std::pair<std::string,std::string>> relpaths;
+
+  if(!DirFilter::enabled())
+    return fs::rename(oldfullpath_,newfullpath_);
+
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    for(auto &kv : *g_REGISTRY)
+      {
+        if(!l::relative(kv.first,oldfullpath_,&oldrelpath))
+          continue;
+        if(!l::relative(kv.first,newfullpath_,&newrelpath))
+          continue;
+
+        kv.second->_pending.fetch_add(1);
+        filters.push_back(kv.second);
+        relpaths.emplace_back(oldrelpath,newrelpath);
+      }
+  }
+
+  rv  = fs::rename(oldfullpath_,newfullpath_);
+  err = errno;
+
+  for(size_t i = 0; i < filters.size(); i++)
+    {
+      if(rv == -1)
+        filters[i]->_pending.fetch_sub(1);
+      else
+        filters[i]->moved(relpaths[i].first,relpaths[i].second);
+    }
+
+  errno = err;
+
+  return rv;
+}
+
+bool
+DirFilter::parent_may_exist(const char *fusepath_)
+{
+  const char *slash;
+
+  if(!g_ENABLED.load(std::memory_order_relaxed))
+    return true;
+
+  if(_generation.load(std::memory_order_relaxed) !=
+     g_GENERATION.load(std::memory_order_relaxed))
+    build();
+
+  if(_rebuilding.load() || (_pending.load() > 0))
+    return true;
+
+  slash = strrchr(fusepath_,'/');
+  if((slash == NULL) || (slash == fusepath_))
+    return true;
+
+  return contains(l::hash(fusepath_,(slash - fusepath_)));
+}
+
+// A seqlock: if the table was modified while being read the answer
+// can't be trusted and the path is assumed to exist.
+bool
+DirFilter::contains(const uint64_t hash_)
+{
+  bool rv;
+  Table *table;
+  uint64_t seq;
+  rcu::ReadGuard guard;
+
+  table = _table.load(std::memory_order_acquire);
+  if((table == NULL) || table->saturated())
+    return true;
+
+  seq = _seq.load(std::memory_order_acquire);
+  if(seq & 1)
+    return true;
+
+  rv = table->contains(hash_);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if(_seq.load(std::memory_order_relaxed) != seq)
+    return true;
+
+  return rv;
+}
+
+void
+DirFilter::add(const std::string &fusepath_)
+{
+  bool rv;
+  uint64_t hash;
+  uint64_t seq;
+  Table *table;
+
+  hash = l::hash(fusepath_);
+
+  std::lock_guard<std::mutex> lg(_mutex);
+
+  if(_building != NULL)
+    _building->insert(hash);
+
+  table = _table.load(std::memory_order_relaxed);
+  if(table == NULL)
+    return;
+
+  seq = _seq.load(std::memory_order_relaxed);
+  _seq.store(seq + 1,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  rv = table->insert(hash);
+  _seq.store(seq + 2,std::memory_order_release);
+
+  if(rv == false)
+    {
+      _buckets = (table->size() * 2);
+      build();
+    }
+}
+
+void
+DirFilter::remove(const std::string &fusepath_)
+{
+  uint64_t hash;
+  uint64_t seq;
+  Table *table;
+
+  hash = l::hash(fusepath_);
+
+  std::lock_guard<std::mutex> lg(_mutex);
+
+  if(_building != NULL)
+    _building->remove(hash);
+
+  table = _table.load(std::memory_order_relaxed);
+  if(table == NULL)
+    return;
+
+  seq = _seq.load(std::memory_order_relaxed);
+  _seq.store(seq + 1,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  table->remove(hash);
+  _seq.store(seq + 2,std::memory_order_release);
+}
+
+/*
+  Everything below a renamed directory moves with it. Called with the
+  rename already counted as pending. The paths are updated in the
+  background, one rename after another, while paths on the branch are reported as possibly
+  existing. Something not in the filter isn't a directory it knows of
+  and is skipped unless other renames are pending as it may be the
+  new name from one of those. A build in progress may already have
+  passed either location so it is always updated.
+*/
+void
+DirFilter::moved(const std::string &oldfusepath_,
+                 const std::string &newfusepath_)
+{
+  if(!_rebuilding.load() && (_pending.load() == 1))
+    {
+      if((_table.load() == NULL) || !contains(l::hash(oldfusepath_)))
+        {
+          _pending.fetch_sub(1);
+          return;
+        }
+    }
+
+  std::call_once(_rename_once,
+                 [this]()
+                 {
+                   std::thread t(&DirFilter::rename_thread,this);
+                   t.detach();
+                 });
+
+  std::lock_guard<std::mutex> lg(_rename_mutex);
+
+  _renames.emplace_back(oldfusepath_,newfusepath_);
+  _rename_cv.notify_one();
+}
+
+// Filters are never freed so neither is their thread.
+void
+DirFilter::rename_thread(void)
+{
+  std::pair<std::string,std::string> r;
+
+  for(;;)
+    {
+      {
+        std::unique_lock<std::mutex> lk(_rename_mutex);
+
+        _rename_cv.wait(lk,[this]() { return !_renames.empty(); });
+        r = std::move(_renames.front());
+        _renames.pop_front();
+      }
+
+      apply_rename(r.first,r.second);
+    }
+}
+
+/*
+  If the new name is already gone, renamed again or removed, which
+  paths moved where can't be worked out so the filter is rebuilt. A
+  file or symlink renamed is simply ignored.
+*/
+void
+DirFilter::apply_rename(const std::string &oldfusepath_,
+                        const std::string &newfusepath_)
+{
+  int fd;
+  std::string fullpath;
+  std::string relpath;
+
+  fullpath = _path + newfusepath_;
+
+  fd = ::open(fullpath.c_str(),O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+  if(fd != -1)
+    {
+      remove(oldfusepath_);
+      add(newfusepath_);
+      l::walk(fd,
+              relpath,
+              [&](const std::string &relpath_)
+              {
+                remove(oldfusepath_ + relpath_);
+                add(newfusepath_ + relpath_);
+                return true;
+              });
+    }
+  else if((errno != ENOTDIR) && (errno != ELOOP))
+    {
+      build();
+    }
+
+  _pending.fetch_sub(1);
+}
+
+void
+DirFilter::build(void)
+{
+  if(_rebuilding.exchange(true))
+    return;
+
+  _generation.store(g_GENERATION.load());
+
+  std::thread t(&DirFilter::build_thread,this);
+  t.detach();
+}
+
+bool
+DirFilter::crawl(Table *table_)
+{
+  int fd;
+  std::string fusepath;
+
+  fd = ::open(_path.c_str(),O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if(fd == -1)
+    return false;
+
+  l::walk(fd,
+          fusepath,
+          [&](const std::string &fusepath_)
+          {
+            uint64_t hash;
+
+            hash = l::hash(fusepath_);
+
+            std::lock_guard<std::mutex> lg(_mutex);
+            return table_->insert(hash);
+          });
+
+  return true;
+}
+
+/*
+  The new table is filled off to the side while changes are applied
+  to both it and the current table. If it fills up it is thrown away
+  and the crawl started over with twice the size. If the branch can't
+  be read there is no table and every path may exist.
+*/
+void
+DirFilter::build_thread(void)
+{
+  int err;
+  bool ok;
+  Table *old;
+  Table *table;
+  uint64_t buckets;
+  std::chrono::seconds elapsed;
+  std::chrono::steady_clock::time_point start;
+
+  start = std::chrono::steady_clock::now();
+  for(;;)
+    {
+      {
+        std::lock_guard<std::mutex> lg(_mutex);
+        buckets   = _buckets;
+        table     = new Table(buckets);
+        _building = table;
+      }
+
+      ok  = crawl(table);
+      err = errno;
+
+      std::lock_guard<std::mutex> lg(_mutex);
+      _building = NULL;
+      if(ok && table->saturated())
+        {
+          delete table;
+          _buckets = (buckets * 2);
+          continue;
+        }
+
+      if(!ok)
+        {
+          delete table;
+          table = NULL;
+        }
+
+      old = _table.exchange(table);
+      break;
+    }
+
+  if(old != NULL)
+    rcu::retire([old]() { delete old; });
+
+  elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
+  if(table == NULL)
+    syslog_error("dir-filter: unable to crawl %s - %s",
+                 _path.c_str(),
+                 strerror(err));
+  else
+    syslog_info("dir-filter: crawled %s in %lds using %lu buckets",
+                _path.c_str(),
+                (long)elapsed.count(),
+                buckets);
+
+  _rebuilding.store(false);
+}
@@ -0,0 +1,101 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+
+
+/*
+  An approximate set of the directories on a branch used to skip
+  looking for a path on branches where its parent directory doesn't
+  exist.
+
+  It is a cuckoo filter so directories can be removed as well as
+  added. It is filled by crawling the branch in the background and
+  kept current by mkdir, rmdir and rename through mergerfs. Renames
+  are made through the filter so it is marked as changing before the
+  rename happens and are applied to it in order by a thread per
+  filter. A false
+  positive only costs the lookup which would have happened anyway.
+  Until the crawl finishes, while a renamed directory's contents are
+  being updated or if the filter fills up every path is reported as
+  possibly existing.
+
+  Directories created on a branch directly rather than through
+  mergerfs are not seen until the filter is rebuilt.
+
+  Like BranchIO filters are keyed by path and outlive branches.
+*/
+class DirFilter
+{
+public:
+  static DirFilter *get(const std::string &path);
+
+  static bool enabled(void);
+  static void enabled(const bool);
+
+  static void added(const std::string &fullpath);
+  static void removed(const std::string &fullpath);
+  static int  rename(const std::string &oldfullpath,
+                     const std::string &newfullpath);
+
+public:
+  bool parent_may_exist(const char *fusepath);
+
+private:
+  DirFilter(const std::string &path);
+
+private:
+  class Table;
+
+private:
+  void add(const std::string &fusepath);
+  void remove(const std::string &fusepath);
+  void moved(const std::string &oldfusepath,
+             const std::string &newfusepath);
+  bool contains(const uint64_t hash);
+  void build(void);
+  void build_thread(void);
+  bool crawl(Table *table);
+  void rename_thread(void);
+  void apply_rename(const std::string &oldfusepath,
+                    const std::string &newfusepath);
+
+private:
+  const std::string      _path;
+  std::mutex             _mutex;
+  std::atomic<Table*>    _table;
+  Table                 *_building;
+  std::atomic<bool>      _rebuilding;
+  std::atomic<unsigned>  _pending;
+  std::atomic<uint64_t>  _seq;
+  std::atomic<uint64_t>  _generation;
+  uint64_t               _buckets;
+
+  std::once_flag                                   _rename_once;
+  std::mutex                                       _rename_mutex;
+  std::condition_variable                          _rename_cv;
+  std::deque<std::pair<std::string,std::string>>  _renames;
+};
@@ -16,10 +16,17 @@
 
 #pragma once
 
+#include "branches.hpp"
+#include "dedup_set.hpp"
 #include "fh.hpp"
 
+#include <cerrno>
+#include <memory>
 #include <string>
 
+#include <sys/types.h>
+#include <unistd.h>
+
 
 class DirInfo : public FH
 {
@@ -28,4 +35,37 @@ public:
     : FH(fusepath_)
   {
   }
+
+public:
+  // Where a streaming readdir (func.readdir=stream) left off. Kept
+  // between requests and recreated when the listing restarts.
+  struct Stream
+  {
+    Stream(const Branches::CPtr &branches_)
+      : branches(branches_),
+        branch(0),
+        fd(-1),
+        dev(0),
+        added(0),
+        err(ENOENT)
+    {
+    }
+
+    ~Stream()
+    {
+      if(fd != -1)
+        ::close(fd);
+    }
+
+    Branches::CPtr branches;
+    size_t         branch;
+    int            fd;
+    dev_t          dev;
+    DedupSet       names;
+    uint64_t       added;
+    int            err;
+  };
+
+public:
+  std::unique_ptr<Stream> stream;
 };
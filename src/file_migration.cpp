@@ -0,0 +1,1325 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "file_migration.hpp"
+
+#include "errno.hpp"
+#include "fileinfo.hpp"
+#include "fs_clonefile.hpp"
+#include "fs_clonepath.hpp"
+#include "fs_close.hpp"
+#include "fs_copy_file_range.hpp"
+#include "fs_dup.hpp"
+#include "fs_dup2.hpp"
+#include "fs_fadvise.hpp"
+#include "fs_fallocate.hpp"
+#include "fs_fdatasync.hpp"
+#include "fs_file_size.hpp"
+#include "fs_findonfs.hpp"
+#include "fs_fstat.hpp"
+#include "fs_fsync.hpp"
+#include "fs_ftruncate.hpp"
+#include "fs_futimens.hpp"
+#include "fs_getfl.hpp"
+#include "fs_has_space.hpp"
+#include "fs_mktemp.hpp"
+#include "fs_open.hpp"
+#include "fs_path.hpp"
+#include "fs_pread.hpp"
+#include "fs_pwriten.hpp"
+#include "fs_rename.hpp"
+#include "fs_splicen.hpp"
+#include "fs_unlink.hpp"
+#include "location_index.hpp"
+#include "policy_cache.hpp"
+#include "syslog.hpp"
+#include "ugid.hpp"
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+
+
+#define CHUNK_SIZE        (64 * 1024 * 1024)
+#define READWRITE_BUFSIZE (1024 * 1024)
+#define POOL_THREADS      2
+#define POOL_QUEUE_DEPTH  1024
+
+typedef std::multimap<std::string,std::weak_ptr<FileMigration>> Registry;
+
+static std::mutex            g_REGISTRY_LOCK;
+static Registry              g_REGISTRY;
+static std::atomic<uint64_t> g_LIVE(0);
+
+static std::once_flag        g_TP_ONCE;
+static ThreadPool           *g_TP = NULL;
+
+static std::atomic<uint64_t> g_STARTED(0);
+static std::atomic<uint64_t> g_COMPLETED(0);
+static std::atomic<uint64_t> g_FAILED(0);
+static std::atomic<uint64_t> g_BYTES_COPIED(0);
+static std::atomic<uint64_t> g_BYTES_REDIRECTED(0);
+
+namespace l
+{
+  static
+  uint64_t
+  now_ms(void)
+  {
+    using namespace std::chrono;
+
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  static
+  int
+  cleanup_flags(const int flags_)
+  {
+    return (flags_ & ~(O_TRUNC|O_CREAT|O_EXCL));
+  }
+
+  static
+  bool
+  shifts_range(const int mode_)
+  {
+    int shifting = 0;
+
+#ifdef FALLOC_FL_COLLAPSE_RANGE
+    shifting |= FALLOC_FL_COLLAPSE_RANGE;
+#endif
+#ifdef FALLOC_FL_INSERT_RANGE
+    shifting |= FALLOC_FL_INSERT_RANGE;
+#endif
+
+    return (mode_ & shifting);
+  }
+
+  static
+  bool
+  clears_range(const int mode_)
+  {
+    int clearing = 0;
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    clearing |= FALLOC_FL_PUNCH_HOLE;
+#endif
+#ifdef FALLOC_FL_ZERO_RANGE
+    clearing |= FALLOC_FL_ZERO_RANGE;
+#endif
+
+    return (mode_ & clearing);
+  }
+
+  static
+  int
+  copy(const int   fdin_,
+       const int   fdout_,
+       const off_t begin_,
+       const off_t end_)
+  {
+    int err;
+    ssize_t rv;
+    off_t off;
+    std::vector<char> buf;
+
+    buf.resize(READWRITE_BUFSIZE);
+    for(off = begin_; off < end_; off += rv)
+      {
+        rv = fs::pread(fdin_,&buf[0],std::min((off_t)buf.size(),end_ - off),off);
+        if(rv == -EINTR)
+          {
+            rv = 0;
+            continue;
+          }
+        if(rv < 0)
+          return rv;
+        if(rv == 0)
+          break;
+
+        rv = fs::pwriten(fdout_,&buf[0],rv,off,&err);
+        if(err < 0)
+          return err;
+      }
+
+    return 0;
+  }
+
+  static
+  ThreadPool*
+  pool(void)
+  {
+    std::call_once(g_TP_ONCE,
+                   []()
+                   {
+                     g_TP = new ThreadPool(POOL_THREADS,
+                                           POOL_QUEUE_DEPTH,
+                                           "moveonenospc");
+                   });
+
+    return g_TP;
+  }
+}
+
+int
+FileMigration::start(const Policy::Create &policy_,
+                     const Branches::CPtr &branches_,
+                     FileInfo             *fi_)
+{
+  int rv;
+  std::shared_ptr<FileMigration> m;
+
+  rv = FileMigration::join(fi_);
+  if(rv != -ENOENT)
+    return rv;
+
+  m.reset(new FileMigration(fi_));
+
+  rv = m->setup(policy_,branches_);
+  if(rv < 0)
+    return rv;
+
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    g_REGISTRY.emplace(m->_fusepath,m);
+  }
+
+  std::atomic_store(&fi_->migration,m);
+  g_STARTED.fetch_add(1,std::memory_order_relaxed);
+
+  syslog_info("moveonenospc: migrating %s from %s to %s",
+              m->_fusepath.c_str(),
+              m->_src_filepath.c_str(),
+              m->_dst_filepath.c_str());
+
+  l::pool()->enqueue_work([m]() { m->run(); });
+
+  return 0;
+}
+
+/*
+  A handle which was open before a move of its file started writes
+  to the original so runs out of space too. Two moves of the same
+  file would race on the rename and unlink so it is added to the one
+  under way. If that is already finishing it waits for it and is
+  pointed at the new location. -ENOENT if there is none.
+*/
+int
+FileMigration::join(FileInfo *fi_)
+{
+  int fd;
+  int rv;
+  int flags;
+  std::shared_ptr<FileMigration> m;
+
+  if(g_LIVE.load(std::memory_order_relaxed) == 0)
+    return -ENOENT;
+
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    auto range = g_REGISTRY.equal_range(fi_->fusepath);
+    for(auto i = range.first; (i != range.second) && !m; ++i)
+      m = i->second.lock();
+  }
+
+  if(!m)
+    return -ENOENT;
+
+  flags = fs::getfl(fi_->fd);
+  if(flags == -1)
+    return -errno;
+
+  {
+    std::lock_guard<std::mutex> lg(m->_mutex);
+
+    if(m->_state == State::FAILED)
+      return -EIO;
+    if(m->_state == State::ABORTED)
+      return -ENOSPC;
+    if((m->_state == State::RUNNING) && !m->_finishing)
+      {
+        m->_fis.emplace_back(fi_,flags);
+        std::atomic_store(&fi_->migration,m);
+        return 0;
+      }
+  }
+
+  if(m->wait() < 0)
+    return -EIO;
+
+  {
+    std::lock_guard<std::mutex> lg(m->_mutex);
+
+    if((m->_state != State::DONE) || m->_unlinked)
+      return -ENOSPC;
+  }
+
+  fd = m->reopen(flags);
+  if(fd < 0)
+    return fd;
+
+  rv = m->swap(fi_,fd);
+  if(rv < 0)
+    return rv;
+
+  return 1;
+}
+
+/*
+  Files opened after the move's final swap began can't be included
+  in it so are pointed at the new location once it is done.
+*/
+void
+FileMigration::attach(FileInfo *fi_)
+{
+  int fd;
+  int flags;
+  std::shared_ptr<FileMigration> m;
+
+  if(g_LIVE.load(std::memory_order_relaxed) == 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    auto i = g_REGISTRY.find(fi_->fusepath);
+    if(i != g_REGISTRY.end())
+      m = i->second.lock();
+  }
+
+  if(!m)
+    return;
+
+  flags = fs::getfl(fi_->fd);
+  if(flags == -1)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lg(m->_mutex);
+
+    if((m->_state == State::FAILED) ||
+       ((m->_state == State::RUNNING) && !m->_finishing))
+      {
+        m->_fis.emplace_back(fi_,flags);
+        std::atomic_store(&fi_->migration,m);
+        return;
+      }
+  }
+
+  if(m->wait() != 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lg(m->_mutex);
+
+    if((m->_state != State::DONE) || m->_unlinked)
+      return;
+  }
+
+  fd = m->reopen(flags);
+  if(fd < 0)
+    return;
+
+  std::lock_guard<std::mutex> lg(fi_->mutex);
+
+  m->swap(fi_,fd);
+}
+
+// Only waits if fi is about to be swapped.
+void
+FileMigration::detach(FileInfo *fi_)
+{
+  std::shared_ptr<FileMigration> m;
+
+  m = FileMigration::get(fi_);
+  if(!m)
+    return;
+
+  std::unique_lock<std::mutex> lk(m->_mutex);
+
+  m->_cv.wait(lk,[&]()
+  {
+    return (!m->_finishing || (m->_state != State::RUNNING));
+  });
+
+  for(auto i = m->_fis.begin(); i != m->_fis.end(); ++i)
+    {
+      if(i->first != fi_)
+        continue;
+      m->_fis.erase(i);
+      break;
+    }
+
+  std::atomic_store(&fi_->migration,std::shared_ptr<FileMigration>());
+}
+
+std::shared_ptr<FileMigration>
+FileMigration::get(FileInfo *fi_)
+{
+  if(g_LIVE.load(std::memory_order_relaxed) == 0)
+    return {};
+
+  return std::atomic_load(&fi_->migration);
+}
+
+int
+FileMigration::wait(FileInfo *fi_)
+{
+  std::shared_ptr<FileMigration> m;
+
+  m = FileMigration::get(fi_);
+  if(!m)
+    return 0;
+
+  return m->wait();
+}
+
+void
+FileMigration::wait(const char *fusepath_)
+{
+  std::vector<std::shared_ptr<FileMigration>> ms;
+
+  if(g_LIVE.load(std::memory_order_relaxed) == 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    auto range = g_REGISTRY.equal_range(fusepath_);
+    for(auto i = range.first; i != range.second; ++i)
+      {
+        std::shared_ptr<FileMigration> m = i->second.lock();
+        if(m)
+          ms.push_back(m);
+      }
+  }
+
+  for(auto &m : ms)
+    m->wait();
+}
+
+void
+FileMigration::fix_size(const char  *fusepath_,
+                        struct stat *st_)
+{
+  std::shared_ptr<FileMigration> m;
+
+  if(g_LIVE.load(std::memory_order_relaxed) == 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    auto i = g_REGISTRY.find(fusepath_);
+    if(i != g_REGISTRY.end())
+      m = i->second.lock();
+  }
+
+  if(m)
+    m->fix_size(st_);
+}
+
+FileMigration::Hold::Hold(const char *fusepath_)
+{
+  if(g_LIVE.load(std::memory_order_relaxed) == 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    auto range = g_REGISTRY.equal_range(fusepath_);
+    for(auto i = range.first; i != range.second; ++i)
+      {
+        std::shared_ptr<FileMigration> m = i->second.lock();
+        if(m)
+          _ms.push_back(m);
+      }
+  }
+
+  for(auto &m : _ms)
+    {
+      std::lock_guard<std::mutex> lg(m->_mutex);
+
+      m->_holds++;
+    }
+}
+
+FileMigration::Hold::~Hold()
+{
+  for(auto &m : _ms)
+    {
+      std::lock_guard<std::mutex> lg(m->_mutex);
+
+      m->_holds--;
+      m->_cv.notify_all();
+    }
+}
+
+// Once renamed into place the truncate by path already reached the
+// copy.
+void
+FileMigration::Hold::truncated(const off_t size_)
+{
+  for(auto &m : _ms)
+    {
+      {
+        std::lock_guard<std::mutex> lg(m->_mutex);
+
+        if((m->_state != State::RUNNING) || m->_renamed)
+          continue;
+      }
+
+      m->ftruncate(size_);
+    }
+}
+
+/*
+  The original is gone so the copy is not renamed into place. Open
+  handles are left on it and it is removed once done. Dropped from
+  the registry so a file created at the same path isn't mistaken for
+  the one being moved.
+*/
+void
+FileMigration::Hold::unlinked(void)
+{
+  for(auto &m : _ms)
+    {
+      {
+        std::lock_guard<std::mutex> lg(m->_mutex);
+
+        m->_unlinked = true;
+      }
+
+      std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+      auto range = g_REGISTRY.equal_range(m->_fusepath);
+      for(auto i = range.first; i != range.second;)
+        {
+          if(i->second.lock() == m)
+            i = g_REGISTRY.erase(i);
+          else
+            ++i;
+        }
+    }
+}
+
+uint64_t
+FileMigration::active(void)
+{
+  return g_LIVE.load(std::memory_order_relaxed);
+}
+
+/*
+  A summary line followed by a line per migration in progress with
+  the bytes of the original gone through, its size and the rate in
+  bytes per second.
+*/
+std::string
+FileMigration::stats(void)
+{
+  uint64_t now;
+  uint64_t running;
+  std::ostringstream lines;
+  std::ostringstream os;
+  std::vector<std::shared_ptr<FileMigration>> ms;
+
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    for(auto &kv : g_REGISTRY)
+      {
+        std::shared_ptr<FileMigration> m = kv.second.lock();
+        if(m)
+          ms.push_back(m);
+      }
+  }
+
+  now     = l::now_ms();
+  running = 0;
+  for(auto &m : ms)
+    {
+      int64_t progress;
+      uint64_t elapsed;
+      std::lock_guard<std::mutex> lg(m->_mutex);
+
+      if(m->_state != State::RUNNING)
+        continue;
+
+      running++;
+      progress = m->_progress.load(std::memory_order_relaxed);
+      elapsed  = std::max((uint64_t)1,now - m->_started_ms);
+      lines << '\n'
+            << m->_fusepath << ' '
+            << progress << '/' << m->_src_size << ' '
+            << ((progress * 1000) / elapsed);
+    }
+
+  os << "running=" << running
+     << " started=" << g_STARTED.load()
+     << " completed=" << g_COMPLETED.load()
+     << " failed=" << g_FAILED.load()
+     << " copied=" << g_BYTES_COPIED.load()
+     << " redirected=" << g_BYTES_REDIRECTED.load()
+     << lines.str();
+
+  return os.str();
+}
+
+FileMigration::FileMigration(FileInfo *fi_)
+  : _fi(fi_),
+    _fusepath(fi_->fusepath),
+    _srcfd(-1),
+    _dstfd(-1),
+    _srcwfd(-1),
+    _renamed(false),
+    _unlinked(false),
+    _keep_tmp(false),
+    _holds(0),
+    _use_copy_file_range(true),
+    _state(State::RUNNING),
+    _finishing(false),
+    _err(0),
+    _src_size(0),
+    _copied(0),
+    _chunk_begin(0),
+    _chunk_end(0),
+    _progress(0),
+    _started_ms(l::now_ms())
+{
+  g_LIVE.fetch_add(1,std::memory_order_relaxed);
+}
+
+FileMigration::~FileMigration()
+{
+  {
+    std::lock_guard<std::mutex> lg(g_REGISTRY_LOCK);
+    auto range = g_REGISTRY.equal_range(_fusepath);
+    for(auto i = range.first; i != range.second;)
+      {
+        if(i->second.expired())
+          i = g_REGISTRY.erase(i);
+        else
+          ++i;
+      }
+  }
+
+  if(_srcfd != -1)
+    fs::close(_srcfd);
+  if(_dstfd != -1)
+    fs::close(_dstfd);
+  if(_srcwfd != -1)
+    fs::close(_srcwfd);
+
+  if(!_renamed && !_keep_tmp && !_dst_tmp_filepath.empty())
+    {
+      const ugid::SetRootGuard ugid;
+      fs::unlink(_dst_tmp_filepath);
+    }
+
+  g_LIVE.fetch_sub(1,std::memory_order_relaxed);
+}
+
+/*
+  The same preparation the synchronous move did minus the copy. Runs
+  on the writing thread so the write which hit ENOSPC can land in the
+  new file.
+*/
+int
+FileMigration::setup(const Policy::Create &policy_,
+                     const Branches::CPtr &branches_)
+{
+  int rv;
+  int flags;
+  int64_t size;
+  std::string fusedir;
+  BasePaths dst_branch;
+  std::string src_branch;
+  const ugid::Set ugid(0,0);
+
+  rv = fs::findonfs(branches_,_fusepath,_fi->fd,&src_branch);
+  if(rv == -1)
+    return -errno;
+
+  rv = policy_(branches_,_fusepath,&dst_branch);
+  if(rv == -1)
+    return -errno;
+
+  flags = fs::getfl(_fi->fd);
+  if(flags == -1)
+    return -errno;
+
+  size = fs::file_size(_fi->fd);
+  if(size == -1)
+    return -errno;
+
+  if(fs::has_space(dst_branch[0],size) == false)
+    return -ENOSPC;
+
+  fusedir = fs::path::dirname(_fusepath);
+
+  rv = fs::clonepath(src_branch,dst_branch[0],fusedir);
+  if(rv == -1)
+    return -ENOSPC;
+
+  _src_filepath = fs::path::make(src_branch,_fusepath);
+  _srcfd = fs::open(_src_filepath,O_RDONLY);
+  if(_srcfd == -1)
+    return -ENOSPC;
+
+  _dst_filepath = fs::path::make(dst_branch[0],_fusepath);
+  std::tie(_dstfd,_dst_tmp_filepath) = fs::mktemp(_dst_filepath,O_RDWR);
+  if(_dstfd < 0)
+    {
+      _dst_tmp_filepath.clear();
+      return -ENOSPC;
+    }
+
+  rv = fs::ftruncate(_dstfd,size);
+  if(rv == -1)
+    return -ENOSPC;
+
+  _src_size = size;
+  _fis.emplace_back(_fi,flags);
+
+  fs::fadvise_sequential(_srcfd,0,size);
+
+  return 0;
+}
+
+void
+FileMigration::run(void)
+{
+  int rv;
+
+  rv = 0;
+  for(;;)
+    {
+      off_t begin;
+      off_t end;
+      std::vector<std::pair<off_t,off_t>> ranges;
+
+      {
+        std::lock_guard<std::mutex> lg(_mutex);
+
+        if(_copied >= _src_size)
+          break;
+
+        begin = _copied;
+        end   = std::min(_src_size,(off_t)(begin + CHUNK_SIZE));
+
+        _chunk_begin = begin;
+        _chunk_end   = end;
+
+        auto i = _written.upper_bound(begin);
+        if(i != _written.begin())
+          {
+            auto p = std::prev(i);
+            if(p->second > begin)
+              begin = p->second;
+          }
+        for(; (i != _written.end()) && (i->first < end); ++i)
+          {
+            if(i->first > begin)
+              ranges.emplace_back(begin,i->first);
+            begin = std::max(begin,i->second);
+          }
+        if(begin < end)
+          ranges.emplace_back(begin,end);
+      }
+
+      for(const auto &r : ranges)
+        {
+          rv = copy_range(r.first,r.second);
+          if(rv < 0)
+            break;
+        }
+
+      {
+        std::lock_guard<std::mutex> lg(_mutex);
+
+        _chunk_begin = _chunk_end = 0;
+        if(rv == 0)
+          _copied = end;
+        _progress.store(_copied,std::memory_order_relaxed);
+        _cv.notify_all();
+      }
+
+      if(rv < 0)
+        break;
+    }
+
+  if(rv == 0)
+    rv = finish();
+  if(rv == 0)
+    return;
+
+  std::lock_guard<std::mutex> lg(_mutex);
+
+  _err = rv;
+  g_FAILED.fetch_add(1,std::memory_order_relaxed);
+
+  rv = restore();
+  if(rv == 0)
+    {
+      _state = State::ABORTED;
+      syslog_error("moveonenospc: migrating %s to %s failed - %s;"
+                   " writes restored to %s",
+                   _fusepath.c_str(),
+                   _dst_filepath.c_str(),
+                   strerror(-_err),
+                   _src_filepath.c_str());
+    }
+  else
+    {
+      _state    = State::FAILED;
+      _keep_tmp = !_unlinked;
+      syslog_error("moveonenospc: migrating %s to %s failed - %s;"
+                   " restoring writes failed - %s;"
+                   " %s holds the file's current content",
+                   _fusepath.c_str(),
+                   _dst_filepath.c_str(),
+                   strerror(-_err),
+                   strerror(-rv),
+                   _dst_tmp_filepath.c_str());
+    }
+
+  _cv.notify_all();
+}
+
+/*
+  Called with _mutex held. Puts what was written to the copy back
+  into the original, provided it is still at its path, and sizes it
+  to match. The copy is then removed and the writable fd kept for
+  writes which follow.
+*/
+int
+FileMigration::restore(void)
+{
+  int fd;
+  int rv;
+  struct stat st;
+  struct stat src_st;
+  struct stat dst_st;
+  const ugid::Set ugid(0,0);
+
+  if(_unlinked)
+    return -ENOENT;
+
+  rv = fs::fstat(_srcfd,&src_st);
+  if(rv == -1)
+    return -errno;
+
+  rv = fs::fstat(_dstfd,&dst_st);
+  if(rv == -1)
+    return -errno;
+
+  fd = fs::open(_src_filepath,O_WRONLY);
+  if(fd == -1)
+    return -errno;
+
+  rv = fs::fstat(fd,&st);
+  if(rv == -1)
+    rv = -errno;
+  else if((st.st_dev != src_st.st_dev) || (st.st_ino != src_st.st_ino))
+    rv = -ESTALE;
+
+  for(auto i = _written.begin(); (rv >= 0) && (i != _written.end()); ++i)
+    rv = l::copy(_dstfd,fd,i->first,i->second);
+
+  if((rv >= 0) && (fs::ftruncate(fd,dst_st.st_size) == -1))
+    rv = -errno;
+
+  if(rv < 0)
+    {
+      fs::close(fd);
+      return rv;
+    }
+
+  _srcwfd = fd;
+  fs::unlink(_dst_tmp_filepath);
+  _dst_tmp_filepath.clear();
+
+  return 0;
+}
+
+/*
+  copy_file_range where the kernel allows it, which can be across
+  filesystems on some kernels and not others, falling back to
+  read/write.
+*/
+int
+FileMigration::copy_range(const off_t begin_,
+                          const off_t end_)
+{
+  int err;
+  ssize_t rv;
+  int64_t src_off;
+  int64_t dst_off;
+  std::vector<char> buf;
+
+  src_off = dst_off = begin_;
+  while(_use_copy_file_range && (src_off < end_))
+    {
+      rv = fs::copy_file_range(_srcfd,&src_off,_dstfd,&dst_off,end_ - src_off,0);
+      if((rv == -1) && (errno == EINTR))
+        continue;
+      if(rv == -1)
+        {
+          if(src_off != begin_)
+            return -errno;
+          _use_copy_file_range = false;
+          break;
+        }
+      if(rv == 0)
+        return 0;
+
+      g_BYTES_COPIED.fetch_add(rv,std::memory_order_relaxed);
+      _progress.store(src_off,std::memory_order_relaxed);
+    }
+
+  if(src_off >= end_)
+    return 0;
+
+  buf.resize(READWRITE_BUFSIZE);
+  while(src_off < end_)
+    {
+      rv = fs::pread(_srcfd,&buf[0],std::min((int64_t)buf.size(),end_ - src_off),src_off);
+      if(rv == -EINTR)
+        continue;
+      if(rv < 0)
+        return rv;
+      if(rv == 0)
+        return 0;
+
+      rv = fs::pwriten(_dstfd,&buf[0],rv,src_off,&err);
+      if(err < 0)
+        return err;
+
+      src_off += rv;
+      g_BYTES_COPIED.fetch_add(rv,std::memory_order_relaxed);
+      _progress.store(src_off,std::memory_order_relaxed);
+    }
+
+  return 0;
+}
+
+/*
+  Writes continue to go to the copy until each FileInfo is swapped
+  over so nothing is lost in between. Times are the original's atime
+  and the copy's mtime which reflects the writes made to it. Once
+  renamed it is the file so nothing after can fail the move. A
+  FileInfo which can't be reopened, or all of them if the file was
+  unlinked meanwhile, is pointed at the copy's own fd. One which
+  can't be swapped at all stays on the pair which from then on is
+  the copy alone.
+*/
+int
+FileMigration::finish(void)
+{
+  int fd;
+  int rv;
+  bool unlinked;
+  FileInfos fis;
+  std::vector<int> fds;
+  struct stat src_st;
+  struct stat dst_st;
+  struct timespec ts[2];
+  const ugid::Set ugid(0,0);
+
+  {
+    std::lock_guard<std::mutex> lg(_mutex);
+
+    _finishing = true;
+    fis = _fis;
+  }
+
+  rv = fs::fstat(_srcfd,&src_st);
+  if(rv == -1)
+    return -errno;
+
+  rv = fs::fstat(_dstfd,&dst_st);
+  if(rv == -1)
+    return -errno;
+
+  rv = fs::clonemetadata(_srcfd,_dstfd,src_st);
+  if(rv == -1)
+    return -errno;
+
+  ts[0] = *fs::stat_atime(&src_st);
+  ts[1] = *fs::stat_mtime(&dst_st);
+  fs::futimens(_dstfd,ts);
+
+  {
+    std::unique_lock<std::mutex> lk(_mutex);
+
+    _cv.wait(lk,[this]() { return (_holds == 0); });
+
+    unlinked = _unlinked;
+    if(!unlinked)
+      {
+        rv = fs::rename(_dst_tmp_filepath,_dst_filepath);
+        if(rv == -1)
+          return -errno;
+        _renamed = true;
+        g_LOCATION_INDEX.added(_dst_filepath);
+      }
+  }
+
+  for(const auto &fi : fis)
+    {
+      fd = (unlinked ? -1 : reopen(fi.second));
+      if(fd < 0)
+        fd = fs::dup(_dstfd);
+      fds.push_back(fd);
+    }
+
+  for(size_t i = 0; i < fis.size(); i++)
+    {
+      if(fds[i] == -1)
+        continue;
+
+      std::lock_guard<std::mutex> lg(fis[i].first->mutex);
+
+      swap(fis[i].first,fds[i]);
+    }
+
+  if(unlinked)
+    {
+      fs::unlink(_dst_tmp_filepath);
+      _dst_tmp_filepath.clear();
+    }
+  else
+    {
+      if(fs::unlink(_src_filepath) == 0)
+        g_LOCATION_INDEX.removed(_src_filepath);
+      g_POLICY_CACHE.erase(_fusepath.c_str());
+    }
+
+  g_COMPLETED.fetch_add(1,std::memory_order_relaxed);
+  syslog_info("moveonenospc: migrated %s to %s",
+              _fusepath.c_str(),
+              _dst_filepath.c_str());
+
+  std::lock_guard<std::mutex> lg(_mutex);
+
+  _state = State::DONE;
+  _cv.notify_all();
+
+  return 0;
+}
+
+int
+FileMigration::reopen(const int flags_)
+{
+  int fd;
+
+  fd = fs::open(_dst_filepath,l::cleanup_flags(flags_));
+  if(fd == -1)
+    return -errno;
+
+  return fd;
+}
+
+// Called with fi->mutex held. Takes ownership of fd.
+int
+FileMigration::swap(FileInfo  *fi_,
+                    const int  fd_)
+{
+  int rv;
+
+  rv = fs::dup2(fd_,fi_->fd);
+  fs::close(fd_);
+  if(rv == -1)
+    return -errno;
+
+  std::atomic_store(&fi_->migration,std::shared_ptr<FileMigration>());
+
+  return 0;
+}
+
+int
+FileMigration::wait_for_chunk(std::unique_lock<std::mutex> &lk_,
+                              const off_t                   begin_,
+                              const off_t                   end_)
+{
+  _cv.wait(lk_,[&]()
+  {
+    return ((_chunk_begin >= end_) || (_chunk_end <= begin_));
+  });
+
+  return ((_state == State::FAILED) ? -EIO : 0);
+}
+
+// Called with _mutex held. Where writes go.
+int
+FileMigration::target(void) const
+{
+  return ((_state == State::ABORTED) ? _srcwfd : _dstfd);
+}
+
+void
+FileMigration::add_written(off_t begin_,
+                           off_t end_)
+{
+  auto i = _written.upper_bound(begin_);
+
+  if(i != _written.begin())
+    {
+      auto p = std::prev(i);
+      if(p->second >= begin_)
+        {
+          begin_ = p->first;
+          end_   = std::max(end_,p->second);
+          i      = _written.erase(p);
+        }
+    }
+
+  while((i != _written.end()) && (i->first <= end_))
+    {
+      end_ = std::max(end_,i->second);
+      i    = _written.erase(i);
+    }
+
+  _written[begin_] = end_;
+}
+
+// Where [pos,end) starts being read from and where that stops.
+void
+FileMigration::source(const off_t  pos_,
+                      const off_t  end_,
+                      off_t       *seg_end_,
+                      bool        *from_dst_) const
+{
+  if(_state == State::ABORTED)
+    {
+      *from_dst_ = false;
+      *seg_end_  = end_;
+      return;
+    }
+
+  if((pos_ >= _src_size) || (_state == State::DONE))
+    {
+      *from_dst_ = true;
+      *seg_end_  = end_;
+      return;
+    }
+
+  auto i = _written.upper_bound(pos_);
+  if(i != _written.begin())
+    {
+      auto p = std::prev(i);
+      if(p->second > pos_)
+        {
+          *from_dst_ = true;
+          *seg_end_  = std::min(end_,p->second);
+          return;
+        }
+    }
+
+  *from_dst_ = false;
+  *seg_end_  = std::min(end_,_src_size);
+  if(i != _written.end())
+    *seg_end_ = std::min(*seg_end_,i->first);
+}
+
+ssize_t
+FileMigration::pwrite(const void   *buf_,
+                      const size_t  count_,
+                      const off_t   offset_,
+                      int          *err_)
+{
+  ssize_t rv;
+  std::unique_lock<std::mutex> lk(_mutex);
+
+  *err_ = wait_for_chunk(lk,offset_,offset_ + count_);
+  if(*err_ < 0)
+    return 0;
+
+  rv = fs::pwriten(target(),buf_,count_,offset_,err_);
+  if((rv > 0) && (_state != State::ABORTED))
+    {
+      add_written(offset_,offset_ + rv);
+      g_BYTES_REDIRECTED.fetch_add(rv,std::memory_order_relaxed);
+    }
+
+  return rv;
+}
+
+ssize_t
+FileMigration::splice(const int     pipefd_,
+                      const size_t  count_,
+                      const off_t   offset_,
+                      int          *err_)
+{
+  ssize_t rv;
+  std::unique_lock<std::mutex> lk(_mutex);
+
+  *err_ = wait_for_chunk(lk,offset_,offset_ + count_);
+  if(*err_ < 0)
+    return 0;
+
+  rv = fs::splicen(pipefd_,target(),count_,offset_,err_);
+  if((rv > 0) && (_state != State::ABORTED))
+    {
+      add_written(offset_,offset_ + rv);
+      g_BYTES_REDIRECTED.fetch_add(rv,std::memory_order_relaxed);
+    }
+
+  return rv;
+}
+
+ssize_t
+FileMigration::pread(void         *buf_,
+                     const size_t  count_,
+                     const off_t   offset_)
+{
+  ssize_t rv;
+  off_t pos;
+  off_t end;
+  off_t seg_end;
+  bool from_dst;
+  std::lock_guard<std::mutex> lg(_mutex);
+
+  pos = offset_;
+  end = (offset_ + count_);
+  while(pos < end)
+    {
+      source(pos,end,&seg_end,&from_dst);
+
+      rv = fs::pread((from_dst ? _dstfd : _srcfd),
+                     (char*)buf_ + (pos - offset_),
+                     seg_end - pos,
+                     pos);
+      if(rv < 0)
+        return ((pos == offset_) ? rv : (pos - offset_));
+
+      pos += rv;
+      if(pos < seg_end)
+        break;
+    }
+
+  return (pos - offset_);
+}
+
+/*
+  The original is left alone. Shrinking below its size just means
+  less of it needs copying.
+*/
+int
+FileMigration::ftruncate(const off_t size_)
+{
+  int rv;
+  std::unique_lock<std::mutex> lk(_mutex);
+
+  rv = wait_for_chunk(lk,size_,std::numeric_limits<off_t>::max());
+  if(rv < 0)
+    return rv;
+
+  rv = fs::ftruncate(target(),size_);
+  if(rv == -1)
+    return -errno;
+
+  _src_size = std::min(_src_size,size_);
+
+  return 0;
+}
+
+/*
+  Allocating and clearing apply to the copy. A cleared range is
+  marked written so it isn't filled back in from the original.
+  Shifting ranges can't be done to the pair so waits for the move to
+  end and returns 1 to have it applied to the file as normal.
+*/
+int
+FileMigration::fallocate(const int   mode_,
+                         const off_t offset_,
+                         const off_t len_)
+{
+  int rv;
+  std::unique_lock<std::mutex> lk(_mutex);
+
+  if(l::shifts_range(mode_))
+    {
+      _cv.wait(lk,[this]() { return (_state != State::RUNNING); });
+      return ((_state == State::FAILED) ? -EIO : 1);
+    }
+
+  rv = wait_for_chunk(lk,offset_,offset_ + len_);
+  if(rv < 0)
+    return rv;
+
+  rv = fs::fallocate(target(),mode_,offset_,len_);
+  if(rv == -1)
+    return -errno;
+
+  if((_state != State::ABORTED) && l::clears_range(mode_))
+    add_written(offset_,offset_ + len_);
+
+  return 0;
+}
+
+// Both halves of the pair so whatever was acknowledged is on disk
+// whichever it landed in.
+int
+FileMigration::fsync(const int isdatasync_)
+{
+  int rv;
+
+  for(const int fd : {_srcfd,_dstfd})
+    {
+      rv = (isdatasync_ ?
+            fs::fdatasync(fd) :
+            fs::fsync(fd));
+      if(rv == -1)
+        return -errno;
+    }
+
+  std::lock_guard<std::mutex> lg(_mutex);
+
+  return ((_state == State::FAILED) ? -EIO : 0);
+}
+
+// The copy was sized to the original and grows with writes so holds
+// the current size.
+void
+FileMigration::fix_size(struct stat *st_)
+{
+  int rv;
+  struct stat st;
+  std::lock_guard<std::mutex> lg(_mutex);
+
+  if(_state == State::ABORTED)
+    return;
+
+  rv = fs::fstat(_dstfd,&st);
+  if(rv == -1)
+    return;
+
+  st_->st_size = st.st_size;
+}
+
+int
+FileMigration::wait(void)
+{
+  std::unique_lock<std::mutex> lk(_mutex);
+
+  _cv.wait(lk,[this]() { return (_state != State::RUNNING); });
+
+  return ((_state == State::FAILED) ? -EIO : 0);
+}
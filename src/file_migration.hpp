@@ -0,0 +1,197 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "branches.hpp"
+#include "policy.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+class FileInfo;
+
+
+/*
+  Background relocation of an open file for moveonenospc.
+
+  When a write fails for lack of space a temporary file is created on
+  the branch chosen by the moveonenospc policy and that write, and
+  those which follow, land there instead. Another handle of the same
+  file running out of space joins the move rather than starting its
+  own. A pool thread copies the
+  rest of the original over in large chunks skipping ranges already
+  written. Once done the copy is renamed into place, dup2'ed over the
+  fd of every FileInfo attached to it and the original unlinked.
+  Files opened while the move is under way are attached to it.
+
+  Until then reads of written ranges, and of anything past the
+  original's size, come from the copy. Writes overlapping the chunk
+  being copied wait for it. fsync syncs both files. truncate and
+  unlink by path hold off the rename until applied to the original
+  and are then applied to the copy, or in the case of unlink the
+  rename is skipped. Other operations which can't be applied to the
+  pair wait for the migration to finish.
+
+  The move carries on if every file is closed. If the copy fails the
+  ranges written to it are put back into the original and the pair
+  forwards everything there until closed. Should that fail too the
+  copy is kept, and its path logged, and writes return EIO. Once
+  renamed into place the copy is never removed. A handle which can't
+  be reopened there shares the copy's fd instead.
+*/
+class FileMigration
+{
+public:
+  // Called with fi->mutex held. 0 if writes are to go through
+  // fi->migration. 1 if the file had already been moved and fi now
+  // refers to the new location.
+  static int start(const Policy::Create &policy,
+                   const Branches::CPtr &branches,
+                   FileInfo             *fi);
+
+  static void attach(FileInfo *fi);
+  static void detach(FileInfo *fi);
+  static std::shared_ptr<FileMigration> get(FileInfo *fi);
+
+  static int  wait(FileInfo *fi);
+  static void wait(const char *fusepath);
+  static void fix_size(const char *fusepath, struct stat *st);
+
+  /*
+    Taken around a truncate or unlink by path. Keeps any move of the
+    file from being renamed into place until released so the change
+    can't land on the original only.
+  */
+  class Hold
+  {
+  public:
+    Hold(const char *fusepath);
+    ~Hold();
+
+  public:
+    void truncated(const off_t size);
+    void unlinked(void);
+
+  private:
+    std::vector<std::shared_ptr<FileMigration>> _ms;
+  };
+
+  static uint64_t    active(void);
+  static std::string stats(void);
+
+private:
+  static int join(FileInfo *fi);
+
+private:
+  FileMigration(FileInfo *fi);
+
+public:
+  ~FileMigration();
+
+public:
+  ssize_t pwrite(const void *buf,
+                 const size_t count,
+                 const off_t  offset,
+                 int         *err);
+  ssize_t splice(const int    pipefd,
+                 const size_t count,
+                 const off_t  offset,
+                 int         *err);
+  ssize_t pread(void         *buf,
+                const size_t  count,
+                const off_t   offset);
+  int     ftruncate(const off_t size);
+  int     fallocate(const int   mode,
+                    const off_t offset,
+                    const off_t len);
+  int     fsync(const int isdatasync);
+  void    fix_size(struct stat *st);
+  int     wait(void);
+
+private:
+  int  setup(const Policy::Create &policy,
+             const Branches::CPtr &branches);
+  void run(void);
+  int  reopen(const int flags);
+  int  swap(FileInfo *fi, const int fd);
+  int  copy_range(const off_t begin,
+                  const off_t end);
+  int  finish(void);
+  int  restore(void);
+  int  target(void) const;
+  int  wait_for_chunk(std::unique_lock<std::mutex> &lk,
+                      const off_t                   begin,
+                      const off_t                   end);
+  void add_written(const off_t begin,
+                   const off_t end);
+  void source(const off_t  pos,
+              const off_t  end,
+              off_t       *seg_end,
+              bool        *from_dst) const;
+
+private:
+  enum class State
+    {
+     RUNNING,
+     DONE,
+     FAILED,
+     ABORTED
+    };
+
+private:
+  typedef std::vector<std::pair<FileInfo*,int>> FileInfos;
+
+private:
+  FileInfo                *_fi;
+  const std::string        _fusepath;
+  std::string              _src_filepath;
+  std::string              _dst_filepath;
+  std::string              _dst_tmp_filepath;
+  int                      _srcfd;
+  int                      _dstfd;
+  int                      _srcwfd;
+  bool                     _renamed;
+  bool                     _unlinked;
+  bool                     _keep_tmp;
+  int                      _holds;
+  bool                     _use_copy_file_range;
+  std::mutex               _mutex;
+  std::condition_variable  _cv;
+  State                    _state;
+  bool                     _finishing;
+  int                      _err;
+  FileInfos                _fis;
+  off_t                    _src_size;
+  off_t                    _copied;
+  off_t                    _chunk_begin;
+  off_t                    _chunk_end;
+  std::map<off_t,off_t>    _written;
+  std::atomic<int64_t>     _progress;
+  uint64_t                 _started_ms;
+};
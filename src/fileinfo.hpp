@@ -19,8 +19,11 @@
 #include "fh.hpp"
 
 #include <cstdint>
-#include <string>
+#include <memory>
 #include <mutex>
+#include <string>
+
+class FileMigration;
 
 
 class FileInfo : public FH
@@ -39,4 +42,5 @@ public:
   int fd;
   uint32_t direct_io:1;
   std::mutex mutex;
+  std::shared_ptr<FileMigration> migration;
 };
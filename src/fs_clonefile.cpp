@@ -46,33 +46,47 @@ namespace l
 namespace fs
 {
   int
-  clonefile(const int src_fd_,
-            const int dst_fd_)
+  clonemetadata(const int          src_fd_,
+                const int          dst_fd_,
+                const struct stat &src_st_)
   {
     int rv;
-    struct stat src_st;
 
-    rv = fs::fstat(src_fd_,&src_st);
-    if(rv == -1)
+    rv = fs::attr::copy(src_fd_,dst_fd_);
+    if((rv == -1) && !l::ignorable_error(errno))
       return -1;
 
-    rv = fs::copydata(src_fd_,dst_fd_,src_st.st_size);
+    rv = fs::xattr::copy(src_fd_,dst_fd_);
+    if((rv == -1) && !l::ignorable_error(errno))
+      return -1;
+
+    rv = fs::fchown_check_on_error(dst_fd_,src_st_);
     if(rv == -1)
       return -1;
 
-    rv = fs::attr::copy(src_fd_,dst_fd_);
-    if((rv == -1) && !l::ignorable_error(errno))
+    rv = fs::fchmod_check_on_error(dst_fd_,src_st_);
+    if(rv == -1)
       return -1;
 
-    rv = fs::xattr::copy(src_fd_,dst_fd_);
-    if((rv == -1) && !l::ignorable_error(errno))
+    return 0;
+  }
+
+  int
+  clonefile(const int src_fd_,
+            const int dst_fd_)
+  {
+    int rv;
+    struct stat src_st;
+
+    rv = fs::fstat(src_fd_,&src_st);
+    if(rv == -1)
       return -1;
 
-    rv = fs::fchown_check_on_error(dst_fd_,src_st);
+    rv = fs::copydata(src_fd_,dst_fd_,src_st.st_size);
     if(rv == -1)
       return -1;
 
-    rv = fs::fchmod_check_on_error(dst_fd_,src_st);
+    rv = fs::clonemetadata(src_fd_,dst_fd_,src_st);
     if(rv == -1)
       return -1;
 
@@ -16,9 +16,17 @@
 
 #pragma once
 
+#include <sys/stat.h>
+
 
 namespace fs
 {
+  // Inode flags, xattrs, owner and mode. Not data or times.
+  int
+  clonemetadata(const int          src_fd,
+                const int          dst_fd,
+                const struct stat &src_st);
+
   int
   clonefile(const int src_fd,
             const int dst_fd);
@@ -14,6 +14,7 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "dir_filter.hpp"
 #include "errno.h"
 #include "fs_attr.hpp"
 #include "fs_clonepath.hpp"
@@ -23,6 +24,7 @@
 #include "fs_mkdir.hpp"
 #include "fs_path.hpp"
 #include "fs_xattr.hpp"
+#include "location_index.hpp"
 #include "ugid.hpp"
 
 #include <string>
@@ -98,6 +100,9 @@ namespace fs
           return -1;
       }
 
+    DirFilter::added(topath);
+    g_LOCATION_INDEX.added(topath);
+
     // it may not support it... it's fine...
     rv = fs::attr::copy(frompath,topath);
     if(return_metadata_errors_ && (rv == -1) && !l::ignorable_error(errno))
@@ -18,9 +18,15 @@
 
 #pragma once
 
+#include "branch.hpp"
+#include "branch_io.hpp"
+#include "dir_filter.hpp"
+#include "fs_fstatat.hpp"
 #include "fs_lstat.hpp"
 #include "fs_path.hpp"
 
+#include <cerrno>
+#include <memory>
 #include <string>
 
 
@@ -86,4 +92,90 @@ namespace fs
 
     return fs::exists(basepath_,relpath_,&st);
   }
+
+  // False when the branch's directory filter knows the parent
+  // directory of fusepath_ isn't there.
+  static
+  inline
+  bool
+  may_exist(const Branch &branch_,
+            const char   *fusepath_)
+  {
+    DirFilter *filter = branch_.dir_filter();
+
+    return ((filter == NULL) || filter->parent_may_exist(fusepath_));
+  }
+
+  static
+  inline
+  bool
+  exists_at(const Branch &branch_,
+            const char   *fusepath_,
+            struct stat  *st_)
+  {
+    int rv;
+
+    if(!fs::may_exist(branch_,fusepath_))
+      return (errno=ENOENT,false);
+
+    if(branch_.fd() < 0)
+      return fs::exists(branch_.path,fusepath_,st_);
+
+    rv = fs::fstatat_nofollow(branch_.fd(),
+                              fs::path::relative(fusepath_),
+                              st_);
+
+    return (rv == 0);
+  }
+
+  // The task holds a copy of the branch and its own buffers as the
+  // caller may time out and return before it runs.
+  static
+  inline
+  bool
+  exists(const Branch &branch_,
+         const char   *fusepath_,
+         struct stat  *st_)
+  {
+    int rv;
+
+    if(!BranchIO::enabled(branch_))
+      return fs::exists_at(branch_,fusepath_,st_);
+
+    std::string fusepath(fusepath_);
+    std::shared_ptr<struct stat> st = std::make_shared<struct stat>();
+
+    rv = BranchIO::run_on(branch_,[fusepath,st](const Branch &branch)
+    {
+      if(fs::exists_at(branch,fusepath.c_str(),st.get()))
+        return 0;
+      return -errno;
+    });
+    if(rv < 0)
+      return (errno=-rv,false);
+
+    *st_ = *st;
+
+    return true;
+  }
+
+  static
+  inline
+  bool
+  exists(const Branch &branch_,
+         const char   *fusepath_)
+  {
+    struct stat st;
+
+    return fs::exists(branch_,fusepath_,&st);
+  }
+
+  static
+  inline
+  bool
+  exists(const Branch      &branch_,
+         const std::string &fusepath_)
+  {
+    return fs::exists(branch_,fusepath_.c_str());
+  }
 }
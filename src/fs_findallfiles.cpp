@@ -17,6 +17,7 @@
 */
 
 #include "fs_exists.hpp"
+#include "fs_findallfiles.hpp"
 #include "fs_path.hpp"
 
 #include <string>
@@ -26,20 +27,18 @@
 namespace fs
 {
   void
-  findallfiles(const std::vector<std::string> &basepaths_,
-               const char                     *fusepath_,
-               std::vector<std::string>       *paths_)
+  findallfiles(const Branches::CPtr &branches_,
+               const char           *fusepath_,
+               StrVec               *paths_)
   {
-    std::string fullpath;
+    struct stat st;
 
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
+    for(const auto &branch : *branches_)
       {
-        fullpath = fs::path::make(basepaths_[i],fusepath_);
-
-        if(!fs::exists(fullpath))
+        if(!fs::exists(branch,fusepath_,&st))
           continue;
 
-        paths_->push_back(fullpath);
+        paths_->push_back(fs::path::make(branch.path,fusepath_));
       }
   }
 }
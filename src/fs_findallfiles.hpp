@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "branches.hpp"
 #include "strvec.hpp"
 
 #include <string>
@@ -27,7 +28,7 @@
 namespace fs
 {
   void
-  findallfiles(const StrVec &basepaths,
-               const char   *fusepath,
-               StrVec       *paths);
+  findallfiles(const Branches::CPtr &branches,
+               const char           *fusepath,
+               StrVec               *paths);
 }
@@ -0,0 +1,102 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "config_follow_symlinks.hpp"
+#include "fs_fstatat.hpp"
+
+
+namespace fs
+{
+  static
+  inline
+  void
+  set_stat_if_leads_to_dir(const int    dirfd_,
+                           const char  *relpath_,
+                           struct stat *st_)
+  {
+    int rv;
+    struct stat st;
+
+    rv = fs::fstatat(dirfd_,relpath_,&st,0);
+    if(rv == -1)
+      return;
+
+    if(S_ISDIR(st.st_mode))
+      *st_ = st;
+
+    return;
+  }
+
+  static
+  inline
+  void
+  set_stat_if_leads_to_reg(const int    dirfd_,
+                           const char  *relpath_,
+                           struct stat *st_)
+  {
+    int rv;
+    struct stat st;
+
+    rv = fs::fstatat(dirfd_,relpath_,&st,0);
+    if(rv == -1)
+      return;
+
+    if(S_ISREG(st.st_mode))
+      *st_ = st;
+
+    return;
+  }
+
+  static
+  inline
+  int
+  fstatat_follow(const int       dirfd_,
+                 const char     *relpath_,
+                 struct stat    *st_,
+                 FollowSymlinks  followsymlinks_)
+  {
+    int rv;
+
+    rv = -1;
+    switch(followsymlinks_)
+      {
+      case FollowSymlinks::ENUM::NEVER:
+        rv = fs::fstatat_nofollow(dirfd_,relpath_,st_);
+        break;
+      case FollowSymlinks::ENUM::DIRECTORY:
+        rv = fs::fstatat_nofollow(dirfd_,relpath_,st_);
+        if((rv == 0) && S_ISLNK(st_->st_mode))
+          fs::set_stat_if_leads_to_dir(dirfd_,relpath_,st_);
+        break;
+      case FollowSymlinks::ENUM::REGULAR:
+        rv = fs::fstatat_nofollow(dirfd_,relpath_,st_);
+        if((rv == 0) && S_ISLNK(st_->st_mode))
+          fs::set_stat_if_leads_to_reg(dirfd_,relpath_,st_);
+        break;
+      case FollowSymlinks::ENUM::ALL:
+        rv = fs::fstatat(dirfd_,relpath_,st_,0);
+        if(rv != 0)
+          rv = fs::fstatat_nofollow(dirfd_,relpath_,st_);
+        break;
+      }
+
+    return rv;
+  }
+}
@@ -16,36 +16,16 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
-#include "fs_info_t.hpp"
-#include "fs_path.hpp"
-#include "fs_stat.hpp"
-#include "fs_statvfs.hpp"
+#include "fs_info.hpp"
 #include "fs_statvfs_cache.hpp"
-#include "statvfs_util.hpp"
-
-#include <cstdint>
-#include <string>
-
-using std::string;
 
 
 namespace fs
 {
   int
-  info(const string &path_,
+  info(const Branch &branch_,
        fs::info_t   *info_)
   {
-    int rv;
-    struct statvfs st;
-
-    rv = fs::statvfs_cache(path_.c_str(),&st);
-    if(rv == 0)
-      {
-        info_->readonly   = StatVFS::readonly(st);
-        info_->spaceavail = StatVFS::spaceavail(st);
-        info_->spaceused  = StatVFS::spaceused(st);
-      }
-
-    return rv;
+    return fs::statvfs_cache(branch_,info_);
   }
 }
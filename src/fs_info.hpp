@@ -18,14 +18,13 @@
 
 #pragma once
 
+#include "branch.hpp"
 #include "fs_info_t.hpp"
 
-#include <string>
-
 
 namespace fs
 {
   int
-  info(const std::string &path,
-       fs::info_t        *info);
+  info(const Branch &branch,
+       fs::info_t   *info);
 }
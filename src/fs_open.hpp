@@ -72,4 +72,16 @@ namespace fs
   {
     return fs::open(path_,O_RDONLY|O_DIRECTORY);
   }
+
+  static
+  inline
+  int
+  open_dir_path(const std::string &path_)
+  {
+#ifdef O_PATH
+    return fs::open(path_,O_PATH|O_DIRECTORY|O_CLOEXEC);
+#else
+    return fs::open(path_,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+#endif
+  }
 }
@@ -51,6 +51,22 @@ namespace fs
       base_ += suffix_;
     }
 
+    /*
+      fusepaths are always absolute. For *at() calls relative to a
+      branch's directory fd the leading slash is dropped and the root
+      becomes ".".
+    */
+    static
+    inline
+    const char*
+    relative(const char *fusepath_)
+    {
+      if(fusepath_[0] == '/')
+        fusepath_++;
+
+      return ((fusepath_[0] == '\0') ? "." : fusepath_);
+    }
+
     static
     inline
     std::string
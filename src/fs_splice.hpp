@@ -1,5 +1,7 @@
 /*
-  Copyright (c) 2016, Antonio SJ Musumeci <trapexit@spawn.link>
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
 
   Permission to use, copy, modify, and/or distribute this software for any
   purpose with or without fee is hereby granted, provided that the above
@@ -16,23 +18,27 @@
 
 #pragma once
 
-#include "branches.hpp"
-#include "policy.hpp"
-
-#include <string>
+#include <fcntl.h>
 
 
 namespace fs
 {
-  int
-  movefile(const Policy::Create &policy,
-           const Branches::CPtr &branches,
-           const std::string    &fusepath,
-           int                   origfd);
-
-  int
-  movefile_as_root(const Policy::Create &policy,
-                   const Branches::CPtr &branches,
-                   const std::string    &fusepath,
-                   int                   origfd);
+  static
+  inline
+  ssize_t
+  splice(int const     fd_in_,
+         off_t        *off_in_,
+         int const     fd_out_,
+         off_t        *off_out_,
+         size_t const  len_,
+         unsigned int  flags_)
+  {
+    ssize_t rv;
+
+    rv = ::splice(fd_in_,off_in_,fd_out_,off_out_,len_,flags_);
+    if(rv == -1)
+      return -errno;
+
+    return rv;
+  }
 }
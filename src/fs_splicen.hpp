@@ -0,0 +1,58 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "fs_splice.hpp"
+
+
+namespace fs
+{
+  // Splice `count_` bytes from the pipe `pipefd_` to `fd_` at
+  // `offset_`. Data not moved remains in the pipe.
+  static
+  inline
+  ssize_t
+  splicen(int const     pipefd_,
+          int const     fd_,
+          size_t const  count_,
+          off_t const   offset_,
+          int          *err_)
+  {
+    ssize_t rv;
+    ssize_t count  = count_;
+    off_t   offset = offset_;
+
+    *err_ = 0;
+    while(count > 0)
+      {
+        rv = fs::splice(pipefd_,NULL,fd_,&offset,count,SPLICE_F_MOVE);
+        if(rv == 0)
+          return (count_ - count);
+        if(rv < 0)
+          {
+            *err_ = rv;
+            return (count_ - count);
+          }
+
+        count -= rv;
+      }
+
+    return count_;
+  }
+}
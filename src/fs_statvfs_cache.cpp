@@ -16,29 +16,24 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "fs_statvfs_cache.hpp"
+
+#include "branch_io.hpp"
 #include "fs_statvfs.hpp"
 #include "statvfs_util.hpp"
 
+#include <atomic>
+#include <cerrno>
 #include <cstdint>
-#include <map>
-#include <string>
+#include <memory>
+#include <thread>
 
-#include <pthread.h>
 #include <sys/statvfs.h>
 #include <time.h>
 
 
-struct Element
-{
-  uint64_t       time;
-  struct statvfs st;
-};
-
-typedef std::map<std::string,Element> statvfs_cache;
-
-static uint64_t        g_timeout    = 0;
-static statvfs_cache   g_cache;
-static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::atomic<uint64_t> g_timeout{0};
+static std::atomic<bool>     g_background{false};
 
 namespace l
 {
@@ -46,97 +41,320 @@ namespace l
   uint64_t
   get_time(void)
   {
-    uint64_t rv;
+    struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE,&ts);
+#else
+    ::clock_gettime(CLOCK_MONOTONIC,&ts);
+#endif
+
+    return ts.tv_sec;
+  }
+
+  static
+  int
+  statvfs_direct(const Branch &branch_,
+                 fs::info_t   *info_)
+  {
+    int rv;
+    struct statvfs st;
+
+    if(branch_.fd() >= 0)
+      rv = fs::fstatvfs(branch_.fd(),&st);
+    else
+      rv = fs::statvfs(branch_.path,&st);
+    if(rv == -1)
+      return -errno;
+
+    info_->readonly   = StatVFS::readonly(st);
+    info_->spaceavail = StatVFS::spaceavail(st);
+    info_->spaceused  = StatVFS::spaceused(st);
+
+    return 0;
+  }
+
+  static
+  int
+  statvfs(const Branch &branch_,
+          fs::info_t   *info_)
+  {
+    int rv;
 
-    rv = ::time(NULL);
+    if(!BranchIO::enabled(branch_))
+      return l::statvfs_direct(branch_,info_);
+
+    std::shared_ptr<fs::info_t> info = std::make_shared<fs::info_t>();
+
+    rv = BranchIO::run_on(branch_,[info](const Branch &branch)
+    {
+      return l::statvfs_direct(branch,info.get());
+    });
+    if(rv == 0)
+      *info_ = *info;
 
     return rv;
   }
+
+  /*
+    seq is odd while a write is in progress and 0 if nothing was ever
+    published. A writer which can't claim the entry drops its result
+    since someone else is publishing one just as fresh.
+  */
+  static
+  void
+  publish(fs::StatVFSCacheEntry *e_,
+          const int              err_,
+          const fs::info_t      &info_)
+  {
+    uint64_t seq;
+
+    seq = e_->seq.load(std::memory_order_relaxed);
+    if(seq & 1)
+      return;
+    if(!e_->seq.compare_exchange_strong(seq,seq + 1,
+                                        std::memory_order_acquire))
+      return;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    e_->err.store(err_,std::memory_order_relaxed);
+    e_->readonly.store(info_.readonly,std::memory_order_relaxed);
+    e_->spaceavail.store(info_.spaceavail,std::memory_order_relaxed);
+    e_->spaceused.store(info_.spaceused,std::memory_order_relaxed);
+
+    e_->seq.store(seq + 2,std::memory_order_release);
+  }
+
+  static
+  bool
+  read(const fs::StatVFSCacheEntry *e_,
+       int                         *err_,
+       fs::info_t                  *info_)
+  {
+    uint64_t seq;
+
+    for(;;)
+      {
+        seq = e_->seq.load(std::memory_order_acquire);
+        if(seq == 0)
+          return false;
+        if(seq & 1)
+          continue;
+
+        *err_              = e_->err.load(std::memory_order_relaxed);
+        info_->readonly   = e_->readonly.load(std::memory_order_relaxed);
+        info_->spaceavail = e_->spaceavail.load(std::memory_order_relaxed);
+        info_->spaceused  = e_->spaceused.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(e_->seq.load(std::memory_order_relaxed) == seq)
+          return true;
+      }
+  }
+
+  static
+  int
+  refresh(const Branch &branch_,
+          fs::info_t   *info_)
+  {
+    int err;
+
+    *info_ = fs::info_t();
+    branch_.statvfs_cache()->time.store(l::get_time(),
+                                        std::memory_order_relaxed);
+
+    err = l::statvfs(branch_,info_);
+    l::publish(branch_.statvfs_cache(),err,*info_);
+
+    return err;
+  }
+
+  /*
+    The branch is copied so its fd and cache entry outlive the
+    request which triggered the refresh. Skipped while the last one
+    is still running so a hung branch holds at most one thread.
+  */
+  static
+  void
+  refresh_async(const Branch &branch_)
+  {
+    fs::StatVFSCacheEntry *e;
+
+    e = branch_.statvfs_cache();
+    if(e->refreshing.exchange(true,std::memory_order_acquire))
+      return;
+
+    std::thread t([branch_,e]()
+                  {
+                    fs::info_t info;
+
+                    l::refresh(branch_,&info);
+                    e->refreshing.store(false,std::memory_order_release);
+                  });
+    t.detach();
+  }
+
+  /*
+    Only the request which claims an expired entry refreshes it and
+    does so off thread. It and everyone else use the previous result
+    rather than queuing up behind the syscall.
+  */
+  static
+  bool
+  claim_expired(fs::StatVFSCacheEntry *e_,
+                const uint64_t         timeout_)
+  {
+    uint64_t now;
+    uint64_t time;
+
+    now  = l::get_time();
+    time = e_->time.load(std::memory_order_relaxed);
+    if((now - time) <= timeout_)
+      return false;
+
+    return e_->time.compare_exchange_strong(time,now,
+                                            std::memory_order_relaxed);
+  }
 }
 
 namespace fs
 {
+  StatVFSCacheEntry::StatVFSCacheEntry()
+    : seq(0),
+      time(0),
+      err(0),
+      readonly(false),
+      spaceavail(0),
+      spaceused(0),
+      refreshing(false)
+  {
+  }
+
   uint64_t
   statvfs_cache_timeout(void)
   {
-    return g_timeout;
+    return g_timeout.load(std::memory_order_relaxed);
   }
 
   void
   statvfs_cache_timeout(const uint64_t timeout_)
   {
-    g_timeout = timeout_;
+    g_timeout.store(timeout_,std::memory_order_relaxed);
   }
 
-  int
-  statvfs_cache(const char     *path_,
-                struct statvfs *st_)
+  bool
+  statvfs_cache_background(void)
   {
-    int rv;
-    Element *e;
-    uint64_t now;
-
-    if(g_timeout == 0)
-      return fs::statvfs(path_,st_);
-
-    rv = 0;
-    now = l::get_time();
+    return g_background.load(std::memory_order_relaxed);
+  }
 
-    pthread_mutex_lock(&g_cache_lock);
+  void
+  statvfs_cache_background(const bool background_)
+  {
+    g_background.store(background_,std::memory_order_relaxed);
+  }
 
-    e = &g_cache[path_];
+  void
+  statvfs_cache_refresh(const Branches::CPtr &branches_)
+  {
+    fs::info_t info;
 
-    if((now - e->time) > g_timeout)
+    for(const auto &branch : *branches_)
       {
-        e->time = now;
-        rv = fs::statvfs(path_,&e->st);
+        if(branch.statvfs_cache() == NULL)
+          continue;
+
+        l::refresh(branch,&info);
       }
+  }
 
-    *st_ = e->st;
+  /*
+    Called when the branch is opened so requests always find a
+    result and never have to make the syscall themselves. Made
+    directly as this can happen before the process has forked. Not
+    needed when caching is off. Branches opened before it is turned
+    on at init are refreshed there instead.
+  */
+  void
+  statvfs_cache_seed(const Branch &branch_)
+  {
+    int err;
+    fs::info_t info;
+    StatVFSCacheEntry *e;
 
-    pthread_mutex_unlock(&g_cache_lock);
+    if(fs::statvfs_cache_timeout() == 0)
+      return;
 
-    return rv;
+    e = branch_.statvfs_cache();
+    if(e == NULL)
+      return;
+
+    e->time.store(l::get_time(),std::memory_order_relaxed);
+    err = l::statvfs_direct(branch_,&info);
+    l::publish(e,err,info);
+  }
+
+  int
+  statvfs_cache(const Branch &branch_,
+                fs::info_t   *info_)
+  {
+    int err;
+    uint64_t timeout;
+    StatVFSCacheEntry *e;
+
+    timeout = fs::statvfs_cache_timeout();
+    e       = branch_.statvfs_cache();
+    if((timeout == 0) || (e == NULL))
+      err = l::statvfs(branch_,info_);
+    else if(!l::read(e,&err,info_))
+      err = l::refresh(branch_,info_);
+    else if(!fs::statvfs_cache_background() && l::claim_expired(e,timeout))
+      l::refresh_async(branch_);
+
+    if(err < 0)
+      return (errno=-err,-1);
+
+    return 0;
   }
 
   int
-  statvfs_cache_readonly(const std::string &path_,
-                         bool              *readonly_)
+  statvfs_cache_readonly(const Branch &branch_,
+                         bool         *readonly_)
   {
     int rv;
-    struct statvfs st;
+    fs::info_t info;
 
-    rv = fs::statvfs_cache(path_.c_str(),&st);
+    rv = fs::statvfs_cache(branch_,&info);
     if(rv == 0)
-      *readonly_ = StatVFS::readonly(st);
+      *readonly_ = info.readonly;
 
     return rv;
   }
 
   int
-  statvfs_cache_spaceavail(const std::string &path_,
-                           uint64_t          *spaceavail_)
+  statvfs_cache_spaceavail(const Branch &branch_,
+                           uint64_t     *spaceavail_)
   {
     int rv;
-    struct statvfs st;
+    fs::info_t info;
 
-    rv = fs::statvfs_cache(path_.c_str(),&st);
+    rv = fs::statvfs_cache(branch_,&info);
     if(rv == 0)
-      *spaceavail_ = StatVFS::spaceavail(st);
+      *spaceavail_ = info.spaceavail;
 
     return rv;
   }
 
   int
-  statvfs_cache_spaceused(const std::string &path_,
-                          uint64_t          *spaceused_)
+  statvfs_cache_spaceused(const Branch &branch_,
+                          uint64_t     *spaceused_)
   {
     int rv;
-    struct statvfs st;
+    fs::info_t info;
 
-    rv = fs::statvfs_cache(path_.c_str(),&st);
+    rv = fs::statvfs_cache(branch_,&info);
     if(rv == 0)
-      *spaceused_ = StatVFS::spaceused(st);
+      *spaceused_ = info.spaceused;
 
     return rv;
   }
@@ -18,31 +18,68 @@
 
 #pragma once
 
+#include "branch.hpp"
+#include "branches.hpp"
+#include "fs_info_t.hpp"
+
+#include <atomic>
 #include <cstdint>
+#include <string>
 
 #include <sys/statvfs.h>
 
 
 namespace fs
 {
+  /*
+    Per branch cached statvfs results. Published by a single writer
+    at a time under a seqlock so readers never block on a refresh.
+    At most one refresh made on behalf of requests runs per entry.
+  */
+  class StatVFSCacheEntry
+  {
+  public:
+    StatVFSCacheEntry();
+
+  public:
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> time;
+    std::atomic<int>      err;
+    std::atomic<bool>     readonly;
+    std::atomic<uint64_t> spaceavail;
+    std::atomic<uint64_t> spaceused;
+    std::atomic<bool>     refreshing;
+  };
+
   uint64_t
   statvfs_cache_timeout(void);
   void
   statvfs_cache_timeout(const uint64_t timeout);
 
+  bool
+  statvfs_cache_background(void);
+  void
+  statvfs_cache_background(const bool background);
+
+  void
+  statvfs_cache_refresh(const Branches::CPtr &branches);
+
+  void
+  statvfs_cache_seed(const Branch &branch);
+
   int
-  statvfs_cache(const char     *path,
-                struct statvfs *st);
+  statvfs_cache(const Branch &branch,
+                fs::info_t   *info);
 
   int
-  statvfs_cache_readonly(const std::string &path,
-                         bool              *readonly);
+  statvfs_cache_readonly(const Branch &branch,
+                         bool         *readonly);
 
   int
-  statvfs_cache_spaceavail(const std::string &path,
-                           uint64_t          *spaceavail);
+  statvfs_cache_spaceavail(const Branch &branch,
+                           uint64_t     *spaceavail);
 
   int
-  statvfs_cache_spaceused(const std::string &path,
-                          uint64_t          *spaceused);
+  statvfs_cache_spaceused(const Branch &branch,
+                          uint64_t     *spaceused);
 }
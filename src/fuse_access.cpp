@@ -38,7 +38,7 @@ namespace l
   {
     int rv;
     string fullpath;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = searchFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
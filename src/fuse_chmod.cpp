@@ -14,6 +14,7 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
 #include "config.hpp"
 #include "errno.hpp"
 #include "fs_lchmod.hpp"
@@ -53,11 +54,10 @@ namespace l
   }
 
   static
-  void
+  int
   chmod_loop_core(const string &basepath_,
                   const char   *fusepath_,
-                  const mode_t  mode_,
-                  PolicyRV     *prv_)
+                  const mode_t  mode_)
   {
     string fullpath;
 
@@ -66,20 +66,22 @@ namespace l
     errno = 0;
     fs::lchmod(fullpath,mode_);
 
-    prv_->insert(errno,basepath_);
+    return errno;
   }
 
   static
   void
-  chmod_loop(const StrVec &basepaths_,
-             const char   *fusepath_,
-             const mode_t  mode_,
-             PolicyRV     *prv_)
+  chmod_loop(const BasePaths &basepaths_,
+             const char      *fusepath_,
+             const mode_t     mode_,
+             PolicyRV        *prv_)
   {
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
-      {
-        l::chmod_loop_core(basepaths_[i],fusepath_,mode_,prv_);
-      }
+    BranchFanOut::run(basepaths_,
+                      [=](const string &basepath_)
+                      {
+                        return l::chmod_loop_core(basepath_,fusepath_,mode_);
+                      },
+                      prv_);
   }
 
   static
@@ -92,7 +94,7 @@ namespace l
   {
     int rv;
     PolicyRV prv;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = actionFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -14,6 +14,7 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
 #include "config.hpp"
 #include "errno.hpp"
 #include "fs_lchown.hpp"
@@ -24,10 +25,8 @@
 #include "fuse.h"
 
 #include <string>
-#include <vector>
 
 using std::string;
-using std::vector;
 
 
 namespace l
@@ -53,12 +52,11 @@ namespace l
   }
 
   static
-  void
+  int
   chown_loop_core(const string &basepath_,
                   const char   *fusepath_,
                   const uid_t   uid_,
-                  const gid_t   gid_,
-                  PolicyRV     *prv_)
+                  const gid_t   gid_)
   {
     string fullpath;
 
@@ -67,21 +65,23 @@ namespace l
     errno = 0;
     fs::lchown(fullpath,uid_,gid_);
 
-    prv_->insert(errno,basepath_);
+    return errno;
   }
 
   static
   void
-  chown_loop(const vector<string> &basepaths_,
+  chown_loop(const BasePaths      &basepaths_,
              const char           *fusepath_,
              const uid_t           uid_,
              const gid_t           gid_,
              PolicyRV             *prv_)
   {
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
-      {
-        l::chown_loop_core(basepaths_[i],fusepath_,uid_,gid_,prv_);
-      }
+    BranchFanOut::run(basepaths_,
+                      [=](const string &basepath_)
+                      {
+                        return l::chown_loop_core(basepath_,fusepath_,uid_,gid_);
+                      },
+                      prv_);
   }
 
   static
@@ -95,7 +95,7 @@ namespace l
   {
     int rv;
     PolicyRV prv;
-    vector<string> basepaths;
+    BasePaths basepaths;
 
     rv = actionFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -15,6 +15,7 @@
 */
 
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_copy_file_range.hpp"
 
@@ -60,6 +61,10 @@ namespace FUSE
     FileInfo *fi_in  = reinterpret_cast<FileInfo*>(ffi_in_->fh);
     FileInfo *fi_out = reinterpret_cast<FileInfo*>(ffi_out_->fh);
 
+    FileMigration::wait(fi_in);
+    if(FileMigration::wait(fi_out) < 0)
+      return -EIO;
+
     return l::copy_file_range(fi_in->fd,
                               offset_in_,
                               fi_out->fd,
@@ -16,11 +16,17 @@
 
 #include "config.hpp"
 #include "errno.hpp"
+#include "branch_io.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_acl.hpp"
 #include "fs_clonepath.hpp"
+#include "fs_close.hpp"
 #include "fs_open.hpp"
 #include "fs_path.hpp"
+#include "fuse_passthrough.hpp"
+#include "location_index.hpp"
+#include "policy_cache.hpp"
 #include "procfs_get_name.hpp"
 #include "ugid.hpp"
 
@@ -147,23 +153,96 @@ namespace l
 
   static
   int
-  create_core(const std::string &createpath_,
-              const char        *fusepath_,
-              fuse_file_info_t  *ffi_,
-              const mode_t       mode_,
-              const mode_t       umask_)
+  create_fd(const std::string &existingpath_,
+            const std::string &createpath_,
+            const std::string &fusepath_,
+            const int          flags_,
+            const mode_t       mode_,
+            const mode_t       umask_)
   {
     int rv;
-    FileInfo *fi;
     std::string fullpath;
+    std::string fusedirpath;
+
+    fusedirpath = fs::path::dirname(fusepath_);
+
+    rv = fs::clonepath_as_root(existingpath_,createpath_,fusedirpath);
+    if(rv == -1)
+      return -errno;
 
     fullpath = fs::path::make(createpath_,fusepath_);
 
-    rv = l::create_core(fullpath,mode_,umask_,ffi_->flags);
+    rv = l::create_core(fullpath,mode_,umask_,flags_);
     if(rv == -1)
       return -errno;
 
+    return rv;
+  }
+
+  // Made on the create branch's own threads, as the caller, so a hung
+  // branch doesn't tie up the FUSE threads. If the caller times out
+  // first the file is closed once the create does return.
+  static
+  int
+  create_fd_branch_io(const std::string &existingpath_,
+                      const Branch      &createbranch_,
+                      const char        *fusepath_,
+                      const int          flags_,
+                      const mode_t       mode_,
+                      const mode_t       umask_)
+  {
+    if(!BranchIO::enabled(createbranch_))
+      return l::create_fd(existingpath_,
+                          createbranch_.path,
+                          fusepath_,
+                          flags_,
+                          mode_,
+                          umask_);
+
+    std::string existingpath(existingpath_);
+    std::string fusepath(fusepath_);
+
+    return BranchIO::run_as(createbranch_,
+                            [existingpath,fusepath,
+                             flags_,mode_,umask_](const Branch &branch)
+    {
+      return l::create_fd(existingpath,
+                          branch.path,
+                          fusepath,
+                          flags_,
+                          mode_,
+                          umask_);
+    },
+    [](const int fd_)
+    {
+      if(fd_ >= 0)
+        fs::close(fd_);
+    });
+  }
+
+  static
+  int
+  create_core(const std::string &existingpath_,
+              const Branch      &createbranch_,
+              const char        *fusepath_,
+              fuse_file_info_t  *ffi_,
+              const mode_t       mode_,
+              const mode_t       umask_)
+  {
+    int rv;
+    FileInfo *fi;
+
+    rv = l::create_fd_branch_io(existingpath_,
+                                createbranch_,
+                                fusepath_,
+                                ffi_->flags,
+                                mode_,
+                                umask_);
+    if(rv < 0)
+      return rv;
+
     fi = new FileInfo(rv,fusepath_,ffi_->direct_io);
+    FileMigration::attach(fi);
 
     ffi_->fh = reinterpret_cast<uint64_t>(fi);
 
@@ -181,10 +260,9 @@ namespace l
          const mode_t          umask_)
   {
     int rv;
-    std::string fullpath;
     std::string fusedirpath;
-    StrVec createpaths;
-    StrVec existingpaths;
+    BasePaths createpaths;
+    BasePaths existingpaths;
 
     fusedirpath = fs::path::dirname(fusepath_);
 
@@ -196,15 +274,16 @@ namespace l
     if(rv == -1)
       return -errno;
 
-    rv = fs::clonepath_as_root(existingpaths[0],createpaths[0],fusedirpath);
-    if(rv == -1)
-      return -errno;
+    rv = l::create_core(existingpaths[0],
+                        createpaths.branch(0),
+                        fusepath_,
+                        ffi_,
+                        mode_,
+                        umask_);
+    if(rv == 0)
+      g_LOCATION_INDEX.add(branches_,fusepath_,createpaths.branch(0));
 
-    return l::create_core(createpaths[0],
-                          fusepath_,
-                          ffi_,
-                          mode_,
-                          umask_);
+    return rv;
   }
 }
 
@@ -238,6 +317,7 @@ namespace FUSE
     if(rv == -EROFS)
       {
         Config::Write()->branches.find_and_set_mode_ro();
+        cfg.refresh();
         rv = l::create(cfg->func.getattr.policy,
                        cfg->func.create.policy,
                        cfg->branches,
@@ -247,6 +327,11 @@ namespace FUSE
                        fc->umask);
       }
 
+    g_POLICY_CACHE.erase(fusepath_);
+
+    if(rv == 0)
+      FUSE::passthrough_if_wanted(cfg,ffi_);
+
     return rv;
   }
 }
@@ -15,6 +15,7 @@
 */
 
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_fallocate.hpp"
 
@@ -46,7 +47,16 @@ namespace FUSE
             off_t                   offset_,
             off_t                   len_)
   {
+    int rv;
     FileInfo *fi = reinterpret_cast<FileInfo*>(ffi_->fh);
+    std::shared_ptr<FileMigration> m = FileMigration::get(fi);
+
+    if(m)
+      {
+        rv = m->fallocate(mode_,offset_,len_);
+        if(rv <= 0)
+          return rv;
+      }
 
     return l::fallocate(fi->fd,
                         mode_,
@@ -16,6 +16,7 @@
 
 #include "config.hpp"
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_fstat.hpp"
 #include "fs_inode.hpp"
@@ -55,6 +56,12 @@ namespace FUSE
     FileInfo *fi = reinterpret_cast<FileInfo*>(ffi_->fh);
 
     rv = l::fgetattr(fi->fd,fi->fusepath,st_);
+    if(rv == 0)
+      {
+        std::shared_ptr<FileMigration> m = FileMigration::get(fi);
+        if(m)
+          m->fix_size(st_);
+      }
 
     timeout_->entry = ((rv >= 0) ?
                        cfg->cache_entry :
@@ -15,6 +15,7 @@
 */
 
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_fdatasync.hpp"
 #include "fs_fsync.hpp"
@@ -49,6 +50,10 @@ namespace FUSE
         int                     isdatasync_)
   {
     FileInfo *fi = reinterpret_cast<FileInfo*>(ffi_->fh);
+    std::shared_ptr<FileMigration> m = FileMigration::get(fi);
+
+    if(m)
+      return m->fsync(isdatasync_);
 
     return l::fsync(fi->fd,isdatasync_);
   }
@@ -15,6 +15,7 @@
 */
 
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_ftruncate.hpp"
 
@@ -43,6 +44,10 @@ namespace FUSE
             off_t                   size_)
   {
     FileInfo *fi = reinterpret_cast<FileInfo*>(ffi_->fh);
+    std::shared_ptr<FileMigration> m = FileMigration::get(fi);
+
+    if(m)
+      return m->ftruncate(size_);
 
     return l::ftruncate(fi->fd,size_);
   }
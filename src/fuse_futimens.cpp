@@ -15,6 +15,7 @@
 */
 
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_futimens.hpp"
 
@@ -46,8 +47,13 @@ namespace FUSE
   futimens(const fuse_file_info_t *ffi_,
            const struct timespec   ts_[2])
   {
+    int rv;
     FileInfo *fi = reinterpret_cast<FileInfo*>(ffi_->fh);
 
+    rv = FileMigration::wait(fi);
+    if(rv < 0)
+      return rv;
+
     return l::futimens(fi->fd,ts_);
   }
 }
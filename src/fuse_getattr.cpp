@@ -16,15 +16,18 @@
 
 #include "config.hpp"
 #include "errno.hpp"
+#include "branch_io.hpp"
+#include "file_migration.hpp"
+#include "fs_fstatat_follow.hpp"
 #include "fs_inode.hpp"
-#include "fs_lstat.hpp"
 #include "fs_path.hpp"
-#include "fs_stat.hpp"
+#include "policy_cache.hpp"
 #include "symlinkify.hpp"
 #include "ugid.hpp"
 
 #include "fuse.h"
 
+#include <memory>
 #include <string>
 
 using std::string;
@@ -32,42 +35,6 @@ using std::string;
 
 namespace l
 {
-  static
-  void
-  set_stat_if_leads_to_dir(const std::string &path_,
-                           struct stat       *st_)
-  {
-    int rv;
-    struct stat st;
-
-    rv = fs::stat(path_,&st);
-    if(rv == -1)
-      return;
-
-    if(S_ISDIR(st.st_mode))
-      *st_ = st;
-
-    return;
-  }
-
-  static
-  void
-  set_stat_if_leads_to_reg(const std::string &path_,
-                           struct stat       *st_)
-  {
-    int rv;
-    struct stat st;
-
-    rv = fs::stat(path_,&st);
-    if(rv == -1)
-      return;
-
-    if(S_ISREG(st.st_mode))
-      *st_ = st;
-
-    return;
-  }
-
   static
   int
   getattr_controlfile(struct stat *st_)
@@ -95,51 +62,98 @@ namespace l
 
   static
   int
-  getattr(const Policy::Search &searchFunc_,
-          const Branches       &branches_,
+  fstatat(const Branch         &branch_,
           const char           *fusepath_,
           struct stat          *st_,
-          const bool            symlinkify_,
-          const time_t          symlinkify_timeout_,
-          FollowSymlinks        followsymlinks_)
+          const FollowSymlinks  followsymlinks_)
   {
     int rv;
+    int dirfd;
     string fullpath;
-    StrVec basepaths;
+    const char *relpath;
 
-    rv = searchFunc_(branches_,fusepath_,&basepaths);
+    dirfd = branch_.fd();
+    if(dirfd < 0)
+      {
+        fullpath = fs::path::make(branch_.path,fusepath_);
+        dirfd    = AT_FDCWD;
+        relpath  = fullpath.c_str();
+      }
+    else
+      {
+        relpath = fs::path::relative(fusepath_);
+      }
+
+    rv = fs::fstatat_follow(dirfd,relpath,st_,followsymlinks_);
     if(rv == -1)
       return -errno;
 
-    fullpath = fs::path::make(basepaths[0],fusepath_);
+    return 0;
+  }
 
-    switch(followsymlinks_)
-      {
-      case FollowSymlinks::ENUM::NEVER:
-        rv = fs::lstat(fullpath,st_);
-        break;
-      case FollowSymlinks::ENUM::DIRECTORY:
-        rv = fs::lstat(fullpath,st_);
-        if(S_ISLNK(st_->st_mode))
-          l::set_stat_if_leads_to_dir(fullpath,st_);
-        break;
-      case FollowSymlinks::ENUM::REGULAR:
-        rv = fs::lstat(fullpath,st_);
-        if(S_ISLNK(st_->st_mode))
-          l::set_stat_if_leads_to_reg(fullpath,st_);
-        break;
-      case FollowSymlinks::ENUM::ALL:
-        rv = fs::stat(fullpath,st_);
-        if(rv != 0)
-          rv = fs::lstat(fullpath,st_);
-        break;
-      }
+  // Made on the branch's own threads, as the caller, so a hung branch
+  // doesn't tie up the FUSE threads. The task holds copies as the
+  // caller may time out and return first.
+  static
+  int
+  fstatat_branch_io(const Branch         &branch_,
+                    const char           *fusepath_,
+                    struct stat          *st_,
+                    const FollowSymlinks  followsymlinks_)
+  {
+    int rv;
+
+    if(!BranchIO::enabled(branch_))
+      return l::fstatat(branch_,fusepath_,st_,followsymlinks_);
+
+    string fusepath(fusepath_);
+    std::shared_ptr<struct stat> st = std::make_shared<struct stat>();
+
+    rv = BranchIO::run_as(branch_,
+                          [fusepath,st,followsymlinks_](const Branch &branch)
+    {
+      return l::fstatat(branch,fusepath.c_str(),st.get(),followsymlinks_);
+    });
+    if(rv < 0)
+      return rv;
+
+    *st_ = *st;
+
+    return 0;
+  }
 
+  static
+  int
+  getattr(const Policy::Search &searchFunc_,
+          const Branches       &branches_,
+          const uint64_t        cache_open_,
+          const char           *fusepath_,
+          struct stat          *st_,
+          const bool            symlinkify_,
+          const time_t          symlinkify_timeout_,
+          FollowSymlinks        followsymlinks_)
+  {
+    int rv;
+    BasePaths basepaths;
+    Branches::CPtr branches;
+
+    branches = branches_;
+    rv = g_POLICY_CACHE(cache_open_,searchFunc_,branches,fusepath_,&basepaths);
     if(rv == -1)
       return -errno;
 
+    rv = l::fstatat_branch_io(basepaths.branch(0),
+                              fusepath_,
+                              st_,
+                              followsymlinks_);
+    if(rv < 0)
+      return rv;
+
     if(symlinkify_ && symlinkify::can_be_symlink(*st_,symlinkify_timeout_))
-      symlinkify::convert(fullpath,st_);
+      symlinkify::convert(fs::path::make(basepaths[0],fusepath_),st_);
+
+    if(S_ISREG(st_->st_mode))
+      FileMigration::fix_size(fusepath_,st_);
 
     fs::inode::calc(fusepath_,st_);
 
@@ -158,6 +172,7 @@ namespace l
 
     rv = l::getattr(cfg->func.getattr.policy,
                     cfg->branches,
+                    cfg->cache_open,
                     fusepath_,
                     st_,
                     cfg->symlinkify,
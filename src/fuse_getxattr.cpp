@@ -123,11 +123,8 @@ namespace l
   {
     string concated;
     StrVec paths;
-    StrVec branches;
 
-    branches_->to_paths(branches);
-
-    fs::findallfiles(branches,fusepath_,&paths);
+    fs::findallfiles(branches_,fusepath_,&paths);
 
     concated = str::join(paths,'\0');
 
@@ -171,7 +168,7 @@ namespace l
   {
     int rv;
     string fullpath;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = searchFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -14,15 +14,22 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
+#include "branch_io.hpp"
 #include "config.hpp"
+#include "dir_filter.hpp"
 #include "ugid.hpp"
 #include "fs_readahead.hpp"
+#include "fs_statvfs_cache.hpp"
+#include "location_index.hpp"
+#include "policy_probe.hpp"
 #include "syslog.hpp"
 
 #include "fmt/core.h"
 
 #include "fuse.h"
 
+#include <chrono>
 #include <thread>
 
 
@@ -84,6 +91,46 @@ namespace l
       }
   }
 
+  // The kernel disables passthrough when writeback caching is
+  // enabled so prefer the explicitly requested writeback cache.
+  static
+  void
+  want_if_capable_passthrough(fuse_conn_info *conn_,
+                              Config::Write  &cfg_)
+  {
+    if(cfg_->passthrough == Passthrough::ENUM::OFF)
+      return;
+
+    if(l::capable(conn_,FUSE_CAP_PASSTHROUGH) && !cfg_->writeback_cache)
+      {
+        l::want(conn_,FUSE_CAP_PASSTHROUGH);
+        return;
+      }
+
+    syslog_warning("passthrough unavailable - disabling");
+    cfg_->passthrough = Passthrough::ENUM::OFF;
+  }
+
+  // Requires kernel support and the fuse module's enable_uring
+  // parameter. Without it requests are read from /dev/fuse.
+  static
+  void
+  want_if_capable_io_uring(fuse_conn_info *conn_,
+                           Config::Write  &cfg_)
+  {
+    if(!cfg_->io_uring)
+      return;
+
+    if(l::capable(conn_,FUSE_CAP_OVER_IO_URING))
+      {
+        l::want(conn_,FUSE_CAP_OVER_IO_URING);
+        return;
+      }
+
+    syslog_warning("io-uring unavailable - using /dev/fuse");
+    cfg_->io_uring = false;
+  }
+
   static
   void
   readahead(const std::string path_,
@@ -126,6 +173,68 @@ namespace l
 
     readahead_thread.detach();
   }
+
+  // Wakes once a second so changes to cache.statfs at runtime are
+  // picked up without needing to be signaled.
+  static
+  void
+  statvfs_cache_refresh_loop()
+  {
+    uint64_t timeout;
+    uint64_t elapsed;
+
+    elapsed = 0;
+    for(;;)
+      {
+        timeout = fs::statvfs_cache_timeout();
+        if((timeout > 0) &&
+           fs::statvfs_cache_background() &&
+           (elapsed >= timeout))
+          {
+            Config::Read cfg;
+            Branches::CPtr branches;
+
+            branches = cfg->branches;
+            fs::statvfs_cache_refresh(branches);
+            elapsed = 0;
+          }
+
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        elapsed++;
+      }
+  }
+
+  static
+  void
+  open_location_index(Config::Write &cfg_)
+  {
+    int rv;
+
+    if(cfg_->location_index->empty())
+      return;
+
+    rv = g_LOCATION_INDEX.open(cfg_->location_index,
+                               cfg_->location_index_entries,
+                               cfg_->branches);
+    if(rv == -1)
+      {
+        syslog_error("location-index: unable to open %s - %s",
+                     cfg_->location_index->c_str(),
+                     strerror(errno));
+        return;
+      }
+
+    g_LOCATION_INDEX.scan(cfg_->branches);
+  }
+
+  static
+  void
+  spawn_thread_to_refresh_statvfs_cache()
+  {
+    std::thread refresh_thread(l::statvfs_cache_refresh_loop);
+
+    refresh_thread.detach();
+  }
 }
 
 namespace FUSE
@@ -148,14 +257,35 @@ namespace FUSE
     l::want_if_capable(conn_,FUSE_CAP_IOCTL_DIR);
     l::want_if_capable(conn_,FUSE_CAP_PARALLEL_DIROPS);
     l::want_if_capable(conn_,FUSE_CAP_READDIR_PLUS,&cfg->readdirplus);
+    l::want_if_capable(conn_,FUSE_CAP_SPLICE_READ,&cfg->splice_read);
+    l::want_if_capable(conn_,FUSE_CAP_SPLICE_WRITE,&cfg->splice_write);
     //l::want_if_capable(conn_,FUSE_CAP_READDIR_PLUS_AUTO);
     l::want_if_capable(conn_,FUSE_CAP_POSIX_ACL,&cfg->posix_acl);
     l::want_if_capable(conn_,FUSE_CAP_WRITEBACK_CACHE,&cfg->writeback_cache);
     l::want_if_capable_max_pages(conn_,cfg);
+    l::want_if_capable_passthrough(conn_,cfg);
+    l::want_if_capable_io_uring(conn_,cfg);
     conn_->want &= ~FUSE_CAP_POSIX_LOCKS;
     conn_->want &= ~FUSE_CAP_FLOCK_LOCKS;
 
+    fs::statvfs_cache_timeout(cfg->cache_statfs);
+    fs::statvfs_cache_background(cfg->cache_statfs_background);
+    BranchIO::threads(cfg->branch_io_threads);
+    BranchIO::timeout(cfg->branch_io_timeout);
+    BranchIO::fast_fail(cfg->branch_io_fast_fail);
+    Policy::Probe::threads(cfg->policy_probe_threads);
+    BranchFanOut::threads(cfg->fanout_threads);
+    BranchFanOut::min_branches(cfg->fanout_min_branches);
+    DirFilter::enabled(cfg->dir_filter &&
+                       (cfg->follow_symlinks != FollowSymlinks::ENUM::DIRECTORY) &&
+                       (cfg->follow_symlinks != FollowSymlinks::ENUM::ALL));
+
+    if(cfg->cache_statfs > 0)
+      fs::statvfs_cache_refresh(cfg->branches);
+
+    l::open_location_index(cfg);
     l::spawn_thread_to_set_readahead();
+    l::spawn_thread_to_refresh_statvfs_cache();
 
     return NULL;
   }
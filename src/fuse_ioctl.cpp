@@ -147,7 +147,7 @@ namespace l
     int fd;
     int rv;
     string fullpath;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = searchFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -210,7 +210,7 @@ namespace l
                 void                 *data_)
   {
     int rv;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = searchFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -252,7 +252,7 @@ namespace l
   {
     int rv;
     string fullpath;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = searchFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -285,12 +285,9 @@ namespace l
     Config::Read cfg;
     string concated;
     StrVec paths;
-    StrVec branches;
     string &fusepath = reinterpret_cast<FH*>(ffi_->fh)->fusepath;
 
-    cfg->branches->to_paths(branches);
-
-    fs::findallfiles(branches,fusepath.c_str(),&paths);
+    fs::findallfiles(cfg->branches,fusepath.c_str(),&paths);
 
     concated = str::join(paths,'\0');
 
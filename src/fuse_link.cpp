@@ -23,6 +23,8 @@
 #include "fuse_getattr.hpp"
 #include "fuse_symlink.hpp"
 #include "ghc/filesystem.hpp"
+#include "location_index.hpp"
+#include "policy_cache.hpp"
 #include "ugid.hpp"
 
 #include "fuse.h"
@@ -58,11 +60,11 @@ namespace l
 {
   static
   int
-  link_create_path_loop(const StrVec &oldbasepaths_,
-                        const string &newbasepath_,
-                        const char   *oldfusepath_,
-                        const char   *newfusepath_,
-                        const string &newfusedirpath_)
+  link_create_path_loop(const BasePaths &oldbasepaths_,
+                        const string    &newbasepath_,
+                        const char      *oldfusepath_,
+                        const char      *newfusepath_,
+                        const string    &newfusedirpath_)
   {
     int rv;
     int error;
@@ -99,8 +101,8 @@ namespace l
   {
     int rv;
     string newfusedirpath;
-    StrVec oldbasepaths;
-    StrVec newbasepaths;
+    BasePaths oldbasepaths;
+    BasePaths newbasepaths;
 
     rv = actionFunc_(branches_,oldfusepath_,&oldbasepaths);
     if(rv == -1)
@@ -143,10 +145,10 @@ namespace l
 
   static
   int
-  link_preserve_path_loop(const StrVec &oldbasepaths_,
-                          const char   *oldfusepath_,
-                          const char   *newfusepath_,
-                          struct stat  *st_)
+  link_preserve_path_loop(const BasePaths &oldbasepaths_,
+                          const char      *oldfusepath_,
+                          const char      *newfusepath_,
+                          struct stat     *st_)
   {
     int error;
 
@@ -172,7 +174,7 @@ namespace l
                      struct stat          *st_)
   {
     int rv;
-    StrVec oldbasepaths;
+    BasePaths oldbasepaths;
 
     rv = actionFunc_(branches_,oldfusepath_,&oldbasepaths);
     if(rv == -1)
@@ -256,7 +258,7 @@ namespace l
                               fuse_timeouts_t      *timeouts_)
   {
     int rv;
-    StrVec basepaths;
+    BasePaths basepaths;
     std::string target;
 
     rv = openPolicy_(branches_,oldpath_,&basepaths);
@@ -285,7 +287,7 @@ namespace l
                               fuse_timeouts_t   *timeouts_)
   {
     int rv;
-    StrVec basepaths;
+    BasePaths basepaths;
     std::string target;
 
     target = fs::path::make(mount_,oldpath_);
@@ -354,6 +356,10 @@ namespace FUSE
     if(rv == -EXDEV)
       rv = l::link_exdev(cfg,oldpath_,newpath_,st_,timeouts_);
 
+    g_POLICY_CACHE.erase(newpath_);
+    if(rv == 0)
+      g_LOCATION_INDEX.link(oldpath_,newpath_);
+
     return rv;
   }
 }
@@ -15,12 +15,15 @@
 */
 
 #include "config.hpp"
+#include "dir_filter.hpp"
 #include "errno.hpp"
 #include "fs_acl.hpp"
 #include "fs_clonepath.hpp"
 #include "fs_mkdir.hpp"
 #include "fs_path.hpp"
+#include "location_index.hpp"
 #include "policy.hpp"
+#include "policy_cache.hpp"
 #include "ugid.hpp"
 
 #include "fuse.h"
@@ -78,18 +81,23 @@ namespace l
     fullpath = fs::path::make(createpath_,fusepath_);
 
     rv = l::mkdir_core(fullpath,mode_,umask_);
+    if(rv == 0)
+      {
+        DirFilter::added(fullpath);
+        g_LOCATION_INDEX.added(fullpath);
+      }
 
     return error::calc(rv,error_,errno);
   }
 
   static
   int
-  mkdir_loop(const string &existingpath_,
-             const StrVec &createpaths_,
-             const char   *fusepath_,
-             const string &fusedirpath_,
-             const mode_t  mode_,
-             const mode_t  umask_)
+  mkdir_loop(const string    &existingpath_,
+             const BasePaths &createpaths_,
+             const char      *fusepath_,
+             const string    &fusedirpath_,
+             const mode_t     mode_,
+             const mode_t     umask_)
   {
     int rv;
     int error;
@@ -122,8 +130,8 @@ namespace l
   {
     int rv;
     string fusedirpath;
-    StrVec createpaths;
-    StrVec existingpaths;
+    BasePaths createpaths;
+    BasePaths existingpaths;
 
     fusedirpath = fs::path::dirname(fusepath_);
 
@@ -164,6 +172,7 @@ namespace FUSE
     if(rv == -EROFS)
       {
         Config::Write()->branches.find_and_set_mode_ro();
+        cfg.refresh();
         rv = l::mkdir(cfg->func.getattr.policy,
                       cfg->func.mkdir.policy,
                       cfg->branches,
@@ -172,6 +181,8 @@ namespace FUSE
                       fc->umask);
       }
 
+    g_POLICY_CACHE.erase(fusepath_);
+
     return rv;
   }
 }
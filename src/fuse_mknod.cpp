@@ -20,15 +20,15 @@
 #include "fs_mknod.hpp"
 #include "fs_clonepath.hpp"
 #include "fs_path.hpp"
+#include "location_index.hpp"
+#include "policy_cache.hpp"
 #include "ugid.hpp"
 
 #include "fuse.h"
 
 #include <string>
-#include <vector>
 
 using std::string;
-using std::vector;
 
 
 namespace error
@@ -89,7 +89,7 @@ namespace l
   static
   int
   mknod_loop(const string         &existingpath_,
-             const vector<string> &createpaths_,
+             const BasePaths      &createpaths_,
              const char           *fusepath_,
              const string         &fusedirpath_,
              const mode_t          mode_,
@@ -126,8 +126,8 @@ namespace l
   {
     int rv;
     string fusedirpath;
-    vector<string> createpaths;
-    vector<string> existingpaths;
+    BasePaths createpaths;
+    BasePaths existingpaths;
 
     fusedirpath = fs::path::dirname(fusepath_);
 
@@ -139,9 +139,13 @@ namespace l
     if(rv == -1)
       return -errno;
 
-    return l::mknod_loop(existingpaths[0],createpaths,
-                         fusepath_,fusedirpath,
-                         mode_,umask_,dev_);
+    rv = l::mknod_loop(existingpaths[0],createpaths,
+                       fusepath_,fusedirpath,
+                       mode_,umask_,dev_);
+    if(rv == 0)
+      g_LOCATION_INDEX.add(branches_,fusepath_,createpaths);
+
+    return rv;
   }
 }
 
@@ -167,6 +171,7 @@ namespace FUSE
     if(rv == -EROFS)
       {
         Config::Write()->branches.find_and_set_mode_ro();
+        cfg.refresh();
         rv = l::mknod(cfg->func.getattr.policy,
                       cfg->func.mknod.policy,
                       cfg->branches,
@@ -176,6 +181,8 @@ namespace FUSE
                       rdev_);
       }
 
+    g_POLICY_CACHE.erase(fusepath_);
+
     return rv;
   }
 }
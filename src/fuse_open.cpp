@@ -16,13 +16,19 @@
 
 #include "config.hpp"
 #include "errno.hpp"
+#include "branch_io.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
+#include "fs_close.hpp"
 #include "fs_cow.hpp"
 #include "fs_fchmod.hpp"
 #include "fs_lchmod.hpp"
 #include "fs_open.hpp"
+#include "fs_openat.hpp"
 #include "fs_path.hpp"
 #include "fs_stat.hpp"
+#include "fuse_passthrough.hpp"
+#include "policy_cache.hpp"
 #include "procfs_get_name.hpp"
 #include "stat_util.hpp"
 #include "ugid.hpp"
@@ -190,28 +196,89 @@ namespace l
 
   static
   int
-  open_core(const std::string &basepath_,
-            const char        *fusepath_,
-            fuse_file_info_t  *ffi_,
-            const bool         link_cow_,
-            const NFSOpenHack  nfsopenhack_)
+  open_fd(const Branch      &branch_,
+          const char        *fusepath_,
+          const int          flags_,
+          const bool         link_cow_,
+          const NFSOpenHack  nfsopenhack_)
   {
     int fd;
-    FileInfo *fi;
     std::string fullpath;
 
-    fullpath = fs::path::make(basepath_,fusepath_);
+    if(link_cow_ || (branch_.fd() < 0))
+      fullpath = fs::path::make(branch_.path,fusepath_);
 
-    if(link_cow_ && fs::cow::is_eligible(fullpath.c_str(),ffi_->flags))
+    if(link_cow_ && fs::cow::is_eligible(fullpath.c_str(),flags_))
       fs::cow::break_link(fullpath.c_str());
 
-    fd = fs::open(fullpath,ffi_->flags);
-    if((fd == -1) && (errno == EACCES))
-      fd = l::nfsopenhack(fullpath,ffi_->flags,nfsopenhack_);
+    if(branch_.fd() < 0)
+      fd = fs::open(fullpath,flags_);
+    else
+      fd = fs::openat(branch_.fd(),fs::path::relative(fusepath_),flags_);
     if(fd == -1)
-      return -errno;
+      fd = -errno;
+    if(fd == -EACCES)
+      {
+        if(fullpath.empty())
+          fullpath = fs::path::make(branch_.path,fusepath_);
+        fd = l::nfsopenhack(fullpath,flags_,nfsopenhack_);
+        if(fd == -1)
+          fd = -errno;
+      }
+
+    return fd;
+  }
+
+  // Made on the branch's own threads, as the caller, so a hung branch
+  // doesn't tie up the FUSE threads. If the caller times out first the
+  // file is closed once the open does return.
+  static
+  int
+  open_fd_branch_io(const Branch      &branch_,
+                    const char        *fusepath_,
+                    const int          flags_,
+                    const bool         link_cow_,
+                    const NFSOpenHack  nfsopenhack_)
+  {
+    if(!BranchIO::enabled(branch_))
+      return l::open_fd(branch_,fusepath_,flags_,link_cow_,nfsopenhack_);
+
+    std::string fusepath(fusepath_);
+
+    return BranchIO::run_as(branch_,
+                            [fusepath,flags_,
+                             link_cow_,nfsopenhack_](const Branch &branch)
+    {
+      return l::open_fd(branch,fusepath.c_str(),flags_,link_cow_,nfsopenhack_);
+    },
+    [](const int fd_)
+    {
+      if(fd_ >= 0)
+        fs::close(fd_);
+    });
+  }
+
+  static
+  int
+  open_core(const Branch      &branch_,
+            const char        *fusepath_,
+            fuse_file_info_t  *ffi_,
+            const bool         link_cow_,
+            const NFSOpenHack  nfsopenhack_)
+  {
+    int fd;
+    FileInfo *fi;
+
+    fd = l::open_fd_branch_io(branch_,
+                              fusepath_,
+                              ffi_->flags,
+                              link_cow_,
+                              nfsopenhack_);
+    if(fd < 0)
+      return fd;
 
     fi = new FileInfo(fd,fusepath_,ffi_->direct_io);
+    FileMigration::attach(fi);
 
     ffi_->fh = reinterpret_cast<uint64_t>(fi);
 
@@ -222,19 +289,26 @@ namespace l
   int
   open(const Policy::Search &searchFunc_,
        const Branches       &branches_,
+       const uint64_t        cache_open_,
        const char           *fusepath_,
        fuse_file_info_t     *ffi_,
        const bool            link_cow_,
        const NFSOpenHack     nfsopenhack_)
   {
     int rv;
-    StrVec basepaths;
+    BasePaths basepaths;
+    Branches::CPtr branches;
 
-    rv = searchFunc_(branches_,fusepath_,&basepaths);
+    branches = branches_;
+    rv = g_POLICY_CACHE(cache_open_,searchFunc_,branches,fusepath_,&basepaths);
     if(rv == -1)
       return -errno;
 
-    return l::open_core(basepaths[0],fusepath_,ffi_,link_cow_,nfsopenhack_);
+    return l::open_core(basepaths.branch(0),
+                        fusepath_,
+                        ffi_,
+                        link_cow_,
+                        nfsopenhack_);
   }
 }
 
@@ -259,10 +333,13 @@ namespace FUSE
 
     rv = l::open(cfg->func.open.policy,
                  cfg->branches,
+                 cfg->cache_open,
                  fusepath_,
                  ffi_,
                  cfg->link_cow,
                  cfg->nfsopenhack);
+    if(rv == 0)
+      FUSE::passthrough_if_wanted(cfg,ffi_);
 
     return rv;
   }
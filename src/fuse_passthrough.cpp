@@ -0,0 +1,91 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "fuse_passthrough.hpp"
+
+#include "config.hpp"
+#include "file_migration.hpp"
+#include "fileinfo.hpp"
+
+#include "fuse.h"
+
+#include <fcntl.h>
+
+
+namespace l
+{
+  static
+  bool
+  rdonly(const int flags_)
+  {
+    return ((flags_ & O_ACCMODE) == O_RDONLY);
+  }
+
+  static
+  bool
+  passthrough_wanted(Config::Read &cfg_,
+                     const int     flags_)
+  {
+    if(cfg_->nullrw)
+      return false;
+
+    // Writes which hit ENOSPC must be serviced in userspace to
+    // trigger moveonenospc. Reads too as a file being moved is read
+    // from the original and the copy together and a reader left on
+    // the original once it is replaced would see stale data.
+    if(cfg_->moveonenospc.enabled)
+      return false;
+
+    switch(cfg_->passthrough)
+      {
+      default:
+      case Passthrough::ENUM::OFF:
+        return false;
+      case Passthrough::ENUM::RO:
+        return l::rdonly(flags_);
+      case Passthrough::ENUM::WO:
+        return ((flags_ & O_ACCMODE) == O_WRONLY);
+      case Passthrough::ENUM::RW:
+        return true;
+      }
+  }
+}
+
+// Failure to register the backing file (no CAP_SYS_ADMIN, nested
+// stacking, etc.) falls back to regular userspace IO.
+void
+FUSE::passthrough_if_wanted(Config::Read     &cfg_,
+                            fuse_file_info_t *ffi_)
+{
+  int backing_id;
+  FileInfo *fi;
+
+  if(!l::passthrough_wanted(cfg_,ffi_->flags))
+    return;
+
+  fi = reinterpret_cast<FileInfo*>(ffi_->fh);
+  if(FileMigration::get(fi))
+    return;
+
+  backing_id = fuse_passthrough_open(fi->fd);
+  if(backing_id <= 0)
+    return;
+
+  ffi_->passthrough = true;
+  ffi_->backing_id  = backing_id;
+}
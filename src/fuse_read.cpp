@@ -14,7 +14,9 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "config.hpp"
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_pread.hpp"
 
@@ -64,6 +66,10 @@ namespace FUSE
        off_t                   offset_)
   {
     FileInfo *fi = reinterpret_cast<FileInfo*>(ffi_->fh);
+    std::shared_ptr<FileMigration> m = FileMigration::get(fi);
+
+    if(m)
+      return m->pread(buf_,size_,offset_);
 
     if(fi->direct_io)
       return l::read_direct_io(fi->fd,buf_,size_,offset_);
@@ -71,6 +77,23 @@ namespace FUSE
     return l::read_cached(fi->fd,buf_,size_,offset_);
   }
 
+  int
+  read_fd(const fuse_file_info_t *ffi_)
+  {
+    Config::Read cfg;
+    FileInfo *fi = reinterpret_cast<FileInfo*>(ffi_->fh);
+
+    // Part of the file may only be in the copy. libfuse splices from
+    // the fd after this returns, and a move may start in between, so
+    // regular reads are used whenever moveonenospc is enabled.
+    if(cfg->moveonenospc.enabled)
+      return -1;
+    if(FileMigration::get(fi))
+      return -1;
+
+    return fi->fd;
+  }
+
   int
   read_null(const fuse_file_info_t *ffi_,
             char                   *buf_,
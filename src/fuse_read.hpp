@@ -29,6 +29,9 @@ namespace FUSE
        size_t                  size,
        off_t                   offset);
 
+  int
+  read_fd(const fuse_file_info_t *ffi);
+
   int
   read_null(const fuse_file_info_t *ffi,
             char                   *buf,
@@ -31,7 +31,7 @@ int
 FUSE::readdir(const fuse_file_info_t *ffi_,
               fuse_dirents_t         *buf_)
 {
-  Config::Write cfg;
+  Config::Read cfg;
 
   return cfg->readdir(ffi_,buf_);
 }
@@ -47,8 +47,6 @@ FUSE::ReadDir::ReadDir(std::string const s_)
 std::string
 FUSE::ReadDir::to_string() const
 {
-  std::lock_guard<std::mutex> lg(_mutex);
-
   return _type;
 }
 
@@ -70,17 +68,11 @@ FUSE::ReadDir::from_string(std::string const &str_)
       if(!tmp)
         return -EINVAL;
 
-      {
-        std::lock_guard<std::mutex> lg(_mutex);
-
-        _type    = str_;
-        std::swap(_readdir,tmp);
-      }
+      _type    = str_;
+      _readdir = tmp;
     }
   else
     {
-      std::lock_guard<std::mutex> lg(_mutex);
-
       if(!FUSE::ReadDirFactory::valid(str_))
         return -EINVAL;
 
@@ -97,14 +89,14 @@ FUSE::ReadDir::from_string(std::string const &str_)
 */
 int
 FUSE::ReadDir::operator()(fuse_file_info_t const *ffi_,
-                          fuse_dirents_t         *buf_)
+                          fuse_dirents_t         *buf_) const
 {
-  std::shared_ptr<FUSE::ReadDirBase> readdir;
-
-  {
-    std::lock_guard<std::mutex> lg(_mutex);
-    readdir = _readdir;
-  }
+  return (*_readdir)(ffi_,buf_);
+}
 
-  return (*readdir)(ffi_,buf_);
+int
+FUSE::ReadDir::plus(fuse_file_info_t const *ffi_,
+                    fuse_dirents_t         *buf_) const
+{
+  return _readdir->plus(ffi_,buf_);
 }
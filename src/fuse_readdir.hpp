@@ -21,7 +21,6 @@
 #include "fuse_readdir_base.hpp"
 
 #include <memory>
-#include <mutex>
 
 #include <assert.h>
 
@@ -45,14 +44,13 @@ namespace FUSE
 
   public:
     int operator()(fuse_file_info_t const *ffi,
-                   fuse_dirents_t         *buf);
+                   fuse_dirents_t         *buf) const;
+    int plus(fuse_file_info_t const *ffi,
+             fuse_dirents_t         *buf) const;
 
   public:
     void initialize();
 
-  private:
-    mutable std::mutex _mutex;
-
   private:
     bool _initialized;
     std::string _type;
@@ -30,5 +30,7 @@ namespace FUSE
   public:
     virtual int operator()(fuse_file_info_t const *ffi,
                            fuse_dirents_t         *buf) = 0;
+    virtual int plus(fuse_file_info_t const *ffi,
+                     fuse_dirents_t         *buf) = 0;
   };
 }
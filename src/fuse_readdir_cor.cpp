@@ -17,6 +17,7 @@
 #include "fuse_readdir_cor.hpp"
 
 #include "config.hpp"
+#include "dedup_set.hpp"
 #include "dirinfo.hpp"
 #include "errno.hpp"
 #include "fs_close.hpp"
@@ -25,14 +26,20 @@
 #include "fs_inode.hpp"
 #include "fs_open.hpp"
 #include "fs_path.hpp"
-#include "fs_readdir.hpp"
-#include "hashset.hpp"
-#include "scope_guard.hpp"
+#include "fuse_readdir_dents.hpp"
+#include "fuse_readdir_plus.hpp"
 #include "ugid.hpp"
 
 #include "fuse_dirents.h"
 #include "linux_dirent64.h"
 
+#include <memory>
+#include <vector>
+
+// Buffers past these per branch come from the heap and are released
+// with the listing rather than kept by the pool.
+#define MAX_POOLED_DENTS_BUFS 2
+
 
 FUSE::ReadDirCOR::ReadDirCOR(unsigned concurrency_,
                              unsigned max_queue_depth_)
@@ -74,120 +81,239 @@ namespace l
     }
   };
 
+  struct DentsBatch
+  {
+    std::unique_ptr<FUSE::DentsBuf> buf;
+    long                            nread;
+  };
+
+  // Everything read from one branch. Filled in by a pool thread with
+  // the name hashes and inodes already calculated so all the request
+  // thread does is merge. Entries are walked in place in the
+  // getdents64 buffers rather than also kept as a list of pointers.
+  struct BranchDents
+  {
+    BranchDents()
+      : fd(-1),
+        err(0)
+    {
+    }
+
+    ~BranchDents()
+    {
+      if(fd != -1)
+        fs::close(fd);
+    }
+
+    int                            fd;
+    int                            err;
+    std::string                    basepath;
+    std::vector<DentsBatch>        batches;
+    std::vector<uint64_t>          hashes;
+    std::vector<linux_dirent64_t*> added;
+    std::vector<struct stat>       st;
+
+  private:
+    BranchDents(const BranchDents&);
+    BranchDents& operator=(const BranchDents&);
+  };
+
   static
-  inline
   int
-  readdir(std::string     basepath_,
-          HashSet        &names_,
-          fuse_dirents_t *buf_,
-          std::mutex     &mutex_)
+  read_branch(const char  *dirname_,
+              BranchDents &bd_)
   {
-    int rv;
-    int dfd;
     dev_t dev;
-    std::string filepath;
+    FUSE::DirentPath path(dirname_);
 
-    dfd = fs::open_dir_ro(basepath_);
-    if(dfd == -1)
+    bd_.fd = fs::open_dir_ro(bd_.basepath);
+    if(bd_.fd == -1)
       return errno;
 
-    DEFER{ fs::close(dfd); };
+    dev = fs::devid(bd_.fd);
 
-    dev = fs::devid(dfd);
-
-    rv = 0;
     for(;;)
       {
         long nread;
-        char buf[32 * 1024];
+        linux_dirent64_t *d;
+        bool pooled = (bd_.batches.size() < MAX_POOLED_DENTS_BUFS);
+        std::unique_ptr<FUSE::DentsBuf> buf(new FUSE::DentsBuf(pooled));
+
+        if(buf->data == NULL)
+          return ENOMEM;
 
-        nread = fs::getdents_64(dfd,buf,sizeof(buf));
+        nread = fs::getdents_64(bd_.fd,buf->data,buf->size());
         if(nread == -1)
           return errno;
         if(nread == 0)
           break;
 
-        linux_dirent64_t *d;
-        std::lock_guard<std::mutex> lk(mutex_);
         for(long pos = 0; pos < nread; pos += d->reclen)
           {
-            std::uint64_t namelen;
+            uint64_t namelen;
 
-            d = (linux_dirent64_t*)&buf[pos];
+            d = (linux_dirent64_t*)&buf->data[pos];
 
             namelen = DIRENT_NAMELEN(d);
 
-            rv = names_.put(d->name,namelen);
-            if(rv == 0)
-              continue;
+            const std::string &fusepath = path.set(d->name,namelen);
 
-            filepath = fs::path::make(basepath_,d->name);
-            d->ino = fs::inode::calc(filepath,
+            d->ino = fs::inode::calc(fusepath.c_str(),
+                                     fusepath.size(),
                                      DTTOIF(d->type),
                                      dev,
                                      d->ino);
 
-            rv = fuse_dirents_add_linux(buf_,d,namelen);
-            if(rv >= 0)
-              continue;
-
-            return ENOMEM;
+            bd_.hashes.push_back(DedupSet::hash(d->name,namelen));
           }
+
+        bd_.batches.push_back(DentsBatch());
+        bd_.batches.back().buf   = std::move(buf);
+        bd_.batches.back().nread = nread;
       }
 
     return 0;
   }
 
+  /*
+    Branches are read concurrently each into its own list of entries
+    and hashes. They are then merged in branch order on the calling
+    thread into a single set sized from the first branch so no lock
+    is taken per entry and, as with seq, the first branch a name is
+    found in wins.
+
+    For readdirplus only the entries which survive the merge are
+    stat'ed, again one task per branch.
+  */
   static
   int
-  concurrent_readdir(ThreadPool           &tp_,
-                     const Branches::CPtr &branches_,
-                     const char           *dirname_,
-                     fuse_dirents_t       *buf_,
-                     uid_t const           uid_,
-                     gid_t const           gid_)
+  concurrent_readdir(ThreadPool              &tp_,
+                     const Branches::CPtr    &branches_,
+                     const char              *dirname_,
+                     const FUSE::ReadDirPlus *plus_,
+                     fuse_dirents_t          *buf_,
+                     uid_t const              uid_,
+                     gid_t const              gid_)
   {
-    HashSet names;
-    std::mutex mutex;
+    int rv;
+    Error error;
+    std::vector<BranchDents> bds(branches_->size());
     std::vector<std::future<int>> futures;
 
     futures.reserve(branches_->size());
-    for(auto const &branch : *branches_)
+    for(size_t i = 0; i < branches_->size(); i++)
       {
-        auto func = [&,dirname_,buf_,uid_,gid_]()
+        BranchDents &bd = bds[i];
+
+        bd.basepath = fs::path::make((*branches_)[i].path,dirname_);
+
+        auto func = [&bd,dirname_,uid_,gid_]()
         {
-          std::string basepath;
           ugid::Set const ugid(uid_,gid_);
 
-          basepath = fs::path::make(branch.path,dirname_);
-
-          return l::readdir(basepath,names,buf_,mutex);
+          return l::read_branch(dirname_,bd);
         };
 
-        auto rv = tp_.enqueue_task(func);
+        futures.emplace_back(tp_.enqueue_task(func));
+      }
+
+    for(size_t i = 0; i < futures.size(); i++)
+      bds[i].err = futures[i].get();
+
+    DedupSet names(bds.empty() ? 0 : bds[0].hashes.size());
+
+    for(auto &bd : bds)
+      {
+        size_t i;
+        linux_dirent64_t *d;
+
+        error = bd.err;
 
-        futures.emplace_back(std::move(rv));
+        i = 0;
+        for(auto &batch : bd.batches)
+          {
+            for(long pos = 0; pos < batch.nread; pos += d->reclen)
+              {
+                d = (linux_dirent64_t*)&batch.buf->data[pos];
+
+                if(names.put(bd.hashes[i++]) == 0)
+                  continue;
+
+                if(plus_ != NULL)
+                  {
+                    bd.added.push_back(d);
+                    continue;
+                  }
+
+                rv = fuse_dirents_add_linux(buf_,d,DIRENT_NAMELEN(d));
+                if(rv < 0)
+                  return -ENOMEM;
+              }
+          }
+      }
+
+    if(plus_ == NULL)
+      return -error;
+
+    futures.clear();
+    for(auto &bd : bds)
+      {
+        if(bd.added.empty())
+          continue;
+
+        auto func = [&bd,dirname_,plus_,uid_,gid_]()
+        {
+          ugid::Set const ugid(uid_,gid_);
+
+          FUSE::readdir_plus_stat(NULL,
+                                  *plus_,
+                                  bd.fd,
+                                  bd.basepath,
+                                  dirname_,
+                                  bd.added,
+                                  bd.st,
+                                  uid_,
+                                  gid_);
+
+          return 0;
+        };
+
+        futures.emplace_back(tp_.enqueue_task(func));
       }
 
-    Error error;
     for(auto &future : futures)
-      error = future.get();
+      future.get();
+
+    for(auto &bd : bds)
+      {
+        for(size_t i = 0; i < bd.added.size(); i++)
+          {
+            rv = fuse_dirents_add_linux_plus(buf_,
+                                             bd.added[i],
+                                             DIRENT_NAMELEN(bd.added[i]),
+                                             plus_->entry(),
+                                             &bd.st[i]);
+            if(rv < 0)
+              return -ENOMEM;
+          }
+      }
 
     return -error;
   }
 
   static
   int
-  readdir(ThreadPool           &tp_,
-          const Branches::CPtr &branches_,
-          const char           *dirname_,
-          fuse_dirents_t       *buf_,
-          uid_t const           uid_,
-          gid_t const           gid_)
+  readdir(ThreadPool              &tp_,
+          const Branches::CPtr    &branches_,
+          const char              *dirname_,
+          const FUSE::ReadDirPlus *plus_,
+          fuse_dirents_t          *buf_,
+          uid_t const              uid_,
+          gid_t const              gid_)
   {
     fuse_dirents_reset(buf_);
 
-    return l::concurrent_readdir(tp_,branches_,dirname_,buf_,uid_,gid_);
+    return l::concurrent_readdir(tp_,branches_,dirname_,plus_,buf_,uid_,gid_);
   }
 }
 
@@ -202,6 +328,25 @@ FUSE::ReadDirCOR::operator()(fuse_file_info_t const *ffi_,
   return l::readdir(_tp,
                     cfg->branches,
                     di->fusepath.c_str(),
+                    NULL,
+                    buf_,
+                    fc->uid,
+                    fc->gid);
+}
+
+int
+FUSE::ReadDirCOR::plus(fuse_file_info_t const *ffi_,
+                       fuse_dirents_t         *buf_)
+{
+  Config::Read        cfg;
+  DirInfo            *di = reinterpret_cast<DirInfo*>(ffi_->fh);
+  const fuse_context *fc = fuse_get_context();
+  const ReadDirPlus   plus(cfg);
+
+  return l::readdir(_tp,
+                    cfg->branches,
+                    di->fusepath.c_str(),
+                    &plus,
                     buf_,
                     fc->uid,
                     fc->gid);
@@ -35,6 +35,8 @@ namespace FUSE
 
     int operator()(fuse_file_info_t const *ffi,
                    fuse_dirents_t         *buf);
+    int plus(fuse_file_info_t const *ffi,
+             fuse_dirents_t         *buf);
 
   private:
     ThreadPool _tp;
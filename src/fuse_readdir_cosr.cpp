@@ -17,17 +17,14 @@
 #include "fuse_readdir_cosr.hpp"
 
 #include "config.hpp"
+#include "dedup_set.hpp"
 #include "dirinfo.hpp"
 #include "errno.hpp"
-#include "fs_closedir.hpp"
-#include "fs_devid.hpp"
-#include "fs_dirfd.hpp"
-#include "fs_inode.hpp"
-#include "fs_opendir.hpp"
+#include "fs_close.hpp"
+#include "fs_open.hpp"
 #include "fs_path.hpp"
-#include "fs_readdir.hpp"
-#include "fs_stat.hpp"
-#include "hashset.hpp"
+#include "fuse_readdir_dents.hpp"
+#include "fuse_readdir_plus.hpp"
 #include "scope_guard.hpp"
 #include "ugid.hpp"
 
@@ -50,8 +47,8 @@ namespace l
 {
   struct DirRV
   {
-    DIR *dir;
-    int  err;
+    int fd;
+    int err;
   };
 
   struct Error
@@ -81,19 +78,6 @@ namespace l
     }
   };
 
-  static
-  uint64_t
-  dirent_exact_namelen(const struct dirent *d_)
-  {
-#ifdef _D_EXACT_NAMLEN
-    return _D_EXACT_NAMLEN(d_);
-#elif defined _DIRENT_HAVE_D_NAMLEN
-    return d_->d_namlen;
-#else
-    return strlen(d_->d_name);
-#endif
-  }
-
   static
   inline
   std::vector<std::future<DirRV>>
@@ -116,9 +100,8 @@ namespace l
 
           basepath = fs::path::make(branch.path,dirname_);
 
-          errno  = 0;
-          rv.dir = fs::opendir(basepath);
-          rv.err = errno;
+          rv.fd  = fs::open_dir_ro(basepath);
+          rv.err = ((rv.fd == -1) ? errno : 0);
 
           return rv;
         };
@@ -134,52 +117,37 @@ namespace l
   static
   inline
   int
-  readdir(std::vector<std::future<DirRV>> &dh_futures_,
+  readdir(ThreadPool                      &tp_,
+          std::vector<std::future<DirRV>> &dh_futures_,
+          const Branches::CPtr            &branches_,
           char const                      *dirname_,
-          fuse_dirents_t                  *buf_)
+          const FUSE::ReadDirPlus         *plus_,
+          fuse_dirents_t                  *buf_,
+          uid_t const                      uid_,
+          gid_t const                      gid_)
   {
     Error error;
-    HashSet names;
-    std::string fullpath;
+    DedupSet names;
+    std::string basepath;
+    FUSE::ReadDirDents dents(dirname_,plus_,names,buf_);
 
-    for(auto &dh_future : dh_futures_)
+    for(size_t i = 0; i < dh_futures_.size(); i++)
       {
         int rv;
-        dev_t dev;
         DirRV dirrv;
 
-        dirrv = dh_future.get();
+        dirrv = dh_futures_[i].get();
         error = dirrv.err;
-        if(dirrv.dir == NULL)
+        if(dirrv.fd == -1)
           continue;
 
-        DEFER { fs::closedir(dirrv.dir); };
-
-        dev = fs::devid(dirrv.dir);
-
-        rv = 0;
-        for(dirent *de = fs::readdir(dirrv.dir); de && !rv; de = fs::readdir(dirrv.dir))
-          {
-            std::uint64_t namelen;
-
-            namelen = l::dirent_exact_namelen(de);
+        DEFER { fs::close(dirrv.fd); };
 
-            rv = names.put(de->d_name,namelen);
-            if(rv == 0)
-              continue;
+        basepath = fs::path::make((*branches_)[i].path,dirname_);
 
-            fullpath  = fs::path::make(dirname_,de->d_name);
-            de->d_ino = fs::inode::calc(fullpath,
-                                        DTTOIF(de->d_type),
-                                        dev,
-                                        de->d_ino);
-
-            rv = fuse_dirents_add(buf_,de,namelen);
-            if(rv == 0)
-              continue;
-
-            error = ENOMEM;
-          }
+        rv = dents.read(dirrv.fd,basepath,&tp_,uid_,gid_);
+        if(rv == ENOMEM)
+          error = ENOMEM;
       }
 
     return -error;
@@ -188,12 +156,13 @@ namespace l
   static
   inline
   int
-  readdir(ThreadPool           &tp_,
-          const Branches::CPtr &branches_,
-          const char           *dirname_,
-          fuse_dirents_t       *buf_,
-          uid_t const           uid_,
-          gid_t const           gid_)
+  readdir(ThreadPool              &tp_,
+          const Branches::CPtr    &branches_,
+          const char              *dirname_,
+          const FUSE::ReadDirPlus *plus_,
+          fuse_dirents_t          *buf_,
+          uid_t const              uid_,
+          gid_t const              gid_)
   {
     int rv;
     std::vector<std::future<DirRV>> futures;
@@ -201,7 +170,7 @@ namespace l
     fuse_dirents_reset(buf_);
 
     futures = l::opendir(tp_,branches_,dirname_,uid_,gid_);
-    rv      = l::readdir(futures,dirname_,buf_);
+    rv      = l::readdir(tp_,futures,branches_,dirname_,plus_,buf_,uid_,gid_);
 
     return rv;
   }
@@ -218,6 +187,26 @@ FUSE::ReadDirCOSR::operator()(fuse_file_info_t const *ffi_,
   return l::readdir(_tp,
                     cfg->branches,
                     di->fusepath.c_str(),
+                    NULL,
+                    buf_,
+                    fc->uid,
+                    fc->gid);
+}
+
+int
+FUSE::ReadDirCOSR::plus(fuse_file_info_t const *ffi_,
+                        fuse_dirents_t         *buf_)
+{
+  Config::Read        cfg;
+  DirInfo            *di = reinterpret_cast<DirInfo*>(ffi_->fh);
+  const fuse_context *fc = fuse_get_context();
+  const ugid::Set     ugid(fc->uid,fc->gid);
+  const ReadDirPlus   plus(cfg);
+
+  return l::readdir(_tp,
+                    cfg->branches,
+                    di->fusepath.c_str(),
+                    &plus,
                     buf_,
                     fc->uid,
                     fc->gid);
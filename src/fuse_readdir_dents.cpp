@@ -0,0 +1,247 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "fuse_readdir_dents.hpp"
+
+#include "fs_devid.hpp"
+#include "fs_getdents64.hpp"
+#include "fs_inode.hpp"
+#include "mempools.hpp"
+#include "thread_pool.hpp"
+#include "ugid.hpp"
+
+#include "linux_dirent64.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#include <sys/stat.h>
+
+#define PLUS_STAT_BATCH_SIZE 256
+
+
+namespace l
+{
+  static
+  void
+  plus_stat(const FUSE::ReadDirPlus        &plus_,
+            const int                       dfd_,
+            const std::string              &basepath_,
+            const char                     *dirname_,
+            std::vector<linux_dirent64_t*> &dirents_,
+            std::vector<struct stat>       &st_,
+            const size_t                    begin_,
+            const size_t                    end_)
+  {
+    FUSE::DirentPath path(dirname_);
+
+    for(size_t i = begin_; i < end_; i++)
+      {
+        const std::string &fusepath = path.set(dirents_[i]->name,
+                                               DIRENT_NAMELEN(dirents_[i]));
+
+        plus_.stat(dfd_,dirents_[i]->name,basepath_,fusepath,&st_[i]);
+        if(st_[i].st_mode != 0)
+          dirents_[i]->ino = st_[i].st_ino;
+      }
+  }
+}
+
+/*
+  Small batches are done inline as the handoff would cost more than
+  it saves.
+*/
+void
+FUSE::readdir_plus_stat(ThreadPool                     *tp_,
+                        const FUSE::ReadDirPlus        &plus_,
+                        const int                       dfd_,
+                        const std::string              &basepath_,
+                        const char                     *dirname_,
+                        std::vector<linux_dirent64_t*> &dirents_,
+                        std::vector<struct stat>       &st_,
+                        const uid_t                     uid_,
+                        const gid_t                     gid_)
+{
+  std::vector<std::future<int>> futures;
+
+  st_.resize(dirents_.size());
+  if((tp_ == NULL) || (dirents_.size() <= PLUS_STAT_BATCH_SIZE))
+    return l::plus_stat(plus_,dfd_,basepath_,dirname_,dirents_,st_,0,dirents_.size());
+
+  for(size_t i = 0; i < dirents_.size(); i += PLUS_STAT_BATCH_SIZE)
+    {
+      size_t end;
+
+      end = std::min(i + PLUS_STAT_BATCH_SIZE,dirents_.size());
+
+      auto task = [&,i,end]()
+      {
+        ugid::Set const ugid(uid_,gid_);
+
+        l::plus_stat(plus_,dfd_,basepath_,dirname_,dirents_,st_,i,end);
+
+        return 0;
+      };
+
+      futures.emplace_back(tp_->enqueue_task(task));
+    }
+
+  for(auto &future : futures)
+    future.get();
+}
+
+FUSE::DentsBuf::DentsBuf(const bool pooled_)
+  : data((char*)(pooled_ ?
+                 g_DENTS_BUF_POOL.alloc() :
+                 ::malloc(g_DENTS_BUF_POOL.size()))),
+    _pooled(pooled_)
+{
+}
+
+FUSE::DentsBuf::~DentsBuf()
+{
+  if(data == NULL)
+    return;
+
+  if(_pooled)
+    g_DENTS_BUF_POOL.free(data);
+  else
+    ::free(data);
+}
+
+size_t
+FUSE::DentsBuf::size(void) const
+{
+  return g_DENTS_BUF_POOL.size();
+}
+
+FUSE::DirentPath::DirentPath(const char *dirname_)
+  : _path(dirname_)
+{
+  if(_path.empty() || (*_path.rbegin() != '/'))
+    _path.push_back('/');
+  _prefixlen = _path.size();
+}
+
+const std::string&
+FUSE::DirentPath::set(const char   *name_,
+                      const size_t  namelen_)
+{
+  _path.resize(_prefixlen);
+  _path.append(name_,namelen_);
+
+  return _path;
+}
+
+FUSE::ReadDirDents::ReadDirDents(const char              *dirname_,
+                                 const FUSE::ReadDirPlus *plus_,
+                                 DedupSet                &names_,
+                                 fuse_dirents_t          *buf_)
+  : _dirname(dirname_),
+    _plus(plus_),
+    _names(names_),
+    _buf(buf_),
+    _path(dirname_),
+    _dents()
+{
+}
+
+int
+FUSE::ReadDirDents::read(const int          dfd_,
+                         const std::string &basepath_,
+                         ThreadPool        *tp_,
+                         const uid_t        uid_,
+                         const gid_t        gid_)
+{
+  int rv;
+  dev_t dev;
+  std::vector<struct stat> st;
+  std::vector<linux_dirent64_t*> dirents;
+
+  if(_dents.data == NULL)
+    return ENOMEM;
+
+  dev = fs::devid(dfd_);
+
+  for(;;)
+    {
+      long nread;
+      linux_dirent64_t *d;
+
+      nread = fs::getdents_64(dfd_,_dents.data,_dents.size());
+      if(nread == -1)
+        return errno;
+      if(nread == 0)
+        break;
+
+      dirents.clear();
+
+      for(long pos = 0; pos < nread; pos += d->reclen)
+        {
+          uint64_t namelen;
+
+          d = (linux_dirent64_t*)&_dents.data[pos];
+
+          namelen = DIRENT_NAMELEN(d);
+
+          rv = _names.put(d->name,namelen);
+          if(rv == 0)
+            continue;
+
+          const std::string &fusepath = _path.set(d->name,namelen);
+
+          d->ino = fs::inode::calc(fusepath.c_str(),
+                                   fusepath.size(),
+                                   DTTOIF(d->type),
+                                   dev,
+                                   d->ino);
+
+          if(_plus != NULL)
+            {
+              dirents.push_back(d);
+              continue;
+            }
+
+          rv = fuse_dirents_add_linux(_buf,d,namelen);
+          if(rv < 0)
+            return ENOMEM;
+        }
+
+      if(_plus == NULL)
+        continue;
+
+      FUSE::readdir_plus_stat(tp_,*_plus,dfd_,basepath_,_dirname,dirents,st,uid_,gid_);
+
+      for(size_t i = 0; i < dirents.size(); i++)
+        {
+          rv = fuse_dirents_add_linux_plus(_buf,
+                                           dirents[i],
+                                           DIRENT_NAMELEN(dirents[i]),
+                                           _plus->entry(),
+                                           &st[i]);
+          if(rv < 0)
+            return ENOMEM;
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "dedup_set.hpp"
+#include "fuse_readdir_plus.hpp"
+
+#include "fuse_dirents.h"
+#include "linux_dirent64.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+class ThreadPool;
+
+
+namespace FUSE
+{
+  // A getdents64 buffer from g_DENTS_BUF_POOL or, if not pooled, the
+  // heap so that a one off large listing doesn't grow the pool for
+  // good. data is NULL if the allocation failed.
+  class DentsBuf
+  {
+  public:
+    DentsBuf(const bool pooled = true);
+    ~DentsBuf();
+
+  public:
+    size_t size(void) const;
+
+  public:
+    char *data;
+
+  private:
+    const bool _pooled;
+
+  private:
+    DentsBuf(const DentsBuf&);
+    DentsBuf& operator=(const DentsBuf&);
+  };
+
+  // "dirname/name" built in place after a prefix copied once so
+  // entries of a directory can be hashed and stat'ed without
+  // allocating a path for each.
+  class DirentPath
+  {
+  public:
+    DirentPath(const char *dirname);
+
+  public:
+    const std::string& set(const char   *name,
+                           const size_t  namelen);
+
+  private:
+    std::string _path;
+    size_t      _prefixlen;
+  };
+
+  // Fills st with the readdirplus attributes of dirents updating
+  // their inodes. Large sets are split across tp if not NULL.
+  void readdir_plus_stat(ThreadPool                     *tp,
+                         const FUSE::ReadDirPlus        &plus,
+                         const int                       dfd,
+                         const std::string              &basepath,
+                         const char                     *dirname,
+                         std::vector<linux_dirent64_t*> &dirents,
+                         std::vector<struct stat>       &st,
+                         const uid_t                     uid,
+                         const gid_t                     gid);
+
+  /*
+    The getdents64 loop shared by the readdir strategies. Reads a
+    branch directory into a buffer from g_DENTS_BUF_POOL, drops names
+    already seen and adds the rest to buf.
+
+    For readdirplus the attributes of each batch are gathered once
+    the batch is deduped and, if tp is not NULL, spread across it for
+    large batches.
+  */
+  class ReadDirDents
+  {
+  public:
+    ReadDirDents(const char              *dirname,
+                 const FUSE::ReadDirPlus *plus,
+                 DedupSet                &names,
+                 fuse_dirents_t          *buf);
+
+  public:
+    int read(const int          dfd,
+             const std::string &basepath,
+             ThreadPool        *tp  = NULL,
+             const uid_t        uid = 0,
+             const gid_t        gid = 0);
+
+  private:
+    ReadDirDents(const ReadDirDents&);
+    ReadDirDents& operator=(const ReadDirDents&);
+
+  private:
+    const char              *_dirname;
+    const FUSE::ReadDirPlus *_plus;
+    DedupSet                &_names;
+    fuse_dirents_t          *_buf;
+    DirentPath               _path;
+    DentsBuf                 _dents;
+  };
+}
@@ -18,12 +18,62 @@
 
 #include "fuse_readdir_plus.hpp"
 
-#include <errno.h>
+#include "fs_fstatat_follow.hpp"
+#include "fs_inode.hpp"
+#include "fs_path.hpp"
+#include "symlinkify.hpp"
+
+#include <cstring>
 
 
 int
 FUSE::readdir_plus(const fuse_file_info_t *ffi_,
                    fuse_dirents_t         *buf_)
 {
-  return -ENOTSUP;
+  Config::Read cfg;
+
+  return cfg->readdir.plus(ffi_,buf_);
+}
+
+FUSE::ReadDirPlus::ReadDirPlus(const Config::Read &cfg_)
+  : _follow_symlinks(cfg_->follow_symlinks),
+    _symlinkify(cfg_->symlinkify),
+    _symlinkify_timeout(cfg_->symlinkify_timeout)
+{
+  memset(&_entry,0,sizeof(_entry));
+  _entry.entry_valid = cfg_->cache_entry;
+  _entry.attr_valid  = cfg_->cache_attr;
+}
+
+/*
+  Mirrors getattr for an entry found in the branch directory open as
+  dirfd_. On failure st_ is zeroed and libfuse will return the entry
+  without attributes leaving the kernel to look it up.
+*/
+void
+FUSE::ReadDirPlus::stat(const int          dirfd_,
+                        const char        *name_,
+                        const std::string &basepath_,
+                        const std::string &fusepath_,
+                        struct stat       *st_) const
+{
+  int rv;
+
+  rv = fs::fstatat_follow(dirfd_,name_,st_,_follow_symlinks);
+  if(rv == -1)
+    {
+      memset(st_,0,sizeof(struct stat));
+      return;
+    }
+
+  if(_symlinkify && symlinkify::can_be_symlink(*st_,_symlinkify_timeout))
+    symlinkify::convert(fs::path::make(basepath_,name_),st_);
+
+  fs::inode::calc(fusepath_,st_);
+}
+
+const fuse_entry_t*
+FUSE::ReadDirPlus::entry(void) const
+{
+  return &_entry;
 }
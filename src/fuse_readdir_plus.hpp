@@ -16,11 +16,40 @@
 
 #pragma once
 
+#include "config.hpp"
+
 #include "fuse.h"
+#include "fuse_entry.h"
+
+#include <string>
+
+#include <sys/stat.h>
 
 
 namespace FUSE
 {
   int readdir_plus(fuse_file_info_t const *ffi,
                    fuse_dirents_t         *buf);
+
+  // Settings needed by the readdir strategies to fill in readdirplus
+  // entries. Captured once per request.
+  class ReadDirPlus
+  {
+  public:
+    ReadDirPlus(const Config::Read &cfg);
+
+  public:
+    void stat(const int          dirfd,
+              const char        *name,
+              const std::string &basepath,
+              const std::string &fusepath,
+              struct stat       *st) const;
+    const fuse_entry_t* entry(void) const;
+
+  private:
+    FollowSymlinks _follow_symlinks;
+    bool           _symlinkify;
+    time_t         _symlinkify_timeout;
+    fuse_entry_t   _entry;
+  };
 }
@@ -20,17 +20,14 @@
 
 #include "branches.hpp"
 #include "config.hpp"
+#include "dedup_set.hpp"
 #include "dirinfo.hpp"
 #include "errno.hpp"
-#include "fs_closedir.hpp"
-#include "fs_devid.hpp"
-#include "fs_dirfd.hpp"
-#include "fs_inode.hpp"
-#include "fs_opendir.hpp"
+#include "fs_close.hpp"
+#include "fs_open.hpp"
 #include "fs_path.hpp"
-#include "fs_readdir.hpp"
-#include "fs_stat.hpp"
-#include "hashset.hpp"
+#include "fuse_readdir_dents.hpp"
+#include "fuse_readdir_plus.hpp"
 #include "scope_guard.hpp"
 #include "ugid.hpp"
 
@@ -69,71 +66,40 @@ namespace l
     }
   };
 
-  static
-  uint64_t
-  dirent_exact_namelen(const struct dirent *d_)
-  {
-#ifdef _D_EXACT_NAMLEN
-    return _D_EXACT_NAMLEN(d_);
-#elif defined _DIRENT_HAVE_D_NAMLEN
-    return d_->d_namlen;
-#else
-    return strlen(d_->d_name);
-#endif
-  }
-
   static
   int
-  readdir(const Branches::CPtr &branches_,
-          const char           *dirname_,
-          fuse_dirents_t       *buf_)
+  readdir(const Branches::CPtr    &branches_,
+          const char              *dirname_,
+          const FUSE::ReadDirPlus *plus_,
+          fuse_dirents_t          *buf_)
   {
+    int rv;
     Error error;
-    HashSet names;
+    DedupSet names;
     std::string basepath;
-    std::string fullpath;
+    FUSE::ReadDirDents dents(dirname_,plus_,names,buf_);
 
     fuse_dirents_reset(buf_);
 
     for(auto const &branch : *branches_)
       {
-        int rv;
-        DIR *dh;
-        dev_t dev;
+        int dfd;
 
         basepath = fs::path::make(branch.path,dirname_);
 
-        errno = 0;
-        dh = fs::opendir(basepath);
-        error = errno;
-        if(!dh)
-          continue;
-
-        DEFER{ fs::closedir(dh); };
-
-        dev = fs::devid(dh);
-
-        rv = 0;
-        for(dirent *de = fs::readdir(dh); de && !rv; de = fs::readdir(dh))
+        dfd = fs::open_dir_ro(basepath);
+        if(dfd == -1)
           {
-            std::uint64_t namelen;
-
-            namelen = l::dirent_exact_namelen(de);
-
-            rv = names.put(de->d_name,namelen);
-            if(rv == 0)
-              continue;
+            error = errno;
+            continue;
+          }
 
-            fullpath = fs::path::make(dirname_,de->d_name);
-            de->d_ino = fs::inode::calc(fullpath,
-                                        DTTOIF(de->d_type),
-                                        dev,
-                                        de->d_ino);
+        DEFER{ fs::close(dfd); };
 
-            rv = fuse_dirents_add(buf_,de,namelen);
-            if(rv)
-              return -ENOMEM;
-          }
+        error = 0;
+        rv = dents.read(dfd,basepath);
+        if(rv == ENOMEM)
+          return -ENOMEM;
       }
 
     return -error;
@@ -151,5 +117,22 @@ FUSE::ReadDirSeq::operator()(fuse_file_info_t const *ffi_,
 
   return l::readdir(cfg->branches,
                     di->fusepath.c_str(),
+                    NULL,
+                    buf_);
+}
+
+int
+FUSE::ReadDirSeq::plus(fuse_file_info_t const *ffi_,
+                       fuse_dirents_t         *buf_)
+{
+  Config::Read        cfg;
+  DirInfo            *di = reinterpret_cast<DirInfo*>(ffi_->fh);
+  const fuse_context *fc = fuse_get_context();
+  const ugid::Set     ugid(fc->uid,fc->gid);
+  const ReadDirPlus   plus(cfg);
+
+  return l::readdir(cfg->branches,
+                    di->fusepath.c_str(),
+                    &plus,
                     buf_);
 }
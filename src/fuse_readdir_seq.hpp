@@ -31,5 +31,7 @@ namespace FUSE
 
     int operator()(fuse_file_info_t const *ffi,
                    fuse_dirents_t         *buf);
+    int plus(fuse_file_info_t const *ffi,
+             fuse_dirents_t         *buf);
   };
 }
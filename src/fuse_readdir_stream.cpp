@@ -0,0 +1,203 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "fuse_readdir_stream.hpp"
+
+#include "branches.hpp"
+#include "config.hpp"
+#include "dirinfo.hpp"
+#include "errno.hpp"
+#include "fs_close.hpp"
+#include "fs_devid.hpp"
+#include "fs_getdents64.hpp"
+#include "fs_inode.hpp"
+#include "fs_open.hpp"
+#include "fs_path.hpp"
+#include "fuse_readdir_dents.hpp"
+#include "fuse_readdir_plus.hpp"
+#include "ugid.hpp"
+
+#include "fuse.h"
+#include "fuse_dirents.h"
+#include "linux_dirent64.h"
+
+#include <string>
+
+
+namespace l
+{
+  static
+  int
+  add(const FUSE::ReadDirPlus *plus_,
+      const DirInfo::Stream   *s_,
+      const std::string       &basepath_,
+      const std::string       &fusepath_,
+      linux_dirent64_t        *d_,
+      const uint64_t           namelen_,
+      fuse_dirents_t          *buf_)
+  {
+    struct stat st;
+
+    if(plus_ == NULL)
+      return fuse_dirents_add_linux(buf_,d_,namelen_);
+
+    plus_->stat(s_->fd,d_->name,basepath_,fusepath_,&st);
+    if(st.st_mode != 0)
+      d_->ino = st.st_ino;
+
+    return fuse_dirents_add_linux_plus(buf_,d_,namelen_,plus_->entry(),&st);
+  }
+
+  static
+  int
+  next_branch(DirInfo::Stream *s_,
+              const char      *dirname_,
+              std::string     *basepath_)
+  {
+    if(s_->fd != -1)
+      {
+        fs::close(s_->fd);
+        s_->fd = -1;
+        s_->branch++;
+      }
+
+    for(; s_->branch < s_->branches->size(); s_->branch++)
+      {
+        *basepath_ = fs::path::make((*s_->branches)[s_->branch].path,dirname_);
+
+        s_->fd = fs::open_dir_ro(*basepath_);
+        if(s_->fd == -1)
+          {
+            s_->err = errno;
+            continue;
+          }
+
+        s_->err = 0;
+        s_->dev = fs::devid(s_->fd);
+
+        return 0;
+      }
+
+    return -1;
+  }
+
+  /*
+    Adds one getdents64 worth of new entries per call. Branches are
+    read in order and the set of names seen is kept in the DirInfo so
+    the listing can be resumed by the next request. Offsets are the
+    count of entries added so far which libfuse uses to decide where
+    to resume and when to start over.
+  */
+  static
+  int
+  readdir(const Branches::CPtr    &branches_,
+          DirInfo                 *di_,
+          const FUSE::ReadDirPlus *plus_,
+          fuse_dirents_t          *buf_)
+  {
+    int rv;
+    long nread;
+    uint64_t added;
+    uint64_t namelen;
+    DirInfo::Stream *s;
+    linux_dirent64_t *d;
+    std::string basepath;
+    FUSE::DirentPath path(di_->fusepath.c_str());
+    FUSE::DentsBuf buf;
+
+    if(buf.data == NULL)
+      return -ENOMEM;
+    if((buf_->base == 0) && (kv_size(buf_->data) == 0))
+      di_->stream.reset(new DirInfo::Stream(branches_));
+
+    s = di_->stream.get();
+    if(s->fd != -1)
+      basepath = fs::path::make((*s->branches)[s->branch].path,di_->fusepath);
+    else if(l::next_branch(s,di_->fusepath.c_str(),&basepath) == -1)
+      return -s->err;
+
+    added = 0;
+    while(added == 0)
+      {
+        nread = fs::getdents_64(s->fd,buf.data,buf.size());
+        if(nread <= 0)
+          {
+            if(l::next_branch(s,di_->fusepath.c_str(),&basepath) == 0)
+              continue;
+            if(s->added == 0)
+              return -s->err;
+            return 0;
+          }
+
+        for(long pos = 0; pos < nread; pos += d->reclen)
+          {
+            d = (linux_dirent64_t*)&buf.data[pos];
+
+            namelen = DIRENT_NAMELEN(d);
+
+            rv = s->names.put(d->name,namelen);
+            if(rv == 0)
+              continue;
+
+            const std::string &fusepath = path.set(d->name,namelen);
+
+            d->ino = fs::inode::calc(fusepath,
+                                     DTTOIF(d->type),
+                                     s->dev,
+                                     d->ino);
+
+            rv = l::add(plus_,s,basepath,fusepath,d,namelen,buf_);
+            if(rv < 0)
+              return -ENOMEM;
+
+            added++;
+          }
+
+        s->added += added;
+      }
+
+    buf_->more = 1;
+
+    return 0;
+  }
+}
+
+int
+FUSE::ReadDirStream::operator()(fuse_file_info_t const *ffi_,
+                                fuse_dirents_t         *buf_)
+{
+  Config::Read        cfg;
+  DirInfo            *di = reinterpret_cast<DirInfo*>(ffi_->fh);
+  const fuse_context *fc = fuse_get_context();
+  const ugid::Set     ugid(fc->uid,fc->gid);
+
+  return l::readdir(cfg->branches,di,NULL,buf_);
+}
+
+int
+FUSE::ReadDirStream::plus(fuse_file_info_t const *ffi_,
+                          fuse_dirents_t         *buf_)
+{
+  Config::Read        cfg;
+  DirInfo            *di = reinterpret_cast<DirInfo*>(ffi_->fh);
+  const fuse_context *fc = fuse_get_context();
+  const ugid::Set     ugid(fc->uid,fc->gid);
+  const ReadDirPlus   plus(cfg);
+
+  return l::readdir(cfg->branches,di,&plus,buf_);
+}
@@ -101,7 +101,7 @@ namespace l
            const time_t          symlinkify_timeout_)
   {
     int rv;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = searchFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -16,6 +16,7 @@
 
 #include "config.hpp"
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
 #include "fs_close.hpp"
 #include "fs_fadvise.hpp"
@@ -32,6 +33,13 @@ namespace l
   release(FileInfo   *fi_,
           const bool  dropcacheonclose_)
   {
+    // Taking the lock ensures a move which just swapped fi's fd has
+    // let go of it.
+    FileMigration::detach(fi_);
+    {
+      std::lock_guard<std::mutex> lg(fi_->mutex);
+    }
+
     // according to Feh of nocache calling it once doesn't always work
     // https://github.com/Feh/nocache
     if(dropcacheonclose_)
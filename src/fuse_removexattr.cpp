@@ -14,6 +14,7 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
 #include "config.hpp"
 #include "errno.hpp"
 #include "fs_lremovexattr.hpp"
@@ -24,10 +25,8 @@
 #include "fuse.h"
 
 #include <string>
-#include <vector>
 
 using std::string;
-using std::vector;
 
 
 namespace l
@@ -53,11 +52,10 @@ namespace l
   }
 
   static
-  void
+  int
   removexattr_loop_core(const string &basepath_,
                         const char   *fusepath_,
-                        const char   *attrname_,
-                        PolicyRV     *prv_)
+                        const char   *attrname_)
   {
     string fullpath;
 
@@ -66,20 +64,22 @@ namespace l
     errno = 0;
     fs::lremovexattr(fullpath,attrname_);
 
-    prv_->insert(errno,basepath_);
+    return errno;
   }
 
   static
   void
-  removexattr_loop(const vector<string> &basepaths_,
+  removexattr_loop(const BasePaths      &basepaths_,
                    const char           *fusepath_,
                    const char           *attrname_,
                    PolicyRV             *prv_)
   {
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
-      {
-        l::removexattr_loop_core(basepaths_[i],fusepath_,attrname_,prv_);
-      }
+    BranchFanOut::run(basepaths_,
+                      [=](const string &basepath_)
+                      {
+                        return l::removexattr_loop_core(basepath_,fusepath_,attrname_);
+                      },
+                      prv_);
   }
 
   static
@@ -92,7 +92,7 @@ namespace l
   {
     int rv;
     PolicyRV prv;
-    vector<string> basepaths;
+    BasePaths basepaths;
 
     rv = actionFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
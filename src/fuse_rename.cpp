@@ -15,16 +15,19 @@
 */
 
 #include "config.hpp"
+#include "dir_filter.hpp"
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fs_clonepath.hpp"
 #include "fs_link.hpp"
 #include "fs_mkdir_as_root.hpp"
 #include "fs_path.hpp"
 #include "fs_remove.hpp"
-#include "fs_rename.hpp"
 #include "fs_symlink.hpp"
 #include "fs_unlink.hpp"
 #include "fuse_symlink.hpp"
+#include "location_index.hpp"
+#include "policy_cache.hpp"
 #include "ugid.hpp"
 
 #include "ghc/filesystem.hpp"
@@ -62,8 +65,8 @@ namespace l
 {
   static
   bool
-  contains(const StrVec &haystack_,
-           const char   *needle_)
+  contains(const BasePaths &haystack_,
+           const char      *needle_)
   {
     for(auto &hay : haystack_)
       {
@@ -76,8 +79,8 @@ namespace l
 
   static
   bool
-  contains(const StrVec &haystack_,
-           const string &needle_)
+  contains(const BasePaths &haystack_,
+           const string    &needle_)
   {
     return l::contains(haystack_,needle_.c_str());
   }
@@ -115,8 +118,8 @@ namespace l
     int rv;
     int error;
     StrVec toremove;
-    StrVec newbasepath;
-    StrVec oldbasepaths;
+    BasePaths newbasepath;
+    BasePaths oldbasepaths;
     gfs::path oldfullpath;
     gfs::path newfullpath;
 
@@ -143,12 +146,12 @@ namespace l
         oldfullpath  = branch.path;
         oldfullpath += oldfusepath_;
 
-        rv = fs::rename(oldfullpath,newfullpath);
+        rv = DirFilter::rename(oldfullpath,newfullpath);
         if(rv == -1)
           {
             rv = fs::clonepath_as_root(newbasepath[0],branch.path,newfusepath_.parent_path());
             if(rv == 0)
-              rv = fs::rename(oldfullpath,newfullpath);
+              rv = DirFilter::rename(oldfullpath,newfullpath);
           }
 
         error = error::calc(rv,error,errno);
@@ -172,7 +175,7 @@ namespace l
     int rv;
     bool success;
     StrVec toremove;
-    StrVec oldbasepaths;
+    BasePaths oldbasepaths;
     gfs::path oldfullpath;
     gfs::path newfullpath;
 
@@ -195,7 +198,7 @@ namespace l
         oldfullpath  = branch.path;
         oldfullpath += oldfusepath_;
 
-        rv = fs::rename(oldfullpath,newfullpath);
+        rv = DirFilter::rename(oldfullpath,newfullpath);
         if(rv == -1)
           {
             toremove.push_back(oldfullpath);
@@ -216,7 +219,7 @@ namespace l
 
   static
   void
-  rename_exdev_rename_back(const StrVec    &basepaths_,
+  rename_exdev_rename_back(const BasePaths &basepaths_,
                            const gfs::path &oldfusepath_)
   {
     gfs::path oldpath;
@@ -231,7 +234,7 @@ namespace l
         newpath  = basepath;
         newpath += oldfusepath_;
 
-        fs::rename(oldpath,newpath);
+        DirFilter::rename(oldpath,newpath);
       }
   }
 
@@ -240,7 +243,7 @@ namespace l
   rename_exdev_rename_target(const Policy::Action &actionPolicy_,
                              const Branches::CPtr &branches_,
                              const gfs::path      &oldfusepath_,
-                             StrVec               *basepaths_)
+                             BasePaths            *basepaths_)
   {
     int rv;
     gfs::path clonesrc;
@@ -260,7 +263,11 @@ namespace l
         rv = fs::clonepath(clonesrc,clonetgt,oldfusepath_.parent_path());
         if((rv == -1) && (errno == ENOENT))
           {
-            fs::mkdir(clonetgt,01777);
+            if(fs::mkdir(clonetgt,01777) == 0)
+              {
+                DirFilter::added(clonetgt);
+                g_LOCATION_INDEX.added(clonetgt);
+              }
             rv = fs::clonepath(clonesrc,clonetgt,oldfusepath_.parent_path());
           }
 
@@ -270,9 +277,11 @@ namespace l
         clonesrc += oldfusepath_;
         clonetgt += oldfusepath_;
 
-        rv = fs::rename(clonesrc,clonetgt);
+        rv = DirFilter::rename(clonesrc,clonetgt);
         if(rv == -1)
           goto error;
+
+        g_LOCATION_INDEX.added(clonetgt);
       }
 
     return 0;
@@ -291,7 +300,7 @@ namespace l
                            const gfs::path      &newfusepath_)
   {
     int rv;
-    StrVec basepaths;
+    BasePaths basepaths;
     gfs::path target;
     gfs::path linkpath;
 
@@ -320,7 +329,7 @@ namespace l
                            const gfs::path      &newfusepath_)
   {
     int rv;
-    StrVec basepaths;
+    BasePaths basepaths;
     gfs::path target;
     gfs::path linkpath;
 
@@ -399,9 +408,17 @@ namespace FUSE
     const fuse_context *fc = fuse_get_context();
     const ugid::Set     ugid(fc->uid,fc->gid);
 
+    FileMigration::wait(oldfusepath_);
+    FileMigration::wait(newfusepath_);
+
     rv = l::rename(cfg,oldfusepath,newfusepath);
     if(rv == -EXDEV)
-      return l::rename_exdev(cfg,oldfusepath,newfusepath);
+      rv = l::rename_exdev(cfg,oldfusepath,newfusepath);
+
+    // Renaming a directory changes everything below it.
+    g_POLICY_CACHE.clear();
+    if(rv == 0)
+      g_LOCATION_INDEX.link(oldfusepath_,newfusepath_);
 
     return rv;
   }
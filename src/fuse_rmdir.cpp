@@ -14,11 +14,15 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
 #include "config.hpp"
+#include "dir_filter.hpp"
 #include "errno.hpp"
 #include "fs_path.hpp"
 #include "fs_rmdir.hpp"
 #include "fs_unlink.hpp"
+#include "location_index.hpp"
+#include "policy_cache.hpp"
 #include "ugid.hpp"
 
 #include "fuse.h"
@@ -28,25 +32,8 @@
 #include <unistd.h>
 
 using std::string;
-using std::vector;
 
 
-namespace error
-{
-  static
-  int
-  calc(const int rv_,
-       const int prev_,
-       const int cur_)
-  {
-    if(prev_ != 0)
-      return prev_;
-    if(rv_ == -1)
-      return cur_;
-    return 0;
-  }
-}
-
 namespace l
 {
   static
@@ -64,8 +51,7 @@ namespace l
   int
   rmdir_core(const string         &basepath_,
              const char           *fusepath_,
-             const FollowSymlinks  followsymlinks_,
-             const int             error_)
+             const FollowSymlinks  followsymlinks_)
   {
     int rv;
     string fullpath;
@@ -73,25 +59,30 @@ namespace l
     fullpath = fs::path::make(basepath_,fusepath_);
 
     rv = fs::rmdir(fullpath);
-    if(l::should_unlink(rv,errno,followsymlinks_))
+    if(rv == 0)
+      DirFilter::removed(fullpath);
+    else if(l::should_unlink(rv,errno,followsymlinks_))
       rv = fs::unlink(fullpath);
+    if(rv == 0)
+      g_LOCATION_INDEX.removed(fullpath);
 
-    return error::calc(rv,error_,errno);
+    return ((rv == -1) ? errno : 0);
   }
 
   static
   int
-  rmdir_loop(const StrVec         &basepaths_,
+  rmdir_loop(const BasePaths      &basepaths_,
              const char           *fusepath_,
              const FollowSymlinks  followsymlinks_)
   {
     int error;
 
-    error = 0;
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
-      {
-        error = l::rmdir_core(basepaths_[i],fusepath_,followsymlinks_,error);
-      }
+    error = BranchFanOut::run(basepaths_,
+                              [=](const string &basepath_)
+                              {
+                                return l::rmdir_core(basepath_,fusepath_,
+                                                     followsymlinks_);
+                              });
 
     return -error;
   }
@@ -104,7 +95,7 @@ namespace l
         const char           *fusepath_)
   {
     int rv;
-    vector<string> basepaths;
+    BasePaths basepaths;
 
     rv = actionFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -123,9 +114,15 @@ namespace FUSE
     const fuse_context *fc = fuse_get_context();
     const ugid::Set     ugid(fc->uid,fc->gid);
 
-    return l::rmdir(cfg->func.rmdir.policy,
-                    cfg->branches,
-                    cfg->follow_symlinks,
-                    fusepath_);
+    int rv;
+
+    rv = l::rmdir(cfg->func.rmdir.policy,
+                  cfg->branches,
+                  cfg->follow_symlinks,
+                  fusepath_);
+
+    g_POLICY_CACHE.erase(fusepath_);
+
+    return rv;
   }
 }
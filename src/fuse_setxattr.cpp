@@ -14,7 +14,10 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
+#include "branch_io.hpp"
 #include "config.hpp"
+#include "dir_filter.hpp"
 #include "errno.hpp"
 #include "fs_glob.hpp"
 #include "fs_lsetxattr.hpp"
@@ -93,19 +96,25 @@ namespace l
       return rv;
 
     fs::statvfs_cache_timeout(cfg->cache_statfs);
+    fs::statvfs_cache_background(cfg->cache_statfs_background);
+    BranchIO::timeout(cfg->branch_io_timeout);
+    BranchIO::fast_fail(cfg->branch_io_fast_fail);
+    BranchFanOut::min_branches(cfg->fanout_min_branches);
+    DirFilter::enabled(cfg->dir_filter &&
+                       (cfg->follow_symlinks != FollowSymlinks::ENUM::DIRECTORY) &&
+                       (cfg->follow_symlinks != FollowSymlinks::ENUM::ALL));
 
     return rv;
   }
 
   static
-  void
+  int
   setxattr_loop_core(const string &basepath_,
                      const char   *fusepath_,
                      const char   *attrname_,
                      const char   *attrval_,
                      const size_t  attrvalsize_,
-                     const int     flags_,
-                     PolicyRV     *prv_)
+                     const int     flags_)
   {
     string fullpath;
 
@@ -114,25 +123,27 @@ namespace l
     errno = 0;
     fs::lsetxattr(fullpath,attrname_,attrval_,attrvalsize_,flags_);
 
-    prv_->insert(errno,basepath_);
+    return errno;
   }
 
   static
   void
-  setxattr_loop(const StrVec &basepaths_,
-                const char   *fusepath_,
-                const char   *attrname_,
-                const char   *attrval_,
-                const size_t  attrvalsize_,
-                const int     flags_,
-                PolicyRV     *prv_)
+  setxattr_loop(const BasePaths &basepaths_,
+                const char      *fusepath_,
+                const char      *attrname_,
+                const char      *attrval_,
+                const size_t     attrvalsize_,
+                const int        flags_,
+                PolicyRV        *prv_)
   {
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
-      {
-        l::setxattr_loop_core(basepaths_[i],fusepath_,
-                              attrname_,attrval_,attrvalsize_,
-                              flags_,prv_);
-      }
+    BranchFanOut::run(basepaths_,
+                      [=](const string &basepath_)
+                      {
+                        return l::setxattr_loop_core(basepath_,fusepath_,
+                                                     attrname_,attrval_,
+                                                     attrvalsize_,flags_);
+                      },
+                      prv_);
   }
 
   static
@@ -148,7 +159,7 @@ namespace l
   {
     int rv;
     PolicyRV prv;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = setxattrPolicy_(branches_,fusepath_,&basepaths);
     if(rv == -1)
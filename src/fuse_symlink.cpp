@@ -22,6 +22,8 @@
 #include "fs_inode.hpp"
 #include "fs_symlink.hpp"
 #include "fuse_getattr.hpp"
+#include "location_index.hpp"
+#include "policy_cache.hpp"
 #include "ugid.hpp"
 
 #include "fuse.h"
@@ -82,12 +84,12 @@ namespace l
 
   static
   int
-  symlink_loop(const string &existingpath_,
-               const StrVec &newbasepaths_,
-               const char   *target_,
-               const char   *linkpath_,
-               const string &newdirpath_,
-               struct stat  *st_)
+  symlink_loop(const string    &existingpath_,
+               const BasePaths &newbasepaths_,
+               const char      *target_,
+               const char      *linkpath_,
+               const string    &newdirpath_,
+               struct stat     *st_)
   {
     int rv;
     int error;
@@ -120,8 +122,8 @@ namespace l
   {
     int rv;
     string newdirpath;
-    StrVec newbasepaths;
-    StrVec existingpaths;
+    BasePaths newbasepaths;
+    BasePaths existingpaths;
 
     newdirpath = fs::path::dirname(linkpath_);
 
@@ -133,8 +135,12 @@ namespace l
     if(rv == -1)
       return -errno;
 
-    return l::symlink_loop(existingpaths[0],newbasepaths,
-                           target_,linkpath_,newdirpath,st_);
+    rv = l::symlink_loop(existingpaths[0],newbasepaths,
+                         target_,linkpath_,newdirpath,st_);
+    if(rv == 0)
+      g_LOCATION_INDEX.add(branches_,linkpath_,newbasepaths);
+
+    return rv;
   }
 }
 
@@ -160,6 +166,7 @@ namespace FUSE
     if(rv == -EROFS)
       {
         Config::Write()->branches.find_and_set_mode_ro();
+        cfg.refresh();
         rv = l::symlink(cfg->func.getattr.policy,
                         cfg->func.symlink.policy,
                         cfg->branches,
@@ -168,6 +175,8 @@ namespace FUSE
                         st_);
       }
 
+    g_POLICY_CACHE.erase(linkpath_);
+
     if(timeouts_ != NULL)
       {
         switch(cfg->follow_symlinks)
@@ -14,8 +14,10 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
 #include "config.hpp"
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fs_path.hpp"
 #include "fs_truncate.hpp"
 #include "policy_rv.hpp"
@@ -54,11 +56,10 @@ namespace l
   }
 
   static
-  void
+  int
   truncate_loop_core(const string &basepath_,
                      const char   *fusepath_,
-                     const off_t   size_,
-                     PolicyRV     *prv_)
+                     const off_t   size_)
   {
     string fullpath;
 
@@ -67,20 +68,22 @@ namespace l
     errno = 0;
     fs::truncate(fullpath,size_);
 
-    prv_->insert(errno,basepath_);
+    return errno;
   }
 
   static
   void
-  truncate_loop(const StrVec &basepaths_,
-                const char   *fusepath_,
-                const off_t   size_,
-                PolicyRV     *prv_)
+  truncate_loop(const BasePaths &basepaths_,
+                const char      *fusepath_,
+                const off_t      size_,
+                PolicyRV        *prv_)
   {
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
-      {
-        l::truncate_loop_core(basepaths_[i],fusepath_,size_,prv_);
-      }
+    BranchFanOut::run(basepaths_,
+                      [=](const string &basepath_)
+                      {
+                        return l::truncate_loop_core(basepath_,fusepath_,size_);
+                      },
+                      prv_);
   }
 
   static
@@ -93,7 +96,7 @@ namespace l
   {
     int rv;
     PolicyRV prv;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = actionFunc_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -120,14 +123,20 @@ namespace FUSE
   truncate(const char *fusepath_,
            off_t       size_)
   {
+    int rv;
     Config::Read cfg;
     const fuse_context *fc = fuse_get_context();
     const ugid::Set     ugid(fc->uid,fc->gid);
+    FileMigration::Hold hold(fusepath_);
+
+    rv = l::truncate(cfg->func.truncate.policy,
+                     cfg->func.getattr.policy,
+                     cfg->branches,
+                     fusepath_,
+                     size_);
+    if(rv == 0)
+      hold.truncated(size_);
 
-    return l::truncate(cfg->func.truncate.policy,
-                       cfg->func.getattr.policy,
-                       cfg->branches,
-                       fusepath_,
-                       size_);
+    return rv;
   }
 }
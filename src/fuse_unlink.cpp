@@ -14,47 +14,31 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
 #include "config.hpp"
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fs_path.hpp"
 #include "fs_unlink.hpp"
+#include "location_index.hpp"
+#include "policy_cache.hpp"
 #include "ugid.hpp"
 
 #include "fuse.h"
 
 #include <string>
-#include <vector>
 
 #include <unistd.h>
 
 using std::string;
-using std::vector;
 
 
-namespace error
-{
-  static
-  inline
-  int
-  calc(const int rv_,
-       const int prev_,
-       const int cur_)
-  {
-    if(prev_ != 0)
-      return prev_;
-    if(rv_ == -1)
-      return cur_;
-    return 0;
-  }
-}
-
 namespace l
 {
   static
   int
   unlink_loop_core(const string &basepath_,
-                   const char   *fusepath_,
-                   const int     error_)
+                   const char   *fusepath_)
   {
     int rv;
     string fullpath;
@@ -62,22 +46,24 @@ namespace l
     fullpath = fs::path::make(basepath_,fusepath_);
 
     rv = fs::unlink(fullpath);
+    if(rv == 0)
+      g_LOCATION_INDEX.removed(fullpath);
 
-    return error::calc(rv,error_,errno);
+    return ((rv == -1) ? errno : 0);
   }
 
   static
   int
-  unlink_loop(const vector<string> &basepaths_,
-              const char           *fusepath_)
+  unlink_loop(const BasePaths &basepaths_,
+              const char      *fusepath_)
   {
     int error;
 
-    error = 0;
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
-      {
-        error = l::unlink_loop_core(basepaths_[i],fusepath_,error);
-      }
+    error = BranchFanOut::run(basepaths_,
+                              [=](const string &basepath_)
+                              {
+                                return l::unlink_loop_core(basepath_,fusepath_);
+                              });
 
     return -error;
   }
@@ -89,7 +75,7 @@ namespace l
          const char           *fusepath_)
   {
     int rv;
-    vector<string> basepaths;
+    BasePaths basepaths;
 
     rv = unlinkPolicy_(branches_,fusepath_,&basepaths);
     if(rv == -1)
@@ -108,8 +94,17 @@ namespace FUSE
     const fuse_context *fc = fuse_get_context();
     const ugid::Set     ugid(fc->uid,fc->gid);
 
-    return l::unlink(cfg->func.unlink.policy,
-                     cfg->branches,
-                     fusepath_);
+    int rv;
+    FileMigration::Hold hold(fusepath_);
+
+    rv = l::unlink(cfg->func.unlink.policy,
+                   cfg->branches,
+                   fusepath_);
+    if(rv == 0)
+      hold.unlinked();
+
+    g_POLICY_CACHE.erase(fusepath_);
+
+    return rv;
   }
 }
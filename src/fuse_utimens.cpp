@@ -14,6 +14,7 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include "branch_fanout.hpp"
 #include "config.hpp"
 #include "errno.hpp"
 #include "fs_lutimens.hpp"
@@ -53,11 +54,10 @@ namespace l
   }
 
   static
-  void
+  int
   utimens_loop_core(const string   &basepath_,
                     const char     *fusepath_,
-                    const timespec  ts_[2],
-                    PolicyRV       *prv_)
+                    const timespec  ts_[2])
   {
     string fullpath;
 
@@ -66,20 +66,22 @@ namespace l
     errno = 0;
     fs::lutimens(fullpath,ts_);
 
-    prv_->insert(errno,basepath_);
+    return errno;
   }
 
   static
   void
-  utimens_loop(const StrVec   &basepaths_,
-               const char     *fusepath_,
-               const timespec  ts_[2],
-               PolicyRV       *prv_)
+  utimens_loop(const BasePaths &basepaths_,
+               const char      *fusepath_,
+               const timespec   ts_[2],
+               PolicyRV        *prv_)
   {
-    for(size_t i = 0, ei = basepaths_.size(); i != ei; i++)
-      {
-        l::utimens_loop_core(basepaths_[i],fusepath_,ts_,prv_);
-      }
+    BranchFanOut::run(basepaths_,
+                      [=](const string &basepath_)
+                      {
+                        return l::utimens_loop_core(basepath_,fusepath_,ts_);
+                      },
+                      prv_);
   }
 
   static
@@ -92,7 +94,7 @@ namespace l
   {
     int rv;
     PolicyRV prv;
-    StrVec basepaths;
+    BasePaths basepaths;
 
     rv = utimensPolicy_(branches_,fusepath_,&basepaths);
     if(rv == -1)
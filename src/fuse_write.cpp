@@ -16,12 +16,11 @@
 
 #include "config.hpp"
 #include "errno.hpp"
+#include "file_migration.hpp"
 #include "fileinfo.hpp"
-#include "fs_close.hpp"
-#include "fs_dup2.hpp"
-#include "fs_movefile.hpp"
 #include "fs_pwrite.hpp"
 #include "fs_pwriten.hpp"
+#include "fs_splicen.hpp"
 
 #include "fuse.h"
 
@@ -36,6 +35,29 @@ namespace l
             (error_ == -EDQUOT));
   }
 
+  // Starts moving the file in the background, or joins the move
+  // already under way. Writes from here on go to the new location
+  // through fi->migration. 1 if the file had already been moved and
+  // the write can simply be retried.
+  static
+  int
+  movefile(FileInfo *fi_)
+  {
+    int rv;
+    Config::Read cfg;
+
+    if(cfg->moveonenospc.enabled == false)
+      return -1;
+
+    rv = FileMigration::start(cfg->moveonenospc.policy,
+                              cfg->branches,
+                              fi_);
+    if(rv < 0)
+      return -1;
+
+    return rv;
+  }
+
   static
   int
   move_and_pwrite(const char   *buf_,
@@ -46,24 +68,18 @@ namespace l
   {
     int err;
     ssize_t rv;
-    Config::Read cfg;
 
-    if(cfg->moveonenospc.enabled == false)
-      return err_;
-
-    rv = fs::movefile_as_root(cfg->moveonenospc.policy,
-                              cfg->branches,
-                              fi_->fusepath,
-                              fi_->fd);
+    rv = l::movefile(fi_);
     if(rv < 0)
       return err_;
+    if(rv > 0)
+      return fs::pwrite(fi_->fd,buf_,count_,offset_);
 
-    err = fs::dup2(rv,fi_->fd);
-    fs::close(rv);
-    if(err < 0)
-      return err_;
+    rv = fi_->migration->pwrite(buf_,count_,offset_,&err);
+    if(rv == 0)
+      return err;
 
-    return fs::pwrite(fi_->fd,buf_,count_,offset_);
+    return rv;
   }
 
   static
@@ -77,34 +93,48 @@ namespace l
   {
     int err;
     ssize_t rv;
-    Config::Read cfg;
-
-    if(cfg->moveonenospc.enabled == false)
-      return err_;
 
-    rv = fs::movefile_as_root(cfg->moveonenospc.policy,
-                              cfg->branches,
-                              fi_->fusepath,
-                              fi_->fd);
+    rv = l::movefile(fi_);
     if(rv < 0)
       return err_;
-
-    err = fs::dup2(rv,fi_->fd);
-    fs::close(rv);
-    if(err < 0)
-      return err_;
-
-    rv = fs::pwriten(fi_->fd,
-                     buf_ + written_,
-                     count_ - written_,
-                     offset_ + written_,
-                     &err);
+    if(rv > 0)
+      rv = fs::pwriten(fi_->fd,
+                       buf_ + written_,
+                       count_ - written_,
+                       offset_ + written_,
+                       &err);
+    else
+      rv = fi_->migration->pwrite(buf_ + written_,
+                                  count_ - written_,
+                                  offset_ + written_,
+                                  &err);
     if(err < 0)
       return err;
 
     return (written_ + rv);
   }
 
+  // While a move is under way everything is written to the new
+  // location.
+  static
+  int
+  write_migrating(const char   *buf_,
+                  const size_t  count_,
+                  const off_t   offset_,
+                  FileInfo     *fi_)
+  {
+    int err;
+    ssize_t rv;
+
+    rv = fi_->migration->pwrite(buf_,count_,offset_,&err);
+    if(err == 0)
+      return rv;
+    if(fi_->direct_io && (rv > 0))
+      return rv;
+
+    return err;
+  }
+
   // When in direct_io mode write's return value should match that of
   // the operation.
   // 0 on EOF
@@ -175,11 +205,67 @@ namespace l
     // transfer to complete before retrying.
     std::lock_guard<std::mutex> guard(fi->mutex);
 
+    if(fi->migration)
+      return l::write_migrating(buf_,count_,offset_,fi);
+
     if(fi->direct_io)
       return l::write_direct_io(buf_,count_,offset_,fi);
 
     return l::write_cached(buf_,count_,offset_,fi);
   }
+
+  // Short writes are only reported in direct_io mode. Same as the
+  // regular write path. On ENOSPC the file is moved and the rest of
+  // the data in the pipe spliced to the new location.
+  static
+  int
+  write_pipe(const fuse_file_info_t *ffi_,
+             const int               pipefd_,
+             const size_t            count_,
+             const off_t             offset_)
+  {
+    int err;
+    ssize_t rv;
+    FileInfo *fi;
+
+    fi = reinterpret_cast<FileInfo*>(ffi_->fh);
+
+    std::lock_guard<std::mutex> guard(fi->mutex);
+
+    // Nothing consumed so libfuse falls back to a regular write.
+    if(fi->migration)
+      return -ENOTSUP;
+
+    rv = fs::splicen(pipefd_,fi->fd,count_,offset_,&err);
+    if(err == 0)
+      return rv;
+
+    // Destination doesn't support splicing (O_APPEND for
+    // example). Nothing was consumed so have libfuse fall back to
+    // a regular write.
+    if((rv == 0) && (err == -EINVAL))
+      return -ENOTSUP;
+
+    if(l::out_of_space(err))
+      {
+        switch(l::movefile(fi))
+          {
+          case 0:
+            rv += fi->migration->splice(pipefd_,count_ - rv,offset_ + rv,&err);
+            break;
+          case 1:
+            rv += fs::splicen(pipefd_,fi->fd,count_ - rv,offset_ + rv,&err);
+            break;
+          }
+      }
+    if(err == 0)
+      return rv;
+
+    if(fi->direct_io && (rv > 0))
+      return rv;
+
+    return err;
+  }
 }
 
 namespace FUSE
@@ -193,6 +279,15 @@ namespace FUSE
     return l::write(ffi_,buf_,count_,offset_);
   }
 
+  int
+  write_pipe(const fuse_file_info_t *ffi_,
+             int                     pipefd_,
+             size_t                  count_,
+             off_t                   offset_)
+  {
+    return l::write_pipe(ffi_,pipefd_,count_,offset_);
+  }
+
   int
   write_null(const fuse_file_info_t *ffi_,
              const char             *buf_,
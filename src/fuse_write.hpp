@@ -27,6 +27,12 @@ namespace FUSE
         size_t                  count,
         off_t                   offset);
 
+  int
+  write_pipe(const fuse_file_info_t *ffi,
+             int                     pipefd,
+             size_t                  count,
+             off_t                   offset);
+
   int
   write_null(const fuse_file_info_t *ffi,
              const char             *buf,
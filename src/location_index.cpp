@@ -0,0 +1,677 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "location_index.hpp"
+
+#include "fs_exists.hpp"
+#include "syslog.hpp"
+#include "wyhash.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC        "mfslocx"
+#define VERSION      1
+#define MAX_BRANCHES 64
+#define MAX_PROBES   64
+
+LocationIndex g_LOCATION_INDEX;
+
+struct LocationIndex::Header
+{
+  char     magic[8];
+  uint64_t version;
+  uint64_t capacity;
+  uint64_t signature;
+  uint64_t used;
+  uint64_t reserved[3];
+};
+
+static_assert(sizeof(LocationIndex::Header) == 64,"");
+
+struct LocationIndex::Slot
+{
+  uint64_t hash;
+  uint64_t bits;
+};
+
+namespace l
+{
+  static
+  uint64_t
+  hash(const char        *fusepath_,
+       const std::size_t  len_)
+  {
+    uint64_t h;
+
+    h = wyhash(fusepath_,len_,0x6c6f636174696f6e,_wyp);
+
+    return ((h == 0) ? 1 : h);
+  }
+
+  static
+  uint64_t
+  hash(const char *fusepath_)
+  {
+    return l::hash(fusepath_,strlen(fusepath_));
+  }
+
+  static
+  uint64_t
+  signature(const Branches::CPtr &branches_)
+  {
+    uint64_t h;
+
+    h = 0;
+    for(const auto &branch : *branches_)
+      h = wyhash(branch.path.c_str(),branch.path.size() + 1,h,_wyp);
+
+    return h;
+  }
+
+  static
+  bool
+  same_branches(const std::weak_ptr<const Branches::Impl> &a_,
+                const Branches::CPtr                      &b_)
+  {
+    return (!a_.owner_before(b_) && !b_.owner_before(a_));
+  }
+
+  static
+  uint64_t
+  load(const uint64_t *v_)
+  {
+    return __atomic_load_n(v_,__ATOMIC_ACQUIRE);
+  }
+
+  static
+  void *
+  map(const int         fd_,
+      const std::size_t size_)
+  {
+    void *mem;
+
+    mem = ::mmap(NULL,size_,PROT_READ|PROT_WRITE,MAP_SHARED,fd_,0);
+    if(mem == MAP_FAILED)
+      return NULL;
+
+    return mem;
+  }
+}
+
+LocationIndex::LocationIndex()
+  : _header(NULL),
+    _slots(NULL),
+    _mask(0),
+    _signature(0),
+    _enabled(false),
+    _scanning(0),
+    _scan_failed(false),
+    _scanned(false)
+{
+
+}
+
+// The mapping is left for the process exit to clean up as scanning
+// threads may still be running.
+LocationIndex::~LocationIndex()
+{
+
+}
+
+/*
+  Removed paths leave their slots behind so rather than let probe
+  sequences grow the table is started over once it gets crowded.
+*/
+bool
+LocationIndex::valid(const Header   *header_,
+                     const uint64_t  capacity_,
+                     const uint64_t  signature_)
+{
+  if(memcmp(header_->magic,MAGIC,sizeof(header_->magic)) != 0)
+    return false;
+  if(header_->version != VERSION)
+    return false;
+  if(header_->capacity != capacity_)
+    return false;
+  if(header_->signature != signature_)
+    return false;
+  if(header_->used > ((capacity_ / 4) * 3))
+    return false;
+
+  return true;
+}
+
+int
+LocationIndex::open(const std::string    &filepath_,
+                    const uint64_t        entries_,
+                    const Branches::CPtr &branches_)
+{
+  int fd;
+  int rv;
+  void *mem;
+  uint64_t capacity;
+  std::size_t size;
+  struct stat st;
+
+  capacity = 1024;
+  while(capacity < entries_)
+    capacity <<= 1;
+  size = (sizeof(Header) + (capacity * sizeof(Slot)));
+
+  fd = ::open(filepath_.c_str(),O_RDWR|O_CREAT|O_CLOEXEC,0600);
+  if(fd == -1)
+    return -1;
+
+  rv = ::fstat(fd,&st);
+  if(rv == -1)
+    goto error;
+
+  if((uint64_t)st.st_size != size)
+    {
+      rv = ::ftruncate(fd,0);
+      if(rv == -1)
+        goto error;
+      rv = ::ftruncate(fd,size);
+      if(rv == -1)
+        goto error;
+    }
+
+  mem = l::map(fd,size);
+  if(mem == NULL)
+    goto error;
+
+  _signature = l::signature(branches_);
+  _paths.clear();
+  for(const auto &branch : *branches_)
+    _paths.push_back(branch.path);
+  if(!valid((Header*)mem,capacity,_signature))
+    {
+      ::munmap(mem,size);
+      rv = ::ftruncate(fd,0);
+      if(rv == -1)
+        goto error;
+      rv = ::ftruncate(fd,size);
+      if(rv == -1)
+        goto error;
+      mem = l::map(fd,size);
+      if(mem == NULL)
+        goto error;
+    }
+
+  ::close(fd);
+
+  _header = (Header*)mem;
+  _slots  = (Slot*)((char*)mem + sizeof(Header));
+  _mask   = (capacity - 1);
+
+  memcpy(_header->magic,MAGIC,sizeof(_header->magic));
+  _header->version   = VERSION;
+  _header->capacity  = capacity;
+  _header->signature = _signature;
+
+  _enabled.store(true);
+
+  return 0;
+
+ error:
+  rv = errno;
+  ::close(fd);
+
+  return (errno=rv,-1);
+}
+
+/*
+  With more branches than are tracked a path may be on one the index
+  knows nothing about so it is never considered scanned.
+*/
+void
+LocationIndex::scan(const Branches::CPtr &branches_)
+{
+  if(!_enabled.load())
+    return;
+
+  _scanned.store(false);
+  _scan_failed.store(branches_->size() > MAX_BRANCHES);
+  _scanning.store(std::min(branches_->size(),(std::size_t)MAX_BRANCHES));
+  for(std::size_t i = 0; i < branches_->size(); i++)
+    {
+      if(i >= MAX_BRANCHES)
+        break;
+
+      std::thread t(&LocationIndex::scan_branch,
+                    this,
+                    (*branches_)[i].path,
+                    i);
+      t.detach();
+    }
+}
+
+void
+LocationIndex::scan_branch(const std::string &path_,
+                           const std::size_t  idx_)
+{
+  int fd;
+  uint64_t count;
+  std::string fusepath;
+  std::chrono::seconds elapsed;
+  std::chrono::steady_clock::time_point start;
+
+  fd = ::open(path_.c_str(),O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if(fd == -1)
+    {
+      syslog_error("location-index: unable to scan %s - %s",
+                   path_.c_str(),
+                   strerror(errno));
+      _scan_failed.store(true);
+    }
+  else
+    {
+      start = std::chrono::steady_clock::now();
+      count = scan_dir(fd,fusepath,(1ULL << idx_));
+      elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
+
+      syslog_info("location-index: scanned %lu paths on %s in %lds",
+                  count,
+                  path_.c_str(),
+                  (long)elapsed.count());
+    }
+
+  if(_scanning.fetch_sub(1) != 1)
+    return;
+
+  if(_scan_failed.load())
+    {
+      syslog_warning("location-index: scan incomplete, index not used");
+      return;
+    }
+
+  _scanned.store(true,std::memory_order_release);
+  syslog_info("location-index: scan complete");
+}
+
+bool
+LocationIndex::scanned(void) const
+{
+  return _scanned.load(std::memory_order_acquire);
+}
+
+// Takes ownership of dirfd_.
+uint64_t
+LocationIndex::scan_dir(const int       dirfd_,
+                        std::string    &fusepath_,
+                        const uint64_t  bit_)
+{
+  int fd;
+  DIR *dir;
+  Slot *slot;
+  bool isdir;
+  uint64_t count;
+  std::size_t len;
+  struct stat st;
+  struct dirent *de;
+
+  dir = ::fdopendir(dirfd_);
+  if(dir == NULL)
+    {
+      ::close(dirfd_);
+      _scan_failed.store(true);
+      return 0;
+    }
+
+  count = 0;
+  len   = fusepath_.size();
+  for(;;)
+    {
+      errno = 0;
+      de = ::readdir(dir);
+      if(de == NULL)
+        break;
+
+      if((strcmp(de->d_name,".") == 0) ||
+         (strcmp(de->d_name,"..") == 0))
+        continue;
+
+      fusepath_ += '/';
+      fusepath_ += de->d_name;
+
+      slot = insert(l::hash(fusepath_.data(),fusepath_.size()));
+      if(slot != NULL)
+        __atomic_fetch_or(&slot->bits,bit_,__ATOMIC_RELEASE);
+      count++;
+
+      isdir = (de->d_type == DT_DIR);
+      if(de->d_type == DT_UNKNOWN)
+        isdir = ((::fstatat(::dirfd(dir),de->d_name,&st,AT_SYMLINK_NOFOLLOW) == 0) &&
+                 S_ISDIR(st.st_mode));
+
+      if(isdir)
+        {
+          fd = ::openat(::dirfd(dir),
+                        de->d_name,
+                        O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+          if(fd != -1)
+            count += scan_dir(fd,fusepath_,bit_);
+          else if(errno != ENOENT)
+            _scan_failed.store(true);
+        }
+
+      fusepath_.resize(len);
+    }
+
+  if(errno != 0)
+    _scan_failed.store(true);
+
+  ::closedir(dir);
+
+  return count;
+}
+
+LocationIndex::Slot*
+LocationIndex::lookup(const uint64_t hash_)
+{
+  uint64_t h;
+  uint64_t i;
+
+  i = (hash_ & _mask);
+  for(int n = 0; n < MAX_PROBES; n++)
+    {
+      h = l::load(&_slots[i].hash);
+      if(h == hash_)
+        return &_slots[i];
+      if(h == 0)
+        return NULL;
+
+      i = ((i + 1) & _mask);
+    }
+
+  return NULL;
+}
+
+/*
+  Slots are never emptied so probe sequences stay intact. A slot
+  whose bits have all been cleared may be taken over by another path
+  which at worst leaves a stale hint to be corrected on use.
+*/
+LocationIndex::Slot*
+LocationIndex::insert(const uint64_t hash_)
+{
+  uint64_t h;
+  uint64_t i;
+  Slot *unused;
+
+  unused = NULL;
+  i = (hash_ & _mask);
+  for(int n = 0; n < MAX_PROBES; n++)
+    {
+      h = l::load(&_slots[i].hash);
+      if(h == hash_)
+        return &_slots[i];
+
+      if(h == 0)
+        {
+          if(unused != NULL)
+            break;
+          if(__atomic_compare_exchange_n(&_slots[i].hash,&h,hash_,false,
+                                         __ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+            {
+              __atomic_fetch_add(&_header->used,1,__ATOMIC_RELAXED);
+              return &_slots[i];
+            }
+          if(h == hash_)
+            return &_slots[i];
+        }
+      else if((unused == NULL) && (l::load(&_slots[i].bits) == 0))
+        {
+          unused = &_slots[i];
+        }
+
+      i = ((i + 1) & _mask);
+    }
+
+  if(unused == NULL)
+    return NULL;
+
+  h = l::load(&unused->hash);
+  if(!__atomic_compare_exchange_n(&unused->hash,&h,hash_,false,
+                                  __ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+    return NULL;
+
+  return unused;
+}
+
+bool
+LocationIndex::usable(const Branches::CPtr &branches_)
+{
+  static thread_local uint64_t t_SIGNATURE = 0;
+  static thread_local std::weak_ptr<const Branches::Impl> t_BRANCHES;
+
+  if(!_enabled.load(std::memory_order_relaxed))
+    return false;
+
+  // Config updates may copy the branches so they are compared by
+  // content. The result is kept until the thread sees another list.
+  if(t_BRANCHES.expired() || !l::same_branches(t_BRANCHES,branches_))
+    {
+      t_BRANCHES  = branches_;
+      t_SIGNATURE = l::signature(branches_);
+    }
+
+  return (t_SIGNATURE == _signature);
+}
+
+/*
+  A branch which can't be checked, as opposed to not having the path,
+  leaves the answer unknown rather than clearing its bit.
+*/
+LocationIndex::Result
+LocationIndex::find(const Branches::CPtr  &branches_,
+                    const char            *fusepath_,
+                    const Branch         **branch_)
+{
+  int i;
+  Slot *slot;
+  uint64_t bits;
+  struct stat st;
+
+  if(!scanned())
+    return Result::UNKNOWN;
+  if(!usable(branches_))
+    return Result::UNKNOWN;
+
+  slot = lookup(l::hash(fusepath_));
+  if(slot == NULL)
+    return Result::UNKNOWN;
+
+  bits = l::load(&slot->bits);
+  while(bits != 0)
+    {
+      i     = __builtin_ctzll(bits);
+      bits &= (bits - 1);
+      if((std::size_t)i >= branches_->size())
+        return Result::UNKNOWN;
+
+      const Branch &branch = (*branches_)[i];
+
+      if(fs::exists(branch,fusepath_,&st))
+        {
+          *branch_ = &branch;
+          return Result::FOUND;
+        }
+
+      if((errno != ENOENT) && (errno != ENOTDIR))
+        return Result::UNKNOWN;
+
+      __atomic_fetch_and(&slot->bits,~(1ULL << i),__ATOMIC_RELEASE);
+    }
+
+  return Result::ABSENT;
+}
+
+void
+LocationIndex::add(const Branches::CPtr &branches_,
+                   const char           *fusepath_,
+                   const std::size_t     idx_)
+{
+  Slot *slot;
+
+  if(idx_ >= MAX_BRANCHES)
+    return;
+  if(!usable(branches_))
+    return;
+
+  slot = insert(l::hash(fusepath_));
+  if(slot == NULL)
+    return;
+
+  __atomic_fetch_or(&slot->bits,(1ULL << idx_),__ATOMIC_RELEASE);
+}
+
+void
+LocationIndex::add(const Branches::CPtr &branches_,
+                   const char           *fusepath_,
+                   const Branch         &branch_)
+{
+  add(branches_,fusepath_,(std::size_t)(&branch_ - &(*branches_)[0]));
+}
+
+void
+LocationIndex::add(const Branches::CPtr &branches_,
+                   const char           *fusepath_,
+                   const BasePaths      &paths_)
+{
+  for(std::size_t i = 0; i < paths_.size(); i++)
+    add(branches_,fusepath_,paths_.branch(i));
+}
+
+// The longest branch path fullpath is under. -1 if none.
+int
+LocationIndex::branch_of(const std::string &fullpath_,
+                         std::string       *fusepath_) const
+{
+  int idx;
+  std::size_t len;
+
+  idx = -1;
+  len = 0;
+  for(std::size_t i = 0; (i < _paths.size()) && (i < MAX_BRANCHES); i++)
+    {
+      const std::string &path = _paths[i];
+
+      if(path.size() < len)
+        continue;
+      if(fullpath_.size() <= path.size())
+        continue;
+      if(fullpath_[path.size()] != '/')
+        continue;
+      if(fullpath_.compare(0,path.size(),path) != 0)
+        continue;
+
+      idx = i;
+      len = path.size();
+    }
+
+  if(idx != -1)
+    fusepath_->assign(fullpath_,len,std::string::npos);
+
+  return idx;
+}
+
+// For paths created on a branch by something other than a policy.
+void
+LocationIndex::added(const std::string &fullpath_)
+{
+  int idx;
+  Slot *slot;
+  std::string fusepath;
+
+  if(!_enabled.load(std::memory_order_relaxed))
+    return;
+
+  idx = branch_of(fullpath_,&fusepath);
+  if(idx == -1)
+    return;
+
+  slot = insert(l::hash(fusepath.data(),fusepath.size()));
+  if(slot == NULL)
+    return;
+
+  __atomic_fetch_or(&slot->bits,(1ULL << idx),__ATOMIC_RELEASE);
+}
+
+void
+LocationIndex::removed(const std::string &fullpath_)
+{
+  int idx;
+  Slot *slot;
+  std::string fusepath;
+
+  if(!_enabled.load(std::memory_order_relaxed))
+    return;
+
+  idx = branch_of(fullpath_,&fusepath);
+  if(idx == -1)
+    return;
+
+  slot = lookup(l::hash(fusepath.data(),fusepath.size()));
+  if(slot == NULL)
+    return;
+
+  __atomic_fetch_and(&slot->bits,~(1ULL << idx),__ATOMIC_RELEASE);
+}
+
+/*
+  The new path is where the old one was. The old path's bits are left
+  as the rename may not have been made on every branch it was on. Like
+  anything below a renamed directory they are cleared as it is looked
+  up.
+*/
+void
+LocationIndex::link(const char *oldpath_,
+                    const char *newpath_)
+{
+  Slot *slot;
+  uint64_t bits;
+
+  if(!_enabled.load(std::memory_order_relaxed))
+    return;
+
+  slot = lookup(l::hash(oldpath_));
+  if(slot == NULL)
+    return;
+
+  bits = l::load(&slot->bits);
+  if(bits == 0)
+    return;
+
+  slot = insert(l::hash(newpath_));
+  if(slot == NULL)
+    return;
+
+  __atomic_fetch_or(&slot->bits,bits,__ATOMIC_RELEASE);
+}
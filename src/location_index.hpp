@@ -0,0 +1,123 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "basepaths.hpp"
+#include "branches.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/*
+  Remembers which branches a path was last seen on so first found
+  searches can confirm it there rather than searching every branch
+  in order.
+
+  The index is a fixed size open addressing table of path hashes to
+  bitmaps of branch indexes kept in a memory mapped file so it
+  survives remounts. It is filled by scanning all branches in
+  parallel at mount and updated as paths are created, linked, renamed
+  and removed, including the directories clonepath creates and the
+  files moveonenospc and rename-exdev move. Bits may be stale but are
+  never missing for changes made through mergerfs, so once the scan
+  has finished the lowest set bit is the first branch with the path
+  and a slot with none set means it is on none. A hit is still
+  confirmed on the branch and a stale bit cleared. Until the scan
+  finishes, or if any part of it failed, the index isn't used. Paths
+  with no slot fall back to checking each branch. Changes made
+  directly to the branches aren't seen until the next mount rescans
+  them. Only the first 64 branches are tracked and the index is
+  ignored if there are more or they differ from those it was built
+  with.
+*/
+class LocationIndex
+{
+public:
+  LocationIndex();
+  ~LocationIndex();
+
+public:
+  int open(const std::string    &filepath,
+           const uint64_t        entries,
+           const Branches::CPtr &branches);
+  void scan(const Branches::CPtr &branches);
+
+public:
+  enum class Result
+    {
+     FOUND,
+     ABSENT,
+     UNKNOWN
+    };
+
+public:
+  bool   scanned(void) const;
+  Result find(const Branches::CPtr  &branches,
+              const char            *fusepath,
+              const Branch         **branch);
+
+  void add(const Branches::CPtr &branches,
+           const char           *fusepath,
+           const std::size_t     idx);
+  void add(const Branches::CPtr &branches,
+           const char           *fusepath,
+           const Branch         &branch);
+  void add(const Branches::CPtr &branches,
+           const char           *fusepath,
+           const BasePaths      &paths);
+  void added(const std::string &fullpath);
+  void removed(const std::string &fullpath);
+  void link(const char *oldpath,
+            const char *newpath);
+
+public:
+  struct Header;
+  struct Slot;
+
+private:
+  static bool valid(const Header   *header,
+                    const uint64_t  capacity,
+                    const uint64_t  signature);
+  bool usable(const Branches::CPtr &branches);
+  Slot *lookup(const uint64_t hash);
+  Slot *insert(const uint64_t hash);
+  int  branch_of(const std::string &fullpath,
+                 std::string       *fusepath) const;
+  void scan_branch(const std::string &path,
+                   const std::size_t  idx);
+  uint64_t scan_dir(const int       dirfd,
+                    std::string    &fusepath,
+                    const uint64_t  bit);
+
+private:
+  Header                   *_header;
+  Slot                     *_slots;
+  uint64_t                  _mask;
+  uint64_t                  _signature;
+  std::vector<std::string>  _paths;
+  std::atomic<bool>         _enabled;
+  std::atomic<int>          _scanning;
+  std::atomic<bool>         _scan_failed;
+  std::atomic<bool>         _scanned;
+};
+
+extern LocationIndex g_LOCATION_INDEX;
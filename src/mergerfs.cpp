@@ -127,6 +127,7 @@ namespace l
     ops_.poll            = FUSE::poll;;
     ops_.prepare_hide    = FUSE::prepare_hide;
     ops_.read            = (nullrw_ ? FUSE::read_null : FUSE::read);
+    ops_.read_fd         = (nullrw_ ? NULL : FUSE::read_fd);
     ops_.readdir         = FUSE::readdir;
     ops_.readdir_plus    = FUSE::readdir_plus;
     ops_.readlink        = FUSE::readlink;
@@ -146,6 +147,7 @@ namespace l
     ops_.unlink          = FUSE::unlink;
     ops_.utimens         = FUSE::utimens;
     ops_.write           = (nullrw_ ? FUSE::write_null : FUSE::write);
+    ops_.write_pipe      = (nullrw_ ? NULL : FUSE::write_pipe);
 
     return;
   }
@@ -250,7 +252,6 @@ namespace l
        char      **argv_)
   {
     int rv;
-    Config::Read    cfg;
     Config::ErrVec  errs;
     fuse_args       args;
     fuse_operations ops;
@@ -272,15 +273,24 @@ namespace l
         return 1;
       }
 
-    if(cfg->branches_mount_timeout > 0)
-      l::wait_for_mount(cfg);
+    // Scoped so the main thread doesn't pin this config for the life
+    // of the process.
+    {
+      Config::Read cfg;
 
-    l::setup_resources(cfg->scheduling_priority);
-    l::setup_signal_handlers();
-    l::get_fuse_operations(ops,cfg->nullrw);
+      if(cfg->branches_mount_timeout > 0)
+        {
+          l::wait_for_mount(cfg);
+          Config::Write()->branches.reopen_fds();
+        }
 
-    if(cfg->lazy_umount_mountpoint)
-      l::lazy_umount(cfg->mountpoint);
+      l::setup_resources(cfg->scheduling_priority);
+      l::setup_signal_handlers();
+      l::get_fuse_operations(ops,cfg->nullrw);
+
+      if(cfg->lazy_umount_mountpoint)
+        l::lazy_umount(cfg->mountpoint);
+    }
 
     procfs::init();
 
@@ -84,7 +84,10 @@ set_fuse_threads(Config::Write &cfg_)
   fuse_config_set_read_thread_count(cfg_->fuse_read_thread_count);
   fuse_config_set_process_thread_count(cfg_->fuse_process_thread_count);
   fuse_config_set_process_thread_queue_depth(cfg_->fuse_process_thread_queue_depth);
+  fuse_config_set_process_thread_scheduler(cfg_->fuse_process_thread_scheduler);
   fuse_config_set_pin_threads(cfg_->fuse_pin_threads);
+  fuse_config_set_clone_fd(cfg_->fuse_clone_fd);
+  fuse_config_set_io_uring_queue_depth(cfg_->io_uring_queue_depth);
 }
 
 static
@@ -131,16 +134,11 @@ should_ignore(const std::string &key_)
     {
       "atomic_o_trunc",
       "big_writes",
-      "cache.open",
       "defaults",
       "hard_remove",
       "no_splice_move",
-      "no_splice_read",
-      "no_splice_write",
       "nonempty",
       "splice_move",
-      "splice_read",
-      "splice_write",
       "use_ino",
     };
 
@@ -177,6 +175,14 @@ parse_and_process_kv_arg(Config::Write     &cfg_,
     val = "true";
   ef(key == "sync_read" && val.empty())
     {key = "async_read", val = "false";}
+  ef(key == "splice_read" && val.empty())
+    val = "true";
+  ef(key == "no_splice_read" && val.empty())
+    {key = "splice_read", val = "false";}
+  ef(key == "splice_write" && val.empty())
+    val = "true";
+  ef(key == "no_splice_write" && val.empty())
+    {key = "splice_write", val = "false";}
   ef(::should_ignore(key_))
     return 0;
 
@@ -260,6 +266,37 @@ usage(void)
     "    -o func.FUNC=POLICY    Set function FUNC to policy POLICY\n"
     "    -o category.CAT=POLICY Set functions in category CAT to POLICY\n"
     "    -o fsname=STR          Sets the name of the filesystem.\n"
+    "    -o branch-io-threads=UINT\n"
+    "                           Threads per branch used to probe branches so\n"
+    "                           one which hangs doesn't block others. default=0\n"
+    "    -o branch-io-timeout=UINT\n"
+    "                           Seconds before a branch probe fails and the\n"
+    "                           branch is marked unhealthy. default=10\n"
+    "    -o branch-io-fast-fail=BOOL\n"
+    "                           Fail probes of unhealthy branches immediately.\n"
+    "                           default=true\n"
+    "    -o fanout-threads=UINT\n"
+    "                           Threads used to apply chmod, chown, unlink, etc.\n"
+    "                           to all branches returned by the policy at once.\n"
+    "                           default=0\n"
+    "    -o fanout-min-branches=UINT\n"
+    "                           Minimum number of branches before fanout-threads\n"
+    "                           are used. default=3\n"
+    "    -o policy-probe-threads=UINT\n"
+    "                           Threads used to check for a path on all branches\n"
+    "                           at once when evaluating ep*, msp* and newest\n"
+    "                           policies. default=0\n"
+    "    -o location-index=PATH\n"
+    "                           File used to remember which branch paths are on\n"
+    "                           so ff and epff searches check it first.\n"
+    "                           default=\n"
+    "    -o location-index-entries=UINT\n"
+    "                           Number of paths the location index can hold.\n"
+    "                           default=1048576\n"
+    "    -o dir-filter=BOOL\n"
+    "                           Track directories on each branch to skip looking\n"
+    "                           for paths on branches without the parent\n"
+    "                           directory. default=false\n"
     "    -o read-thread-count=INT\n"
     "                           Number of threads used to read from FUSE (and process)\n"
     "                           * 0 = number of logical cores\n"
@@ -270,8 +307,24 @@ usage(void)
     "    -o process-thread-count=INT\n"
     "                           Same as read-thread-count but for FUSE message processing\n"
     "                           If not set then read threads will do both read and process\n"
+    "    -o process-thread-scheduler=shared|steal\n"
+    "                           How read threads hand requests to process threads.\n"
+    "                           * shared = a single queue for all process threads\n"
+    "                           * steal = a queue per read thread, idle threads steal\n"
+    "                           default=shared\n"
+    "    -o clone-fd=BOOL       Give each read thread its own cloned /dev/fuse\n"
+    "                           file descriptor. default=false\n"
+    "    -o io-uring=BOOL       Receive and reply to FUSE requests over io_uring\n"
+    "                           when supported by the kernel. default=false\n"
+    "    -o io-uring-queue-depth=INT\n"
+    "                           Requests in flight per io_uring queue. default=4\n"
     "    -o cache.statfs=INT    'statfs' cache timeout in seconds. Used by\n"
     "                           policies. default = 0 (disabled)\n"
+    "    -o cache.statfs.background=BOOL\n"
+    "                           Refresh the 'statfs' cache from a background\n"
+    "                           thread rather than on the request. default=false\n"
+    "    -o cache.open=INT      'getattr' and 'open' search policy result cache\n"
+    "                           timeout in seconds. default = 0 (disabled)\n"
     "    -o cache.files=libfuse|off|partial|full|auto-full|per-process\n"
     "                           * libfuse: Use direct_io, kernel_cache, auto_cache\n"
     "                             values directly\n"
@@ -308,7 +361,8 @@ usage(void)
     "    -o minfreespace=INT    Minimum free space needed for certain policies.\n"
     "                           default = 4G\n"
     "    -o moveonenospc=BOOL   Try to move file to another drive when ENOSPC\n"
-    "                           on write. default = false\n"
+    "                           on write. The copy is done in the background.\n"
+    "                           default = false\n"
     "    -o dropcacheonclose=BOOL\n"
     "                           When a file is closed suggest to OS it drop\n"
     "                           the file's cache. This is useful when using\n"
@@ -331,6 +385,16 @@ usage(void)
     "                           where there are issues with creating files for\n"
     "                           write while setting the mode to read-only.\n"
     "                           default = off\n"
+    "    -o splice_read=BOOL    Splice requests from the kernel into a pipe so\n"
+    "                           write payloads can be spliced directly to\n"
+    "                           branches. default = false\n"
+    "    -o splice_write=BOOL   Splice file data read from branches directly to\n"
+    "                           the kernel rather than copying through\n"
+    "                           userspace. default = false\n"
+    "    -o passthrough=off|ro|wo|rw\n"
+    "                           Have the kernel perform reads/writes directly\n"
+    "                           against the branch file. Requires Linux v6.9+\n"
+    "                           and root. default = off\n"
     "    -o security_capability=BOOL\n"
     "                           When disabled return ENOATTR when the xattr\n"
     "                           security.capability is queried. default = true\n"
@@ -351,6 +415,8 @@ usage(void)
     "                           available space for branches tagged as\n"
     "                           'no create'. default = none\n"
     "    -o posix_acl=BOOL      Enable POSIX ACL support. default = false\n"
+    "    -o readdirplus=BOOL    Return attributes with directory entries.\n"
+    "                           default = false\n"
     "    -o async_read=BOOL     If disabled or unavailable the kernel will\n"
     "                           ensure there is at most one pending read \n"
     "                           request per file and will attempt to order\n"
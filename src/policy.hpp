@@ -16,8 +16,8 @@
 
 #pragma once
 
+#include "basepaths.hpp"
 #include "branches.hpp"
-#include "strvec.hpp"
 
 #include <string>
 
@@ -33,7 +33,7 @@ namespace Policy
 
   public:
     std::string name;
-    virtual int operator()(const Branches::CPtr&,const char*,StrVec*) const = 0;
+    virtual int operator()(const Branches::CPtr&,const char*,BasePaths*) const = 0;
   };
 
   class Action
@@ -60,7 +60,7 @@ namespace Policy
     int
     operator()(const Branches::CPtr &branches_,
                const char           *fusepath_,
-               StrVec               *paths_) const
+               BasePaths            *paths_) const
     {
       return (*impl)(branches_,fusepath_,paths_);
     }
@@ -68,7 +68,7 @@ namespace Policy
     int
     operator()(const Branches::CPtr &branches_,
                const std::string    &fusepath_,
-               StrVec               *paths_) const
+               BasePaths            *paths_) const
     {
       return (*impl)(branches_,fusepath_.c_str(),paths_);
     }
@@ -92,7 +92,7 @@ namespace Policy
 
   public:
     std::string name;
-    virtual int operator()(const Branches::CPtr&,const char*,StrVec*) const = 0;
+    virtual int operator()(const Branches::CPtr&,const char*,BasePaths*) const = 0;
     virtual bool path_preserving(void) const = 0;
   };
 
@@ -126,7 +126,7 @@ namespace Policy
     int
     operator()(const Branches::CPtr &branches_,
                const char           *fusepath_,
-               StrVec               *paths_) const
+               BasePaths            *paths_) const
     {
       return (*impl)(branches_,fusepath_,paths_);
     }
@@ -134,7 +134,7 @@ namespace Policy
     int
     operator()(const Branches::CPtr &branches_,
                const std::string    &fusepath_,
-               StrVec               *paths_) const
+               BasePaths            *paths_) const
     {
       return (*impl)(branches_,fusepath_.c_str(),paths_);
     }
@@ -158,7 +158,7 @@ namespace Policy
 
   public:
     std::string name;
-    virtual int operator()(const Branches::CPtr&,const char*,StrVec*) const = 0;
+    virtual int operator()(const Branches::CPtr&,const char*,BasePaths*) const = 0;
   };
 
   class Search
@@ -182,10 +182,17 @@ namespace Policy
       return impl->name;
     }
 
+    const
+    SearchImpl*
+    get(void) const
+    {
+      return impl;
+    }
+
     int
     operator()(const Branches::CPtr &branches_,
                const char           *fusepath_,
-               StrVec               *paths_) const
+               BasePaths            *paths_) const
     {
       return (*impl)(branches_,fusepath_,paths_);
     }
@@ -193,7 +200,7 @@ namespace Policy
     int
     operator()(const Branches::CPtr &branches_,
                const std::string    &fusepath_,
-               StrVec               *paths_) const
+               BasePaths            *paths_) const
     {
       return (*impl)(branches_,fusepath_.c_str(),paths_);
     }
@@ -21,7 +21,7 @@
 #include "policy.hpp"
 #include "policies.hpp"
 #include "policy_error.hpp"
-#include "strvec.hpp"
+#include "basepaths.hpp"
 
 #include <string>
 
@@ -32,7 +32,7 @@ namespace all
   static
   int
   create(const Branches::CPtr &branches_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
@@ -43,7 +43,7 @@ namespace all
       {
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -51,7 +51,7 @@ namespace all
         if(info.spaceavail < branch.minfreespace())
           error_and_continue(error,ENOSPC);
 
-        paths_->push_back(branch.path);
+        paths_->push_back(branch);
       }
 
     if(paths_->empty())
@@ -64,7 +64,7 @@ namespace all
 int
 Policy::All::Action::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return Policies::Action::epall(branches_,fusepath_,paths_);
 }
@@ -72,7 +72,7 @@ Policy::All::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::All::Create::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return ::all::create(branches_,paths_);
 }
@@ -80,7 +80,7 @@ Policy::All::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::All::Search::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return Policies::Search::epall(branches_,fusepath_,paths_);
 }
@@ -1,131 +1,233 @@
 #include "policy_cache.hpp"
 
-#include <cstdlib>
-#include <map>
+#include "wyhash.h"
+
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include <time.h>
 
-using std::map;
-using std::string;
+#define SHARD_COUNT 64
+#define MAX_CACHED_PATHS 4
 
-static const uint64_t DEFAULT_TIMEOUT = 0;
+PolicyCache g_POLICY_CACHE;
 
 namespace l
 {
   static
   uint64_t
-  get_time(void)
+  get_time_ms(void)
   {
-    uint64_t rv;
+    struct timespec ts;
 
-    rv = ::time(NULL);
+#ifdef CLOCK_MONOTONIC_COARSE
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE,&ts);
+#else
+    ::clock_gettime(CLOCK_MONOTONIC,&ts);
+#endif
 
-    return rv;
+    return ((ts.tv_sec * 1000ULL) + (ts.tv_nsec / 1000000ULL));
   }
-}
 
+  static
+  uint64_t
+  hash(const char   *fusepath_,
+       const size_t  len_)
+  {
+    return wyhash(fusepath_,len_,0x706f6c6963616368,_wyp);
+  }
 
-PolicyCache::Value::Value()
-  : time(0),
-    paths()
-{
-
+  static
+  bool
+  same_branches(const std::weak_ptr<const Branches::Impl> &a_,
+                const Branches::CPtr                      &b_)
+  {
+    return (!a_.owner_before(b_) && !b_.owner_before(a_));
+  }
 }
 
-PolicyCache::PolicyCache(void)
-  : timeout(DEFAULT_TIMEOUT)
+namespace
 {
-  pthread_mutex_init(&_lock,NULL);
+  struct Entry
+  {
+    const std::string                   *key;
+    uint64_t                             expires;
+    uint64_t                             generation;
+    const Policy::SearchImpl            *policy;
+    std::weak_ptr<const Branches::Impl>  branches;
+    int                                  err;
+    uint8_t                              count;
+    uint16_t                             idx[MAX_CACHED_PATHS];
+  };
+
+  typedef std::list<Entry> EntryList;
+  typedef std::unordered_map<std::string,EntryList::iterator> EntryMap;
 }
 
-void
-PolicyCache::erase(const char *fusepath_)
+struct PolicyCache::Shard
 {
-  if(timeout == 0)
-    return;
-
-  pthread_mutex_lock(&_lock);
+  std::mutex lock;
+  EntryList  lru;
+  EntryMap   map;
+  uint64_t   version;
+};
+
+PolicyCache::PolicyCache(const uint64_t max_entries_)
+  : _shards(new Shard[SHARD_COUNT]),
+    _max_entries_per_shard((max_entries_ / SHARD_COUNT) + 1),
+    _generation(0),
+    _used(false)
+{
+  for(int i = 0; i < SHARD_COUNT; i++)
+    _shards[i].version = 0;
+}
 
-  _cache.erase(fusepath_);
+PolicyCache::~PolicyCache()
+{
 
-  pthread_mutex_unlock(&_lock);
 }
 
 void
-PolicyCache::cleanup(const int prob_)
+PolicyCache::erase(const char *fusepath_)
 {
-  uint64_t now;
-  map<string,Value>::iterator i;
+  size_t len;
+  Shard *shard;
+  EntryMap::iterator i;
 
-  if(timeout == 0)
+  if(_used.load() == false)
     return;
 
-  if(rand() % prob_)
-    return;
+  len   = strlen(fusepath_);
+  shard = &_shards[l::hash(fusepath_,len) % SHARD_COUNT];
 
-  now = l::get_time();
+  std::lock_guard<std::mutex> lg(shard->lock);
 
-  pthread_mutex_lock(&_lock);
-
-  i = _cache.begin();
-  while(i != _cache.end())
-    {
-      if((now - i->second.time) >= timeout)
-        _cache.erase(i++);
-      else
-        ++i;
-    }
+  shard->version++;
+  i = shard->map.find(std::string(fusepath_,len));
+  if(i == shard->map.end())
+    return;
 
-  pthread_mutex_unlock(&_lock);
+  shard->lru.erase(i->second);
+  shard->map.erase(i);
 }
 
+/*
+  Bumping the generation invalidates every entry at once. Stale
+  entries are reclaimed as they are looked up or fall off the LRU.
+  Shard versions are also bumped so in flight lookups don't insert
+  results calculated before the clear.
+*/
 void
 PolicyCache::clear(void)
 {
-  pthread_mutex_lock(&_lock);
-
-  _cache.clear();
+  _generation.fetch_add(1,std::memory_order_relaxed);
 
-  pthread_mutex_unlock(&_lock);
+  for(int i = 0; i < SHARD_COUNT; i++)
+    {
+      std::lock_guard<std::mutex> lg(_shards[i].lock);
+      _shards[i].version++;
+    }
 }
 
 int
-PolicyCache::operator()(const Policy::Search &policy_,
-                        const Branches       &branches_,
+PolicyCache::operator()(const uint64_t        timeout_,
+                        const Policy::Search &policy_,
+                        const Branches::CPtr &branches_,
                         const char           *fusepath_,
-                        StrVec               *paths_)
+                        BasePaths            *paths_)
 {
   int rv;
-  Value *v;
+  int err;
+  Entry e{};
+  Shard *shard;
   uint64_t now;
+  uint64_t version;
+  uint64_t generation;
+  std::string key;
+  EntryMap::iterator i;
 
-  if(timeout == 0)
+  if(timeout_ == 0)
     return policy_(branches_,fusepath_,paths_);
 
-  now = l::get_time();
+  _used.store(true);
 
-  pthread_mutex_lock(&_lock);
-  v = &_cache[fusepath_];
+  key        = fusepath_;
+  shard      = &_shards[l::hash(key.data(),key.size()) % SHARD_COUNT];
+  now        = l::get_time_ms();
+  generation = _generation.load(std::memory_order_relaxed);
 
-  if((now - v->time) >= timeout)
-    {
-      pthread_mutex_unlock(&_lock);
+  {
+    std::lock_guard<std::mutex> lg(shard->lock);
+
+    version = shard->version;
+    i = shard->map.find(key);
+    if(i != shard->map.end())
+      {
+        const Entry &c = *i->second;
+
+        if((c.expires > now) &&
+           (c.generation == generation) &&
+           (c.policy == policy_.get()) &&
+           l::same_branches(c.branches,branches_))
+          {
+            shard->lru.splice(shard->lru.begin(),shard->lru,i->second);
+            if(c.err)
+              return (errno=c.err,-1);
+
+            for(uint8_t j = 0; j < c.count; j++)
+              paths_->push_back((*branches_)[c.idx[j]]);
+
+            return 0;
+          }
+
+        shard->lru.erase(i->second);
+        shard->map.erase(i);
+      }
+  }
 
-      rv = policy_(branches_,fusepath_,paths_);
-      if(rv == -1)
-        return -1;
+  rv  = policy_(branches_,fusepath_,paths_);
+  err = errno;
+  if((rv == -1) && (err != ENOENT))
+    return rv;
 
-      pthread_mutex_lock(&_lock);
-      v->time  = now;
-      v->paths = *paths_;
-    }
-  else
+  e.count = 0;
+  if(rv == 0)
     {
-      *paths_ = v->paths;
+      if(paths_->size() > MAX_CACHED_PATHS)
+        return rv;
+
+      for(size_t j = 0; j < paths_->size(); j++)
+        e.idx[e.count++] = (&paths_->branch(j) - &(*branches_)[0]);
     }
 
-  pthread_mutex_unlock(&_lock);
+  e.expires    = now + (timeout_ * 1000);
+  e.generation = generation;
+  e.policy     = policy_.get();
+  e.branches   = branches_;
+  e.err        = ((rv == -1) ? err : 0);
+
+  {
+    std::lock_guard<std::mutex> lg(shard->lock);
+
+    if(shard->version != version)
+      return (errno=err,rv);
+    if(shard->map.count(key))
+      return (errno=err,rv);
+
+    shard->lru.push_front(e);
+    i = shard->map.emplace(std::move(key),shard->lru.begin()).first;
+    shard->lru.front().key = &i->first;
+
+    while(shard->map.size() > _max_entries_per_shard)
+      {
+        shard->map.erase(shard->map.find(*shard->lru.back().key));
+        shard->lru.pop_back();
+      }
+  }
 
-  return 0;
+  return (errno=err,rv);
 }
@@ -18,45 +18,53 @@
 
 #pragma once
 
+#include "branches.hpp"
 #include "policy.hpp"
-#include "strvec.hpp"
+#include "basepaths.hpp"
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <string>
-#include <map>
 
-#include <pthread.h>
 
+/*
+  Caches the result of search policies keyed on fusepath.
 
+  Entries store the indexes of the selected branches (or ENOENT)
+  rather than copies of the paths, are tied to the branch list and
+  policy they were calculated with, expire after the timeout and are
+  evicted LRU once a shard is full. The table is split into
+  independently locked shards so unrelated paths don't contend.
+*/
 class PolicyCache
 {
 public:
-  struct Value
-  {
-    Value();
-
-    uint64_t time;
-    StrVec   paths;
-  };
+  static const uint64_t DEFAULT_MAX_ENTRIES = (1 << 17);
 
 public:
-  PolicyCache(void);
+  PolicyCache(const uint64_t max_entries = DEFAULT_MAX_ENTRIES);
+  ~PolicyCache();
 
 public:
   void erase(const char *fusepath);
-  void cleanup(const int prob = 1);
   void clear(void);
 
 public:
-  int operator()(const Policy::Search &policy,
-                 const Branches       &branches,
+  int operator()(const uint64_t        timeout,
+                 const Policy::Search &policy,
+                 const Branches::CPtr &branches,
                  const char           *fusepath,
-                 StrVec               *paths);
+                 BasePaths            *paths);
 
-public:
-  uint64_t timeout;
+private:
+  struct Shard;
 
 private:
-  pthread_mutex_t             _lock;
-  std::map<std::string,Value> _cache;
+  std::unique_ptr<Shard[]> _shards;
+  uint64_t                 _max_entries_per_shard;
+  std::atomic<uint64_t>    _generation;
+  std::atomic<bool>        _used;
 };
+
+extern PolicyCache g_POLICY_CACHE;
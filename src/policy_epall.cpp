@@ -15,14 +15,14 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
 #include "policy.hpp"
 #include "policy_epall.hpp"
 #include "policy_error.hpp"
-#include "strvec.hpp"
+#include "policy_probe.hpp"
+#include "basepaths.hpp"
 
 #include <string>
 
@@ -35,20 +35,23 @@ namespace epall
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     fs::info_t info;
 
     error = ENOENT;
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -56,7 +59,7 @@ namespace epall
         if(info.spaceavail < branch.minfreespace())
           error_and_continue(error,ENOSPC);
 
-        paths_->push_back(branch.path);
+        paths_->push_back(branch);
       }
 
     if(paths_->empty())
@@ -69,26 +72,29 @@ namespace epall
   int
   action(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     bool readonly;
 
     error = ENOENT;
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::statvfs_cache_readonly(branch.path,&readonly);
+        rv = fs::statvfs_cache_readonly(branch,&readonly);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(readonly)
           error_and_continue(error,EROFS);
 
-        paths_->push_back(branch.path);
+        paths_->push_back(branch);
       }
 
     if(paths_->empty())
@@ -101,14 +107,17 @@ namespace epall
   int
   search(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::NONE);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
-        if(!fs::exists(branch.path,fusepath_))
+        const Branch &branch = (*branches_)[i];
+
+        if(!probe.exists(i))
           continue;
 
-        paths_->push_back(branch.path);
+        paths_->push_back(branch);
       }
 
     if(paths_->empty())
@@ -121,7 +130,7 @@ namespace epall
 int
 Policy::EPAll::Action::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::epall::action(branches_,fusepath_,paths_);
 }
@@ -129,7 +138,7 @@ Policy::EPAll::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPAll::Create::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::epall::create(branches_,fusepath_,paths_);
 }
@@ -137,7 +146,7 @@ Policy::EPAll::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPAll::Search::operator()(const Branches::CPtr &branches_,
                                   const char     *fusepath_,
-                                  StrVec         *paths_) const
+                                  BasePaths      *paths_) const
 {
   return ::epall::search(branches_,fusepath_,paths_);
 }
@@ -16,13 +16,14 @@
 
 #include "branches.hpp"
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
+#include "location_index.hpp"
 #include "policy.hpp"
 #include "policy_epff.hpp"
 #include "policy_error.hpp"
+#include "policy_probe.hpp"
 #include "rwlock.hpp"
 
 #include <string>
@@ -37,20 +38,23 @@ namespace epff
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     fs::info_t info;
 
     error = ENOENT;
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -58,7 +62,7 @@ namespace epff
         if(info.spaceavail < branch.minfreespace())
           error_and_continue(error,ENOSPC);
 
-        paths_->push_back(branch.path);
+        paths_->push_back(branch);
 
         return 0;
       }
@@ -70,26 +74,29 @@ namespace epff
   int
   action(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     bool readonly;
 
     error = ENOENT;
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::statvfs_cache_readonly(branch.path,&readonly);
+        rv = fs::statvfs_cache_readonly(branch,&readonly);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(readonly)
           error_and_continue(error,EROFS);
 
-        paths_->push_back(branch.path);
+        paths_->push_back(branch);
 
         return 0;
       }
@@ -101,14 +108,31 @@ namespace epff
   int
   search(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
-    for(auto &branch : *branches_)
+    const Branch *found;
+
+    switch(g_LOCATION_INDEX.find(branches_,fusepath_,&found))
+      {
+      case LocationIndex::Result::FOUND:
+        paths_->push_back(*found);
+        return 0;
+      case LocationIndex::Result::ABSENT:
+        return (errno=ENOENT,-1);
+      case LocationIndex::Result::UNKNOWN:
+        break;
+      }
+
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::NONE);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
-        if(!fs::exists(branch.path,fusepath_))
+        const Branch &branch = (*branches_)[i];
+
+        if(!probe.exists(i))
           continue;
 
-        paths_->push_back(branch.path);
+        paths_->push_back(branch);
+        g_LOCATION_INDEX.add(branches_,fusepath_,i);
 
         return 0;
       }
@@ -120,7 +144,7 @@ namespace epff
 int
 Policy::EPFF::Action::operator()(const Branches::CPtr &branches_,
                                  const char          *fusepath_,
-                                 StrVec              *paths_) const
+                                 BasePaths           *paths_) const
 {
   return ::epff::action(branches_,fusepath_,paths_);
 }
@@ -128,7 +152,7 @@ Policy::EPFF::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPFF::Create::operator()(const Branches::CPtr &branches_,
                                  const char           *fusepath_,
-                                 StrVec               *paths_) const
+                                 BasePaths            *paths_) const
 {
   return ::epff::create(branches_,fusepath_,paths_);
 }
@@ -136,7 +160,7 @@ Policy::EPFF::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPFF::Search::operator()(const Branches::CPtr &branches_,
                                  const char           *fusepath_,
-                                 StrVec               *paths_) const
+                                 BasePaths            *paths_) const
 {
   return ::epff::search(branches_,fusepath_,paths_);
 }
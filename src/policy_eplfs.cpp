@@ -15,7 +15,6 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
@@ -23,6 +22,7 @@
 #include "policy.hpp"
 #include "policy_eplfs.hpp"
 #include "policy_error.hpp"
+#include "policy_probe.hpp"
 
 #include <limits>
 #include <string>
@@ -37,24 +37,27 @@ namespace eplfs
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     uint64_t eplfs;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     eplfs = std::numeric_limits<uint64_t>::max();
-    basepath = NULL;
-    for(const auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -65,13 +68,13 @@ namespace eplfs
           continue;
 
         eplfs = info.spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -80,24 +83,27 @@ namespace eplfs
   int
   action(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     uint64_t eplfs;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     eplfs = std::numeric_limits<uint64_t>::max();
-    basepath = NULL;
-    for(const auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -106,13 +112,13 @@ namespace eplfs
           continue;
 
         eplfs = info.spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -121,33 +127,36 @@ namespace eplfs
   int
   search(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     uint64_t eplfs;
     uint64_t spaceavail;
-    const string *basepath;
+    const Branch *selected;
 
     eplfs = std::numeric_limits<uint64_t>::max();
-    basepath = NULL;
-    for(const auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::NONE);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
-        if(!fs::exists(branch.path,fusepath_))
+        const Branch &branch = (*branches_)[i];
+
+        if(!probe.exists(i))
           continue;
-        rv = fs::statvfs_cache_spaceavail(branch.path,&spaceavail);
+        rv = fs::statvfs_cache_spaceavail(branch,&spaceavail);
         if(rv == -1)
           continue;
         if(spaceavail > eplfs)
           continue;
 
         eplfs = spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=ENOENT,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -156,7 +165,7 @@ namespace eplfs
 int
 Policy::EPLFS::Action::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::eplfs::action(branches_,fusepath_,paths_);
 }
@@ -164,7 +173,7 @@ Policy::EPLFS::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPLFS::Create::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::eplfs::create(branches_,fusepath_,paths_);
 }
@@ -172,7 +181,7 @@ Policy::EPLFS::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPLFS::Search::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::eplfs::search(branches_,fusepath_,paths_);
 }
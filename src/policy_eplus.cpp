@@ -15,13 +15,13 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
 #include "policy.hpp"
 #include "policy_eplus.hpp"
 #include "policy_error.hpp"
+#include "policy_probe.hpp"
 #include "rwlock.hpp"
 
 #include <limits>
@@ -35,24 +35,27 @@ namespace eplus
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     uint64_t eplus;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     eplus = std::numeric_limits<uint64_t>::max();
-    basepath = NULL;
-    for(auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -63,13 +66,13 @@ namespace eplus
           continue;
 
         eplus = info.spaceused;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -78,24 +81,27 @@ namespace eplus
   int
   action(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     uint64_t eplus;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     eplus = std::numeric_limits<uint64_t>::max();
-    basepath = NULL;
-    for(auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -104,13 +110,13 @@ namespace eplus
           continue;
 
         eplus = info.spaceused;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -119,33 +125,36 @@ namespace eplus
   int
   search(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     uint64_t eplus;
     uint64_t spaceused;
-    const string *basepath;
+    const Branch *selected;
 
     eplus = 0;
-    basepath = NULL;
-    for(auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::NONE);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
-        if(!fs::exists(branch.path,fusepath_))
+        const Branch &branch = (*branches_)[i];
+
+        if(!probe.exists(i))
           continue;
-        rv = fs::statvfs_cache_spaceused(branch.path,&spaceused);
+        rv = fs::statvfs_cache_spaceused(branch,&spaceused);
         if(rv == -1)
           continue;
         if(spaceused >= eplus)
           continue;
 
         eplus = spaceused;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=ENOENT,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -154,7 +163,7 @@ namespace eplus
 int
 Policy::EPLUS::Action::operator()(const Branches::CPtr &branches_,
                                   const char          *fusepath_,
-                                  StrVec              *paths_) const
+                                  BasePaths           *paths_) const
 {
   return ::eplus::action(branches_,fusepath_,paths_);
 }
@@ -162,7 +171,7 @@ Policy::EPLUS::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPLUS::Create::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::eplus::create(branches_,fusepath_,paths_);
 }
@@ -170,7 +179,7 @@ Policy::EPLUS::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPLUS::Search::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::eplus::search(branches_,fusepath_,paths_);
 }
@@ -15,13 +15,13 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
 #include "policy.hpp"
 #include "policy_epmfs.hpp"
 #include "policy_error.hpp"
+#include "policy_probe.hpp"
 
 #include <limits>
 #include <string>
@@ -36,24 +36,27 @@ namespace epmfs
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     uint64_t epmfs;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     epmfs = std::numeric_limits<uint64_t>::min();
-    basepath = NULL;
-    for(const auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -64,13 +67,13 @@ namespace epmfs
           continue;
 
         epmfs = info.spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -79,24 +82,27 @@ namespace epmfs
   int
   action(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     uint64_t epmfs;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     epmfs = std::numeric_limits<uint64_t>::min();
-    basepath = NULL;
-    for(const auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -105,13 +111,13 @@ namespace epmfs
           continue;
 
         epmfs = info.spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -120,33 +126,36 @@ namespace epmfs
   int
   search(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     uint64_t epmfs;
     uint64_t spaceavail;
-    const string *basepath;
+    const Branch *selected;
 
     epmfs = 0;
-    basepath = NULL;
-    for(const auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::NONE);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
-        if(!fs::exists(branch.path,fusepath_))
+        const Branch &branch = (*branches_)[i];
+
+        if(!probe.exists(i))
           continue;
-        rv = fs::statvfs_cache_spaceavail(branch.path,&spaceavail);
+        rv = fs::statvfs_cache_spaceavail(branch,&spaceavail);
         if(rv == -1)
           continue;
         if(spaceavail < epmfs)
           continue;
 
         epmfs = spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=ENOENT,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -155,7 +164,7 @@ namespace epmfs
 int
 Policy::EPMFS::Action::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::epmfs::action(branches_,fusepath_,paths_);
 }
@@ -163,7 +172,7 @@ Policy::EPMFS::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPMFS::Create::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::epmfs::create(branches_,fusepath_,paths_);
 }
@@ -171,7 +180,7 @@ Policy::EPMFS::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPMFS::Search::operator()(const Branches::CPtr &branches_,
                                   const char           *fusepath_,
-                                  StrVec               *paths_) const
+                                  BasePaths            *paths_) const
 {
   return ::epmfs::search(branches_,fusepath_,paths_);
 }
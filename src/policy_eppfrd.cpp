@@ -15,16 +15,16 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
 #include "policy.hpp"
 #include "policy_eppfrd.hpp"
 #include "policy_error.hpp"
+#include "policy_probe.hpp"
 #include "rnd.hpp"
 #include "rwlock.hpp"
-#include "strvec.hpp"
+#include "basepaths.hpp"
 
 #include <string>
 #include <vector>
@@ -35,7 +35,7 @@ using std::vector;
 struct BranchInfo
 {
   uint64_t      spaceavail;
-  const string *basepath;
+  const Branch *branch;
 };
 
 typedef vector<BranchInfo> BranchInfoVec;
@@ -56,13 +56,16 @@ namespace eppfrd
 
     *sum_ = 0;
     error = ENOENT;
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -73,7 +76,7 @@ namespace eppfrd
         *sum_ += info.spaceavail;
 
         bi.spaceavail = info.spaceavail;
-        bi.basepath   = &branch.path;
+        bi.branch     = &branch;
         branchinfo_->push_back(bi);
       }
 
@@ -94,13 +97,16 @@ namespace eppfrd
 
     *sum_ = 0;
     error = ENOENT;
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -109,7 +115,7 @@ namespace eppfrd
         *sum_ += info.spaceavail;
 
         bi.spaceavail = info.spaceavail;
-        bi.basepath   = &branch.path;
+        bi.branch     = &branch;
         branchinfo_->push_back(bi);
       }
 
@@ -128,18 +134,21 @@ namespace eppfrd
     uint64_t spaceavail;
 
     *sum_ = 0;
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::NONE);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
-        if(!fs::exists(branch.path,fusepath_))
+        const Branch &branch = (*branches_)[i];
+
+        if(!probe.exists(i))
           continue;
-        rv = fs::statvfs_cache_spaceavail(branch.path,&spaceavail);
+        rv = fs::statvfs_cache_spaceavail(branch,&spaceavail);
         if(rv == -1)
           continue;
 
         *sum_ += spaceavail;
 
         bi.spaceavail = spaceavail;
-        bi.basepath   = &branch.path;
+        bi.branch     = &branch;
         branchinfo_->push_back(bi);
       }
 
@@ -148,7 +157,7 @@ namespace eppfrd
 
   static
   const
-  string*
+  Branch*
   get_branch(const BranchInfoVec &branchinfo_,
              const uint64_t       sum_)
   {
@@ -167,7 +176,7 @@ namespace eppfrd
         if(idx < threshold)
           continue;
 
-        return branchinfo_[i].basepath;
+        return branchinfo_[i].branch;
       }
 
     return NULL;
@@ -177,19 +186,19 @@ namespace eppfrd
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int error;
     uint64_t sum;
-    const string *basepath;
+    const Branch *selected;
     BranchInfoVec branchinfo;
 
     error    = eppfrd::get_branchinfo_create(branches_,fusepath_,&branchinfo,&sum);
-    basepath = eppfrd::get_branch(branchinfo,sum);
-    if(basepath == NULL)
+    selected = eppfrd::get_branch(branchinfo,sum);
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -198,19 +207,19 @@ namespace eppfrd
   int
   action(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int error;
     uint64_t sum;
-    const string *basepath;
+    const Branch *selected;
     BranchInfoVec branchinfo;
 
     error    = eppfrd::get_branchinfo_action(branches_,fusepath_,&branchinfo,&sum);
-    basepath = eppfrd::get_branch(branchinfo,sum);
-    if(basepath == NULL)
+    selected = eppfrd::get_branch(branchinfo,sum);
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -219,19 +228,19 @@ namespace eppfrd
   int
   search(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int error;
     uint64_t sum;
-    const string *basepath;
+    const Branch *selected;
     BranchInfoVec branchinfo;
 
     error    = eppfrd::get_branchinfo_search(branches_,fusepath_,&branchinfo,&sum);
-    basepath = eppfrd::get_branch(branchinfo,sum);
-    if(basepath == NULL)
+    selected = eppfrd::get_branch(branchinfo,sum);
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -240,7 +249,7 @@ namespace eppfrd
 int
 Policy::EPPFRD::Action::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return ::eppfrd::action(branches_,fusepath_,paths_);
 }
@@ -248,7 +257,7 @@ Policy::EPPFRD::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPPFRD::Create::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return ::eppfrd::create(branches_,fusepath_,paths_);
 }
@@ -256,7 +265,7 @@ Policy::EPPFRD::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::EPPFRD::Search::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return ::eppfrd::search(branches_,fusepath_,paths_);
 }
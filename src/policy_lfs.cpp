@@ -22,7 +22,7 @@
 #include "policy.hpp"
 #include "policy_error.hpp"
 #include "policy_lfs.hpp"
-#include "strvec.hpp"
+#include "basepaths.hpp"
 
 #include <limits>
 #include <string>
@@ -34,22 +34,22 @@ namespace lfs
   static
   int
   create(const Branches::CPtr &branches_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     uint64_t lfs;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     lfs = std::numeric_limits<uint64_t>::max();
-    basepath = NULL;
+    selected = NULL;
     for(const auto &branch : *branches_)
       {
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -60,13 +60,13 @@ namespace lfs
           continue;
 
         lfs = info.spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -75,7 +75,7 @@ namespace lfs
 int
 Policy::LFS::Action::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return Policies::Action::eplfs(branches_,fusepath_,paths_);
 }
@@ -83,7 +83,7 @@ Policy::LFS::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::LFS::Create::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return ::lfs::create(branches_,paths_);
 }
@@ -91,7 +91,7 @@ Policy::LFS::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::LFS::Search::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return Policies::Search::eplfs(branches_,fusepath_,paths_);
 }
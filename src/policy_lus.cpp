@@ -22,7 +22,7 @@
 #include "policy.hpp"
 #include "policy_error.hpp"
 #include "policy_lus.hpp"
-#include "strvec.hpp"
+#include "basepaths.hpp"
 
 #include <limits>
 #include <string>
@@ -36,22 +36,22 @@ namespace lus
   static
   int
   create(const Branches::CPtr &branches_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     uint64_t lus;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     lus = std::numeric_limits<uint64_t>::max();
-    basepath = NULL;
+    selected = NULL;
     for(auto &branch : *branches_)
       {
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -62,13 +62,13 @@ namespace lus
           continue;
 
         lus      = info.spaceused;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -77,7 +77,7 @@ namespace lus
 int
 Policy::LUS::Action::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return Policies::Action::eplus(branches_,fusepath_,paths_);
 }
@@ -85,7 +85,7 @@ Policy::LUS::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::LUS::Create::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return ::lus::create(branches_,paths_);
 }
@@ -93,7 +93,7 @@ Policy::LUS::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::LUS::Search::operator()(const Branches::CPtr &branches_,
                                 const char           *fusepath_,
-                                StrVec               *paths_) const
+                                BasePaths            *paths_) const
 {
   return Policies::Search::eplus(branches_,fusepath_,paths_);
 }
@@ -15,7 +15,6 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
@@ -23,7 +22,8 @@
 #include "policy.hpp"
 #include "policy_error.hpp"
 #include "policy_msplfs.hpp"
-#include "strvec.hpp"
+#include "policy_probe.hpp"
+#include "basepaths.hpp"
 
 #include <limits>
 #include <string>
@@ -35,7 +35,7 @@ namespace msplfs
 {
   static
   const
-  string*
+  Branch*
   create_1(const Branches::CPtr &branches_,
            const string         &fusepath_,
            int                  *err_)
@@ -43,17 +43,20 @@ namespace msplfs
     int rv;
     uint64_t lfs;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
-    basepath = NULL;
+    selected = NULL;
     lfs = std::numeric_limits<uint64_t>::max();
-    for(const auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_.c_str(),Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(*err_,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(*err_,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(*err_,ENOENT);
         if(info.readonly)
@@ -64,38 +67,38 @@ namespace msplfs
           continue;
 
         lfs = info.spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    return basepath;
+    return selected;
   }
 
   static
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int error;
     string fusepath;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     fusepath = fusepath_;
     for(;;)
       {
-        basepath = msplfs::create_1(branches_,fusepath,&error);
-        if(basepath)
+        selected = msplfs::create_1(branches_,fusepath,&error);
+        if(selected)
           break;
         if(fusepath == "/")
           break;
         fusepath = fs::path::dirname(fusepath);
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -104,7 +107,7 @@ namespace msplfs
 int
 Policy::MSPLFS::Action::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return Policies::Action::eplfs(branches_,fusepath_,paths_);
 }
@@ -112,7 +115,7 @@ Policy::MSPLFS::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::MSPLFS::Create::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return ::msplfs::create(branches_,fusepath_,paths_);
 }
@@ -120,7 +123,7 @@ Policy::MSPLFS::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::MSPLFS::Search::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return Policies::Search::eplfs(branches_,fusepath_,paths_);
 }
@@ -15,7 +15,6 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
@@ -23,6 +22,7 @@
 #include "policy.hpp"
 #include "policy_error.hpp"
 #include "policy_mspmfs.hpp"
+#include "policy_probe.hpp"
 
 #include <limits>
 #include <string>
@@ -36,7 +36,7 @@ namespace mspmfs
 {
   static
   const
-  string*
+  Branch*
   create_1(const Branches::CPtr &branches_,
            const string         &fusepath_,
            int                  *err_)
@@ -44,17 +44,20 @@ namespace mspmfs
     int rv;
     uint64_t mfs;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
-    basepath = NULL;
+    selected = NULL;
     mfs = std::numeric_limits<uint64_t>::min();
-    for(const auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_.c_str(),Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(*err_,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(*err_,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(*err_,ENOENT);
         if(info.readonly)
@@ -65,38 +68,38 @@ namespace mspmfs
           continue;
 
         mfs = info.spaceavail;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    return basepath;
+    return selected;
   }
 
   static
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int error;
     string fusepath;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     fusepath = fusepath_;
     for(;;)
       {
-        basepath = mspmfs::create_1(branches_,fusepath,&error);
-        if(basepath)
+        selected = mspmfs::create_1(branches_,fusepath,&error);
+        if(selected)
           break;
         if(fusepath == "/")
           break;
         fusepath = fs::path::dirname(fusepath);
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -105,7 +108,7 @@ namespace mspmfs
 int
 Policy::MSPMFS::Action::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return Policies::Action::epmfs(branches_,fusepath_,paths_);
 }
@@ -113,7 +116,7 @@ Policy::MSPMFS::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::MSPMFS::Create::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return ::mspmfs::create(branches_,fusepath_,paths_);
 }
@@ -121,7 +124,7 @@ Policy::MSPMFS::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::MSPMFS::Search::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return Policies::Search::epmfs(branches_,fusepath_,paths_);
 }
@@ -17,7 +17,6 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
@@ -25,6 +24,7 @@
 #include "policy_msppfrd.hpp"
 #include "policies.hpp"
 #include "policy_error.hpp"
+#include "policy_probe.hpp"
 #include "rnd.hpp"
 
 #include <string>
@@ -36,7 +36,7 @@ using std::vector;
 struct BranchInfo
 {
   uint64_t      spaceavail;
-  const string *basepath;
+  const Branch *branch;
 };
 
 typedef vector<BranchInfo> BranchInfoVec;
@@ -57,13 +57,16 @@ namespace msppfrd
 
     *sum_ = 0;
     error = ENOENT;
-    for(auto &branch : *branches_)
+    Policy::Probe probe(branches_,fusepath_.c_str(),Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_))
+        if(!probe.exists(i))
           error_and_continue(error,ENOENT);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -74,7 +77,7 @@ namespace msppfrd
         *sum_ += info.spaceavail;
 
         bi.spaceavail = info.spaceavail;
-        bi.basepath   = &branch.path;
+        bi.branch     = &branch;
         branchinfo_->push_back(bi);
       }
 
@@ -107,7 +110,7 @@ namespace msppfrd
 
   static
   const
-  string*
+  Branch*
   get_branch(const BranchInfoVec &branchinfo_,
              const uint64_t       sum_)
   {
@@ -126,7 +129,7 @@ namespace msppfrd
         if(idx < threshold)
           continue;
 
-        return branchinfo_[i].basepath;
+        return branchinfo_[i].branch;
       }
 
     return NULL;
@@ -136,19 +139,19 @@ namespace msppfrd
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int error;
     uint64_t sum;
-    const string *basepath;
+    const Branch *selected;
     BranchInfoVec branchinfo;
 
     error    = msppfrd::get_branchinfo(branches_,fusepath_,&branchinfo,&sum);
-    basepath = msppfrd::get_branch(branchinfo,sum);
-    if(basepath == NULL)
+    selected = msppfrd::get_branch(branchinfo,sum);
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -157,7 +160,7 @@ namespace msppfrd
 int
 Policy::MSPPFRD::Action::operator()(const Branches::CPtr &branches_,
                                     const char           *fusepath_,
-                                    StrVec               *paths_) const
+                                    BasePaths            *paths_) const
 {
   return Policies::Action::eppfrd(branches_,fusepath_,paths_);
 }
@@ -165,7 +168,7 @@ Policy::MSPPFRD::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::MSPPFRD::Create::operator()(const Branches::CPtr &branches_,
                                     const char           *fusepath_,
-                                    StrVec               *paths_) const
+                                    BasePaths            *paths_) const
 {
   return ::msppfrd::create(branches_,fusepath_,paths_);
 }
@@ -173,7 +176,7 @@ Policy::MSPPFRD::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::MSPPFRD::Search::operator()(const Branches::CPtr &branches_,
                                     const char           *fusepath_,
-                                    StrVec               *paths_) const
+                                    BasePaths            *paths_) const
 {
   return Policies::Search::eppfrd(branches_,fusepath_,paths_);
 }
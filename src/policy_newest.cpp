@@ -15,13 +15,13 @@
 */
 
 #include "errno.hpp"
-#include "fs_exists.hpp"
 #include "fs_info.hpp"
 #include "fs_path.hpp"
 #include "fs_statvfs_cache.hpp"
 #include "policy.hpp"
 #include "policy_error.hpp"
 #include "policy_newest.hpp"
+#include "policy_probe.hpp"
 #include "rwlock.hpp"
 
 #include <string>
@@ -37,27 +37,30 @@ namespace newest
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     time_t newest;
     struct stat st;
     fs::info_t info;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     newest = std::numeric_limits<time_t>::min();
-    basepath = NULL;
-    for(auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO_OR_NC);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_,&st))
+        if(!probe.exists(i,&st))
           error_and_continue(error,ENOENT);
         if(st.st_mtime < newest)
           continue;
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -66,13 +69,13 @@ namespace newest
           error_and_continue(error,ENOSPC);
 
         newest = st.st_mtime;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -81,40 +84,43 @@ namespace newest
   int
   action(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int rv;
     int error;
     bool readonly;
     time_t newest;
     struct stat st;
-    const string *basepath;
+    const Branch *selected;
 
     error = ENOENT;
     newest = std::numeric_limits<time_t>::min();
-    basepath = NULL;
-    for(auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::RO);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
+        const Branch &branch = (*branches_)[i];
+
         if(branch.ro())
           error_and_continue(error,EROFS);
-        if(!fs::exists(branch.path,fusepath_,&st))
+        if(!probe.exists(i,&st))
           error_and_continue(error,ENOENT);
         if(st.st_mtime < newest)
           continue;
-        rv = fs::statvfs_cache_readonly(branch.path,&readonly);
+        rv = fs::statvfs_cache_readonly(branch,&readonly);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(readonly)
           error_and_continue(error,EROFS);
 
         newest = st.st_mtime;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -123,29 +129,32 @@ namespace newest
   int
   search(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     time_t newest;
     struct stat st;
-    const string *basepath;
+    const Branch *selected;
 
     newest = std::numeric_limits<time_t>::min();
-    basepath = NULL;
-    for(auto &branch : *branches_)
+    selected = NULL;
+    Policy::Probe probe(branches_,fusepath_,Policy::Probe::Skip::NONE);
+    for(size_t i = 0; i < branches_->size(); i++)
       {
-        if(!fs::exists(branch.path,fusepath_,&st))
+        const Branch &branch = (*branches_)[i];
+
+        if(!probe.exists(i,&st))
           continue;
         if(st.st_mtime < newest)
           continue;
 
         newest = st.st_mtime;
-        basepath = &branch.path;
+        selected = &branch;
       }
 
-    if(basepath == NULL)
+    if(selected == NULL)
       return (errno=ENOENT,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -154,7 +163,7 @@ namespace newest
 int
 Policy::Newest::Action::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return ::newest::action(branches_,fusepath_,paths_);
 }
@@ -162,7 +171,7 @@ Policy::Newest::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::Newest::Create::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return ::newest::create(branches_,fusepath_,paths_);
 }
@@ -170,7 +179,7 @@ Policy::Newest::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::Newest::Search::operator()(const Branches::CPtr &branches_,
                                    const char           *fusepath_,
-                                   StrVec               *paths_) const
+                                   BasePaths            *paths_) const
 {
   return ::newest::search(branches_,fusepath_,paths_);
 }
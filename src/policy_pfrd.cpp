@@ -22,7 +22,7 @@
 #include "policy_error.hpp"
 #include "policy_pfrd.hpp"
 #include "rnd.hpp"
-#include "strvec.hpp"
+#include "basepaths.hpp"
 
 #include <string>
 #include <vector>
@@ -33,7 +33,7 @@ using std::vector;
 struct BranchInfo
 {
   uint64_t      spaceavail;
-  const string *basepath;
+  const Branch *branch;
 };
 
 typedef vector<BranchInfo> BranchInfoVec;
@@ -57,7 +57,7 @@ namespace pfrd
       {
         if(branch.ro_or_nc())
           error_and_continue(error,EROFS);
-        rv = fs::info(branch.path,&info);
+        rv = fs::info(branch,&info);
         if(rv == -1)
           error_and_continue(error,ENOENT);
         if(info.readonly)
@@ -68,7 +68,7 @@ namespace pfrd
         *sum_ += info.spaceavail;
 
         bi.spaceavail = info.spaceavail;
-        bi.basepath   = &branch.path;
+        bi.branch     = &branch;
         branchinfo_->push_back(bi);
       }
 
@@ -77,7 +77,7 @@ namespace pfrd
 
   static
   const
-  string*
+  Branch*
   get_branch(const BranchInfoVec &branchinfo_,
              const uint64_t       sum_)
   {
@@ -96,7 +96,7 @@ namespace pfrd
         if(idx < threshold)
           continue;
 
-        return branchinfo_[i].basepath;
+        return branchinfo_[i].branch;
       }
 
     return NULL;
@@ -106,19 +106,19 @@ namespace pfrd
   int
   create(const Branches::CPtr &branches_,
          const char           *fusepath_,
-         StrVec               *paths_)
+         BasePaths            *paths_)
   {
     int error;
     uint64_t sum;
-    const string *basepath;
+    const Branch *selected;
     BranchInfoVec branchinfo;
 
     error    = pfrd::get_branchinfo(branches_,&branchinfo,&sum);
-    basepath = pfrd::get_branch(branchinfo,sum);
-    if(basepath == NULL)
+    selected = pfrd::get_branch(branchinfo,sum);
+    if(selected == NULL)
       return (errno=error,-1);
 
-    paths_->push_back(*basepath);
+    paths_->push_back(*selected);
 
     return 0;
   }
@@ -127,7 +127,7 @@ namespace pfrd
 int
 Policy::PFRD::Action::operator()(const Branches::CPtr &branches_,
                                  const char           *fusepath_,
-                                 StrVec               *paths_) const
+                                 BasePaths            *paths_) const
 {
   return Policies::Action::eppfrd(branches_,fusepath_,paths_);
 }
@@ -135,7 +135,7 @@ Policy::PFRD::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::PFRD::Create::operator()(const Branches::CPtr &branches_,
                                  const char           *fusepath_,
-                                 StrVec               *paths_) const
+                                 BasePaths            *paths_) const
 {
   return ::pfrd::create(branches_,fusepath_,paths_);
 }
@@ -143,7 +143,7 @@ Policy::PFRD::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::PFRD::Search::operator()(const Branches::CPtr &branches_,
                                  const char           *fusepath_,
-                                 StrVec               *paths_) const
+                                 BasePaths            *paths_) const
 {
   return Policies::Search::eppfrd(branches_,fusepath_,paths_);
 }
@@ -0,0 +1,280 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "policy_probe.hpp"
+
+#include "fs_exists.hpp"
+
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+
+static std::atomic<unsigned>       g_THREADS(0);
+static std::once_flag              g_TP_ONCE;
+static std::unique_ptr<ThreadPool> g_TP;
+
+namespace
+{
+  enum State
+    {
+     SKIPPED,
+     LAZY,
+     SUBMITTED,
+     QUEUED,
+     DONE
+    };
+}
+
+// Queued and submitted probes may outlive the policy call if the
+// branch hangs so they hold their inputs through this.
+struct Policy::Probe::Shared
+{
+  std::mutex                         mutex;
+  std::condition_variable            cv;
+  Branches::CPtr                     branches;
+  std::string                        fusepath;
+  std::vector<Policy::Probe::Result> results;
+};
+
+namespace l
+{
+  static
+  bool
+  skip(const Branch              &branch_,
+       const Policy::Probe::Skip  skip_)
+  {
+    switch(skip_)
+      {
+      case Policy::Probe::Skip::RO:
+        return branch_.ro();
+      case Policy::Probe::Skip::RO_OR_NC:
+        return branch_.ro_or_nc();
+      default:
+      case Policy::Probe::Skip::NONE:
+        return false;
+      }
+  }
+
+  static
+  int
+  exists(const Branch &branch_,
+         const char   *fusepath_,
+         struct stat  *st_)
+  {
+    if(fs::exists_at(branch_,fusepath_,st_))
+      return 0;
+    return errno;
+  }
+}
+
+unsigned
+Policy::Probe::threads(void)
+{
+  return g_THREADS.load(std::memory_order_relaxed);
+}
+
+void
+Policy::Probe::threads(const unsigned threads_)
+{
+  g_THREADS.store(threads_,std::memory_order_relaxed);
+}
+
+Policy::Probe::Probe(const Branches::CPtr &branches_,
+                     const char           *fusepath_,
+                     const Skip            skip_)
+  : _branches(branches_),
+    _fusepath(fusepath_),
+    _results(&_local)
+{
+  std::size_t count;
+
+  _local.resize(branches_->size());
+
+  count = 0;
+  for(std::size_t i = 0; i < _local.size(); i++)
+    {
+      _local[i].state = LAZY;
+      _local[i].err   = 0;
+      _local[i].done  = false;
+      if(l::skip((*branches_)[i],skip_))
+        {
+          _local[i].state = SKIPPED;
+        }
+      else if(!fs::may_exist((*branches_)[i],fusepath_))
+        {
+          _local[i].state = DONE;
+          _local[i].err   = ENOENT;
+        }
+      else
+        {
+          count++;
+        }
+    }
+
+  if(count <= 1)
+    return;
+
+  if(BranchIO::threads() > 0)
+    submit_branch_io();
+  else if(Probe::threads() > 0)
+    submit_pool();
+}
+
+void
+Policy::Probe::submit_branch_io(void)
+{
+  _shared = std::make_shared<Shared>();
+  _shared->branches = _branches;
+  _shared->fusepath = _fusepath;
+  _shared->results.swap(_local);
+  _results = &_shared->results;
+
+  for(std::size_t i = 0; i < _results->size(); i++)
+    {
+      Result &r = (*_results)[i];
+      BranchIO *io = (*_branches)[i].io();
+      std::shared_ptr<Shared> shared = _shared;
+
+      if((r.state != LAZY) || (io == NULL))
+        continue;
+
+      r.state   = SUBMITTED;
+      r.pending = io->submit([shared,i]()
+      {
+        Result &r = shared->results[i];
+
+        return -l::exists((*shared->branches)[i],
+                          shared->fusepath.c_str(),
+                          &r.st);
+      });
+    }
+}
+
+/*
+  The first branch is left for the calling thread to check as it is
+  likely to be asked for first.
+*/
+void
+Policy::Probe::submit_pool(void)
+{
+  bool first;
+
+  std::call_once(g_TP_ONCE,
+                 []()
+                 {
+                   unsigned threads;
+
+                   threads = Probe::threads();
+                   g_TP.reset(new ThreadPool(threads,threads * 4,"policy.probe"));
+                 });
+
+  _shared = std::make_shared<Shared>();
+  _shared->branches = _branches;
+  _shared->fusepath = _fusepath;
+  _shared->results.swap(_local);
+  _results = &_shared->results;
+
+  first = true;
+  for(std::size_t i = 0; i < _results->size(); i++)
+    {
+      Result &r = (*_results)[i];
+      std::shared_ptr<Shared> shared = _shared;
+
+      if(r.state != LAZY)
+        continue;
+      if(first)
+        {
+          first = false;
+          continue;
+        }
+
+      r.state = QUEUED;
+      g_TP->enqueue_work([shared,i]()
+      {
+        int err;
+        struct stat st;
+
+        err = l::exists((*shared->branches)[i],
+                        shared->fusepath.c_str(),
+                        &st);
+
+        std::lock_guard<std::mutex> lg(shared->mutex);
+        Result &r = shared->results[i];
+        r.err  = err;
+        r.st   = st;
+        r.done = true;
+        shared->cv.notify_one();
+      });
+    }
+}
+
+bool
+Policy::Probe::exists(const std::size_t idx_)
+{
+  int rv;
+  Result &r = (*_results)[idx_];
+
+  switch(r.state)
+    {
+    case SKIPPED:
+      return (errno=EROFS,false);
+    case LAZY:
+      if(fs::exists((*_branches)[idx_],_fusepath,&r.st))
+        r.err = 0;
+      else
+        r.err = errno;
+      break;
+    case SUBMITTED:
+      rv = (*_branches)[idx_].io()->wait(r.pending);
+      r.pending.reset();
+      r.err = -rv;
+      break;
+    case QUEUED:
+      {
+        std::unique_lock<std::mutex> lk(_shared->mutex);
+        _shared->cv.wait(lk,[&r]() { return r.done; });
+      }
+      break;
+    default:
+    case DONE:
+      break;
+    }
+
+  r.state = DONE;
+  if(r.err == 0)
+    return true;
+
+  return (errno=r.err,false);
+}
+
+bool
+Policy::Probe::exists(const std::size_t  idx_,
+                      struct stat       *st_)
+{
+  if(!exists(idx_))
+    return false;
+
+  *st_ = (*_results)[idx_].st;
+
+  return true;
+}
@@ -0,0 +1,90 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include "branch_io.hpp"
+#include "branches.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <sys/stat.h>
+
+
+namespace Policy
+{
+  /*
+    Checks for a path on the branches a policy will consider. With
+    branch-io-threads set the checks are all issued up front on each
+    branch's own threads. Otherwise they are queued to a shared pool
+    of policy-probe-threads threads or, if that is 0, made on the
+    calling thread when the policy asks for them. Asking only waits
+    on that branch so first found policies don't wait on the rest.
+
+    Branches the policy would reject for being readonly or nocreate
+    are not probed.
+  */
+  class Probe
+  {
+  public:
+    enum class Skip
+      {
+       NONE,
+       RO,
+       RO_OR_NC
+      };
+
+  public:
+    static unsigned threads(void);
+    static void     threads(const unsigned);
+
+  public:
+    Probe(const Branches::CPtr &branches,
+          const char           *fusepath,
+          const Skip            skip);
+
+  public:
+    bool exists(const std::size_t idx);
+    bool exists(const std::size_t idx, struct stat *st);
+
+  public:
+    struct Shared;
+
+    struct Result
+    {
+      int                   state;
+      int                   err;
+      bool                  done;
+      struct stat           st;
+      BranchIO::PendingPtr  pending;
+    };
+
+  private:
+    void submit_branch_io(void);
+    void submit_pool(void);
+
+  private:
+    const Branches::CPtr    &_branches;
+    const char              *_fusepath;
+    std::shared_ptr<Shared>  _shared;
+    std::vector<Result>     *_results;
+    std::vector<Result>      _local;
+  };
+}
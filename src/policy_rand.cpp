@@ -18,21 +18,19 @@
 #include "policy.hpp"
 #include "policy_rand.hpp"
 #include "policies.hpp"
-
-#include <algorithm>
+#include "rnd.hpp"
 
 int
 Policy::Rand::Action::operator()(const Branches::CPtr &branches_,
                                  const char           *fusepath_,
-                                 StrVec               *paths_) const
+                                 BasePaths            *paths_) const
 {
   int rv;
 
   rv = Policies::Action::all(branches_,fusepath_,paths_);
   if(rv == 0)
     {
-      std::random_shuffle(paths_->begin(),paths_->end());
-      paths_->resize(1);
+      paths_->keep(RND::rand64(paths_->size()));
     }
 
   return rv;
@@ -41,15 +39,14 @@ Policy::Rand::Action::operator()(const Branches::CPtr &branches_,
 int
 Policy::Rand::Create::operator()(const Branches::CPtr &branches_,
                                  const char           *fusepath_,
-                                 StrVec               *paths_) const
+                                 BasePaths            *paths_) const
 {
   int rv;
 
   rv = Policies::Create::all(branches_,fusepath_,paths_);
   if(rv == 0)
     {
-      std::random_shuffle(paths_->begin(),paths_->end());
-      paths_->resize(1);
+      paths_->keep(RND::rand64(paths_->size()));
     }
 
   return rv;
@@ -58,15 +55,14 @@ Policy::Rand::Create::operator()(const Branches::CPtr &branches_,
 int
 Policy::Rand::Search::operator()(const Branches::CPtr &branches_,
                                  const char           *fusepath_,
-                                 StrVec               *paths_) const
+                                 BasePaths            *paths_) const
 {
   int rv;
 
   rv = Policies::Search::all(branches_,fusepath_,paths_);
   if(rv == 0)
     {
-      std::random_shuffle(paths_->begin(),paths_->end());
-      paths_->resize(1);
+      paths_->keep(RND::rand64(paths_->size()));
     }
 
   return rv;
@@ -0,0 +1,183 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "rcu.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+  // Slots are never freed. A thread exiting marks its slot unused so
+  // it can be claimed by a later thread. Padded rather than aligned
+  // (which plain new doesn't honor in C++11) so no two epochs share a
+  // cache line.
+  struct Reader
+  {
+    std::atomic<uint64_t> epoch;
+    char                  pad[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<bool>     used;
+    Reader               *next;
+  };
+
+  struct Retired
+  {
+    uint64_t                  epoch;
+    std::function<void(void)> release;
+  };
+
+  class ThreadReader
+  {
+  public:
+    ThreadReader();
+    ~ThreadReader();
+
+  public:
+    Reader   *reader;
+    uint64_t  depth;
+  };
+}
+
+static std::atomic<Reader*>  g_READERS(NULL);
+static std::atomic<uint64_t> g_EPOCH(1);
+static std::mutex            g_RETIRED_LOCK;
+static std::vector<Retired>  g_RETIRED;
+
+static thread_local ThreadReader t_READER;
+
+ThreadReader::ThreadReader()
+  : reader(NULL),
+    depth(0)
+{
+  bool expected;
+
+  for(Reader *r = g_READERS.load(); r != NULL; r = r->next)
+    {
+      expected = false;
+      if(r->used.compare_exchange_strong(expected,true))
+        {
+          reader = r;
+          return;
+        }
+    }
+
+  reader = new Reader();
+  reader->epoch = 0;
+  reader->used  = true;
+  reader->next  = g_READERS.load();
+  while(!g_READERS.compare_exchange_weak(reader->next,reader))
+    ;
+}
+
+ThreadReader::~ThreadReader()
+{
+  reader->epoch.store(0,std::memory_order_release);
+  reader->used.store(false,std::memory_order_release);
+}
+
+namespace l
+{
+  static
+  uint64_t
+  oldest_active_epoch(void)
+  {
+    uint64_t epoch;
+    uint64_t oldest;
+
+    oldest = std::numeric_limits<uint64_t>::max();
+    for(Reader *r = g_READERS.load(); r != NULL; r = r->next)
+      {
+        epoch = r->epoch.load(std::memory_order_acquire);
+        if((epoch != 0) && (epoch < oldest))
+          oldest = epoch;
+      }
+
+    return oldest;
+  }
+}
+
+/*
+  The fence orders publishing our epoch before the reads of whatever
+  the section protects. It pairs with the fence in retire(): either
+  the writer sees this reader as active or this reader sees the newly
+  published value.
+*/
+void
+rcu::read_lock(void)
+{
+  ThreadReader &t = t_READER;
+
+  if(t.depth++ != 0)
+    return;
+
+  t.reader->epoch.store(g_EPOCH.load(std::memory_order_acquire),
+                        std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void
+rcu::read_unlock(void)
+{
+  ThreadReader &t = t_READER;
+
+  if(--t.depth != 0)
+    return;
+
+  t.reader->epoch.store(0,std::memory_order_release);
+}
+
+/*
+  Never blocks waiting on readers. Anything still in use is held
+  until a later call finds the readers have moved on. This allows
+  retiring from within a read section such as when a request thread
+  updates the config.
+*/
+void
+rcu::retire(std::function<void(void)> release_)
+{
+  uint64_t oldest;
+  std::vector<Retired> ready;
+
+  {
+    std::lock_guard<std::mutex> lg(g_RETIRED_LOCK);
+
+    g_RETIRED.push_back({g_EPOCH.fetch_add(1) + 1,std::move(release_)});
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    oldest = l::oldest_active_epoch();
+    for(auto i = g_RETIRED.begin(); i != g_RETIRED.end();)
+      {
+        if(i->epoch > oldest)
+          {
+            ++i;
+            continue;
+          }
+
+        ready.push_back(std::move(*i));
+        i = g_RETIRED.erase(i);
+      }
+  }
+
+  for(auto &r : ready)
+    r.release();
+}
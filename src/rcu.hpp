@@ -0,0 +1,53 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include <functional>
+
+
+// Epoch based read-copy-update. Readers announce the epoch they
+// entered in through a per thread slot so entering and leaving a read
+// section touches no shared cache lines. Writers publish a new value
+// themselves and hand the old one to retire() which runs the release
+// function once every reader which could have seen it has left.
+namespace rcu
+{
+  void read_lock(void);
+  void read_unlock(void);
+
+  void retire(std::function<void(void)> release);
+
+  class ReadGuard
+  {
+  public:
+    ReadGuard()
+    {
+      rcu::read_lock();
+    }
+
+    ~ReadGuard()
+    {
+      rcu::read_unlock();
+    }
+
+  private:
+    ReadGuard(const ReadGuard&);
+    ReadGuard& operator=(const ReadGuard&);
+  };
+}
@@ -0,0 +1,164 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+  Compares HashSet and DedupSet at deduping the entries of a
+  directory spread over several branches where most names are found
+  on more than one branch.
+
+  usage: bench-dedup [entries-per-branch] [branches] [rounds]
+*/
+
+#include "dedup_set.hpp"
+#include "hashset.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+typedef std::vector<std::vector<std::string>> Branches;
+
+namespace l
+{
+  // Half of each branch is shared with every other branch.
+  static
+  Branches
+  make_branches(const uint64_t entries_,
+                const uint64_t branches_)
+  {
+    char name[64];
+    Branches branches(branches_);
+
+    for(uint64_t b = 0; b < branches_; b++)
+      {
+        for(uint64_t i = 0; i < entries_; i++)
+          {
+            if(i & 1)
+              snprintf(name,sizeof(name),"branch%lu-file-%lu.dat",b,i);
+            else
+              snprintf(name,sizeof(name),"shared-file-%lu.dat",i);
+            branches[b].emplace_back(name);
+          }
+      }
+
+    return branches;
+  }
+
+  template<typename F>
+  static
+  double
+  time_ns(const uint64_t  rounds_,
+          F              &&func_)
+  {
+    uint64_t best;
+
+    best = ~0ULL;
+    for(uint64_t r = 0; r < rounds_; r++)
+      {
+        auto start = std::chrono::steady_clock::now();
+        func_();
+        auto end = std::chrono::steady_clock::now();
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        if(ns < best)
+          best = ns;
+      }
+
+    return best;
+  }
+}
+
+int
+main(int   argc_,
+     char *argv_[])
+{
+  uint64_t entries;
+  uint64_t nbranches;
+  uint64_t rounds;
+  uint64_t total;
+  uint64_t unique;
+  double ns;
+
+  entries   = ((argc_ > 1) ? strtoull(argv_[1],NULL,10) : 100000);
+  nbranches = ((argc_ > 2) ? strtoull(argv_[2],NULL,10) : 4);
+  rounds    = ((argc_ > 3) ? strtoull(argv_[3],NULL,10) : 10);
+  unique    = 0;
+
+  Branches branches = l::make_branches(entries,nbranches);
+  total = (entries * nbranches);
+
+  std::vector<std::vector<uint64_t>> hashes(nbranches);
+  for(uint64_t b = 0; b < nbranches; b++)
+    for(const auto &name : branches[b])
+      hashes[b].push_back(DedupSet::hash(name.data(),name.size()));
+
+  printf("%lu branches x %lu entries, best of %lu\n",
+         nbranches,entries,rounds);
+
+  ns = l::time_ns(rounds,[&]()
+  {
+    HashSet set;
+
+    unique = 0;
+    for(const auto &branch : branches)
+      for(const auto &name : branch)
+        unique += (set.put(name.data(),name.size()) > 0);
+  });
+  printf("  %-34s %8.2f ns/entry (%lu unique)\n",
+         "HashSet",ns / total,unique);
+
+  ns = l::time_ns(rounds,[&]()
+  {
+    DedupSet set;
+
+    unique = 0;
+    for(const auto &branch : branches)
+      for(const auto &name : branch)
+        unique += set.put(name.data(),name.size());
+  });
+  printf("  %-34s %8.2f ns/entry (%lu unique)\n",
+         "DedupSet",ns / total,unique);
+
+  ns = l::time_ns(rounds,[&]()
+  {
+    DedupSet set(entries);
+
+    unique = 0;
+    for(const auto &branch : branches)
+      for(const auto &name : branch)
+        unique += set.put(name.data(),name.size());
+  });
+  printf("  %-34s %8.2f ns/entry (%lu unique)\n",
+         "DedupSet sized from first branch",ns / total,unique);
+
+  ns = l::time_ns(rounds,[&]()
+  {
+    DedupSet set(entries);
+
+    unique = 0;
+    for(const auto &branch : hashes)
+      for(const auto h : branch)
+        unique += set.put(h);
+  });
+  printf("  %-34s %8.2f ns/entry (%lu unique)\n",
+         "DedupSet merge of prehashed",ns / total,unique);
+
+  return 0;
+}
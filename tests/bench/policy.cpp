@@ -0,0 +1,213 @@
+/*
+  ISC License
+
+  Copyright (c) 2024, Antonio SJ Musumeci <trapexit@spawn.link>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+  Cost of evaluating policies per request against a pool of branches
+  in a temporary directory. Half the branches have the file being
+  looked for. statfs results are cached so what's measured is the
+  existence checks and the policies themselves.
+
+  Also compares collecting results as copies of the branch paths
+  (what policies used to return) against BasePaths.
+
+  usage: bench-policy [rounds]
+*/
+
+#include "basepaths.hpp"
+#include "branches.hpp"
+#include "fs_statvfs_cache.hpp"
+#include "policies.hpp"
+#include "policy.hpp"
+#include "strvec.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define ITERATIONS 2000
+
+namespace l
+{
+  static
+  std::string
+  make_pool(const std::string &base_,
+            const uint64_t     count_)
+  {
+    int fd;
+    std::string path;
+    std::string branches;
+
+    for(uint64_t i = 0; i < count_; i++)
+      {
+        path = base_ + "/" + std::to_string(count_) + "-" + std::to_string(i);
+        ::mkdir(path.c_str(),0755);
+        if(i & 1)
+          {
+            path += "/dir";
+            ::mkdir(path.c_str(),0755);
+            path += "/file";
+            fd = ::open(path.c_str(),O_CREAT|O_WRONLY,0644);
+            if(fd >= 0)
+              ::close(fd);
+            path = path.substr(0,path.size() - 9);
+          }
+
+        if(!branches.empty())
+          branches += ':';
+        branches += path;
+      }
+
+    return branches;
+  }
+
+  template<typename F>
+  static
+  double
+  time_ns(const uint64_t   rounds_,
+          F              &&func_)
+  {
+    uint64_t best;
+
+    best = ~0ULL;
+    for(uint64_t r = 0; r < rounds_; r++)
+      {
+        auto start = std::chrono::steady_clock::now();
+        for(uint64_t i = 0; i < ITERATIONS; i++)
+          func_();
+        auto end = std::chrono::steady_clock::now();
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        if(ns < best)
+          best = ns;
+      }
+
+    return ((double)best / ITERATIONS);
+  }
+
+  static
+  void
+  bench(const Branches::CPtr &branches_,
+        const uint64_t        rounds_)
+  {
+    double ns;
+    BasePaths paths;
+
+    struct { const char *name; Policy::SearchImpl *p; } searches[] =
+      {
+       {"search ff",Policies::Search::find("ff")},
+       {"search epff",Policies::Search::find("epff")},
+       {"search newest",Policies::Search::find("newest")}
+      };
+    struct { const char *name; Policy::CreateImpl *p; } creates[] =
+      {
+       {"create mfs",Policies::Create::find("mfs")},
+       {"create pfrd",Policies::Create::find("pfrd")},
+       {"create epmfs",Policies::Create::find("epmfs")},
+       {"create mspmfs",Policies::Create::find("mspmfs")}
+      };
+    struct { const char *name; Policy::ActionImpl *p; } actions[] =
+      {
+       {"action epall",Policies::Action::find("epall")},
+       {"action all",Policies::Action::find("all")}
+      };
+
+    for(const auto &s : searches)
+      {
+        ns = l::time_ns(rounds_,[&]()
+        {
+          paths.clear();
+          (*s.p)(branches_,"/dir/file",&paths);
+        });
+        printf("    %-24s %10.1f ns/op\n",s.name,ns);
+      }
+
+    for(const auto &c : creates)
+      {
+        ns = l::time_ns(rounds_,[&]()
+        {
+          paths.clear();
+          (*c.p)(branches_,"/dir/file",&paths);
+        });
+        printf("    %-24s %10.1f ns/op\n",c.name,ns);
+      }
+
+    for(const auto &a : actions)
+      {
+        ns = l::time_ns(rounds_,[&]()
+        {
+          paths.clear();
+          (*a.p)(branches_,"/dir/file",&paths);
+        });
+        printf("    %-24s %10.1f ns/op\n",a.name,ns);
+      }
+
+    ns = l::time_ns(rounds_,[&]()
+    {
+      StrVec strvec;
+
+      for(const auto &branch : *branches_)
+        strvec.push_back(branch.path);
+    });
+    printf("    %-24s %10.1f ns/op\n","collect all as StrVec",ns);
+
+    ns = l::time_ns(rounds_,[&]()
+    {
+      BasePaths basepaths;
+
+      for(const auto &branch : *branches_)
+        basepaths.push_back(branch);
+    });
+    printf("    %-24s %10.1f ns/op\n","collect all as BasePaths",ns);
+  }
+}
+
+int
+main(int   argc_,
+     char *argv_[])
+{
+  uint64_t rounds;
+  uint64_t minfreespace;
+  char base[] = "/tmp/bench-policy.XXXXXX";
+
+  rounds       = ((argc_ > 1) ? strtoull(argv_[1],NULL,10) : 5);
+  minfreespace = 0;
+
+  if(::mkdtemp(base) == NULL)
+    return 1;
+
+  fs::statvfs_cache_timeout(3600);
+
+  for(const uint64_t count : {4,16,64})
+    {
+      Branches branches(minfreespace);
+
+      branches.from_string(l::make_pool(base,count));
+      printf("%lu branches, best of %lu x %u\n",count,rounds,ITERATIONS);
+      l::bench(branches,rounds);
+    }
+
+  std::string cmd = std::string("rm -rf ") + base;
+  return ::system(cmd.c_str());
+}
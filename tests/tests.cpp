@@ -1,6 +1,16 @@
 #include "acutest.h"
 
 #include "config.hpp"
+#include "dedup_set.hpp"
+#include "dir_filter.hpp"
+#include "location_index.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 void
 test_nop()
@@ -194,15 +204,43 @@ test_config_nfsopenhack()
 void
 test_config_readdir()
 {
-  ReadDir r;
+  FUSE::ReadDir r("seq");
+
+  TEST_CHECK(r.from_string("seq") == 0);
+  TEST_CHECK(r.to_string() == "seq");
 
-  TEST_CHECK(r.from_string("linux") == 0);
-  TEST_CHECK(r.to_string() == "linux");
-  TEST_CHECK(r == ReadDir::ENUM::LINUX);
+  TEST_CHECK(r.from_string("cosr:4") == 0);
+  TEST_CHECK(r.to_string() == "cosr:4");
 
-  TEST_CHECK(r.from_string("posix") == 0);
-  TEST_CHECK(r.to_string() == "posix");
-  TEST_CHECK(r == ReadDir::ENUM::POSIX);
+  TEST_CHECK(r.from_string("cor") == 0);
+  TEST_CHECK(r.to_string() == "cor");
+
+  TEST_CHECK(r.from_string("linux") == -EINVAL);
+  TEST_CHECK(r.to_string() == "cor");
+}
+
+void
+test_config_passthrough()
+{
+  Passthrough p;
+
+  TEST_CHECK(p.from_string("off") == 0);
+  TEST_CHECK(p.to_string() == "off");
+  TEST_CHECK(p == Passthrough::ENUM::OFF);
+
+  TEST_CHECK(p.from_string("ro") == 0);
+  TEST_CHECK(p.to_string() == "ro");
+  TEST_CHECK(p == Passthrough::ENUM::RO);
+
+  TEST_CHECK(p.from_string("wo") == 0);
+  TEST_CHECK(p.to_string() == "wo");
+  TEST_CHECK(p == Passthrough::ENUM::WO);
+
+  TEST_CHECK(p.from_string("rw") == 0);
+  TEST_CHECK(p.to_string() == "rw");
+  TEST_CHECK(p == Passthrough::ENUM::RW);
+
+  TEST_CHECK(p.from_string("foo") == -EINVAL);
 }
 
 void
@@ -269,6 +307,224 @@ test_config()
   TEST_CHECK(cfg.set_raw("async_read","true") == 0);
 }
 
+void
+test_dedup_set()
+{
+  char name[32];
+  DedupSet set(4);
+
+  for(int i = 0; i < 10000; i++)
+    {
+      snprintf(name,sizeof(name),"file%d",i);
+      TEST_CHECK(set.put(name,strlen(name)) == 1);
+    }
+
+  TEST_CHECK(set.size() == 10000);
+
+  for(int i = 0; i < 10000; i++)
+    {
+      snprintf(name,sizeof(name),"file%d",i);
+      TEST_CHECK(set.put(name,strlen(name)) == 0);
+      TEST_CHECK(set.contains(DedupSet::hash(name,strlen(name))));
+    }
+
+  TEST_CHECK(set.size() == 10000);
+  TEST_CHECK(!set.contains(DedupSet::hash("missing",7)));
+
+  set.reserve(100000);
+  TEST_CHECK(set.size() == 10000);
+  TEST_CHECK(set.put("file0",5) == 0);
+}
+
+static
+bool
+wait_for_location_index(const LocationIndex &li_)
+{
+  for(int i = 0; i < 500; i++)
+    {
+      if(li_.scanned())
+        return true;
+      usleep(10000);
+    }
+
+  return false;
+}
+
+void
+test_location_index()
+{
+  int fd;
+  uint64_t minfreespace;
+  std::string dir;
+  std::string index;
+  const Branch *found;
+  Branches b(minfreespace);
+  Branches other(minfreespace);
+  Branches::CPtr bcp;
+  char tmpl[] = "/tmp/mergerfs-test-XXXXXX";
+
+  minfreespace = 0;
+  TEST_CHECK(mkdtemp(tmpl) != NULL);
+  dir   = tmpl;
+  index = dir + "/index";
+  TEST_CHECK(mkdir((dir + "/0").c_str(),0700) == 0);
+  TEST_CHECK(mkdir((dir + "/1").c_str(),0700) == 0);
+  fd = open((dir + "/1/a").c_str(),O_CREAT|O_WRONLY,0600);
+  TEST_CHECK(fd >= 0);
+  close(fd);
+
+  TEST_CHECK(b.from_string(dir + "/0:" + dir + "/1") == 0);
+  TEST_CHECK(other.from_string(dir + "/1") == 0);
+  bcp = b;
+
+  {
+    LocationIndex li;
+
+    TEST_CHECK(li.open(index,1024,b) == 0);
+
+    // Not used until the scan is done.
+    TEST_CHECK(li.find(b,"/a",&found) == LocationIndex::Result::UNKNOWN);
+    li.scan(b);
+    TEST_CHECK(wait_for_location_index(li));
+    TEST_CHECK(li.find(b,"/a",&found) == LocationIndex::Result::FOUND);
+    TEST_CHECK(found == &(*bcp)[1]);
+
+    // Paths without a slot are unknown.
+    TEST_CHECK(li.find(b,"/b",&found) == LocationIndex::Result::UNKNOWN);
+
+    // A stale hint is skipped and cleared.
+    li.add(b,"/a",(std::size_t)0);
+    TEST_CHECK(li.find(b,"/a",&found) == LocationIndex::Result::FOUND);
+    TEST_CHECK(found == &(*bcp)[1]);
+
+    // The old path's bits are cleared once looked up.
+    TEST_CHECK(rename((dir + "/1/a").c_str(),(dir + "/1/c").c_str()) == 0);
+    li.link("/a","/c");
+    TEST_CHECK(li.find(b,"/a",&found) == LocationIndex::Result::ABSENT);
+    TEST_CHECK(li.find(b,"/c",&found) == LocationIndex::Result::FOUND);
+    TEST_CHECK(found == &(*bcp)[1]);
+
+    // Paths recorded by full path. The lowest branch is trusted.
+    fd = open((dir + "/0/c").c_str(),O_CREAT|O_WRONLY,0600);
+    TEST_CHECK(fd >= 0);
+    close(fd);
+    li.added(dir + "/0/c");
+    TEST_CHECK(li.find(b,"/c",&found) == LocationIndex::Result::FOUND);
+    TEST_CHECK(found == &(*bcp)[0]);
+    unlink((dir + "/0/c").c_str());
+    li.removed(dir + "/0/c");
+    TEST_CHECK(li.find(b,"/c",&found) == LocationIndex::Result::FOUND);
+    TEST_CHECK(found == &(*bcp)[1]);
+
+    // Only the branches it was built with are indexed.
+    TEST_CHECK(li.find(other,"/c",&found) == LocationIndex::Result::UNKNOWN);
+  }
+
+  {
+    LocationIndex li;
+
+    TEST_CHECK(li.open(index,1024,b) == 0);
+    li.scan(b);
+    TEST_CHECK(wait_for_location_index(li));
+    TEST_CHECK(li.find(b,"/c",&found) == LocationIndex::Result::FOUND);
+    TEST_CHECK(found == &(*bcp)[1]);
+
+    unlink((dir + "/1/c").c_str());
+    li.removed(dir + "/1/c");
+    TEST_CHECK(li.find(b,"/c",&found) == LocationIndex::Result::ABSENT);
+  }
+
+  unlink(index.c_str());
+  rmdir((dir + "/0").c_str());
+  rmdir((dir + "/1").c_str());
+  rmdir(dir.c_str());
+}
+
+static
+bool
+wait_for_dir_filter(DirFilter         *filter_,
+                    const char        *fusepath_,
+                    const bool         expected_)
+{
+  for(int i = 0; i < 500; i++)
+    {
+      if(filter_->parent_may_exist(fusepath_) == expected_)
+        return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+  return false;
+}
+
+void
+test_dir_filter()
+{
+  std::string dir;
+  DirFilter *filter;
+  char tmpl[] = "/tmp/mergerfs-test-XXXXXX";
+
+  TEST_CHECK(mkdtemp(tmpl) != NULL);
+  dir = tmpl;
+  TEST_CHECK(mkdir((dir + "/a").c_str(),0700) == 0);
+  TEST_CHECK(mkdir((dir + "/a/b").c_str(),0700) == 0);
+  TEST_CHECK(mkdir((dir + "/m").c_str(),0700) == 0);
+  for(int i = 0; i < 10000; i++)
+    mkdir((dir + "/m/" + std::to_string(i)).c_str(),0700);
+
+  filter = DirFilter::get(dir);
+  TEST_CHECK(filter == DirFilter::get(dir));
+  TEST_CHECK(filter->parent_may_exist("/x/y"));
+
+  DirFilter::enabled(true);
+  TEST_CHECK(wait_for_dir_filter(filter,"/x/y",false));
+  TEST_CHECK(filter->parent_may_exist("/x"));
+  TEST_CHECK(filter->parent_may_exist("/a/x"));
+  TEST_CHECK(filter->parent_may_exist("/a/b/x"));
+
+  // More directories than the initial table holds.
+  for(int i = 0; i < 10000; i++)
+    TEST_CHECK(filter->parent_may_exist(("/m/" + std::to_string(i) + "/x").c_str()));
+  TEST_CHECK(!filter->parent_may_exist("/m/10000/x"));
+
+  TEST_CHECK(mkdir((dir + "/x").c_str(),0700) == 0);
+  DirFilter::added(dir + "/x");
+  TEST_CHECK(filter->parent_may_exist("/x/y"));
+
+  // Each add is kept so removing one of two leaves the other.
+  DirFilter::added(dir + "/x");
+  DirFilter::removed(dir + "/x");
+  TEST_CHECK(filter->parent_may_exist("/x/y"));
+
+  TEST_CHECK(DirFilter::rename(dir + "/a",dir + "/c") == 0);
+  TEST_CHECK(filter->parent_may_exist("/c/b/x"));
+  TEST_CHECK(wait_for_dir_filter(filter,"/a/b/x",false));
+  TEST_CHECK(filter->parent_may_exist("/c/b/x"));
+
+  // Renamed again before the first rename was applied.
+  TEST_CHECK(DirFilter::rename(dir + "/c",dir + "/d") == 0);
+  TEST_CHECK(DirFilter::rename(dir + "/d",dir + "/e") == 0);
+  TEST_CHECK(filter->parent_may_exist("/e/b/x"));
+  TEST_CHECK(wait_for_dir_filter(filter,"/c/b/x",false));
+  TEST_CHECK(filter->parent_may_exist("/e/b/x"));
+  TEST_CHECK(DirFilter::rename(dir + "/e",dir + "/c") == 0);
+  TEST_CHECK(wait_for_dir_filter(filter,"/e/b/x",false));
+  TEST_CHECK(filter->parent_may_exist("/c/b/x"));
+
+  TEST_CHECK(rmdir((dir + "/x").c_str()) == 0);
+  DirFilter::removed(dir + "/x");
+  TEST_CHECK(!filter->parent_may_exist("/x/y"));
+
+  DirFilter::enabled(false);
+  TEST_CHECK(filter->parent_may_exist("/x/y"));
+
+  for(int i = 0; i < 10000; i++)
+    rmdir((dir + "/m/" + std::to_string(i)).c_str());
+  rmdir((dir + "/m").c_str());
+  rmdir((dir + "/c/b").c_str());
+  rmdir((dir + "/c").c_str());
+  rmdir(dir.c_str());
+}
+
 TEST_LIST =
   {
    {"nop",test_nop},
@@ -281,10 +537,14 @@ TEST_LIST =
    {"config_inodecalc",test_config_inodecalc},
    {"config_moveonenospc",test_config_moveonenospc},
    {"config_nfsopenhack",test_config_nfsopenhack},
+   {"config_passthrough",test_config_passthrough},
    {"config_readdir",test_config_readdir},
    {"config_statfs",test_config_statfs},
    {"config_statfsignore",test_config_statfs_ignore},
    {"config_xattr",test_config_xattr},
    {"config",test_config},
+   {"dedup_set",test_dedup_set},
+   {"dir_filter",test_dir_filter},
+   {"location_index",test_location_index},
    {NULL,NULL}
   };